@@ -1,5 +1,6 @@
 import {PreferenceCode,ResultCode} from './Enums'
 import Device from './wasm/Device'
+import PlanCache from './wasm/PlanCache'
 import * as utils from './utils'
 import Execution from './Execution'
 import TfjsModel from './tfjs/TfjsModel'
@@ -49,15 +50,164 @@ export default class Compilation {
     return ResultCode.NO_ERROR;
   }
 
+  /**
+   * Sets the number of threads the WASM backend may use for this model.
+   * Only honoured by the threaded nn_ops builds; defaults to
+   * navigator.hardwareConcurrency there.
+   *
+   * @param {number} threads - A positive integer.
+   */
+  setNumThreads(threads) {
+    if (this._finished) {
+      throw new Error('setNumThreads cant modify after compilation finished');
+    }
+    if (!Number.isInteger(threads) || threads < 1) {
+      throw new Error(`Invalid threads number ${threads}`);
+    }
+    this._model._numThreads = threads;
+    return ResultCode.NO_ERROR;
+  }
+
+  /**
+   * Sets the number of frames the WASM backend runs through one pass of the
+   * model. Every non-constant tensor of the model must have a leading batch
+   * dimension of 1; it is scaled to `batchSize`, so weights are read once
+   * per batch. Frames are submitted and read back with the `frame` argument
+   * of Execution.setInput and Execution.setOutput. Only the nn_ops kernels
+   * run batches, so a batch size above 1 moves a float model the WASM
+   * backend would run on TF.js to them.
+   *
+   * @param {number} batchSize - A positive integer.
+   */
+  setBatchSize(batchSize) {
+    if (this._finished) {
+      throw new Error('setBatchSize cant modify after compilation finished');
+    }
+    if (!Number.isInteger(batchSize) || batchSize < 1) {
+      throw new Error(`Invalid batch size ${batchSize}`);
+    }
+    if (batchSize > 1 && this._backend !== 'WASM') {
+      throw new Error(`Batched execution is not supported by backend ${this._backend}`);
+    }
+    this._model._batchSize = batchSize;
+    return ResultCode.NO_ERROR;
+  }
+
+  /**
+   * Runs a float32 model on the quantized kernels of the WASM backend.
+   * finish() runs the calibration frames through the float model to find
+   * the range of every tensor, then rewrites activations to uint8 and conv
+   * and depthwise filters to per-channel int8. Ops without a uint8 kernel
+   * stay float, and so do the model inputs and outputs. The drift of the
+   * outputs against the float model is reported by getQuantizationReport.
+   * The quantized model runs on the nn_ops kernels rather than TF.js.
+   *
+   * @param {Array} frames - Calibration frames, each an array with a
+   *     TypedArray per model input, or a TypedArray for single-input models.
+   * @param {Object} [options={}]
+   * @param {Array} [options.validationFrames=frames] - Frames the drift is
+   *     measured on.
+   */
+  setQuantization(frames, options = {}) {
+    if (this._finished) {
+      throw new Error('setQuantization cant modify after compilation finished');
+    }
+    if (this._backend !== 'WASM') {
+      throw new Error(`Quantization is not supported by backend ${this._backend}`);
+    }
+    if (this._model.isQuant8()) {
+      throw new Error('The model is already quantized');
+    }
+    if (!Array.isArray(frames) || frames.length === 0) {
+      throw new Error('Quantization needs at least one calibration frame');
+    }
+    this._model._quantization = {
+      frames: frames,
+      validationFrames: options.validationFrames || frames
+    };
+    return ResultCode.NO_ERROR;
+  }
+
+  /**
+   * Returns how far a model quantized by setQuantization drifts from the
+   * float model on the validation frames, or null.
+   *
+   * @returns {Object} - quantizedOps and floatOps, the ops of the float model
+   *     that run quantized and float; frames, the validation frames; and
+   *     outputs, per model output its maxError and meanError (absolute) and
+   *     sqnr, the signal to quantization noise ratio in dB.
+   */
+  getQuantizationReport() {
+    if (!this._finished) {
+      throw new Error('Compilation is not finished');
+    }
+    if (typeof this._preparedModel.getQuantizationReport !== 'function') {
+      return null;
+    }
+    return this._preparedModel.getQuantizationReport();
+  }
+
+  /**
+   * Keeps the model compiled by the WASM backend under `key` in a PlanCache
+   * (IndexedDB in browsers, files under Node). finish() loads it from there
+   * when the model, its options and the nn_ops build match, instead of
+   * compiling it again; otherwise it compiles the model and stores it. The
+   * stored image is checked against a hash of the operands, weights
+   * included, and of the setQuantization frames, so a stale image is
+   * compiled again rather than used.
+   *
+   * Only models the WASM backend runs on the nn_ops kernels are cached:
+   * quant8 models, models with ops TF.js lacks and models set up with
+   * setBatchSize or setQuantization. Float models run on TF.js, which has
+   * no compiled plan to keep; for them the cache is not used and
+   * isPlanCached() returns false.
+   *
+   * @param {string} key
+   * @param {Object} [options={}] - Options of the PlanCache.
+   */
+  setPlanCache(key, options = {}) {
+    if (this._finished) {
+      throw new Error('setPlanCache cant modify after compilation finished');
+    }
+    if (this._backend !== 'WASM') {
+      throw new Error(`Plan caching is not supported by backend ${this._backend}`);
+    }
+    if (typeof key !== 'string' || key.length === 0) {
+      throw new Error(`Invalid plan cache key ${key}`);
+    }
+    this._model._planCache = {key: key, cache: new PlanCache(options)};
+    return ResultCode.NO_ERROR;
+  }
+
+  /**
+   * Whether finish() loaded the compiled model from the plan cache.
+   *
+   * @returns {boolean}
+   */
+  isPlanCached() {
+    if (!this._finished) {
+      throw new Error('Compilation is not finished');
+    }
+    return this._preparedModel._fromPlanCache === true;
+  }
+
   /**
    * Indicate that we have finished modifying a compilation.
    */
   async finish() {
     switch (this._backend) {
       case 'WASM': {
-        if (this._model.isQuant8() || this._model.hasUnsupportedOp()) {
+        // batched execution and quantization are implemented by the nn_ops
+        // kernels only; the plan cache keeps what they compiled and does
+        // not move a model off TF.js
+        if (this._model.isQuant8() || this._model.hasUnsupportedOp() ||
+            this._model._batchSize > 1 || this._model._quantization) {
           this._preparedModel = await this._device.prepareModel(this._model);
         } else {
+          if (this._model._planCache) {
+            console.warn(`Plan cache ${this._model._planCache.key} is not used: ` +
+                         'the model runs on TF.js');
+          }
           this._preparedModel = new TfjsModel(this._model);
           await this._preparedModel.prepareModel();
         }
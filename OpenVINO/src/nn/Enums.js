@@ -1427,6 +1427,29 @@ export const OperationCode = {
    */
   PRELU: 71,
 
+  /** Quantizes the input tensor.
+   *
+   * The formula is:
+   *
+   *     output = max(0, min(255, round(input / scale) + zeroPoint))
+   *
+   * Supported input tensor {@link OperandCode}:
+   * * {@link TENSOR_FLOAT32}
+   *
+   * Supported output tensor {@link OperandCode}:
+   * * {@link TENSOR_QUANT8_ASYMM}
+   *
+   * Supported tensor rank: from 1
+   *
+   * Inputs:
+   * * 0: A tensor.
+   *
+   * Outputs:
+   * * 0: The output tensor of same shape as input0, but with type
+   *      {@link TENSOR_QUANT8_ASYMM}.
+   */
+  QUANTIZE: 72,
+
   /** Performs a atrous 2-D convolution operation.
    *
    * The ATROUS_CONV_2D op sweeps a 2-D filter that can mix channels together over a batch of
@@ -23,9 +23,12 @@ export default class Execution {
    * 
    * @param {number} index - The index of the input argument we are setting.
    * @param {TypedArray} buffer - The typed array containing the data.
+   * @param {number} [frame=0] - The frame of a batched compilation, see
+   *                             Compilation.setBatchSize.
    */
-  setInput(index, buffer) {
+  setInput(index, buffer, frame = 0) {
     let model = this._model;
+    this._validateFrame(frame);
     if (index >= model._inputs.length) {
       throw new Error(`Invalid index ${index}`);
     }
@@ -42,20 +45,64 @@ export default class Execution {
     }
     let tensor = {
       index: inputIndex,
-      buffer: buffer
+      buffer: buffer,
+      frame: frame
     }
-    this._inputs.set(index, tensor);
+    this._inputs.set(index + frame * model._inputs.length, tensor);
     return ResultCode.NO_ERROR;
   }
 
+  /**
+   * Preprocess an RGBA image directly into an input of the model, replacing
+   * any buffer set by setInput. Only the nn_ops WASM path implements it, see
+   * supportsInputRGBA and PreparedModel.preprocessRGBA for the options.
+   *
+   * @param {number} index - The index of the input argument we are setting.
+   * @param {Uint8Array|Uint8ClampedArray} pixels - RGBA pixels, row by row.
+   * @param {number} width - Width of the image.
+   * @param {number} height - Height of the image.
+   * @param {Object} options - Crop, resize and normalization options.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   */
+  setInputRGBA(index, pixels, width, height, options = {}, frame = 0) {
+    let model = this._model;
+    this._validateFrame(frame);
+    if (!this.supportsInputRGBA()) {
+      throw new Error('setInputRGBA is not supported by this compilation');
+    }
+    if (index >= model._inputs.length) {
+      throw new Error(`Invalid index ${index}`);
+    }
+    if (pixels.length < width * height * 4) {
+      throw new Error(`Invalid pixels of length ${pixels.length} for ${width}x${height}`);
+    }
+    this._preparedModel.preprocessRGBA(model._inputs[index], pixels, width, height, options, frame);
+    this._inputs.delete(index + frame * model._inputs.length);
+    return ResultCode.NO_ERROR;
+  }
+
+  /**
+   * Whether setInputRGBA is available for this compilation.
+   *
+   * @returns {boolean}
+   */
+  supportsInputRGBA() {
+    const preparedModel = this._preparedModel;
+    return typeof preparedModel.preprocessRGBA === 'function' &&
+           preparedModel.hasKernel('preprocessRGBAFloat32');
+  }
+
   /**
    * Associate a user buffer with an output of the model of the Execution.
    * 
    * @param {number} index - The index of output.
    * @param {TypedArray} buffer - The typed array to receive the output data.
+   * @param {number} [frame=0] - The frame of a batched compilation, see
+   *                             Compilation.setBatchSize.
    */
-  setOutput(index, buffer) {
+  setOutput(index, buffer, frame = 0) {
     let model = this._model;
+    this._validateFrame(frame);
     if (index >= model._outputs.length) {
       throw new Error(`Invalid index ${index}`);
     }
@@ -72,12 +119,126 @@ export default class Execution {
     }
     let tensor = {
       index: outputIndex,
-      buffer: buffer
+      buffer: buffer,
+      frame: frame
     }
-    this._outputs.set(index, tensor);
+    this._outputs.set(index + frame * model._outputs.length, tensor);
     return ResultCode.NO_ERROR;
   }
 
+  /**
+   * Get a view of the memory the compiled model reads an input from, so it
+   * can be filled without a copy; any buffer set by setInput is dropped.
+   * Typed arrays in the same heap may also be passed to setInput and
+   * setOutput, they are then bound to the model and used in place. The view
+   * detaches when the heap grows, fetch it again before every compute.
+   * Only the nn_ops WASM path implements it.
+   *
+   * @param {number} index - The index of the input.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {TypedArray} - The view of the input tensor.
+   */
+  getInputView(index, frame = 0) {
+    let model = this._model;
+    this._validateFrame(frame);
+    this._validateTensorViews();
+    if (index >= model._inputs.length) {
+      throw new Error(`Invalid index ${index}`);
+    }
+    this._inputs.delete(index + frame * model._inputs.length);
+    return this._preparedModel.getTensorView(model._inputs[index], frame);
+  }
+
+  /**
+   * Get a view of the memory the compiled model writes an output to; any
+   * buffer set by setOutput is dropped. See getInputView.
+   *
+   * @param {number} index - The index of the output.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {TypedArray} - The view of the output tensor.
+   */
+  getOutputView(index, frame = 0) {
+    let model = this._model;
+    this._validateFrame(frame);
+    this._validateTensorViews();
+    if (index >= model._outputs.length) {
+      throw new Error(`Invalid index ${index}`);
+    }
+    this._outputs.delete(index + frame * model._outputs.length);
+    return this._preparedModel.getTensorView(model._outputs[index], frame);
+  }
+
+  /**
+   * Decode the boxes and run non-max suppression on the SSD outputs of the
+   * last compute, in wasm and without copying the outputs out. Only the
+   * nn_ops WASM path implements it, see supportsSsdPostprocess and
+   * PreparedModel.ssdPostprocess for the options.
+   *
+   * @param {number} boxesIndex - The index of the box encodings output.
+   * @param {number} scoresIndex - The index of the class scores output.
+   * @param {Array} anchors - The anchors of the boxes.
+   * @param {Object} options - The options of the SsdDecoder.js NMS.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {Array} [totalDetections, boxesList, scoresList, classesList].
+   */
+  ssdPostprocess(boxesIndex, scoresIndex, anchors, options = {}, frame = 0) {
+    let model = this._model;
+    this._validateFrame(frame);
+    if (!this.supportsSsdPostprocess()) {
+      throw new Error('ssdPostprocess is not supported by this compilation');
+    }
+    if (boxesIndex >= model._outputs.length || scoresIndex >= model._outputs.length) {
+      throw new Error(`Invalid index ${boxesIndex} or ${scoresIndex}`);
+    }
+    return this._preparedModel.ssdPostprocess(model._outputs[boxesIndex], model._outputs[scoresIndex],
+                                              anchors, options, frame);
+  }
+
+  /**
+   * Whether ssdPostprocess is available for this compilation.
+   *
+   * @returns {boolean}
+   */
+  supportsSsdPostprocess() {
+    const preparedModel = this._preparedModel;
+    return typeof preparedModel.ssdPostprocess === 'function' &&
+           preparedModel.hasKernel('ssdPostprocessFloat32');
+  }
+
+  /**
+   * Decode the YOLOv2 region output of the last compute and run NMS on it,
+   * in wasm and without allocating. Only the nn_ops WASM path implements it,
+   * see supportsYolo2Region and PreparedModel.yolo2Region for the options.
+   *
+   * @param {number} index - The index of the region output.
+   * @param {Array|Float32Array} anchors - (width, height) of every anchor.
+   * @param {Object} options - The options of decodeYOLOv2.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {Object} {count, detections}, reused by the next call.
+   */
+  yolo2Region(index, anchors, options = {}, frame = 0) {
+    let model = this._model;
+    this._validateFrame(frame);
+    if (!this.supportsYolo2Region()) {
+      throw new Error('yolo2Region is not supported by this compilation');
+    }
+    if (index >= model._outputs.length) {
+      throw new Error(`Invalid index ${index}`);
+    }
+    return this._preparedModel.yolo2Region(model._outputs[index], anchors, options, frame);
+  }
+
+  /**
+   * Whether yolo2Region is available for this compilation.
+   *
+   * @returns {boolean}
+   */
+  supportsYolo2Region() {
+    const preparedModel = this._preparedModel;
+    return typeof preparedModel.yolo2Region === 'function' &&
+           preparedModel.hasKernel('yolo2RegionFloat32');
+  }
+
   /**
    * Schedule evaluation of the execution.
    */
@@ -85,4 +246,18 @@ export default class Execution {
     await this._preparedModel.execute(this._inputs, this._outputs);
     return ResultCode.NO_ERROR;
   }
+
+  // private methods
+  _validateFrame(frame) {
+    let batchSize = this._model._batchSize || 1;
+    if (!Number.isInteger(frame) || frame < 0 || frame >= batchSize) {
+      throw new Error(`Invalid frame ${frame} for batch size ${batchSize}`);
+    }
+  }
+
+  _validateTensorViews() {
+    if (typeof this._preparedModel.getTensorView !== 'function') {
+      throw new Error('Tensor views are not supported by this compilation');
+    }
+  }
 }
@@ -1,4 +1,5 @@
 import PreparedModel from './PreparedModel'
+import Quantizer from './Quantizer'
 
 export default class Device {
   /**
@@ -13,8 +14,65 @@ export default class Device {
    * @returns {Object} The prepared model.
    */
   async prepareModel(model) {
+    if (model._planCache) {
+      return this._prepareCachedModel(model);
+    }
+    return this._prepareModel(model);
+  }
+
+  async _prepareModel(model) {
+    if (model._quantization) {
+      return this._prepareQuantizedModel(model);
+    }
     let preparedModel = new PreparedModel();
     await preparedModel.prepare(model);
     return preparedModel;
   }
-}
\ No newline at end of file
+
+  // Loads the model from the image stored under its key, see
+  // Compilation.setPlanCache. When there is none or it does not match, the
+  // model is prepared and its image stored for the next load. The cache only
+  // saves time, so its errors are reported and otherwise ignored.
+  async _prepareCachedModel(model) {
+    const {key, cache} = model._planCache;
+    try {
+      const image = await cache.get(key);
+      if (image) {
+        const preparedModel = new PreparedModel();
+        if (await preparedModel.load(model, image)) {
+          preparedModel._fromPlanCache = true;
+          return preparedModel;
+        }
+      }
+    } catch (e) {
+      console.warn(`Cannot load plan ${key} from the cache: ${e.message || e}`);
+    }
+    const preparedModel = await this._prepareModel(model);
+    try {
+      const image = preparedModel.serialize(model);
+      if (image) {
+        await cache.put(key, image);
+      } else {
+        await cache.delete(key);
+      }
+    } catch (e) {
+      console.warn(`Cannot store plan ${key} in the cache: ${e.message || e}`);
+    }
+    return preparedModel;
+  }
+
+  // Calibrates the float model, prepares its quantized rewrite and measures
+  // how far its outputs drift, see Compilation.setQuantization.
+  async _prepareQuantizedModel(model) {
+    const quantizer = new Quantizer(model, model._quantization);
+    try {
+      await quantizer.calibrate();
+      const preparedModel = new PreparedModel();
+      await preparedModel.prepare(await quantizer.quantize());
+      preparedModel._quantizationReport = await quantizer.measureDrift(preparedModel);
+      return preparedModel;
+    } finally {
+      quantizer.delete();
+    }
+  }
+}
@@ -0,0 +1,284 @@
+import * as utils from '../utils'
+import { product } from '../utils';
+
+// Samples the statistics of getStats() are averaged over.
+const statsWindow = 64;
+
+const now = () => performance.now();
+
+/**
+ * Overlaps the stages of a frame loop on a model compiled for the nn_ops
+ * WASM path. While the plan runs frame N on its own thread (threaded nn_ops
+ * builds, see PreparedModel.startExecute), the main thread preprocesses
+ * frame N + 1 into a second set of input tensors and postprocesses frame
+ * N - 1 from a second set of output tensors, so a frame takes about the
+ * slowest stage rather than the sum of them. Both sets live in the nn_ops
+ * heap and are bound to the model in place.
+ *
+ * Only one frame waits for the plan: when inference falls behind, a newer
+ * frame replaces it and it is counted as dropped. isSaturated() tells the
+ * caller a frame would replace another, so it can skip the capture.
+ */
+export default class FramePipeline {
+  /**
+   * @param {Execution} execution - An execution of the compilation.
+   * @param {Object} stages - Callbacks run on the main thread. They get
+   *     views of the pipeline's own tensors and must not use the methods of
+   *     the execution while the pipeline runs; the nn_ops kernels are
+   *     reached through `kernels` instead, which runs them on the tensors of
+   *     the stage. Other nn_ops users such as LaneFeatures may be called
+   *     too: while the plan runs they get a single-threaded context of
+   *     their own.
+   * @param {Function} stages.preprocess - (frame, inputs, kernels): writes
+   *     `frame`, as passed to submit(), into `inputs`, a TypedArray per
+   *     model input (all frames of a batched compilation), or with
+   *     kernels.preprocessRGBA(index, pixels, width, height, options,
+   *     batchFrame), which takes the arguments of the PreparedModel method.
+   * @param {Function} stages.postprocess - (outputs, frame, kernels):
+   *     returns the result of `frame`, or a promise of it, from `outputs`, a
+   *     TypedArray per model output, or with kernels.ssdPostprocess and
+   *     kernels.yolo2Region, which take the arguments of the PreparedModel
+   *     methods. The views are reused once it returns or resolves.
+   * @param {Function} stages.onResult - (result, frame): called with every
+   *     result, in frame order while postprocess returns results rather
+   *     than promises.
+   */
+  constructor(execution, stages) {
+    const preparedModel = execution._preparedModel;
+    if (typeof preparedModel.startExecute !== 'function') {
+      throw new Error('FramePipeline needs a compilation on the nn_ops WASM path');
+    }
+    this._preparedModel = preparedModel;
+    this._stages = stages;
+    const model = execution._model;
+    this._inputSlots = [0, 1].map(() => this._allocateSlot(model._inputs));
+    this._outputSlots = [0, 1].map(() => this._allocateSlot(model._outputs));
+    this._inputKernels = this._inputSlots.map(slot => this._kernels(slot));
+    this._outputKernels = this._outputSlots.map(slot => this._kernels(slot));
+    this._outputBusy = [false, false];
+    // The preprocessed frame waiting for the plan, and the one it runs.
+    this._waiting = null;
+    this._running = null;
+    this._jobs = new Set();
+    this._error = null;
+
+    this._frames = 0;
+    this._dropped = 0;
+    this._samples = {
+      preprocess: [],
+      inference: [],
+      postprocess: [],
+      latency: [],
+      finished: []
+    };
+  }
+
+  /**
+   * Preprocesses `frame` into the input tensors the plan is not reading and
+   * starts the plan on it as soon as it is free. Rethrows the error of an
+   * earlier frame.
+   *
+   * @param {*} frame - Passed on to the stages.
+   */
+  submit(frame) {
+    if (this._error) {
+      throw this._error;
+    }
+    const submitted = now();
+    const inputSlot = this._running && this._running.inputSlot === 0 ? 1 : 0;
+    if (this._waiting) {
+      ++this._dropped;
+    }
+    this._waiting = null;
+    this._stages.preprocess(frame, this._views(this._inputSlots[inputSlot]),
+                            this._inputKernels[inputSlot]);
+    this._addSample('preprocess', now() - submitted);
+    this._waiting = {frame: frame, inputSlot: inputSlot, outputSlot: -1, submitted: submitted};
+    this._schedule();
+  }
+
+  /**
+   * Whether a frame is already waiting for the plan, so a new one would
+   * replace it.
+   *
+   * @returns {boolean}
+   */
+  isSaturated() {
+    return this._waiting !== null;
+  }
+
+  /**
+   * Resolves when every submitted frame has its result, rejects with the
+   * first error of a stage.
+   */
+  async flush() {
+    while (this._jobs.size > 0) {
+      await Promise.all(this._jobs);
+    }
+    if (this._error) {
+      throw this._error;
+    }
+  }
+
+  /**
+   * Statistics of the last 64 frames.
+   *
+   * @returns {Object} - frames and dropped, the frames with a result and the
+   *     frames replaced while waiting for the plan; throughput, in results
+   *     per second; latency, the mean milliseconds from submit() to the
+   *     result; and stages, with the mean milliseconds (time) and the
+   *     frames per second it alone would allow (throughput) of preprocess,
+   *     inference and postprocess.
+   */
+  getStats() {
+    const mean = (samples) => samples.length ?
+        samples.reduce((a, b) => a + b, 0) / samples.length : 0;
+    const stage = (name) => {
+      const time = mean(this._samples[name]);
+      return {time: time, throughput: time > 0 ? 1000 / time : 0};
+    };
+    const finished = this._samples.finished;
+    const span = finished.length > 1 ? finished[finished.length - 1] - finished[0] : 0;
+    return {
+      frames: this._frames,
+      dropped: this._dropped,
+      throughput: span > 0 ? (finished.length - 1) * 1000 / span : 0,
+      latency: mean(this._samples.latency),
+      stages: {
+        preprocess: stage('preprocess'),
+        inference: stage('inference'),
+        postprocess: stage('postprocess')
+      }
+    };
+  }
+
+  /**
+   * Waits for the submitted frames, drops a frame still waiting, and frees
+   * the tensors. The model inputs and outputs go back to their own storage.
+   */
+  async delete() {
+    this._waiting = null;
+    try {
+      await this.flush();
+    } finally {
+      const nn_ops = this._preparedModel._nn_ops;
+      for (const slot of this._inputSlots.concat(this._outputSlots)) {
+        for (const tensor of slot) {
+          this._preparedModel._unbindTensor(tensor.index);
+          nn_ops._free(tensor.ptr);
+        }
+      }
+      this._inputSlots = [];
+      this._outputSlots = [];
+    }
+  }
+
+  // Starts the plan on the waiting frame once the plan and an output slot
+  // are free.
+  _schedule() {
+    const outputSlot = this._outputBusy.indexOf(false);
+    if (this._running || !this._waiting || outputSlot < 0 || this._error) {
+      return;
+    }
+    const job = this._waiting;
+    this._waiting = null;
+    job.outputSlot = outputSlot;
+    this._outputBusy[outputSlot] = true;
+    this._running = job;
+    try {
+      this._preparedModel.startExecute(this._tensors(this._inputSlots[job.inputSlot]),
+                                       this._tensors(this._outputSlots[outputSlot]));
+    } catch (error) {
+      this._running = null;
+      this._outputBusy[outputSlot] = false;
+      throw error;
+    }
+    const promise = this._preparedModel.finishExecute()
+        .then(ms => this._finish(job, ms))
+        .catch(error => {
+          this._error = this._error || error;
+        })
+        .then(() => {
+          this._jobs.delete(promise);
+        });
+    this._jobs.add(promise);
+  }
+
+  async _finish(job, inferenceTime) {
+    this._running = null;
+    this._addSample('inference', inferenceTime);
+    // the next frame runs while this one is postprocessed
+    this._schedule();
+    const start = now();
+    let result;
+    try {
+      result = await this._stages.postprocess(this._views(this._outputSlots[job.outputSlot]),
+                                              job.frame, this._outputKernels[job.outputSlot]);
+    } finally {
+      this._outputBusy[job.outputSlot] = false;
+    }
+    const finished = now();
+    this._addSample('postprocess', finished - start);
+    this._addSample('latency', finished - job.submitted);
+    this._addSample('finished', finished);
+    ++this._frames;
+    this._stages.onResult(result, job.frame);
+    this._schedule();
+  }
+
+  _addSample(name, value) {
+    const samples = this._samples[name];
+    if (samples.length === statsWindow) {
+      samples.shift();
+    }
+    samples.push(value);
+  }
+
+  // One heap tensor per operand, shaped as the runtime operand, so batched
+  // compilations get all their frames.
+  _allocateSlot(indexes) {
+    const nn_ops = this._preparedModel._nn_ops;
+    return indexes.map(index => {
+      const operand = this._preparedModel._operands[index];
+      return {
+        index: index,
+        type: operand.type,
+        length: product(operand.dimensions),
+        ptr: nn_ops._malloc(utils.sizeOfTensorData(operand.type, operand.dimensions))
+      };
+    });
+  }
+
+  // The PreparedModel kernels, run on the tensors of `slot` rather than on
+  // the ones bound to the model, which the plan may be using.
+  _kernels(slot) {
+    const preparedModel = this._preparedModel;
+    const data = (index) => {
+      const tensor = slot.find(tensor => tensor.index === index);
+      if (!tensor) {
+        throw new Error(`Operand ${index} is not a tensor of this stage`);
+      }
+      return tensor.ptr;
+    };
+    return {
+      preprocessRGBA: (index, pixels, width, height, options, frame) =>
+          preparedModel._preprocessRGBA(index, data(index), pixels, width, height, options, frame),
+      ssdPostprocess: (boxesIndex, scoresIndex, anchors, options, frame) =>
+          preparedModel._ssdPostprocess(boxesIndex, data(boxesIndex), scoresIndex,
+                                        data(scoresIndex), anchors, options, frame),
+      yolo2Region: (index, anchors, options, frame) =>
+          preparedModel._yolo2Region(index, data(index), anchors, options, frame)
+    };
+  }
+
+  // Views are made for every use, as they detach when the heap grows.
+  _views(slot) {
+    return slot.map(tensor =>
+        this._preparedModel._getTensorDataView(tensor.type, tensor.ptr, tensor.length));
+  }
+
+  _tensors(slot) {
+    const views = this._views(slot);
+    return slot.map((tensor, i) => ({index: tensor.index, buffer: views[i]}));
+  }
+}
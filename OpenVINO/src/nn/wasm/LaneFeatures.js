@@ -0,0 +1,127 @@
+import getNNOpsInstance from './NNOps'
+
+// Source trapezoid of the bird's-eye warp in index 0914.html, for 1280x720.
+const defaultQuad = [550, 468, 742, 468, 1280, 720, 128, 720];
+
+/**
+ * Lane features of RGBA camera frames with the nn_ops laneFeatures kernel:
+ * the HLS saturation and Sobel x thresholds (and optionally an HSV range) of
+ * the lane demos, combined and warped to a bird's-eye view in one call,
+ * together with the column histogram of its lower half. Heap buffers and the
+ * warp map are kept across frames.
+ */
+export default class LaneFeatures {
+  constructor() {
+    this._nn_ops = null;
+    this._frame = {ptr: 0, byteLength: 0};
+    this._map = {ptr: 0, key: null};
+    this._output = {ptr: 0, byteLength: 0};
+    this._mask = null;
+    this._histogram = null;
+  }
+
+  // Rejects on nn_ops builds without the lane kernels, so callers can keep
+  // their OpenCV.js pipeline.
+  async init() {
+    const nn_ops = await getNNOpsInstance();
+    if (typeof nn_ops.laneFeatures !== 'function' || typeof nn_ops.laneWarpMap !== 'function') {
+      throw new Error('LaneFeatures needs an nn_ops build with laneFeatures, rebuild nn_ops.js from src/');
+    }
+    this._nn_ops = nn_ops;
+  }
+
+  /**
+   * Computes the lane features of one frame.
+   *
+   * @param {Uint8Array|Uint8ClampedArray} pixels - RGBA pixels, row by row.
+   * @param {number} width - Width of the frame.
+   * @param {number} height - Height of the frame.
+   * @param {Object} options - {dstWidth, dstHeight} of the warped mask
+   *     (default: the frame size); srcQuad, the [x, y] * 4 corners of the
+   *     warped region, top-left first and clockwise (default: the trapezoid
+   *     of index 0914.html scaled to the frame); sThreshold (100) and
+   *     sobelThreshold (15), as in its pipeline(); colorMask with hsvLower
+   *     and hsvUpper for the cv.inRange test of demo.html; histogramRow, the
+   *     first row counted (default: half the height).
+   * @returns {Object} {mask, histogram}: the warped mask, 0 or 255 per pixel,
+   *     and the set pixels per column. Heap views, valid until the next call.
+   */
+  process(pixels, width, height, options = {}) {
+    const nn_ops = this._nn_ops;
+    if (!nn_ops) {
+      throw new Error('LaneFeatures is not initialized');
+    }
+    if (pixels.length < width * height * 4) {
+      throw new Error(`Invalid pixels of length ${pixels.length} for ${width}x${height}`);
+    }
+    const dstWidth = options.dstWidth || width;
+    const dstHeight = options.dstHeight || height;
+    const srcQuad = options.srcQuad ||
+        defaultQuad.map((v, i) => i % 2 ? v * height / 720 : v * width / 1280);
+    const params = {
+      src_width: width,
+      src_height: height,
+      dst_width: dstWidth,
+      dst_height: dstHeight,
+      src_quad: srcQuad,
+      s_threshold: options.sThreshold !== undefined ? options.sThreshold : 100,
+      sobel_threshold: options.sobelThreshold !== undefined ? options.sobelThreshold : 15,
+      color_mask: options.colorMask || false,
+      hsv_lower: (options.hsvLower || [80, 100, 100]).concat(0).slice(0, 4),
+      hsv_upper: (options.hsvUpper || [100, 255, 255]).concat(0).slice(0, 4),
+      histogram_row: options.histogramRow !== undefined ? options.histogramRow : dstHeight >> 1
+    };
+
+    const byteLength = width * height * 4;
+    let ptr;
+    if (pixels.buffer === nn_ops.HEAPU8.buffer) {
+      ptr = pixels.byteOffset;
+    } else {
+      ptr = this._reserve(this._frame, byteLength);
+      nn_ops.HEAPU8.set(pixels.subarray(0, byteLength), ptr);
+    }
+
+    const mapKey = [width, height, dstWidth, dstHeight].concat(srcQuad).join();
+    if (this._map.key !== mapKey) {
+      nn_ops._free(this._map.ptr);
+      this._map.ptr = nn_ops._malloc(dstWidth * dstHeight * 4);
+      this._map.key = mapKey;
+      nn_ops.laneWarpMap(params, this._map.ptr);
+    }
+
+    // The mask, then the int32 histogram at the next 4-byte boundary.
+    const histogramOffset = (dstWidth * dstHeight + 3) & ~3;
+    const output = this._reserve(this._output, histogramOffset + dstWidth * 4);
+    nn_ops.laneFeatures(params, ptr, this._map.ptr, output, output + histogramOffset);
+
+    if (!this._mask || this._mask.buffer !== nn_ops.HEAPU8.buffer ||
+        this._mask.byteOffset !== output || this._histogram.length !== dstWidth ||
+        this._mask.length !== dstWidth * dstHeight) {
+      this._mask = new Uint8Array(nn_ops.HEAPU8.buffer, output, dstWidth * dstHeight);
+      this._histogram = new Int32Array(nn_ops.HEAPU8.buffer, output + histogramOffset, dstWidth);
+    }
+    return {mask: this._mask, histogram: this._histogram};
+  }
+
+  delete() {
+    if (this._nn_ops) {
+      this._nn_ops._free(this._frame.ptr);
+      this._nn_ops._free(this._map.ptr);
+      this._nn_ops._free(this._output.ptr);
+    }
+    this._frame = {ptr: 0, byteLength: 0};
+    this._map = {ptr: 0, key: null};
+    this._output = {ptr: 0, byteLength: 0};
+    this._mask = null;
+    this._histogram = null;
+  }
+
+  _reserve(buffer, byteLength) {
+    if (buffer.byteLength < byteLength) {
+      this._nn_ops._free(buffer.ptr);
+      buffer.ptr = this._nn_ops._malloc(byteLength);
+      buffer.byteLength = byteLength;
+    }
+    return buffer.ptr;
+  }
+}
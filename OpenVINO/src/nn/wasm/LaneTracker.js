@@ -0,0 +1,126 @@
+import getNNOpsInstance from './NNOps'
+
+/**
+ * Lane polynomials tracked across the warped masks of LaneFeatures with the
+ * nn_ops LaneTracker: a sliding-window search seeds the fits, later frames
+ * only search around them until a lane is lost.
+ */
+export default class LaneTracker {
+  /**
+   * @param {number} width - Width of the masks.
+   * @param {number} height - Height of the masks.
+   * @param {Object} options - numWindows (9), margin (100), minWindowPixels
+   *     (50), minLanePixels (300), minTrackRatio (0.25), histogramRow (half
+   *     the height) and smoothing (0), see LaneTrackerParams in nn_kernels.h.
+   */
+  constructor(width, height, options = {}) {
+    const option = (name, value) => options[name] !== undefined ? options[name] : value;
+    this._params = {
+      width: width,
+      height: height,
+      num_windows: option('numWindows', 9),
+      margin: option('margin', 100),
+      min_window_pixels: option('minWindowPixels', 50),
+      min_lane_pixels: option('minLanePixels', 300),
+      min_track_ratio: option('minTrackRatio', 0.25),
+      histogram_row: option('histogramRow', height >> 1),
+      smoothing: option('smoothing', 0)
+    };
+    this._nn_ops = null;
+    this._tracker = null;
+    this._mask = {ptr: 0, byteLength: 0};
+    this._result = null;
+    this._resultInts = null;
+  }
+
+  // Rejects on nn_ops builds without LaneTracker, see LaneFeatures.init.
+  async init() {
+    const nn_ops = await getNNOpsInstance();
+    if (typeof nn_ops.LaneTracker !== 'function') {
+      throw new Error('LaneTracker needs an nn_ops build with it, rebuild nn_ops.js from src/');
+    }
+    this._nn_ops = nn_ops;
+    this._tracker = new nn_ops.LaneTracker(this._params);
+  }
+
+  /**
+   * Fits the lanes of one mask.
+   *
+   * @param {Uint8Array} mask - width x height bytes, nonzero on lane pixels,
+   *     e.g. LaneFeatures.process().mask, which is read in place.
+   * @param {Int32Array} [histogram] - Its column histogram from histogramRow
+   *     down, used when it lives in the wasm heap.
+   * @returns {Object} {leftFit, rightFit, leftPixels, rightPixels, found,
+   *     fullSearch}. Fits are [a, b, c] of x = a * y^2 + b * y + c in mask
+   *     pixels; found has bit 0 set for the left lane and bit 1 for the
+   *     right one, unfound lanes keep their last fit. The object is reused
+   *     by the next call.
+   */
+  update(mask, histogram = null) {
+    const nn_ops = this._nn_ops;
+    if (!this._tracker) {
+      throw new Error('LaneTracker is not initialized');
+    }
+    const byteLength = this._params.width * this._params.height;
+    if (mask.length < byteLength) {
+      throw new Error(`Invalid mask of length ${mask.length}`);
+    }
+    let ptr;
+    if (mask.buffer === nn_ops.HEAPU8.buffer) {
+      ptr = mask.byteOffset;
+    } else {
+      if (this._mask.byteLength < byteLength) {
+        nn_ops._free(this._mask.ptr);
+        this._mask.ptr = nn_ops._malloc(byteLength);
+        this._mask.byteLength = byteLength;
+      }
+      ptr = this._mask.ptr;
+      nn_ops.HEAPU8.set(mask.subarray(0, byteLength), ptr);
+    }
+    const histogramPtr =
+        histogram && histogram.buffer === nn_ops.HEAPU8.buffer ? histogram.byteOffset : 0;
+    const found = this._tracker.update(ptr, histogramPtr);
+
+    const result = this._getResult();
+    const ints = this._resultInts;
+    result.found = found;
+    result.leftPixels = ints[0];
+    result.rightPixels = ints[1];
+    result.fullSearch = ints[3] !== 0;
+    return result;
+  }
+
+  reset() {
+    this._tracker.reset();
+  }
+
+  delete() {
+    if (this._tracker) {
+      this._tracker.delete();
+      this._nn_ops._free(this._mask.ptr);
+    }
+    this._tracker = null;
+    this._mask = {ptr: 0, byteLength: 0};
+    this._result = null;
+    this._resultInts = null;
+  }
+
+  // LaneTracker::Result: float fits[2][3], then int32 pixels[2], found and
+  // full_search. Views are rebuilt when the heap grows.
+  _getResult() {
+    const buffer = this._nn_ops.HEAPU8.buffer;
+    if (!this._result || this._resultInts.buffer !== buffer) {
+      const ptr = this._tracker.getResult();
+      this._resultInts = new Int32Array(buffer, ptr + 24, 4);
+      this._result = {
+        leftFit: new Float32Array(buffer, ptr, 3),
+        rightFit: new Float32Array(buffer, ptr + 12, 3),
+        leftPixels: 0,
+        rightPixels: 0,
+        found: 0,
+        fullSearch: false
+      };
+    }
+    return this._result;
+  }
+}
@@ -2,20 +2,94 @@ if (!global._babelPolyfill) {
 	require('babel-polyfill');
 }
 
-import Module from './nn_ops'
+// A minimal module using i8x16.splat / i8x16.popcnt, see
+// https://github.com/GoogleChromeLabs/wasm-feature-detect
+const simdTestModule = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10,
+  1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+]);
+
+export function isSIMDSupported() {
+  try {
+    return typeof WebAssembly === 'object' &&
+           WebAssembly.validate(simdTestModule);
+  } catch (e) {
+    return false;
+  }
+}
+
+// The threaded flavours need a shared wasm memory, which browsers only hand
+// out to cross-origin isolated pages.
+export function isThreadsSupported() {
+  if (typeof SharedArrayBuffer === 'undefined') {
+    return false;
+  }
+  if (typeof crossOriginIsolated !== 'undefined' && !crossOriginIsolated) {
+    return false;
+  }
+  try {
+    return new WebAssembly.Memory({initial: 1, maximum: 1, shared: true})
+        .buffer instanceof SharedArrayBuffer;
+  } catch (e) {
+    return false;
+  }
+}
+
+// Every flavour is a SINGLE_FILE build with its wasm inlined, so none is
+// imported statically: the one picked is loaded on first use, as a chunk of
+// its own. Flavours are built from src/ and copied next to this file; one
+// that is not deployed falls back to the baseline nn_ops.js.
+function loadFlavour(name) {
+  return import(/* webpackInclude: /[\\/]nn_ops(_[a-z]+)*\.js$/ */ `./${name}.js`)
+      .then(m => m.default || m);
+}
+
+function instantiate(factory) {
+  return new Promise((resolve, reject) => {
+    factory({onAbort: reject}).then(m => {
+      // https://github.com/kripken/emscripten/issues/5820#issuecomment-353605456
+      delete m['then'];
+      resolve(m);
+    });
+  });
+}
+
+// The flavours to try, best first. A threaded flavour missing, or failing
+// to start its workers, falls back to the single-threaded ones.
+function pickFlavours() {
+  const flavours = [];
+  const simd = isSIMDSupported();
+  if (isThreadsSupported()) {
+    flavours.push(simd ? 'nn_ops_threads_simd' : 'nn_ops_threads');
+  }
+  if (simd) {
+    flavours.push('nn_ops_simd');
+  }
+  flavours.push('nn_ops');
+  return flavours;
+}
+
+async function createInstance() {
+  const flavours = pickFlavours();
+  for (const [i, name] of flavours.entries()) {
+    try {
+      return await instantiate(await loadFlavour(name));
+    } catch (e) {
+      if (i === flavours.length - 1) {
+        throw e;
+      }
+      console.warn(`Cannot load ${name}.js, falling back to ${flavours[i + 1]}.js: ${e.message || e}`);
+    }
+  }
+}
 
 var nn_ops = null;
+var pending = null;
 export default async function getNNOpsInstance() {
-  return new Promise(resolve => {
-    if (nn_ops === null) {
-      Module().then(m => {
-        // https://github.com/kripken/emscripten/issues/5820#issuecomment-353605456
-        delete m['then'];
-        nn_ops = m;
-        resolve(nn_ops);
-      });
-    } else {
-      resolve(nn_ops);
-    }
-  });
-}
\ No newline at end of file
+  if (nn_ops === null) {
+    // concurrent callers share one instance
+    pending = pending || createInstance();
+    nn_ops = await pending;
+  }
+  return nn_ops;
+}
@@ -0,0 +1,111 @@
+const dbName = 'webml-plan-cache';
+const storeName = 'plans';
+
+const isNode = typeof process === 'object' && typeof process.versions === 'object' &&
+               typeof process.versions.node === 'string';
+
+/**
+ * Keeps the images written by PreparedModel.serialize across page loads, so
+ * a model compiled once is loaded with PreparedModel.load afterwards. Images
+ * are stored in IndexedDB in browsers and as files under Node.
+ */
+export default class PlanCache {
+  /**
+   * @param {Object} [options]
+   * @param {string} [options.directory] - Where Node keeps the images,
+   *     webml-plan-cache in the OS temp directory by default.
+   */
+  constructor(options = {}) {
+    this._directory = options.directory || null;
+    this._db = null;
+  }
+
+  /**
+   * @param {string} key
+   * @returns {ArrayBuffer} - The image stored under `key`, or null.
+   */
+  async get(key) {
+    if (isNode) {
+      const fs = require('fs');
+      try {
+        const data = await fs.promises.readFile(this._path(key));
+        return data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength);
+      } catch (e) {
+        if (e.code === 'ENOENT') {
+          return null;
+        }
+        throw e;
+      }
+    }
+    const value = await this._request('readonly', store => store.get(key));
+    return value || null;
+  }
+
+  /**
+   * @param {string} key
+   * @param {ArrayBuffer} image
+   */
+  async put(key, image) {
+    if (isNode) {
+      const fs = require('fs');
+      const path = this._path(key);
+      await fs.promises.mkdir(require('path').dirname(path), {recursive: true});
+      // readers never see a partly written image
+      await fs.promises.writeFile(path + '.tmp', new Uint8Array(image));
+      await fs.promises.rename(path + '.tmp', path);
+      return;
+    }
+    await this._request('readwrite', store => store.put(image, key));
+  }
+
+  /**
+   * @param {string} key
+   */
+  async delete(key) {
+    if (isNode) {
+      try {
+        await require('fs').promises.unlink(this._path(key));
+      } catch (e) {
+        if (e.code !== 'ENOENT') {
+          throw e;
+        }
+      }
+      return;
+    }
+    await this._request('readwrite', store => store.delete(key));
+  }
+
+  _path(key) {
+    const path = require('path');
+    const directory = this._directory || path.join(require('os').tmpdir(), dbName);
+    return path.join(directory, encodeURIComponent(key) + '.plan');
+  }
+
+  async _open() {
+    if (!this._db) {
+      if (typeof indexedDB === 'undefined') {
+        throw new Error('PlanCache needs IndexedDB');
+      }
+      this._db = await new Promise((resolve, reject) => {
+        const request = indexedDB.open(dbName, 1);
+        request.onupgradeneeded = () => request.result.createObjectStore(storeName);
+        request.onsuccess = () => resolve(request.result);
+        request.onerror = () => reject(request.error);
+      });
+    }
+    return this._db;
+  }
+
+  // Runs `operation` on the object store in a transaction of its own and
+  // resolves with the result of its request once the transaction commits.
+  async _request(mode, operation) {
+    const db = await this._open();
+    return new Promise((resolve, reject) => {
+      const transaction = db.transaction(storeName, mode);
+      const request = operation(transaction.objectStore(storeName));
+      transaction.oncomplete = () => resolve(request.result);
+      transaction.onerror = () => reject(transaction.error);
+      transaction.onabort = () => reject(transaction.error);
+    });
+  }
+}
@@ -3,10 +3,71 @@ import { OperationCode, OperandCode, PaddingCode, PreferenceCode, FuseCode, Oper
 import * as utils from '../utils'
 import { product, findKey } from '../utils';
 import Graph from '../GraphUtils';
-import CyclicProfiler from '../instrument';
 
 var warmUpRuns = 1;
 
+// Images of serialize(): imageMagic, imageVersion and the byte length of a
+// JSON header (three little endian uint32), the header, then the plan image
+// at the next multiple of 16 bytes.
+const imageMagic = 0x504c4d57;  // 'WMLP'
+const imageVersion = 1;
+const imageHeaderBytes = 12;
+const alignImage = (bytes) => (bytes + 15) & ~15;
+
+// Folds every byte of `value`, a TypedArray or a nested array of them, into
+// `hash`, two 32-bit lanes mixed a word at a time (64 bits in all). Not a
+// cryptographic hash: it tells apart the weights and frames of models that
+// share a plan cache key, at about 3 ms per MB in V8.
+function hashValue(hash, value) {
+  if (Array.isArray(value)) {
+    value.forEach(v => hashValue(hash, v));
+    return hash;
+  }
+  if (!ArrayBuffer.isView(value)) {
+    // an element of a frame given as a plain array
+    value = Float64Array.of(value);
+  }
+  const bytes = new Uint8Array(value.buffer, value.byteOffset, value.byteLength);
+  const words = value.byteOffset % 4 === 0 ? bytes.length >> 2 : 0;
+  const view = words ? new Uint32Array(value.buffer, value.byteOffset, words) : null;
+  let h1 = hash[0];
+  let h2 = hash[1];
+  const mix = (x) => {
+    h1 = Math.imul(h1 ^ x, 0x9e3779b1);
+    h1 ^= h1 >>> 15;
+    h2 = Math.imul(h2 + x, 0x85ebca6b);
+    h2 ^= h2 >>> 13;
+  };
+  for (let i = 0; i < words; ++i) {
+    mix(view[i]);
+  }
+  for (let i = words * 4; i < bytes.length; ++i) {
+    mix(bytes[i]);
+  }
+  mix(bytes.length);
+  hash[0] = h1 >>> 0;
+  hash[1] = h2 >>> 0;
+  return hash;
+}
+
+// Resolves in a task of its own. setTimeout(0) would do, but browsers clamp
+// nested timeouts to 4 ms, and a message is delivered right away.
+let taskChannel = null;
+const taskResolvers = [];
+function nextTask() {
+  if (typeof setImmediate === 'function') {
+    return new Promise(resolve => setImmediate(resolve));
+  }
+  if (!taskChannel) {
+    taskChannel = new MessageChannel();
+    taskChannel.port1.onmessage = () => taskResolvers.shift()();
+  }
+  return new Promise((resolve) => {
+    taskResolvers.push(resolve);
+    taskChannel.port2.postMessage(null);
+  });
+}
+
 export default class PreparedModel {
   constructor() {
     this._nnNative = navigator.ml.getNeuralNetworkContext();
@@ -22,29 +83,62 @@ export default class PreparedModel {
       tensorValue: [],
       tensorShape: []
     };
-    this._profiler = null;
+    this._plan = null;
+    // Milliseconds each op ran, summed over the executions, on nn_ops builds
+    // without ExecutionPlan, see _preparePerOp.
+    this._opTimings = null;
+    this._arenaSize = 0;
+    this._epochs = 0;
+    this._batchSize = 1;
+    this._frameBuffer = {ptr: 0, byteLength: 0};
+    this._views = new Map();
+    this._ssdAnchors = {source: null, ptr: 0};
+    this._ssdOutput = {ptr: 0, byteLength: 0};
+    this._yolo = null;
+    this._calibration = false;
+    this._quant8 = false;
+    this._quantizationReport = null;
+    // Loaded from the image of a PlanCache, see Device.
+    this._fromPlanCache = false;
+    // Promise of the execution started by startExecute, until finishExecute.
+    this._running = null;
   }
 
   /**
    * Prepare for model execution.
    *
    * @param {Object} model - A model object built by user.
+   * @param {Object} [options]
+   * @param {boolean} [options.calibration=false] - Prepare for calibrate():
+   *     every op runs in WASM on one frame and nothing is fused, so each
+   *     tensor an op writes can be read back after it.
    */
-  async prepare(model) {
-    this._model = model;
-    const modelInputs = model._inputs;
-    const operations = model._operations;
-    this._nn_ops = await getNNOpsInstance();
-
-    this._preference = model._preference;
-    this._supportedOps = model._supportedOps;
-    this._eager = model._eager;
-
-    if (model._operands[modelInputs[0]].type === OperandCode.TENSOR_QUANT8_ASYMM) {
-        this._nn_ops.set_gemm_context_threads_num(1);
+  async prepare(model, options = {}) {
+    await this._initialize(model, options, model.isQuant8());
+    if (!this._nn_ops.ExecutionPlan) {
+      return this._preparePerOp(model);
     }
 
-    this._nn_ops.set_cpu_context_threads_num(1);
+    // The plan addresses operands by index, so every model operand is
+    // registered with it, non-tensors with an empty shape.
+    this._plan = new this._nn_ops.ExecutionPlan();
+
+    // Constant tensors are packed into one block of their own. All other
+    // tensors get their storage from the plan's arena, see planMemory below.
+    const isConstantTensor = (operand) => utils.isTensor(operand.type) &&
+        operand.lifetime === OperandLifetime.CONSTANT_REFERENCE;
+    const alignConstant = (bytes) => (bytes + 15) & ~15;
+    let constantsBytes = 0;
+    for (const operand of model._operands) {
+      if (isConstantTensor(operand)) {
+        constantsBytes += alignConstant(utils.sizeOfTensorData(operand.type, operand.dimensions));
+      }
+    }
+    let constantsPtr = 0;
+    if (constantsBytes > 0) {
+      constantsPtr = this._nn_ops._malloc(constantsBytes);
+      this._toDelete.tensorValue.push(constantsPtr);
+    }
 
     // allocate runtime operands
     for (let i = 0; i < model._operands.length; ++i) {
@@ -53,7 +147,93 @@ export default class PreparedModel {
       runtimeOperand.type = operand.type;
       runtimeOperand.dimensions = operand.dimensions;
       if (utils.isTensor(operand.type)) {
+        // bytes of one frame, model inputs and outputs are copied per frame
+        runtimeOperand.frameBytes = utils.sizeOfTensorData(operand.type, operand.dimensions);
+        if (this._batchSize > 1 && this._isBatched(operand)) {
+          runtimeOperand.dimensions = this._batchDimensions(i, operand.dimensions);
+        }
+        const byteLength = utils.sizeOfTensorData(operand.type, runtimeOperand.dimensions);
+        if (isConstantTensor(operand)) {
+          runtimeOperand.value = constantsPtr;
+          this._setTensorData(operand.type, constantsPtr, operand.value);
+          constantsPtr += alignConstant(byteLength);
+          this._plan.addConstant(operand.dimensions, runtimeOperand.value, byteLength);
+        } else {
+          runtimeOperand.value = 0;   // assigned by planMemory
+          this._plan.addPlannedOperand(runtimeOperand.dimensions, byteLength);
+        }
+        runtimeOperand.runtimeshape = this._allocateRuntimeShape(runtimeOperand);
+        runtimeOperand.scale = operand.scale;
+        runtimeOperand.zeroPoint = operand.zeroPoint;
+        if (operand.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+          runtimeOperand.channelQuant = operand.channelQuant;
+        }
+        this._toDelete.tensorShape.push(runtimeOperand.runtimeshape);
+      } else {
+        runtimeOperand.value = operand.value;
+        this._plan.addOperand([], 0);
+      }
+      this._operands.push(runtimeOperand);
+    }
+
+    this._partition(model);
+
+    // resolve params of every op once and record it in the plan
+    for (const [i, operation] of this._operations.entries()) {
+      this._compileOperation(operation);
+      if (this._plan.size() !== i + 1) {
+        console.warn(`Operation ${findKey(OperationCode, operation.type)} ` +
+                     `has no kernel for its operand types and is skipped.`);
+        this._plan.addNop();
+      }
+    }
+    this._plan.setProfiling(true);
+    this._plan.identifyInputsAndOutputs(model._inputs, model._outputs);
+
+    // fold elementwise ops into the conv or elementwise op producing their
+    // input, their intermediate tensors are then never materialized
+    if (!this._calibration) {
+      this._plan.fuse();
+    }
+
+    // reshapes and concatenations become views, producers write their
+    // slice of a concatenation in place
+    this._plan.alias();
+
+    // place the non-constant tensors in the arena
+    this._arenaSize = this._plan.planMemory();
+    this._operands.forEach((operand, i) => {
+      if (utils.isTensor(operand.type) && !isConstantTensor(model._operands[i])) {
+        operand.value = this._plan.getOperandData(i);
+        operand.arenaValue = operand.value;
+      }
+    });
+
+    // create WebNN models, their inputs and outputs are bound to the arena
+    await this._createSubModels();
+
+    this._prepared = true;
+  }
+
+  // Prepares the model for nn_ops builds without ExecutionPlan, such as the
+  // prebuilt nn_ops.js: every tensor gets a heap block of its own and
+  // execute() runs the ops one by one with _executeOperation. Batches and
+  // calibration need the plan.
+  async _preparePerOp(model) {
+    if (this._batchSize > 1 || this._calibration) {
+      throw new Error(`${this._calibration ? 'Calibration' : 'Batched execution'} needs an ` +
+                      `nn_ops build with ExecutionPlan, rebuild nn_ops.js from src/`);
+    }
+
+    // allocate runtime operands
+    for (const operand of model._operands) {
+      const runtimeOperand = {};
+      runtimeOperand.type = operand.type;
+      runtimeOperand.dimensions = operand.dimensions;
+      if (utils.isTensor(operand.type)) {
+        runtimeOperand.frameBytes = utils.sizeOfTensorData(operand.type, operand.dimensions);
         runtimeOperand.value = this._allocateTensor(operand);
+        runtimeOperand.arenaValue = runtimeOperand.value;
         runtimeOperand.runtimeshape = this._allocateRuntimeShape(operand);
         runtimeOperand.scale = operand.scale;
         runtimeOperand.zeroPoint = operand.zeroPoint;
@@ -68,6 +248,17 @@ export default class PreparedModel {
       this._operands.push(runtimeOperand);
     }
 
+    this._partition(model);
+    await this._createSubModels();
+    this._opTimings = new Float64Array(this._operations.length);
+    this._prepared = true;
+  }
+
+  // Splits the model into WASM ops and WEBNN_SUBGRAPH pseudo ops, whose
+  // WebNN models are created by _createSubModels once tensor storage is
+  // known.
+  _partition(model) {
+    const operations = model._operations;
     const graph = new Graph(operations.length);
     operations.forEach((op, i) => {
       graph.addNode(i, op.inputs, op.outputs);
@@ -102,25 +293,215 @@ export default class PreparedModel {
 
       } else {
 
-        // create WebNN model
-        const {model, compilation, execution} =
-            await this._createSubModel(nodes, inTensors, outTensors);
-
         // add the WEBNN_SUBGRAPH pseudo op
         this._operations.push({
           type: OperationCode.WEBNN_SUBGRAPH,
           summary: summary,
+          nodes: nodes,
           inputs: inTensors,
           outputs: outTensors,
-          model: model,             // avoid GC   intel/webml-polyfill#669
-          compilation: compilation, // avoid GC   intel/webml-polyfill#669
-          execution: execution,
         });
       }
     }
+  }
+
+  async _createSubModels() {
+    for (const operation of this._operations) {
+      if (operation.type === OperationCode.WEBNN_SUBGRAPH) {
+        const {model, compilation, execution} = await this._createSubModel(
+            operation.nodes, operation.inputs, operation.outputs);
+        operation.model = model;              // avoid GC   intel/webml-polyfill#669
+        operation.compilation = compilation;  // avoid GC   intel/webml-polyfill#669
+        operation.execution = execution;
+      }
+    }
+  }
+
+  /**
+   * Writes the prepared model as one image that load() turns back into a
+   * prepared model without compiling it again: a header with the runtime
+   * operands and operations, then the image of the plan (see
+   * ExecutionPlan::save in nn_kernels.h), which holds the records, packed
+   * filters, arena layout and constant values.
+   *
+   * @param {Object} [model=this._model] - The model load() is given, the
+   *     float model of a model quantized by Compilation.setQuantization.
+   * @returns {ArrayBuffer} - The image, null for models prepared for
+   *     calibration, with WebNN subgraphs or without a plan, which cannot
+   *     be stored.
+   */
+  serialize(model = this._model) {
+    if (!this._prepared) {
+      throw new Error('Model is not prepared');
+    }
+    this._checkIdle();
+    if (this._calibration || !this._plan ||
+        this._operations.some(op => op.type === OperationCode.WEBNN_SUBGRAPH)) {
+      return null;
+    }
+    // scalars are only read while compiling
+    const operands = this._operands.map(operand => ({
+      type: operand.type,
+      dimensions: operand.dimensions,
+      frameBytes: operand.frameBytes,
+      scale: operand.scale,
+      zeroPoint: operand.zeroPoint
+    }));
+    const header = new TextEncoder().encode(JSON.stringify({
+      signature: PreparedModel._signature(model),
+      quant8: this._quant8,
+      operands: operands,
+      operations: this._operations.map(op => op.type),
+      subgraphs: this._subgraphs,
+      quantizationReport: this._quantizationReport
+    }));
+
+    const nn_ops = this._nn_ops;
+    const planOffset = alignImage(imageHeaderBytes + header.length);
+    const planBytes = this._plan.getImageSize();
+    const image = new ArrayBuffer(planOffset + planBytes);
+    const view = new DataView(image);
+    view.setUint32(0, imageMagic, true);
+    view.setUint32(4, imageVersion, true);
+    view.setUint32(8, header.length, true);
+    new Uint8Array(image, imageHeaderBytes).set(header);
+    const ptr = nn_ops._malloc(planBytes);
+    try {
+      this._plan.save(ptr, planBytes);
+      new Uint8Array(image, planOffset).set(nn_ops.HEAPU8.subarray(ptr, ptr + planBytes));
+    } finally {
+      nn_ops._free(ptr);
+    }
+    return image;
+  }
+
+  /**
+   * Prepares `model` from an image written by serialize(). The plan image is
+   * copied into the heap in one piece and used in place: nothing is
+   * compiled, packed or planned again.
+   *
+   * @param {Object} model - The model the image was written for.
+   * @param {ArrayBuffer} image
+   * @returns {boolean} - False, leaving the model unprepared, when the image
+   *     is for another model, model options or build of nn_ops.
+   */
+  async load(model, image) {
+    const view = new DataView(image);
+    if (image.byteLength < imageHeaderBytes || view.getUint32(0, true) !== imageMagic ||
+        view.getUint32(4, true) !== imageVersion) {
+      return false;
+    }
+    const headerBytes = view.getUint32(8, true);
+    const planOffset = alignImage(imageHeaderBytes + headerBytes);
+    if (planOffset > image.byteLength) {
+      return false;
+    }
+    const header = JSON.parse(new TextDecoder().decode(
+        new Uint8Array(image, imageHeaderBytes, headerBytes)));
+    if (header.signature !== PreparedModel._signature(model)) {
+      return false;
+    }
+
+    await this._initialize(model, {}, header.quant8);
+    const nn_ops = this._nn_ops;
+    if (!nn_ops.ExecutionPlan) {
+      return false;
+    }
+    const planBytes = image.byteLength - planOffset;
+    const ptr = nn_ops._malloc(planBytes);
+    nn_ops.HEAPU8.set(new Uint8Array(image, planOffset), ptr);
+    const plan = new nn_ops.ExecutionPlan();
+    let loaded = false;
+    try {
+      loaded = plan.load(ptr, planBytes);
+    } finally {
+      if (!loaded) {
+        plan.delete();
+        nn_ops._free(ptr);
+      }
+    }
+    if (!loaded) {
+      return false;
+    }
+    this._plan = plan;
+    // constants live in the image
+    this._toDelete.tensorValue.push(ptr);
 
-    this._profiler = new CyclicProfiler(this._operations.length, warmUpRuns);
+    this._operands = header.operands;
+    this._operands.forEach((operand, i) => {
+      if (utils.isTensor(operand.type)) {
+        operand.value = plan.getOperandData(i);
+        operand.arenaValue = operand.value;
+      }
+    });
+    this._operations = header.operations.map(type => ({type: type}));
+    this._subgraphs = header.subgraphs;
+    this._quantizationReport = header.quantizationReport;
+    this._arenaSize = plan.getArenaSize();
     this._prepared = true;
+    return true;
+  }
+
+  // Model state shared by prepare and load: the options and the threads of
+  // the kernels.
+  async _initialize(model, options, quant8) {
+    this._model = model;
+    this._nn_ops = await getNNOpsInstance();
+
+    this._calibration = options.calibration || false;
+    this._preference = model._preference;
+    this._supportedOps = this._calibration ? new Set() : model._supportedOps;
+    this._eager = model._eager;
+
+    let threadsNum = 1;
+    if (this._nn_ops.PTHREADS) {
+      threadsNum = model._numThreads ||
+                   (typeof navigator !== 'undefined' && navigator.hardwareConcurrency) || 1;
+    }
+
+    this._quant8 = quant8;
+    if (quant8) {
+        this._nn_ops.set_gemm_context_threads_num(threadsNum);
+    }
+
+    this._nn_ops.set_cpu_context_threads_num(threadsNum);
+    // only builds with the kernel worker pool have it
+    if (this._nn_ops.set_kernel_threads_num) {
+      this._nn_ops.set_kernel_threads_num(threadsNum);
+    }
+
+    // In batched mode every non-constant tensor holds `batchSize` frames
+    // along its leading dimension, so one pass reads the weights once and
+    // the conv kernels see batchSize times more output pixels.
+    this._batchSize = this._calibration ? 1 : model._batchSize || 1;
+  }
+
+  // Everything an image written by serialize() depends on: the operands
+  // (constants, scalars included, by a hash of all their bytes), the
+  // operations, the model options, the calibration and validation frames of
+  // setQuantization and the ops left to WebNN. Images carry it as is, so
+  // it is compared exactly.
+  static _signature(model) {
+    const operands = model._operands.map(operand => {
+      const value = operand.value ? hashValue([0, 0], operand.value) : null;
+      return [operand.type, operand.dimensions, operand.lifetime, operand.scale,
+              operand.zeroPoint, value];
+    });
+    const quantization = model._quantization;
+    return JSON.stringify({
+      operands: operands,
+      operations: model._operations.map(op => [op.type, op.inputs, op.outputs]),
+      inputs: model._inputs,
+      outputs: model._outputs,
+      batchSize: model._batchSize || 1,
+      quantization: quantization ? {
+        frames: quantization.frames.length,
+        validationFrames: quantization.validationFrames.length,
+        hash: hashValue(hashValue([0, 0], quantization.frames), quantization.validationFrames)
+      } : null,
+      supportedOps: Array.from(model._supportedOps || []),
+      eager: !!model._eager
+    });
   }
 
   /**
@@ -130,25 +511,473 @@ export default class PreparedModel {
    * @param {Array} outputs - Outputs will receive results.
    */
   async execute(inputs, outputs) {
-    if (!this._prepared) {
-      throw new Error('Model is not prepared');
+    this._checkIdle();
+    const copiedOutputs = this._bindInputsAndOutputs(inputs, outputs);
+
+    if (!this._plan) {
+      for (const [i, operation] of this._operations.entries()) {
+        const start = performance.now();
+        await this._executeOperation(operation);
+        this._opTimings[i] += performance.now() - start;
+      }
+      this._finishExecution(copiedOutputs);
+      return;
     }
 
-    inputs.forEach(input => {
-      const operand = this._operands[input.index];
-      this._setTensorData(operand.type, operand.value, input.buffer);
+    // run the plan between WebNN subgraphs
+    const plan = this._plan;
+    let begin = 0;
+    for (const [i, operation] of this._operations.entries()) {
+      if (operation.type === OperationCode.WEBNN_SUBGRAPH) {
+        plan.run(begin, i);
+        const start = performance.now();
+        await this._executeSubgraph(operation);
+        plan.addTiming(i, performance.now() - start);
+        begin = i + 1;
+      }
+    }
+    plan.run(begin, this._operations.length);
+    this._finishExecution(copiedOutputs);
+  }
+
+  /**
+   * Starts an execution and returns before it finishes, so the caller can
+   * prepare the next inputs meanwhile, see FramePipeline. In the threaded
+   * nn_ops builds the plan runs on a thread of its own; otherwise, for
+   * models with WebNN subgraphs and on nn_ops builds without ExecutionPlan,
+   * the whole execution runs here. Until finishExecute() resolves, the
+   * inputs and outputs must not be touched and no other method of the
+   * model may be called.
+   *
+   * @param {Array} inputs - Inputs provided by user, as for execute.
+   * @param {Array} outputs - Outputs will receive results, as for execute.
+   */
+  startExecute(inputs, outputs) {
+    this._checkIdle();
+    if (!this._plan || this._operations.some(op => op.type === OperationCode.WEBNN_SUBGRAPH)) {
+      const start = performance.now();
+      this._running = this.execute(inputs, outputs).then(() => performance.now() - start);
+      return;
+    }
+    const copiedOutputs = this._bindInputsAndOutputs(inputs, outputs);
+    this._plan.start(0, this._operations.length);
+    this._running = this._waitForPlan().then(() => {
+      this._finishExecution(copiedOutputs);
+      return this._plan.getRunTime();
     });
+  }
 
-    for (const operation of this._operations) {
-      this._profiler.startEvent();
-      await this._executeOperation(operation);
-      this._profiler.endEvent();
+  /**
+   * Waits for the execution started by startExecute.
+   *
+   * @returns {number} - Milliseconds it ran.
+   */
+  async finishExecute() {
+    const running = this._running;
+    if (!running) {
+      throw new Error('No execution was started');
+    }
+    try {
+      return await running;
+    } finally {
+      this._running = null;
     }
+  }
 
-    outputs.forEach((output) => {
-      const operand = this._operands[output.index];
-      this._getTensorData(operand.type, operand.value, output.buffer);
+  /**
+   * Runs one frame through a model prepared with `calibration` op by op and
+   * widens `ranges`, a Map from operand index to [min, max], by the values
+   * of the model inputs and of every float tensor the ops write.
+   *
+   * @param {TypedArray[]} inputs - One buffer per model input.
+   * @param {Map} ranges - Ranges found so far, updated in place.
+   */
+  calibrate(inputs, ranges) {
+    this._checkIdle();
+    if (!this._calibration) {
+      throw new Error('Model is not prepared for calibration');
+    }
+    const observe = (index) => {
+      if (this._operands[index].type !== OperandCode.TENSOR_FLOAT32) {
+        return;
+      }
+      const view = this._getOperandView(index);
+      let min = Infinity, max = -Infinity;
+      for (let i = 0; i < view.length; ++i) {
+        const value = view[i];
+        if (value < min) min = value;
+        if (value > max) max = value;
+      }
+      const range = ranges.get(index);
+      if (range) {
+        range[0] = Math.min(range[0], min);
+        range[1] = Math.max(range[1], max);
+      } else {
+        ranges.set(index, [min, max]);
+      }
+    };
+
+    this._model._inputs.forEach((index, i) => {
+      const operand = this._operands[index];
+      this._setTensorData(operand.type, operand.value, inputs[i]);
+      observe(index);
+    });
+    for (const [i, operation] of this._operations.entries()) {
+      this._plan.run(i, i + 1);
+      operation.outputs.forEach(observe);
+    }
+  }
+
+  /**
+   * Accuracy drift of a model quantized by Compilation.setQuantization
+   * against its float outputs, see Quantizer.measureDrift. Null for other
+   * models.
+   *
+   * @returns {Object}
+   */
+  getQuantizationReport() {
+    return this._quantizationReport;
+  }
+
+  /**
+   * Returns a view of the heap memory the plan reads or writes for a model
+   * input or output. Data written to an input view before execute() is used
+   * as is; output views hold the results after it. The view detaches when
+   * the heap grows, so fetch it again for every execution; views are cached,
+   * so this is cheap.
+   *
+   * @param {number} index - Operand index of the model input or output.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {TypedArray}
+   */
+  getTensorView(index, frame = 0) {
+    const view = this._getOperandView(index);
+    if (this._batchSize === 1) {
+      return view;
+    }
+    const length = view.length / this._batchSize;
+    return view.subarray(frame * length, (frame + 1) * length);
+  }
+
+  /**
+   * Decodes SSD boxes and runs non-max suppression on two model outputs in
+   * place, with the nn_ops ssdPostprocess kernel (TFLite
+   * Detection_PostProcess semantics: a box is suppressed by an IoU above
+   * iou_threshold).
+   *
+   * @param {number} boxesIndex - Operand index of the box encodings output.
+   * @param {number} scoresIndex - Operand index of the class scores output.
+   * @param {Array|Float32Array} anchors - [ycenter, xcenter, height, width]
+   *     of every box, as returned by generateAnchors or flattened. Copied to
+   *     the heap on first use.
+   * @param {Object} options - The options of the SsdDecoder.js NMS, plus
+   *     label_offset (default 1, skips the background class) and
+   *     use_regular_nms (default true, per-class NMS).
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {Array} [totalDetections, boxesList, scoresList, classesList],
+   *     as returned by NMS.
+   */
+  ssdPostprocess(boxesIndex, scoresIndex, anchors, options = {}, frame = 0) {
+    this._checkIdle();
+    return this._ssdPostprocess(boxesIndex, this._operands[boxesIndex].value,
+                                scoresIndex, this._operands[scoresIndex].value,
+                                anchors, options, frame);
+  }
+
+  // ssdPostprocess on the tensors at `boxesData` and `scoresData`, shaped as
+  // the outputs. Does not touch the bound tensors, so FramePipeline uses it
+  // on its own while the plan runs.
+  _ssdPostprocess(boxesIndex, boxesData, scoresIndex, scoresData, anchors, options = {}, frame = 0) {
+    const nn_ops = this._nn_ops;
+    const boxes = this._operands[boxesIndex];
+    const scores = this._operands[scoresIndex];
+    const {
+      score_threshold = 0.1,
+      iou_threshold = 0.5,
+      max_detections_per_class = 10,
+      max_total_detections = 100,
+      num_boxes = 1083 + 600 + 150 + 54 + 24 + 6,
+      num_classes = 91,
+      box_size = 4,
+      label_offset = 1,
+      use_regular_nms = true,
+      scale_factors = [10.0, 10.0, 5.0, 5.0]
+    } = options;
+    if (box_size !== 4 || boxes.type !== scores.type ||
+        boxes.frameBytes < utils.sizeOfTensorData(boxes.type, [num_boxes, 4]) ||
+        scores.frameBytes < utils.sizeOfTensorData(scores.type, [num_boxes, num_classes])) {
+      throw new Error(`Outputs ${boxesIndex} and ${scoresIndex} are not SSD boxes and scores ` +
+                      `of ${num_boxes} boxes and ${num_classes} classes`);
+    }
+    const kernel = boxes.type === OperandCode.TENSOR_FLOAT32 ? 'ssdPostprocessFloat32' :
+                   boxes.type === OperandCode.TENSOR_QUANT8_ASYMM ? 'ssdPostprocessUint8' : null;
+    if (kernel === null) {
+      throw new Error(`Operand type ${boxes.type} is not supported`);
+    }
+    this._requireKernel(kernel);
+    const flatAnchors = anchors.length === num_boxes * 4;
+    if (anchors.length !== num_boxes && !flatAnchors) {
+      throw new Error(`Invalid anchors of length ${anchors.length} for ${num_boxes} boxes`);
+    }
+
+    const ssdAnchors = this._ssdAnchors;
+    if (ssdAnchors.source !== anchors) {
+      nn_ops._free(ssdAnchors.ptr);
+      ssdAnchors.ptr = nn_ops._malloc(num_boxes * 4 * Float32Array.BYTES_PER_ELEMENT);
+      ssdAnchors.source = anchors;
+      const view = new Float32Array(nn_ops.HEAPF32.buffer, ssdAnchors.ptr, num_boxes * 4);
+      if (flatAnchors) {
+        view.set(anchors);
+      } else {
+        anchors.forEach((anchor, i) => view.set(anchor, i * 4));
+      }
+    }
+    const byteLength = max_total_detections * 6 * Float32Array.BYTES_PER_ELEMENT;
+    const ssdOutput = this._ssdOutput;
+    if (ssdOutput.byteLength < byteLength) {
+      nn_ops._free(ssdOutput.ptr);
+      ssdOutput.ptr = nn_ops._malloc(byteLength);
+      ssdOutput.byteLength = byteLength;
+    }
+
+    const params = {
+      num_boxes: num_boxes,
+      num_classes: num_classes,
+      label_offset: label_offset,
+      y_scale: scale_factors[0],
+      x_scale: scale_factors[1],
+      h_scale: scale_factors[2],
+      w_scale: scale_factors[3],
+      score_threshold: score_threshold,
+      iou_threshold: iou_threshold,
+      max_detections: max_total_detections,
+      max_detections_per_class: max_detections_per_class,
+      use_regular_nms: use_regular_nms,
+      box_scale: boxes.scale || 1,
+      box_zero_point: boxes.zeroPoint || 0,
+      score_scale: scores.scale || 1,
+      score_zero_point: scores.zeroPoint || 0
+    };
+    const boxData = boxesData + frame * boxes.frameBytes;
+    const scoreData = scoresData + frame * scores.frameBytes;
+    const totalDetections = nn_ops[kernel](params, boxData, scoreData,
+                                           ssdAnchors.ptr, ssdOutput.ptr);
+
+    const detections = new Float32Array(nn_ops.HEAPF32.buffer, ssdOutput.ptr, totalDetections * 6).slice();
+    const boxesList = [];
+    const scoresList = [];
+    const classesList = [];
+    for (let i = 0; i < totalDetections; ++i) {
+      boxesList.push(detections.subarray(i * 6, i * 6 + 4));
+      classesList.push(detections[i * 6 + 4]);
+      scoresList.push(detections[i * 6 + 5]);
+    }
+    return [totalDetections, boxesList, scoresList, classesList];
+  }
+
+  /**
+   * Decodes a YOLOv2 region output in place and runs per-class NMS with the
+   * nn_ops yolo2Region kernel. Buffers and the returned object are reused,
+   * so repeated calls allocate nothing.
+   *
+   * @param {number} index - Operand index of the region output.
+   * @param {Array|Float32Array} anchors - (width, height) of every anchor,
+   *     as passed to decodeYOLOv2. Copied to the heap on first use.
+   * @param {Object} options - The options of decodeYOLOv2.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   * @returns {Object} {count, detections}: the first `count` rows of
+   *     `detections` are [class, x, y, width, height, score], the entries
+   *     decodeYOLOv2 returns. Valid until the next call.
+   */
+  yolo2Region(index, anchors, options = {}, frame = 0) {
+    this._checkIdle();
+    return this._yolo2Region(index, this._operands[index].value, anchors, options, frame);
+  }
+
+  // yolo2Region on the tensor at `data`, see _ssdPostprocess.
+  _yolo2Region(index, data, anchors, options = {}, frame = 0) {
+    const nn_ops = this._nn_ops;
+    const operand = this._operands[index];
+    const {
+      nb_class = 80,
+      nb_box = 5,
+      grid_h = 13,
+      grid_w = 13,
+      obj_threshold = 0.5,
+      nms_threshold = 0.3,
+    } = options;
+    const numCells = grid_h * grid_w * nb_box;
+    if (operand.type !== OperandCode.TENSOR_FLOAT32 ||
+        operand.frameBytes < utils.sizeOfTensorData(operand.type, [numCells, 5 + nb_class])) {
+      throw new Error(`Output ${index} is not a YOLOv2 region of ${grid_h}x${grid_w} cells, ` +
+                      `${nb_box} anchors and ${nb_class} classes`);
+    }
+    if (anchors.length !== 2 * nb_box) {
+      throw new Error(`Invalid anchors of length ${anchors.length} for ${nb_box} anchors`);
+    }
+    this._requireKernel('yolo2RegionFloat32');
+
+    if (!this._yolo || this._yolo.numCells < numCells || this._yolo.source !== anchors) {
+      this._freeYolo();
+      const anchorsPtr = nn_ops._malloc(2 * nb_box * Float32Array.BYTES_PER_ELEMENT);
+      nn_ops.HEAPF32.set(anchors, anchorsPtr >> 2);
+      this._yolo = {
+        source: anchors,
+        numCells: numCells,
+        anchorsPtr: anchorsPtr,
+        outputPtr: nn_ops._malloc(numCells * 6 * Float32Array.BYTES_PER_ELEMENT),
+        params: {},
+        result: {count: 0, detections: null}
+      };
+    }
+    const yolo = this._yolo;
+    const params = yolo.params;
+    params.grid_height = grid_h;
+    params.grid_width = grid_w;
+    params.num_anchors = nb_box;
+    params.num_classes = nb_class;
+    params.obj_threshold = obj_threshold;
+    params.nms_threshold = nms_threshold;
+
+    const result = yolo.result;
+    result.count = nn_ops.yolo2RegionFloat32(params, data + frame * operand.frameBytes,
+                                             yolo.anchorsPtr, yolo.outputPtr);
+    if (!result.detections || result.detections.buffer !== nn_ops.HEAPF32.buffer) {
+      result.detections = new Float32Array(nn_ops.HEAPF32.buffer, yolo.outputPtr, yolo.numCells * 6);
+    }
+    return result;
+  }
+
+  /**
+   * Returns a heap view of at least `byteLength` bytes that stays allocated
+   * until the model is deleted. Frames written into it are preprocessed by
+   * preprocessRGBA without another copy. The view detaches when the heap
+   * grows, so fetch it again for every frame.
+   *
+   * @param {number} byteLength - Size of the frame in bytes.
+   * @returns {Uint8Array}
+   */
+  getFrameBuffer(byteLength) {
+    const ptr = this._reserveFrameBuffer(byteLength);
+    return new Uint8Array(this._nn_ops.HEAPU8.buffer, ptr, byteLength);
+  }
+
+  // Grows the frame buffer to at least `byteLength` bytes and returns its
+  // address, which moves when it grows.
+  _reserveFrameBuffer(byteLength) {
+    const nn_ops = this._nn_ops;
+    const frameBuffer = this._frameBuffer;
+    if (frameBuffer.byteLength < byteLength) {
+      nn_ops._free(frameBuffer.ptr);
+      frameBuffer.ptr = nn_ops._malloc(byteLength);
+      frameBuffer.byteLength = byteLength;
+    }
+    return frameBuffer.ptr;
+  }
+
+  /**
+   * Whether the loaded nn_ops build exports the kernel `name`. Builds older
+   * than the sources in src/ lack the pre- and postprocessing kernels.
+   *
+   * @param {string} name - Name of the kernel, e.g. 'preprocessRGBAFloat32'.
+   * @returns {boolean}
+   */
+  hasKernel(name) {
+    return typeof this._nn_ops[name] === 'function';
+  }
+
+  _requireKernel(name) {
+    if (!this.hasKernel(name)) {
+      throw new Error(`${name} needs an nn_ops build with it, rebuild nn_ops.js from src/`);
+    }
+  }
+
+  /**
+   * Resizes, normalizes and lays out an RGBA image straight into a model
+   * input, in one pass of the nn_ops preprocessRGBA kernel.
+   *
+   * @param {number} index - Operand index of the model input.
+   * @param {Uint8Array|Uint8ClampedArray} pixels - RGBA pixels, row by row.
+   *     Views returned by getFrameBuffer are read in place.
+   * @param {number} width - Width of the image.
+   * @param {number} height - Height of the image.
+   * @param {Object} options - {crop: {x, y, width, height}, draw: {width,
+   *     height}, mean, std, norm, channelScheme, nchwFlag}. The crop of the
+   *     image (default: all of it) is resized to `draw` (default: the input
+   *     size) at the top-left corner of the input, the rest is zero. Each
+   *     channel becomes (value - mean) / std, with value scaled to [0, 1]
+   *     when `norm` is set, as in the WebNNRunner preprocessing.
+   * @param {number} [frame=0] - The frame of a batched compilation.
+   */
+  preprocessRGBA(index, pixels, width, height, options = {}, frame = 0) {
+    this._checkIdle();
+    this._preprocessRGBA(index, this._operands[index].value, pixels, width, height, options, frame);
+  }
+
+  // preprocessRGBA into the tensor at `data`, see _ssdPostprocess.
+  _preprocessRGBA(index, data, pixels, width, height, options = {}, frame = 0) {
+    const nn_ops = this._nn_ops;
+    const operand = this._operands[index];
+    const nchw = options.nchwFlag || false;
+    const [, d1, d2, d3] = operand.dimensions;
+    const [dstHeight, dstWidth, channels] = nchw ? [d2, d3, d1] : [d1, d2, d3];
+    if (operand.dimensions.length !== 4 || channels > 4) {
+      throw new Error(`Input ${index} of shape [${operand.dimensions}] is not an image`);
+    }
+
+    const kernel = operand.type === OperandCode.TENSOR_FLOAT32 ? 'preprocessRGBAFloat32' :
+                   operand.type === OperandCode.TENSOR_QUANT8_ASYMM ? 'preprocessRGBAUint8' : null;
+    if (kernel === null) {
+      throw new Error(`Operand type ${operand.type} is not supported`);
+    }
+    this._requireKernel(kernel);
+
+    const byteLength = width * height * 4;
+    let ptr;
+    if (pixels.buffer === nn_ops.HEAPU8.buffer) {
+      ptr = pixels.byteOffset;
+    } else {
+      // the buffer of a larger frame is allocated anew, so copy after it
+      ptr = this._reserveFrameBuffer(byteLength);
+      nn_ops.HEAPU8.set(pixels.subarray(0, byteLength), ptr);
+    }
+
+    const crop = options.crop || {x: 0, y: 0, width: width, height: height};
+    const draw = options.draw || {width: dstWidth, height: dstHeight};
+    const mean = options.mean || [0, 0, 0, 0];
+    const std = options.std || [1, 1, 1, 1];
+    const valueScale = options.norm ? 1 / 255 : 1;
+    const channelScheme = options.channelScheme || 'RGB';
+    const channelMap = [0, 1, 2, 3].map(c => {
+      if (c >= channels) {
+        return 0;
+      } else if (channelScheme === 'BGR') {
+        return channels - c - 1;
+      } else if (channelScheme === 'RGB') {
+        return channels === 1 ? -1 : c;
+      } else {
+        throw new Error(`Unsupport '${channelScheme}' Color Channel Scheme`);
+      }
     });
+    const params = {
+      src_width: width,
+      src_height: height,
+      crop_x: crop.x,
+      crop_y: crop.y,
+      crop_width: crop.width,
+      crop_height: crop.height,
+      dst_width: dstWidth,
+      dst_height: dstHeight,
+      draw_width: draw.width,
+      draw_height: draw.height,
+      channels: channels,
+      channel_map: channelMap,
+      scale: [0, 1, 2, 3].map(c => c < channels ? valueScale / std[c] : 0),
+      bias: [0, 1, 2, 3].map(c => c < channels ? -mean[c] / std[c] : 0),
+      nchw: nchw
+    };
+
+    nn_ops[kernel](params, ptr, data + frame * operand.frameBytes);
   }
 
   async _createSubModel(nodes, inTensors, outTensors) {
@@ -180,7 +1009,8 @@ export default class PreparedModel {
           const operand = this._model._operands[globalTensorId];
           const operandType = {
             type: operand.type,
-            dimensions: operand.dimensions,
+            // batched in batched mode
+            dimensions: this._operands[globalTensorId].dimensions,
             scale: operand.scale,
             zeroPoint: operand.zeroPoint,
           };
@@ -211,21 +1041,33 @@ export default class PreparedModel {
 
     // bind input and output tensor buffers at compile time
     inTensors.forEach((tensorId, i) => {
-      const operand = this._operands[tensorId];
-      const length = product(operand.dimensions);
-      const view = this._getTensorDataView(operand.type, operand.value, length);
-      execution.setInput(i, view);
+      execution.setInput(i, this._getOperandView(tensorId));
     });
     outTensors.forEach((tensorId, i) => {
-      const operand = this._operands[tensorId];
-      const length = product(operand.dimensions);
-      const view = this._getTensorDataView(operand.type, operand.value, length);
-      execution.setOutput(i, view);
+      execution.setOutput(i, this._getOperandView(tensorId));
     });
 
     return {model: submodel, compilation: compilation, execution: execution};
   }
 
+  async _executeSubgraph(operation) {
+    const execution = operation.execution;
+
+    // workaround for intel/webml-polyfill#674, outputs are bound again too
+    // as their views change when the heap grows or a tensor is rebound
+    operation.inputs.forEach((tensorId, i) => {
+      execution.setInput(i, this._getOperandView(tensorId));
+    });
+    operation.outputs.forEach((tensorId, i) => {
+      execution.setOutput(i, this._getOperandView(tensorId));
+    });
+
+    // execute subgraph
+    await execution.startCompute();
+  }
+
+  // Runs one op with the nn_ops wrappers on the operands' own tensors, for
+  // models prepared by _preparePerOp.
   async _executeOperation(operation) {
     const nn_ops = this._nn_ops;
     let op = operation.type;
@@ -471,18 +1313,7 @@ export default class PreparedModel {
 
     switch(op) {
       case OperationCode.WEBNN_SUBGRAPH: {
-        const execution = operation.execution;
-
-        // workaround for intel/webml-polyfill#674
-        inputs.forEach((tensorId, i) => {
-          const operand = this._operands[tensorId];
-          const length = product(operand.dimensions);
-          const view = this._getTensorDataView(operand.type, operand.value, length);
-          execution.setInput(i, view);
-        });
-
-        // execute subgraph
-        await operation.execution.startCompute();
+        await this._executeSubgraph(operation);
       } break;
       case OperationCode.ADD: {
         allParametersPresent(3, 1);
@@ -1386,24 +2217,1162 @@ export default class PreparedModel {
     }
   }
 
-  _setTensorData(type, ptr, data) {
+
+  /**
+   * Resolve the parameters of an operation and append its record to the
+   * execution plan. WEBNN_SUBGRAPH is recorded as an external op.
+   */
+  _compileOperation(operation) {
     const nn_ops = this._nn_ops;
-    if (type === OperandCode.TENSOR_FLOAT32) {
-      nn_ops.HEAPF32.set(data, ptr >> 2);
-    } else if (type === OperandCode.TENSOR_INT32) {
-      nn_ops.HEAP32.set(data, ptr >> 2);
-    } else if (type === OperandCode.TENSOR_QUANT8_ASYMM) {
-      nn_ops.HEAPU8.set(data, ptr);
-    } else if (type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
-      nn_ops.HEAP8.set(data, ptr);
-    } else if (type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
-      nn_ops.HEAP8.set(data, ptr);
-    } else {
-      throw new Error(`Operand type ${type} is not supported`);
+    const plan = this._plan;
+    const PlanOpCode = nn_ops.PlanOpCode;
+    let op = operation.type;
+    let inputs = operation.inputs;
+    let outputs = operation.outputs;
+    let operands = this._operands;
+    let modelOperands = this._model._operands;
+
+    if (this._batchSize > 1) {
+      this._checkBatchable(operation);
     }
-  }
 
-  _getTensorData(type, ptr, buffer) {
+    function allParametersPresent(requiredIns, requiredOuts) {
+      function verify(requiredCount, indexes, type) {
+        let actualCount = indexes.length;
+        if (requiredCount !== actualCount) {
+          throw new Error(`Operation ${op} requires ${requiredCount} ${type} operands, but got ${actualCount}.`);
+        }
+        indexes.forEach(index => {
+          if (operands[index].value === null || operands[index].lifetime === OperandLifetime.NO_VALUE) {
+            throw new Error(`Operation ${op} ${type} operand ${index} is required but missing.`);
+          }
+        })
+      }
+      verify(requiredIns, inputs, 'in');
+      verify(requiredOuts, outputs, 'out');
+    }
+
+    function calculateExplicitPadding(inSize, stride, filterSize, dilationFactor, paddingCode) {
+      let paddingHead = 0;
+      let paddingTail = 0;
+
+      let dilatedFilterSize = dilationFactor * (filterSize - 1) + 1;
+
+      if (paddingCode === PaddingCode.SAME) {
+        let outSize = Math.floor((inSize + stride - 1) / stride);
+        let tmp = Math.floor((outSize - 1) * stride + dilatedFilterSize);
+        if (tmp > inSize) {
+          paddingHead = Math.floor((tmp - inSize) / 2);
+          paddingTail = Math.floor((tmp - inSize) - paddingHead);
+        }
+      }
+
+      return [paddingHead, paddingTail];
+    }
+
+    function calculateActivationRange(activation, output) {
+      if (output.type === OperandCode.TENSOR_FLOAT32) {
+        // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#261
+        let float_activation_min, float_activation_max;
+        if (activation === FuseCode.RELU) {
+          float_activation_min = 0.0;
+          float_activation_max = nn_ops.FLOAT_MAX;
+        } else if (activation === FuseCode.RELU6) {
+          float_activation_min = 0.0;
+          float_activation_max = 6.0;
+        } else if (activation === FuseCode.RELU1) {
+          float_activation_min = -1.0;
+          float_activation_max = 1.0;
+        } else if (activation === FuseCode.NONE) {
+          float_activation_min = nn_ops.FLOAT_LOWEST;
+          float_activation_max = nn_ops.FLOAT_MAX;
+        } else {
+          throw new Error("Unsupported fused activation function.");
+        }
+        return [float_activation_min, float_activation_max, 0, 0];
+      } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM ||
+          output.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+        // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#230
+        let quantized_activation_min, quantized_activation_max;
+        let scale = output.scale;
+        let zero_point = output.zeroPoint;
+        let qmin, qmax;
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          qmin = nn_ops.UINT8_MIN;
+          qmax = nn_ops.UINT8_MAX;
+        } else {
+          qmin = nn_ops.INT8_MIN;
+          qmax = nn_ops.INT8_MAX;
+        }
+
+        let quantize = function(f) {
+            return zero_point + Math.round(f / scale);
+        };
+
+        if (activation == FuseCode.RELU) {
+          quantized_activation_min = Math.max(qmin, quantize(0.0));
+          quantized_activation_max = qmax;
+        } else if (activation == FuseCode.RELU6) {
+          quantized_activation_min = Math.max(qmin, quantize(0.0));
+          quantized_activation_max = Math.min(qmax, quantize(6.0));
+        } else if (activation == FuseCode.RELU1) {
+          quantized_activation_min = Math.max(qmin, quantize(-1.0));
+          quantized_activation_max = Math.min(qmax, quantize(1.0));
+        } else if (activation == FuseCode.NONE){
+          quantized_activation_min = qmin;
+          quantized_activation_max = qmax;
+        } else {
+          throw new Error("Unsupported fused activation function.");
+        }
+        return [0.0, 0.0, quantized_activation_min, quantized_activation_max];
+      } else {
+        throw new Error("Unsupported type of tensor for fused activation function.");
+      }
+    }
+
+    // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#153
+    function QuantizeMultiplier(double_multiplier) {
+      let quantized_multiplier, shift;
+      if (double_multiplier == 0.) {
+          quantized_multiplier = 0;
+          shift = 0;
+          return [quantized_multiplier, shift];
+      }
+      let q;
+      [q, shift] = frexp(double_multiplier);
+      let q_fixed = Math.round(q * -(1 << 31));
+      OPS_CHECK(q_fixed <= -(1 << 31));
+      if (q_fixed == -(1 << 31)) {
+        q_fixed /= 2;
+        ++shift;
+      }
+      OPS_CHECK(q_fixed <= nn_ops.INT32_MAX);
+      if (shift < -31) {
+        shift = 0;
+        q_fixed = 0;
+      }
+      quantized_multiplier = q_fixed | 0;
+      return [quantized_multiplier, shift];
+    }
+
+    // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#213
+    function GetQuantizedConvolutionMultipler(input_scale, filter_scale,
+                                              bias_scale, output_scale) {
+      let input_product_scale = input_scale * filter_scale;
+
+      // The following conditions must be guaranteed by the training pipeline.
+      OPS_CHECK(Math.abs(input_product_scale - bias_scale) <=
+                (1e-6 * Math.min(input_product_scale, bias_scale)));
+      OPS_CHECK(input_product_scale >= 0);
+      let multiplier = input_product_scale / output_scale;
+      return multiplier;
+    }
+
+    // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#171
+    function QuantizeMultiplierSmallerThanOne(double_multiplier) {
+      let quantized_multiplier, right_shift, q;
+      OPS_CHECK(double_multiplier >= 0.);
+      OPS_CHECK(double_multiplier < 1.);
+      if (double_multiplier === 0.) {
+        quantized_multiplier = 0;
+        right_shift = 0;
+        return [quantized_multiplier, right_shift];
+      }
+      OPS_CHECK(double_multiplier > 0.);
+      [q, right_shift] = frexp(double_multiplier);
+      right_shift *= -1;
+      quantized_multiplier = Math.round(q * -(1 << 31));
+      OPS_CHECK(quantized_multiplier <= -(1 << 31));
+      if (quantized_multiplier == -(1 << 31)) {
+        quantized_multiplier /= 2;
+        --right_shift;
+      }
+      OPS_CHECK(right_shift >= 0);
+      OPS_CHECK(quantized_multiplier <= nn_ops.INT32_MAX);
+
+      return [quantized_multiplier, right_shift];
+    }
+
+    // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#196
+    function QuantizeMultiplierGreaterThanOne(double_multiplier) {
+      let quantized_multiplier, left_shift, q;
+      OPS_CHECK(double_multiplier > 1.);
+      [q, left_shift] = frexp(double_multiplier);
+      quantized_multiplier = Math.round(q * -(1 << 31));
+      OPS_CHECK(quantized_multiplier <= -(1 << 31));
+      if (quantized_multiplier == -(1 << 31)) {
+        quantized_multiplier /= 2;
+        ++left_shift;
+      }
+      OPS_CHECK(left_shift >= 0);
+      OPS_CHECK(quantized_multiplier <= nn_ops.INT32_MAX);
+      return [quantized_multiplier, left_shift];
+    }
+
+    // reference: https://android.googlesource.com/platform/frameworks/ml/+/refs/heads/master/nn/common/OperationsUtils.cpp#281
+    function CalculateInputRadius(input_integer_bits, input_left_shift) {
+      let max_input_rescaled = 1.0 * ((1 << input_integer_bits) - 1) *
+                               (1 << (31 - input_integer_bits)) /
+                               (1 << input_left_shift);
+      // Tighten bound using floor.  Suppose that we could use the exact value.
+      // After scaling the difference, the result would be at the maximum.  Thus we
+      // must ensure that our value has lower magnitude.
+      return Math.floor(max_input_rescaled);
+    }
+
+    // reference: http://locutus.io/c/math/frexp/index.html
+    function frexp (arg) {
+      arg = Number(arg);
+      const result = [arg, 0];
+      if (arg !== 0 && Number.isFinite(arg)) {
+        const absArg = Math.abs(arg)
+        // Math.log2 was introduced in ES2015, use it when available
+        const log2 = Math.log2 || function log2 (n) { return Math.log(n) * Math.LOG2E }
+        let exp = Math.max(-1023, Math.floor(log2(absArg)) + 1)
+        let x = absArg * Math.pow(2, -exp)
+
+        // These while loops compensate for rounding errors that sometimes occur because of ECMAScript's Math.log2's undefined precision
+        // and also works around the issue of Math.pow(2, -exp) === Infinity when exp <= -1024
+        while (x < 0.5) {
+          x *= 2
+          exp--
+        }
+        while (x >= 1) {
+          x *= 0.5
+          exp++
+        }
+
+        if (arg < 0) {
+          x = -x
+        }
+        result[0] = x
+        result[1] = exp
+      }
+      return result
+    }
+
+    function sameShape(input1, input2) {
+      if (input1.type != input2.type ||
+        input1.runtimeshape.DimensionsCount() != input2.runtimeshape.DimensionsCount()) {
+        return false;
+      }
+      for (let i = 0; i < input1.runtimeshape.DimensionsCount(); i++) {
+        if (input1.runtimeshape.Dims(i) != input2.runtimeshape.Dims(i)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    function OPS_CHECK(option) {
+      if (!option) {
+        throw new Error(`OPS_CHECK failed`);
+      }
+      return true;
+    }
+
+    switch(op) {
+      case OperationCode.WEBNN_SUBGRAPH: {
+        plan.addExternal(inputs, outputs);
+      } break;
+      case OperationCode.ADD: {
+        allParametersPresent(3, 1);
+        let in1 = operands[inputs[0]];
+        let in2 = operands[inputs[1]];
+        let activation = operands[inputs[2]].value[0];
+        let out = operands[outputs[0]];
+
+        let input1_multiplier = 0, input2_multiplier = 0, output_multiplier = 0;
+        let input1_shift = 0, input2_shift = 0, output_shift = 0;
+        let left_shift = 20;
+        if (out.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          let twice_max_input_scale = 2 * Math.max(in1.scale, in2.scale);
+          let real_input1_multiplier = in1.scale / twice_max_input_scale;
+          let real_input2_multiplier = in2.scale / twice_max_input_scale;
+          let real_output_multiplier = twice_max_input_scale / ((1 << left_shift) * out.scale);
+
+          [input1_multiplier, input1_shift] = QuantizeMultiplierSmallerThanOne(real_input1_multiplier);
+          [input2_multiplier, input2_shift] = QuantizeMultiplierSmallerThanOne(real_input2_multiplier);
+          [output_multiplier, output_shift] = QuantizeMultiplierSmallerThanOne(real_output_multiplier);
+        }
+
+        let [float_activation_min, float_activation_max,
+             quantized_activation_min, quantized_activation_max] = calculateActivationRange(activation, out);
+
+        // Error check
+        OPS_CHECK(in1.type === in2.type);
+        OPS_CHECK(in1.runtimeshape.DimensionsCount() <= 4 && in2.runtimeshape.DimensionsCount() <= 4);
+
+        // init arithmeticParams
+        let arithmeticParams = {
+          float_activation_min: float_activation_min,
+          float_activation_max: float_activation_max,
+          input1_offset: -in1.zeroPoint || 0,
+          input2_offset: -in2.zeroPoint || 0,
+          output_offset: out.zeroPoint || 0,
+          output_multiplier: output_multiplier,
+          output_shift: -output_shift,
+          left_shift: left_shift,
+          input1_multiplier: input1_multiplier,
+          input1_shift: -input1_shift,
+          input2_multiplier: input2_multiplier,
+          input2_shift: -input2_shift,
+          quantized_activation_min: quantized_activation_min,
+          quantized_activation_max: quantized_activation_max
+        }
+
+        let needBroadCast = !sameShape(in1, in2);
+        if (needBroadCast) {
+          plan.addArithmetic(PlanOpCode.broadCastAddFloat32, arithmeticParams,
+                             inputs[0], inputs[1], outputs[0]);
+        } else {
+          if (out.type === OperandCode.TENSOR_FLOAT32) {
+            plan.addArithmetic(PlanOpCode.addFloat32, arithmeticParams,
+                               inputs[0], inputs[1], outputs[0]);
+          } else if (out.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+            plan.addArithmetic(PlanOpCode.addUint8, arithmeticParams,
+                               inputs[0], inputs[1], outputs[0]);
+          }
+        }
+      } break;
+      case OperationCode.MUL: {
+        allParametersPresent(3, 1);
+        let in1 = operands[inputs[0]];
+        let in2 = operands[inputs[1]];
+        let activation = operands[inputs[2]].value[0];
+        let out = operands[outputs[0]];
+
+        let output_multiplier = 0, output_shift = 0;
+        if (out.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          let input_product_scale = in1.scale * in2.scale;
+          let real_multiplier = input_product_scale / out.scale;
+          [output_multiplier, output_shift] = QuantizeMultiplierSmallerThanOne(real_multiplier);
+        }
+
+        let [float_activation_min, float_activation_max,
+             quantized_activation_min, quantized_activation_max] = calculateActivationRange(activation, out);
+
+        // Error check
+        OPS_CHECK(in1.type === in2.type);
+        OPS_CHECK(in1.runtimeshape.DimensionsCount() <= 4 && in2.runtimeshape.DimensionsCount() <= 4);
+
+        // init arithmeticParams
+        let arithmeticParams = {
+          float_activation_min: float_activation_min,
+          float_activation_max: float_activation_max,
+          input1_offset: -in1.zeroPoint || 0,
+          input2_offset: -in2.zeroPoint || 0,
+          output_offset: out.zeroPoint || 0,
+          output_multiplier: output_multiplier,
+          output_shift: -output_shift,
+          left_shift: 0,
+          input1_multiplier: 0,
+          input1_shift: 0,
+          input2_multiplier: 0,
+          input2_shift: 0,
+          quantized_activation_min: quantized_activation_min,
+          quantized_activation_max: quantized_activation_max
+        }
+
+        let needBroadCast = !sameShape(in1, in2);
+        if (needBroadCast) {
+          plan.addArithmetic(PlanOpCode.broadCastMulFloat32, arithmeticParams,
+                             inputs[0], inputs[1], outputs[0]);
+        } else {
+          plan.addArithmetic(PlanOpCode.mulFloat32, arithmeticParams,
+                             inputs[0], inputs[1], outputs[0]);
+        }
+      } break;
+      case OperationCode.CONV_2D:
+      case OperationCode.ATROUS_CONV_2D:
+      case OperationCode.DEPTHWISE_CONV_2D:
+      case OperationCode.ATROUS_DEPTHWISE_CONV_2D:
+      {
+        let depth = false;
+        if (op === OperationCode.DEPTHWISE_CONV_2D ||
+            op === OperationCode.ATROUS_DEPTHWISE_CONV_2D) {
+          depth = true;
+        }
+        let atrous = false;
+        if (op === OperationCode.ATROUS_CONV_2D ||
+            op === OperationCode.ATROUS_DEPTHWISE_CONV_2D) {
+          atrous = true;
+        }
+        let inCount = inputs.length;
+        if (!depth) {
+          if (inCount !== 7 && inCount !== 10) {
+            throw new Error('Invalid parameters number of CONV_2D');
+          }
+        } else {
+          if (inCount !== 8 && inCount !== 11) {
+            throw new Error('Invalid parameters number of DEPTHWISE_CONV_2D');
+          }
+        }
+        allParametersPresent(inCount, 1);
+        let i = 0;
+        let input = operands[inputs[i++]];
+        let filter = operands[inputs[i++]];
+        let bias = operands[inputs[i++]];
+        let paddingLeft, paddingRight;  // Just use paddingLeft as paddingWidth
+        let paddingTop, paddingBottom;  // Just use paddingTop as paddingHeight
+        let strideWidth, strideHeight;
+        let dilationWidth, dilationHeight;
+        let filterWidth = filter.runtimeshape.Dims(2);
+        let filterHeight = filter.runtimeshape.Dims(1);
+        let depthMultipler = 1.0;
+        let activation = FuseCode.NONE;
+        if (inCount === 10 || inCount === 11) {  // explict padding
+          paddingLeft = operands[inputs[i++]].value[0];
+          paddingRight = operands[inputs[i++]].value[0];
+          paddingTop = operands[inputs[i++]].value[0];
+          paddingBottom = operands[inputs[i++]].value[0];
+          if (!atrous) {
+            strideWidth = operands[inputs[i++]].value[0];
+            strideHeight = operands[inputs[i++]].value[0];
+            [dilationWidth, dilationHeight] = [1, 1];
+          } else {
+            dilationWidth = operands[inputs[i++]].value[0];
+            dilationHeight = operands[inputs[i++]].value[0];
+            [strideWidth, strideHeight] = [1, 1];
+          }
+          if (depth) {
+            depthMultipler = operands[inputs[i++]].value[0];
+          }
+          activation = operands[inputs[i++]].value[0];
+        } else {  // implict padding
+          let paddingCode = operands[inputs[i++]].value[0];
+          if (!atrous) {
+            strideWidth = operands[inputs[i++]].value[0];
+            strideHeight = operands[inputs[i++]].value[0];
+            [dilationWidth, dilationHeight] = [1, 1];
+          } else {
+            dilationWidth = operands[inputs[i++]].value[0];
+            dilationHeight = operands[inputs[i++]].value[0];
+            [strideWidth, strideHeight] = [1, 1];
+          }
+          if (depth) {
+            depthMultipler = operands[inputs[i++]].value[0];
+          }
+          activation = operands[inputs[i++]].value[0];
+
+          let inputWidth = input.runtimeshape.Dims(2);
+          let inputHeight = input.runtimeshape.Dims(1);
+          [paddingLeft, paddingRight] =
+            calculateExplicitPadding(inputWidth, strideWidth, filterWidth, dilationWidth, paddingCode);
+          [paddingTop, paddingBottom] =
+            calculateExplicitPadding(inputHeight, strideHeight, filterHeight, dilationHeight, paddingCode);
+        }
+        let output = operands[outputs[0]];
+
+        let outBatch = output.runtimeshape.Dims(0);
+        let outHeight = output.runtimeshape.Dims(1);
+        let outWidth = output.runtimeshape.Dims(2);
+        let outDepth = output.runtimeshape.Dims(3);
+        let inDepth = input.runtimeshape.Dims(3);
+
+        let output_multiplier = 0, output_shift = 0;
+        let output_multipliers_data, output_shifts_data;
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM ||
+            output.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+          if (filter.type === output.type) {
+            let real_multiplier =
+                GetQuantizedConvolutionMultipler(input.scale, filter.scale,
+                                                 bias.scale, output.scale);
+            [output_multiplier, output_shift] =
+                QuantizeMultiplier(real_multiplier);
+            output_shift = -output_shift;
+          } else if (filter.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+            let output_multiplier_array = new Int32Array(outDepth, 0);
+            let output_shift_array = new Int32Array(outDepth, 0);
+            for (let i = 0; i < outDepth; ++i) {
+              const bias_scale = input.scale * filter.channelQuant.scales[i];
+              let real_multiplier =
+                  GetQuantizedConvolutionMultipler(input.scale, filter.channelQuant.scales[i],
+                                                   bias_scale, output.scale);
+              [output_multiplier, output_shift] =
+                  QuantizeMultiplier(real_multiplier);
+              output_multiplier_array[i] = output_multiplier;
+              // tflite convention: a positive shift is a left shift.
+              output_shift_array[i] = output_shift;
+            }
+            output_multipliers_data = this._allocateTensor({
+                type: OperandCode.TENSOR_INT32,
+                dimensions: [outDepth],
+                lifetime: OperandLifetime.CONSTANT_REFERENCE,
+                value: output_multiplier_array});
+            output_shifts_data = this._allocateTensor({
+                type: OperandCode.TENSOR_INT32,
+                dimensions: [outDepth],
+                lifetime: OperandLifetime.CONSTANT_REFERENCE,
+                value: output_shift_array});
+            this._toDelete.tensorValue.push(output_multipliers_data, output_shifts_data);
+          }
+        }
+
+        let float_activation_min, float_activation_max,
+            quantized_activation_min, quantized_activation_max;
+        [float_activation_min, float_activation_max,
+            quantized_activation_min, quantized_activation_max] =
+                calculateActivationRange(activation, output);
+
+        // Error check
+        if (filter.type !== OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+          OPS_CHECK(input.type === filter.type);
+        }
+        if (input.type === OperandCode.TENSOR_QUANT8_ASYMM ||
+            input.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+          OPS_CHECK(bias.type === OperandCode.TENSOR_INT32);
+        } else {
+          OPS_CHECK(input.type === bias.type);
+        }
+
+        OPS_CHECK(input.runtimeshape.DimensionsCount() === 4);
+        OPS_CHECK(filter.runtimeshape.DimensionsCount() === 4);
+        OPS_CHECK(bias.runtimeshape.DimensionsCount() === 1);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() === 4);
+
+        if (!depth) {
+          OPS_CHECK(filter.runtimeshape.Dims(0) === bias.runtimeshape.Dims(0));
+          OPS_CHECK(filter.runtimeshape.Dims(3) === input.runtimeshape.Dims(3));
+        } else {
+          OPS_CHECK(filter.runtimeshape.Dims(0) === 1);
+          OPS_CHECK(filter.runtimeshape.Dims(3) === bias.runtimeshape.Dims(0));
+        }
+
+        // init convParams
+        let PaddingValues = {
+          width: paddingLeft,
+          height: paddingTop
+        };
+
+        let convParams = {
+          padding_values: PaddingValues,
+          stride_width: strideWidth,
+          stride_height: strideHeight,
+          dilation_width_factor: dilationWidth,
+          dilation_height_factor: dilationHeight,
+          float_activation_min: float_activation_min,
+          float_activation_max: float_activation_max,
+          input_offset: -input.zeroPoint || 0,
+          weights_offset: -filter.zeroPoint || 0,
+          output_offset: output.zeroPoint || 0,
+          output_multiplier: output_multiplier || 0,
+          output_shift: -output_shift || 0,
+          quantized_activation_min: quantized_activation_min,
+          quantized_activation_max: quantized_activation_max
+        };
+
+        if (!depth) {
+          if (output.type === OperandCode.TENSOR_FLOAT32) {
+            plan.addConv(PlanOpCode.convFloat32, convParams,
+                         inputs[0], inputs[1], inputs[2], outputs[0],
+                         0, 0);
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+            if (filter.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+              plan.addConv(PlanOpCode.convUint8, convParams,
+                           inputs[0], inputs[1], inputs[2], outputs[0],
+                           0, 0);
+            } else if (filter.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+              plan.addConv(PlanOpCode.convUint8PerChannel, convParams,
+                           inputs[0], inputs[1], inputs[2], outputs[0],
+                           output_multipliers_data, output_shifts_data);
+            } else {
+              throw new Error(`CONV_2D: filter type ${filter.type} is not supproted`);
+            }
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+            if (filter.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+              plan.addConv(PlanOpCode.convInt8, convParams,
+                           inputs[0], inputs[1], inputs[2], outputs[0],
+                           0, 0);
+            } else if (filter.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+              plan.addConv(PlanOpCode.convInt8PerChannel, convParams,
+                           inputs[0], inputs[1], inputs[2], outputs[0],
+                           output_multipliers_data, output_shifts_data);
+            } else {
+              throw new Error(`CONV_2D: filter type ${filter.type} is not supproted`);
+            }
+          } else {
+            throw new Error(`CONV_2D: output type ${output.type} is not supported`);
+          }
+        } else {  // depthwise == true
+          convParams.depth_multiplier = depthMultipler;
+          if (output.type === OperandCode.TENSOR_FLOAT32) {
+            plan.addDepthwiseConv(PlanOpCode.depthwiseConvFloat32, convParams,
+                                  inputs[0], inputs[1], inputs[2], outputs[0],
+                                  0, 0);
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+            if (filter.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+              plan.addDepthwiseConv(PlanOpCode.depthwiseConvUint8, convParams,
+                                    inputs[0], inputs[1], inputs[2], outputs[0],
+                                    0, 0);
+            } else if (filter.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+              plan.addDepthwiseConv(PlanOpCode.depthwiseConvUint8PerChannel, convParams,
+                                    inputs[0], inputs[1], inputs[2], outputs[0],
+                                    output_multipliers_data, output_shifts_data);
+            } else {
+              throw new Error(`DEPTHWISE_CONV_2D: filter type ${filter.type} is not supproted`);
+            }
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+            if (filter.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+              plan.addDepthwiseConv(PlanOpCode.depthwiseConvInt8, convParams,
+                                    inputs[0], inputs[1], inputs[2], outputs[0],
+                                    0, 0);
+            } else if (filter.type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+              plan.addDepthwiseConv(PlanOpCode.depthwiseConvInt8PerChannel, convParams,
+                                    inputs[0], inputs[1], inputs[2], outputs[0],
+                                    output_multipliers_data, output_shifts_data);
+            } else {
+              throw new Error(`CONV_2D: filter type ${filter.type} is not supproted`);
+            }
+          } else {
+            throw new Error(`DEPTHWISE_CONV_2D: output type ${output.type} is not supported`);
+          }
+        }
+      } break;
+      case OperationCode.AVERAGE_POOL_2D:
+      case OperationCode.MAX_POOL_2D: {
+        let inCount = inputs.length;
+        if (inCount !== 7 && inCount !== 10) {
+          throw new Error(`Invalid parameters number of Pooling ${op}`);
+        }
+        allParametersPresent(inCount, 1);
+        let i = 0;
+        let input = operands[inputs[i++]];
+        let paddingLeft, paddingRight;  // Just use paddingLeft as paddingWidth
+        let paddingTop, paddingBottom;  // Just use paddingTop as paddingHeight
+        let strideWidth, strideHeight;
+        let filterWidth, filterHeight;
+        let activation;
+        if (inCount === 10) {
+          paddingLeft = operands[inputs[i++]].value[0];
+          paddingRight = operands[inputs[i++]].value[0];
+          paddingTop = operands[inputs[i++]].value[0];
+          paddingBottom = operands[inputs[i++]].value[0];
+          strideWidth = operands[inputs[i++]].value[0];
+          strideHeight = operands[inputs[i++]].value[0];
+          filterWidth = operands[inputs[i++]].value[0];
+          filterHeight = operands[inputs[i++]].value[0];
+          activation = operands[inputs[i++]].value[0];
+        } else {
+          let paddingCode = operands[inputs[i++]].value[0];
+          strideWidth = operands[inputs[i++]].value[0];
+          strideHeight = operands[inputs[i++]].value[0];
+          filterWidth = operands[inputs[i++]].value[0];
+          filterHeight = operands[inputs[i++]].value[0];
+          activation = operands[inputs[i++]].value[0];
+
+          let inputWidth = input.runtimeshape.Dims(2);
+          let inputHeight = input.runtimeshape.Dims(1);
+          [paddingLeft, paddingRight] =
+            calculateExplicitPadding(inputWidth, strideWidth, filterWidth, 1, paddingCode);
+          [paddingTop, paddingBottom] =
+            calculateExplicitPadding(inputHeight, strideHeight, filterHeight, 1, paddingCode);
+        }
+        let output = operands[outputs[0]];
+
+        let [float_activation_min, float_activation_max,
+             quantized_activation_min, quantized_activation_max] = calculateActivationRange(activation, output);
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() === 4);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() === 4);
+
+        // init poolParams
+        let PaddingValues = {
+          width: paddingLeft,
+          height: paddingTop
+        }
+        let poolParams = {
+          padding_values: PaddingValues,
+          stride_width: strideWidth,
+          stride_height: strideHeight,
+          filter_width: filterWidth,
+          filter_height: filterHeight,
+          float_activation_min: float_activation_min,
+          float_activation_max: float_activation_max,
+          quantized_activation_min: quantized_activation_min,
+          quantized_activation_max: quantized_activation_max
+        }
+
+        if (op === OperationCode.AVERAGE_POOL_2D) {
+          if (output.type === OperandCode.TENSOR_FLOAT32) {
+            plan.addPool(PlanOpCode.averagePoolFloat32, poolParams, inputs[0], outputs[0]);
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+            plan.addPool(PlanOpCode.averagePoolUint8, poolParams, inputs[0], outputs[0]);
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+            plan.addPool(PlanOpCode.averagePoolInt8, poolParams, inputs[0], outputs[0]);
+          } else {
+            throw new Error(`output type ${output.type} is not supported by AVERAGE_POOL_2D.`);
+          }
+        } else if (op === OperationCode.MAX_POOL_2D) {
+          if (output.type === OperandCode.TENSOR_FLOAT32) {
+            plan.addPool(PlanOpCode.maxPoolFloat32, poolParams, inputs[0], outputs[0]);
+          } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+            plan.addPool(PlanOpCode.maxPoolUint8, poolParams, inputs[0], outputs[0]);
+          }
+        }
+      } break;
+      case OperationCode.SOFTMAX: {
+        allParametersPresent(2, 1);
+        let input = operands[inputs[0]];
+        let beta = operands[inputs[1]].value[0];
+        if (beta <= 0.0) {
+          throw new Error('beta must be positive for SOFTMAX');
+        }
+        let output = operands[outputs[0]];
+
+        let inputMultiplier = 0, inputLeftShift = 0, diffMin = 0;
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          if (output.zeroPoint != 0 || output.scale != 1 / 256) {
+            console.error("incorrect scale / offset for output");
+          }
+          let kScaledDiffIntegerBits = 5;
+          let input_beta_real_multiplier =
+              Math.min(1.0 * beta * input.scale * (1 << (31 - kScaledDiffIntegerBits)), -(1 << 31) - 1.0);
+          [inputMultiplier, inputLeftShift] = QuantizeMultiplierGreaterThanOne(input_beta_real_multiplier);
+          diffMin = -CalculateInputRadius(kScaledDiffIntegerBits, inputLeftShift);
+        }
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() <= 4);
+
+        // init softmaxParams
+        let softmaxParams = {
+          beta: beta,
+          input_multiplier: inputMultiplier,
+          input_left_shift: inputLeftShift,
+          diff_min: diffMin
+        }
+        if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addSoftmax(PlanOpCode.softmaxFloat32, softmaxParams, inputs[0], outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          plan.addSoftmax(PlanOpCode.softmaxUint8, softmaxParams, inputs[0], outputs[0]);
+        }
+      } break;
+      case OperationCode.RESHAPE: {
+        allParametersPresent(2, 1);
+        let input = operands[inputs[0]];
+        let targetShape = operands[inputs[1]];  // Dont use targetShape since
+                                                // outputShape has been set at first
+        let output = operands[outputs[0]];
+
+        let inputDims = [];
+        let  outputDims = [];
+        for (let i = 0; i < input.runtimeshape.DimensionsCount(); ++i) {
+          inputDims.push(input.runtimeshape.Dims(i));
+        }
+        for (let i = 0; i < output.runtimeshape.DimensionsCount(); ++i) {
+          outputDims.push(output.runtimeshape.Dims(i));
+        }
+
+        // Error check
+        let numInputElements = product(inputDims);
+        let numOutputElements = product(outputDims);
+        OPS_CHECK(numInputElements === numOutputElements);
+
+        if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addOperation(PlanOpCode.reshapeFloat32, inputs[0], -1, -1, outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          plan.addOperation(PlanOpCode.reshapeUint8, inputs[0], -1, -1, outputs[0]);
+        }
+      } break;
+      case OperationCode.CONCATENATION: {
+        if (outputs.length < 1 || inputs.length < 2) {
+          throw new Error('Invalid inputs or outputs');
+        }
+        let numInputTensors = inputs.length - 1;
+        let axis = operands[inputs[numInputTensors]].value[0];
+        let input0 = operands[inputs[0]];
+        let num_dimensions = input0.runtimeshape.DimensionsCount();
+        let input_type = input0.type;
+        if (axis === -1) {
+          axis = num_dimensions - 1;
+        }
+        let output = operands[outputs[0]];
+        let inputTensors = inputs.slice(0, numInputTensors);
+        let inputScale = [];
+        let inputZeroPint = [];
+        for (let i = 0; i < numInputTensors; ++i) {
+          let input = operands[inputs[i]];
+          inputScale.push(input.scale || 0);
+          inputZeroPint.push(input.zeroPoint || 0);
+        }
+
+        // Error check
+        OPS_CHECK(axis >= 0 && axis < num_dimensions);
+        for (let i = 1; i < numInputTensors; ++i) {
+          let input = operands[inputs[i]];
+          OPS_CHECK(input.runtimeshape.DimensionsCount() === num_dimensions);
+          OPS_CHECK(input.type === input_type);
+          for (let d = 0; d < num_dimensions; ++d) {
+            if (d != axis) {
+              OPS_CHECK(input0.runtimeshape.Dims(d) ===
+                        input.runtimeshape.Dims(d));
+            }
+          }
+        }
+
+        // init concatenationParams
+        let concatenationParams = {
+          axis: axis,
+          inputs_count: numInputTensors,
+          output_scale: output.scale || 0,
+          output_zeropoint: output.zeroPoint || 0
+        }
+
+        if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addConcatenation(PlanOpCode.concatenationFloat32, concatenationParams,
+                                inputTensors, inputScale, inputZeroPint, outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          plan.addConcatenation(PlanOpCode.concatenationUint8, concatenationParams,
+                                inputTensors, inputScale, inputZeroPint, outputs[0]);
+        }
+      } break;
+      case OperationCode.FULLY_CONNECTED: {
+        allParametersPresent(4, 1);
+        let input = operands[inputs[0]];
+        let weights = operands[inputs[1]];
+        let bias = operands[inputs[2]];
+        let activation = operands[inputs[3]].value[0];
+        let output = operands[outputs[0]];
+
+        let output_multiplier = 0, output_shift = 0;
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          let real_multiplier = GetQuantizedConvolutionMultipler(input.scale, weights.scale,
+                                                                bias.scale, output.scale);
+          [output_multiplier, output_shift] = QuantizeMultiplier(real_multiplier);
+        }
+
+        let [float_activation_min, float_activation_max,
+             quantized_activation_min, quantized_activation_max] = calculateActivationRange(activation, output);
+
+        // Error check
+        OPS_CHECK(weights.runtimeshape.DimensionsCount() === 2);
+
+        // init fullyConnectedParams
+        let fullyConnectedParams = {
+          float_activation_min: float_activation_min,
+          float_activation_max: float_activation_max,
+          input_offset: -input.zeroPoint || 0,
+          weights_offset: -weights.zeroPoint || 0,
+          output_offset: output.zeroPoint || 0,
+          output_multiplier: output_multiplier,
+          output_shift: output_shift,
+          quantized_activation_min: quantized_activation_min,
+          quantized_activation_max: quantized_activation_max
+        }
+
+        if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addFullyConnected(PlanOpCode.fullyConnectedFloat32, fullyConnectedParams,
+                                 inputs[0], inputs[1], inputs[2], outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          plan.addFullyConnected(PlanOpCode.fullyConnectedUint8, fullyConnectedParams,
+                                 inputs[0], inputs[1], inputs[2], outputs[0]);
+        }
+      } break;
+      case OperationCode.RESIZE_BILINEAR: {
+        let inCount = inputs.length;
+        if (inCount !== 3 && inCount !== 4) {
+          throw new Error(`Invalid parameters number of resize bilinear ${op}`);
+        }
+        allParametersPresent(inCount, 1);
+        let input = operands[inputs[0]];
+        let newHeight = operands[inputs[1]].value[0]; // Dont use newHeight and newWidth
+        let newWidth = operands[inputs[2]].value[0];  // since outputShape has been set at first
+        // init resizeBilinearParams
+        // default set align_corners to false
+        let resizeBilinearParams = {
+          align_corners: false
+        };
+        if (inCount === 4) {
+          resizeBilinearParams.align_corners =
+              operands[inputs[3]].value[0] !== 0;
+        }
+        let output = operands[outputs[0]];
+        let outSizeHeight = output.runtimeshape.Dims(1);
+        let outSizeWidth = output.runtimeshape.Dims(2);
+
+        let outSizeDims = [2];
+        let outSizeValue = new Int32Array([outSizeHeight, outSizeWidth]);
+        let operand = {
+          type: OperandCode.TENSOR_INT32,
+          dimensions: outSizeDims,
+          numberOfConsumers: 0,
+          lifetime: OperandLifetime.CONSTANT_REFERENCE,
+          value: outSizeValue
+        }
+        let outSize = this._addConstantOperand(operand);
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() <= 4);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() <= 4);
+
+        plan.addResizeBilinear(PlanOpCode.resizeBilinearFloat32, resizeBilinearParams,
+                               inputs[0], outSize, outputs[0]);
+      } break;
+      case OperationCode.TANH: {
+        allParametersPresent(1, 1);
+        let input = operands[inputs[0]];
+        let output = operands[outputs[0]];
+
+        plan.addOperation(PlanOpCode.tanhFloat32, inputs[0], -1, -1, outputs[0]);
+      } break;
+      case OperationCode.MAXIMUM: {
+        allParametersPresent(2, 1);
+        let input1 = operands[inputs[0]];
+        let input2 = operands[inputs[1]];
+        let output = operands[outputs[0]];
+
+        // Error check
+        OPS_CHECK(input1.type === input2.type);
+
+        plan.addOperation(PlanOpCode.maximumFloat32, inputs[0], inputs[1], -1, outputs[0]);
+      } break;
+      case OperationCode.BATCH_TO_SPACE_ND: {
+        allParametersPresent(2, 1);
+        let input = operands[inputs[0]];
+        let blockShape = operands[inputs[1]];
+        let output = operands[outputs[0]];
+
+        // set a default crops
+        let operand = {
+          type: OperandCode.TENSOR_INT32,
+          dimensions: [2, 2],
+          numberOfConsumers: 0,
+          lifetime: OperandLifetime.CONSTANT_REFERENCE,
+          value: [0, 0, 0, 0]
+        };
+        let crops = this._addConstantOperand(operand);
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() <= 4);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() <= 4);
+
+        plan.addOperation(PlanOpCode.batchToSpaceNDFloat32,
+                          inputs[0], inputs[1], crops, outputs[0]);
+      } break;
+      case OperationCode.TRANSPOSE: {
+        let inCount = inputs.length;
+        if (inCount !== 1 && inCount !== 2) {
+          throw new Error('Invalid parameters number of TRANSPOSE');
+        }
+        allParametersPresent(inCount, 1);
+        let input = operands[inputs[0]];
+        let perm = [];
+        if (inCount === 1) {
+          // set a default perm
+          let n = input.runtimeshape.DimensionsCount();
+          for (let i = 0; i < n; ++i) {
+            perm[i] = n - i;
+          }
+        } else {
+          perm = modelOperands[inputs[1]].value;
+        }
+        let output = operands[outputs[0]];
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() <= 4);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() <= 4);
+        OPS_CHECK(output.runtimeshape.DimensionsCount() === perm.length);
+
+        // Extend perm to length 4 by appending 0
+        if (perm instanceof Array) {        
+          for (let i = perm.length; i < 4; ++i) {
+            perm[i] = 0;
+          }
+        } else {
+          let extend_perm = new perm.constructor(4);
+          extend_perm.set(perm, 0);
+          perm = extend_perm;
+        }
+
+        // init transposeParams
+        let transposeParams = {
+          perm: perm,
+          perm_count: perm.length
+        }
+
+        plan.addTranspose(PlanOpCode.transposeFloat32, transposeParams,
+                          inputs[0], outputs[0]);
+      } break;
+      case OperationCode.ARGMAX: {
+        allParametersPresent(2, 1);
+        let input1 = operands[inputs[0]];
+        let input2 = operands[inputs[1]];
+        let operand = {
+          type: OperandCode.TENSOR_INT32,
+          dimensions: [1],
+          numberOfConsumers: 0,
+          lifetime: OperandLifetime.CONSTANT_REFERENCE,
+          value: [input2.value[0]]
+        };
+        let axis = this._addConstantOperand(operand);
+
+        plan.addOperation(PlanOpCode.argMaxFloat32, inputs[0], axis, -1, outputs[0]);
+      } break;
+      case OperationCode.LOGISTIC: {
+        allParametersPresent(1, 1);
+        let input = operands[inputs[0]];
+        let output = operands[outputs[0]];
+
+        // Error check
+        OPS_CHECK(input.runtimeshape.DimensionsCount() <= 4);
+
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          if (output.zeroPoint != 0 || output.scale != 1 / 256) {
+            console.error("incorrect scale / offset for output");
+          };
+          let input_zero_point = input.zeroPoint;
+          let input_range_radius = 0;
+          let input_multiplier = 0;
+          let input_left_shift= 0;
+
+          let kInputIntegerBits = 4;
+          let input_real_multiplier = input.scale * (1 << (31 - kInputIntegerBits));
+          [input_multiplier, input_left_shift] = QuantizeMultiplierGreaterThanOne(input_real_multiplier);
+          input_range_radius = CalculateInputRadius(kInputIntegerBits, input_left_shift);
+
+          let logisticParams = {
+            // uint8 inference params.
+            input_zero_point: input_zero_point,
+            input_range_radius: input_range_radius,
+            input_multiplier: input_multiplier,
+            input_left_shift: input_left_shift
+          };
+
+          plan.addLogistic(PlanOpCode.logisticUint8, logisticParams, inputs[0], outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addOperation(PlanOpCode.logisticFloat32, inputs[0], -1, -1, outputs[0]);
+        };
+      } break;
+      case OperationCode.PRELU: {
+        allParametersPresent(2, 1);
+        let input = operands[inputs[0]];
+        let alpha = operands[inputs[1]];
+        let output = operands[outputs[0]];
+
+        if (output.type === OperandCode.TENSOR_QUANT8_ASYMM) {
+          let input_offset = -input.zeroPoint || 0;
+          let alpha_offset = -alpha.zeroPoint || 0;
+          let output_offset = output.zeroPoint || 0;
+
+          let input_product_scale = input.scale * alpha.scale;
+          let real_multiplier = input_product_scale / output.scale;
+          let [output_multiplier, output_shift] = QuantizeMultiplier(real_multiplier);
+
+          let preluParams = {
+            input_offset: input_offset,
+            alpha_offset: alpha_offset,
+            output_offset: output_offset,
+            output_multiplier: output_multiplier,
+            output_shift: output_shift
+          };
+
+          plan.addPrelu(PlanOpCode.preluUint8, preluParams,
+                        inputs[0], inputs[1], outputs[0]);
+        } else if (output.type === OperandCode.TENSOR_FLOAT32) {
+          plan.addOperation(PlanOpCode.preluFloat32, inputs[0], inputs[1], -1, outputs[0]);
+        };
+      } break;
+      case OperationCode.QUANTIZE:
+      case OperationCode.DEQUANTIZE: {
+        allParametersPresent(1, 1);
+        let input = operands[inputs[0]];
+        let output = operands[outputs[0]];
+        let quantized = op === OperationCode.QUANTIZE ? output : input;
+        let real = op === OperationCode.QUANTIZE ? input : output;
+
+        // Error check
+        OPS_CHECK(quantized.type === OperandCode.TENSOR_QUANT8_ASYMM);
+        OPS_CHECK(real.type === OperandCode.TENSOR_FLOAT32);
+        OPS_CHECK(product(input.dimensions) === product(output.dimensions));
+
+        let quantizeParams = {
+          scale: quantized.scale,
+          zero_point: quantized.zeroPoint
+        };
+
+        if (op === OperationCode.QUANTIZE) {
+          plan.addQuantize(PlanOpCode.quantizeUint8, quantizeParams, inputs[0], outputs[0]);
+        } else {
+          plan.addQuantize(PlanOpCode.dequantizeUint8, quantizeParams, inputs[0], outputs[0]);
+        }
+      } break;
+      default: {
+        throw new Error(`Operation ${op} is not supported`);
+      }
+    }
+  }
+
+  // Tensors that carry one value per frame in batched mode.
+  _isBatched(operand) {
+    return utils.isTensor(operand.type) &&
+           (operand.lifetime === OperandLifetime.TEMPORARY_VARIABLE ||
+            operand.lifetime === OperandLifetime.MODEL_INPUT ||
+            operand.lifetime === OperandLifetime.MODEL_OUTPUT);
+  }
+
+  _batchDimensions(index, dimensions) {
+    if (dimensions.length === 0 || dimensions[0] !== 1) {
+      throw new Error(`Batched execution needs a leading batch dimension of 1, ` +
+                      `operand ${index} has shape [${dimensions}]`);
+    }
+    return [this._batchSize, ...dimensions.slice(1)];
+  }
+
+  // Reject operations that mix values across the batch dimension or need
+  // an unbatched operand to have the shape of a batched one.
+  _checkBatchable(operation) {
+    const operands = this._model._operands;
+    const inputs = operation.inputs;
+    const name = findKey(OperationCode, operation.type);
+    let batchAxis = false;
+    switch (operation.type) {
+      case OperationCode.CONCATENATION: {
+        batchAxis = operands[inputs[inputs.length - 1]].value[0] === 0;
+        if (!inputs.slice(0, -1).every(i => this._isBatched(operands[i]))) {
+          throw new Error(`Batched execution cannot concatenate constant tensors`);
+        }
+      } break;
+      case OperationCode.TRANSPOSE: {
+        batchAxis = inputs.length === 1 || operands[inputs[1]].value[0] !== 0;
+      } break;
+      case OperationCode.ARGMAX: {
+        batchAxis = operands[inputs[1]].value[0] === 0;
+      } break;
+      case OperationCode.BATCH_TO_SPACE_ND: {
+        batchAxis = true;
+      } break;
+      case OperationCode.MAXIMUM: {
+        if (!inputs.every(i => this._isBatched(operands[i]))) {
+          throw new Error(`Batched execution needs both ${name} inputs to be batched`);
+        }
+      } break;
+    }
+    if (batchAxis) {
+      throw new Error(`Operation ${name} works along the batch dimension, ` +
+                      `it cannot be executed in batched mode`);
+    }
+  }
+
+  _setTensorData(type, ptr, data) {
+    const nn_ops = this._nn_ops;
+    if (type === OperandCode.TENSOR_FLOAT32) {
+      nn_ops.HEAPF32.set(data, ptr >> 2);
+    } else if (type === OperandCode.TENSOR_INT32) {
+      nn_ops.HEAP32.set(data, ptr >> 2);
+    } else if (type === OperandCode.TENSOR_QUANT8_ASYMM) {
+      nn_ops.HEAPU8.set(data, ptr);
+    } else if (type === OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL) {
+      nn_ops.HEAP8.set(data, ptr);
+    } else if (type === OperandCode.TENSOR_QUANT8_ASYMM_SIGNED) {
+      nn_ops.HEAP8.set(data, ptr);
+    } else {
+      throw new Error(`Operand type ${type} is not supported`);
+    }
+  }
+
+  _getTensorData(type, ptr, buffer) {
     const nn_ops = this._nn_ops;
     let view;
     if (type === OperandCode.TENSOR_FLOAT32) {
@@ -1442,6 +3411,116 @@ export default class PreparedModel {
   }
 
 
+  // Buffers in the nn_ops heap are bound to the plan and read or written in
+  // place, the others are copied: inputs here, outputs by _finishExecution,
+  // to which the returned list is passed.
+  _bindInputsAndOutputs(inputs, outputs) {
+    if (!this._prepared) {
+      throw new Error('Model is not prepared');
+    }
+    this._checkIdle();
+    inputs.forEach(input => {
+      if (this._bindTensor(input.index, input.buffer, input.frame)) {
+        return;
+      }
+      const operand = this._operands[input.index];
+      const offset = (input.frame || 0) * operand.frameBytes;
+      this._setTensorData(operand.type, operand.value + offset, input.buffer);
+    });
+    const copiedOutputs = [];
+    outputs.forEach(output => {
+      if (!this._bindTensor(output.index, output.buffer, output.frame)) {
+        copiedOutputs.push(output);
+      }
+    });
+    return copiedOutputs;
+  }
+
+  _finishExecution(copiedOutputs) {
+    // drop timings of the warm-up runs
+    if (++this._epochs === warmUpRuns) {
+      this._resetTimings();
+    }
+
+    copiedOutputs.forEach((output) => {
+      const operand = this._operands[output.index];
+      const offset = (output.frame || 0) * operand.frameBytes;
+      this._getTensorData(operand.type, operand.value + offset, output.buffer);
+    });
+  }
+
+  // Waits for the run started on the plan's thread without blocking the
+  // page: on the flag the thread notifies when it finishes where
+  // Atomics.waitAsync is available, else by checking once per task.
+  async _waitForPlan() {
+    const plan = this._plan;
+    if (plan.done()) {
+      return;
+    }
+    const flag = plan.getDoneFlag() >> 2;
+    if (typeof Atomics.waitAsync === 'function' &&
+        this._nn_ops.HEAP32.buffer instanceof SharedArrayBuffer) {
+      // HEAP32 is looked up again as the heap may grow meanwhile
+      while (Atomics.load(this._nn_ops.HEAP32, flag) === 0) {
+        const result = Atomics.waitAsync(this._nn_ops.HEAP32, flag, 0);
+        if (result.async) {
+          await result.value;
+        }
+      }
+    }
+    while (!plan.done()) {
+      await nextTask();
+    }
+  }
+
+  // While a started execution runs, the plan owns the tensors. Kernels
+  // called meanwhile run single-threaded, see ExecutionPlan::start.
+  _checkIdle() {
+    if (this._running) {
+      throw new Error('An execution started by startExecute has not finished');
+    }
+  }
+
+  // View of the whole (batched) tensor of operand `index`, cached until the
+  // heap grows or the operand is rebound.
+  _getOperandView(index) {
+    let view = this._views.get(index);
+    if (!view || view.buffer !== this._nn_ops.HEAPU8.buffer) {
+      const operand = this._operands[index];
+      view = this._getTensorDataView(operand.type, operand.value, product(operand.dimensions));
+      this._views.set(index, view);
+    }
+    return view;
+  }
+
+  // Points model input or output `index` at `buffer` when it is nn_ops heap
+  // memory holding the whole tensor, and back at its arena storage otherwise.
+  // Returns whether `buffer` is bound, a view of the operand's own memory
+  // such as one from getTensorView always is.
+  _bindTensor(index, buffer, frame = 0) {
+    const operand = this._operands[index];
+    const inHeap = buffer.buffer === this._nn_ops.HEAPU8.buffer;
+    if (inHeap && buffer.byteOffset === operand.value + frame * operand.frameBytes) {
+      return true;
+    }
+    const bound = inHeap && buffer.length === product(operand.dimensions);
+    const ptr = bound ? buffer.byteOffset : operand.arenaValue;
+    if (operand.value !== ptr) {
+      operand.value = ptr;
+      // ops run without a plan read operand.value as they run
+      if (this._plan) {
+        this._plan.setOperandData(index, ptr);
+      }
+      this._views.delete(index);
+    }
+    return bound;
+  }
+
+  // Points model input or output `index` back at its arena storage.
+  _unbindTensor(index) {
+    this._bindTensor(index, new Uint8Array(0));
+  }
+
   _allocateTensor(operand) {
     const nn_ops = this._nn_ops;
     let byteLength = utils.sizeOfTensorData(operand.type, operand.dimensions);
@@ -1452,6 +3531,15 @@ export default class PreparedModel {
     return ptr;
   }
 
+  // Allocate a constant tensor that is not part of the model (e.g. default
+  // crops) and register it with the plan. Returns its plan operand index.
+  _addConstantOperand(operand) {
+    const value = this._allocateTensor(operand);
+    this._toDelete.tensorValue.push(value);
+    return this._plan.addConstant(operand.dimensions, value,
+                                  utils.sizeOfTensorData(operand.type, operand.dimensions));
+  }
+
   _allocateRuntimeShape(operand) {
     const nn_ops = this._nn_ops;
     let RuntimeShape = new nn_ops.RuntimeShape(operand.dimensions.length);
@@ -1461,14 +3549,41 @@ export default class PreparedModel {
     return RuntimeShape;
   }
 
+  _freeYolo() {
+    if (this._yolo) {
+      this._nn_ops._free(this._yolo.anchorsPtr);
+      this._nn_ops._free(this._yolo.outputPtr);
+      this._yolo = null;
+    }
+  }
+
   _deleteAll() {
+    // a started run still reads the tensors freed below
+    if (this._plan) {
+      this._plan.wait();
+    }
     this._toDelete.tensorValue.forEach(tensorValue => {
       this._nn_ops._free(tensorValue);
     });
+    this._nn_ops._free(this._frameBuffer.ptr);
+    this._frameBuffer = {ptr: 0, byteLength: 0};
+    this._nn_ops._free(this._ssdAnchors.ptr);
+    this._ssdAnchors = {source: null, ptr: 0};
+    this._nn_ops._free(this._ssdOutput.ptr);
+    this._ssdOutput = {ptr: 0, byteLength: 0};
+    this._freeYolo();
+    this._views = new Map();
     this._toDelete.tensorShape.forEach(tensorShape => {
       tensorShape.delete();
     });
-    this._model._operands = [];
+    if (this._plan) {
+      this._plan.delete();
+      this._plan = null;
+    }
+    // a calibration pass only borrows the model it measures
+    if (!this._calibration) {
+      this._model._operands = [];
+    }
   }
 
   getSubgraphsSummary() {
@@ -1477,21 +3592,29 @@ export default class PreparedModel {
   }
 
   dumpProfilingResults() {
-    const res = this._profiler.flush();
+    const epochs = this._epochs - warmUpRuns;
+    const elapsed = this._plan ?
+        new Float64Array(this._nn_ops.HEAPF64.buffer, this._plan.getTimings(),
+                         this._operations.length) :
+        this._opTimings;
     const timings = [];
     const supportedOps = Array.from(this._supportedOps)
         .map(op => findKey(OperationCode, op));
     const mode = this._eager ? 'Eager' : 'Graph';
 
-    if (res.epochs <= 0) {
+    if (epochs <= 0) {
       console.warn(`Report will be available after at least ${warmUpRuns + 1} executions.`);
     } else {
+      const names = this._profileNames();
       for (const [i, op] of this._operations.entries()) {
-        const opTime = res.elpased[i];
+        const opTime = elapsed[i] / epochs;
+        if (this._fusedInto(i) >= 0) {
+          continue;
+        }
         if (op.type !== OperationCode.WEBNN_SUBGRAPH) {
           timings.push({
             backend: 'WASM',
-            summary: findKey(OperationCode, op.type) + ' x 1',
+            summary: names[i] + ' x 1',
             elpased: opTime
           });
         } else {
@@ -1502,14 +3625,86 @@ export default class PreparedModel {
           });
         }
       }
+
+      // start a new measurement window, warm-up is already done
+      this._resetTimings();
+      this._epochs = warmUpRuns;
     }
 
     return {
       mode: mode,
       warmUpRuns: warmUpRuns,
-      epochs: res.epochs,
+      epochs: epochs,
       supportedOps: supportedOps,
       timings: timings
     };
   }
+
+  /**
+   * Latency distribution and roofline counters of every op over the recent
+   * executions, see ExecutionPlan::getProfile in nn_kernels.h. MACs and bytes
+   * are estimated from the shapes and are zero for WebNN subgraphs.
+   *
+   * @returns {Array} {name, backend, runs, min, p50, p99, mean (ms), macs,
+   *     bytes, intensity (MACs per byte), gflops, gbps} per op that ran.
+   */
+  getProfile() {
+    if (!this._plan) {
+      throw new Error('getProfile needs an nn_ops build with ExecutionPlan, ' +
+                      'rebuild nn_ops.js from src/');
+    }
+    const statsSize = 10;
+    const stats = new Float64Array(this._nn_ops.HEAPF64.buffer,
+                                   this._plan.getProfile(),
+                                   this._operations.length * statsSize);
+    const names = this._profileNames();
+    const profile = [];
+    for (const [i, op] of this._operations.entries()) {
+      const s = stats.subarray(i * statsSize, (i + 1) * statsSize);
+      if (this._plan.getFusedInto(i) >= 0 || s[0] === 0) {
+        continue;
+      }
+      const bytes = s[6] + s[7];
+      const webnn = op.type === OperationCode.WEBNN_SUBGRAPH;
+      profile.push({
+        name: webnn ? op.summary : names[i],
+        backend: webnn ? 'WebNN' : 'WASM',
+        runs: s[0],
+        min: s[1],
+        p50: s[2],
+        p99: s[3],
+        mean: s[4],
+        macs: s[5],
+        bytes: bytes,
+        intensity: bytes > 0 ? s[5] / bytes : 0,
+        gflops: s[8],
+        gbps: s[9]
+      });
+    }
+    return profile;
+  }
+
+  // fused ops are reported as part of the op they were folded into
+  _profileNames() {
+    const names = this._operations.map(op => findKey(OperationCode, op.type));
+    for (const i of this._operations.keys()) {
+      const target = this._fusedInto(i);
+      if (target >= 0) {
+        names[target] += ' + ' + names[i];
+      }
+    }
+    return names;
+  }
+
+  _fusedInto(index) {
+    return this._plan ? this._plan.getFusedInto(index) : -1;
+  }
+
+  _resetTimings() {
+    if (this._plan) {
+      this._plan.resetTimings();
+    } else {
+      this._opTimings.fill(0);
+    }
+  }
 }
@@ -0,0 +1,477 @@
+import PreparedModel from './PreparedModel'
+import Model from '../Model'
+import { OperationCode, OperandCode, OperandLifetime } from '../Enums'
+import * as utils from '../utils'
+import { product } from '../utils';
+
+/**
+ * Post-training quantization of a float32 model for the nn_ops kernels, see
+ * Compilation.setQuantization. calibrate() runs frames through the float
+ * model and records the range of every tensor; quantize() then builds a
+ * model in which the ops with a uint8 kernel read and write
+ * TENSOR_QUANT8_ASYMM tensors, with conv and depthwise filters in
+ * per-channel int8 (TENSOR_QUANT8_SYMM_PER_CHANNEL). The other ops stay
+ * float behind DEQUANTIZE and QUANTIZE ops, and so do the model inputs and
+ * outputs, so the operand indexes and buffers of the float model still
+ * apply.
+ */
+export default class Quantizer {
+  /**
+   * @param {Model} model - A finished float32 model.
+   * @param {Object} options - frames and validationFrames, see
+   *     Compilation.setQuantization.
+   */
+  constructor(model, options) {
+    this._model = model;
+    this._frames = options.frames;
+    this._validationFrames = options.validationFrames || options.frames;
+    this._reference = null;
+    this._ranges = new Map();
+    this._quantizedOps = 0;
+  }
+
+  /**
+   * Runs the calibration frames through the float model.
+   */
+  async calibrate() {
+    this._reference = new PreparedModel();
+    await this._reference.prepare(this._model, {calibration: true});
+    for (const frame of this._frames) {
+      this._reference.calibrate(this._frameInputs(frame), this._ranges);
+    }
+  }
+
+  /**
+   * Builds the quantized model from the calibrated ranges. The operands of
+   * the float model keep their indexes; temporaries written by a quantized
+   * op are retyped in place, everything else the quantized ops need is
+   * appended.
+   *
+   * @returns {Model} - The finished quantized model.
+   */
+  async quantize() {
+    const model = this._model;
+    const operands = model._operands;
+    const operations = model._operations;
+    const quantizable = operations.map(operation => this._isQuantizable(operation));
+    const params = this._activationParams(quantizable);
+
+    const retyped = new Set();
+    operations.forEach((operation, i) => {
+      const output = operation.outputs[0];
+      if (quantizable[i] && operands[output].lifetime === OperandLifetime.TEMPORARY_VARIABLE) {
+        retyped.add(output);
+      }
+    });
+
+    const quantized = new Model({
+      backend: model._backend,
+      eager: model._eager,
+      supportedOps: model._supportedOps,
+      isOpenVINOModel: model.isOpenVINOModel
+    });
+    let operandCount = 0;
+    const addOperand = (options, value = null) => {
+      quantized.addOperand(options);
+      if (value !== null) {
+        quantized.setOperandValue(operandCount, value);
+      }
+      return operandCount++;
+    };
+    const addQuant8Operand = (dimensions, {scale, zeroPoint}, value = null) =>
+        addOperand({type: OperandCode.TENSOR_QUANT8_ASYMM, dimensions, scale, zeroPoint}, value);
+
+    operands.forEach((operand, i) => {
+      if (retyped.has(i)) {
+        addQuant8Operand(operand.dimensions, params(i));
+      } else {
+        addOperand({
+          type: operand.type,
+          dimensions: operand.dimensions,
+          scale: operand.scale,
+          zeroPoint: operand.zeroPoint
+        }, operand.value);
+      }
+    });
+
+    // uint8 and float versions of the tensors passed between quantized and
+    // float ops, created by their first consumer
+    const quant8Twins = new Map();
+    const floatTwins = new Map();
+    const toQuant8 = (index) => {
+      if (retyped.has(index)) {
+        return index;
+      }
+      if (!quant8Twins.has(index)) {
+        const operand = operands[index];
+        const quant8Params = params(index);
+        let twin;
+        if (operand.lifetime === OperandLifetime.CONSTANT_REFERENCE) {
+          twin = addQuant8Operand(operand.dimensions, quant8Params,
+                                  quantizeValues(operand.value, quant8Params));
+        } else {
+          twin = addQuant8Operand(operand.dimensions, quant8Params);
+          quantized.addOperation(OperationCode.QUANTIZE, [index], [twin]);
+        }
+        quant8Twins.set(index, twin);
+      }
+      return quant8Twins.get(index);
+    };
+    const toFloat = (index) => {
+      if (!retyped.has(index)) {
+        return index;
+      }
+      if (!floatTwins.has(index)) {
+        const twin = addOperand({
+          type: OperandCode.TENSOR_FLOAT32,
+          dimensions: operands[index].dimensions
+        });
+        quantized.addOperation(OperationCode.DEQUANTIZE, [index], [twin]);
+        floatTwins.set(index, twin);
+      }
+      return floatTwins.get(index);
+    };
+
+    operations.forEach((operation, i) => {
+      const {type, inputs, outputs} = operation;
+      if (!quantizable[i]) {
+        quantized.addOperation(type, inputs.map(toFloat), outputs);
+        return;
+      }
+
+      const quantInputs = inputs.slice();
+      for (const k of this._activationInputs(operation)) {
+        quantInputs[k] = toQuant8(inputs[k]);
+      }
+      const inputScale = params(inputs[0]).scale;
+      switch (type) {
+        case OperationCode.CONV_2D:
+        case OperationCode.ATROUS_CONV_2D:
+        case OperationCode.DEPTHWISE_CONV_2D:
+        case OperationCode.ATROUS_DEPTHWISE_CONV_2D: {
+          // filters are [outDepth, h, w, inDepth], depthwise ones
+          // [1, h, w, outDepth]
+          const channelDim = type === OperationCode.CONV_2D ||
+                             type === OperationCode.ATROUS_CONV_2D ? 0 : 3;
+          const filter = operands[inputs[1]];
+          const bias = operands[inputs[2]];
+          const {values, scales} = quantizePerChannel(filter.value, filter.dimensions, channelDim);
+          quantInputs[1] = addOperand({
+            type: OperandCode.TENSOR_QUANT8_SYMM_PER_CHANNEL,
+            dimensions: filter.dimensions
+          }, values);
+          quantized.setOperandSymmPerChannelQuantParams(quantInputs[1], {
+            channelDim: channelDim,
+            scales: scales
+          });
+          quantInputs[2] = addOperand({
+            type: OperandCode.TENSOR_INT32,
+            dimensions: bias.dimensions,
+            scale: 0,
+            zeroPoint: 0
+          }, Int32Array.from(bias.value, (b, c) => quantizeBias(b, inputScale * scales[c])));
+        } break;
+        case OperationCode.FULLY_CONNECTED: {
+          const weights = operands[inputs[1]];
+          const bias = operands[inputs[2]];
+          const weightsParams = asymmetricParams(valueRange(weights.value));
+          const biasScale = inputScale * weightsParams.scale;
+          quantInputs[1] = addQuant8Operand(weights.dimensions, weightsParams,
+                                            quantizeValues(weights.value, weightsParams));
+          quantInputs[2] = addOperand({
+            type: OperandCode.TENSOR_INT32,
+            dimensions: bias.dimensions,
+            scale: biasScale,
+            zeroPoint: 0
+          }, Int32Array.from(bias.value, b => quantizeBias(b, biasScale)));
+        } break;
+      }
+
+      const output = outputs[0];
+      if (retyped.has(output)) {
+        quantized.addOperation(type, quantInputs, outputs);
+      } else {
+        const twin = addQuant8Operand(operands[output].dimensions, params(output));
+        quantized.addOperation(type, quantInputs, [twin]);
+        quantized.addOperation(OperationCode.DEQUANTIZE, [twin], [output]);
+        quant8Twins.set(output, twin);
+      }
+    });
+
+    quantized.identifyInputsAndOutputs(model._inputs.slice(), model._outputs.slice());
+    quantized._preference = model._preference;
+    quantized._numThreads = model._numThreads;
+    quantized._batchSize = model._batchSize;
+    await quantized.finish();
+    this._quantizedOps = quantizable.filter(q => q).length;
+    return quantized;
+  }
+
+  /**
+   * Runs the validation frames through the float model and `preparedModel`
+   * and compares their outputs.
+   *
+   * @param {PreparedModel} preparedModel - The quantized model.
+   * @returns {Object} - See Compilation.getQuantizationReport.
+   */
+  async measureDrift(preparedModel) {
+    const model = this._model;
+    const outputs = model._outputs.map((index) => {
+      const operand = model._operands[index];
+      const TypedArray = utils.operandCodeToTypedArrayMap.get(operand.type);
+      const length = product(operand.dimensions);
+      return {
+        index: index,
+        expected: new TypedArray(length),
+        actual: new TypedArray(length),
+        maxError: 0,
+        errorSum: 0,
+        signal: 0,
+        noise: 0
+      };
+    });
+
+    for (const frame of this._validationFrames) {
+      const inputs = this._frameInputs(frame).map((buffer, i) => ({
+        index: model._inputs[i],
+        buffer: buffer
+      }));
+      await this._reference.execute(inputs, outputs.map(o => ({index: o.index, buffer: o.expected})));
+      await preparedModel.execute(inputs, outputs.map(o => ({index: o.index, buffer: o.actual})));
+      for (const output of outputs) {
+        const {expected, actual} = output;
+        for (let i = 0; i < expected.length; ++i) {
+          const error = actual[i] - expected[i];
+          output.maxError = Math.max(output.maxError, Math.abs(error));
+          output.errorSum += Math.abs(error);
+          output.signal += expected[i] * expected[i];
+          output.noise += error * error;
+        }
+      }
+    }
+
+    const frames = this._validationFrames.length;
+    return {
+      quantizedOps: this._quantizedOps,
+      floatOps: model._operations.length - this._quantizedOps,
+      frames: frames,
+      outputs: outputs.map((output, i) => ({
+        index: i,
+        maxError: output.maxError,
+        meanError: output.errorSum / (output.expected.length * frames),
+        sqnr: output.noise > 0 ? 10 * Math.log10(output.signal / output.noise) : Infinity
+      }))
+    };
+  }
+
+  /**
+   * Frees the float model of the calibration pass.
+   */
+  delete() {
+    if (this._reference) {
+      this._reference._deleteAll();
+      this._reference = null;
+    }
+  }
+
+  // One buffer per model input, checked like Execution.setInput checks it.
+  _frameInputs(frame) {
+    const model = this._model;
+    const inputs = ArrayBuffer.isView(frame) ? [frame] : frame;
+    if (!Array.isArray(inputs) || inputs.length !== model._inputs.length) {
+      throw new Error(`A quantization frame needs ${model._inputs.length} input buffers`);
+    }
+    inputs.forEach((buffer, i) => {
+      if (!model._validateOperandValue(buffer, model._operands[model._inputs[i]])) {
+        throw new Error(`Invalid buffer for input ${i} of a quantization frame`);
+      }
+    });
+    return inputs;
+  }
+
+  // Ops with a uint8 kernel in PreparedModel, whose weights are constant.
+  // Adds with a constant operand are left alone: in batched mode it would
+  // be broadcast, which only the float kernel does.
+  _isQuantizable({type, inputs, outputs}) {
+    const operands = this._model._operands;
+    const isConstant = (index) => operands[index].lifetime === OperandLifetime.CONSTANT_REFERENCE;
+    if (operands[inputs[0]].type !== OperandCode.TENSOR_FLOAT32 ||
+        operands[outputs[0]].type !== OperandCode.TENSOR_FLOAT32) {
+      return false;
+    }
+    switch (type) {
+      case OperationCode.CONV_2D:
+      case OperationCode.ATROUS_CONV_2D:
+      case OperationCode.DEPTHWISE_CONV_2D:
+      case OperationCode.ATROUS_DEPTHWISE_CONV_2D:
+      case OperationCode.FULLY_CONNECTED:
+        return isConstant(inputs[1]) && isConstant(inputs[2]);
+      case OperationCode.ADD: {
+        const dims1 = operands[inputs[0]].dimensions;
+        const dims2 = operands[inputs[1]].dimensions;
+        return !isConstant(inputs[0]) && !isConstant(inputs[1]) &&
+               dims1.length === dims2.length && dims1.every((d, k) => d === dims2[k]);
+      }
+      case OperationCode.PRELU:
+        return isConstant(inputs[1]);
+      case OperationCode.AVERAGE_POOL_2D:
+      case OperationCode.MAX_POOL_2D:
+      case OperationCode.RESHAPE:
+      case OperationCode.CONCATENATION:
+      case OperationCode.SOFTMAX:
+      case OperationCode.LOGISTIC:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // Positions of the inputs a quantized op reads as uint8 activations; conv
+  // and fully connected weights and biases are quantized on their own.
+  _activationInputs({type, inputs}) {
+    switch (type) {
+      case OperationCode.ADD:
+      case OperationCode.PRELU:
+        return [0, 1];
+      case OperationCode.CONCATENATION:
+        return inputs.slice(0, -1).map((_, k) => k);
+      default:
+        return [0];
+    }
+  }
+
+  // Returns the uint8 quantization of a tensor by operand index. The uint8
+  // pooling, reshape and PReLU kernels need their output quantized like
+  // their input, and concatenations are copy-free when their inputs share
+  // the output's quantization (ExecutionPlan::alias), so these tensors are
+  // tied and get the union of their ranges. Softmax and logistic outputs
+  // are fixed to scale 1/256, zero point 0, which would clamp any wider
+  // range tied to them: a concatenation only ties their groups to its
+  // output when all its inputs are fixed, otherwise its uint8 kernel
+  // requantizes them.
+  _activationParams(quantizable) {
+    const operands = this._model._operands;
+    const parent = operands.map((_, i) => i);
+    const find = (index) => {
+      while (parent[index] !== index) {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+      }
+      return index;
+    };
+    const tie = (a, b) => {
+      parent[find(a)] = find(b);
+    };
+
+    const ranges = new Map(this._ranges);
+    const fixed = [];
+    const concatenations = [];
+    this._model._operations.forEach((operation, i) => {
+      if (!quantizable[i]) {
+        return;
+      }
+      const {type, inputs, outputs} = operation;
+      for (const k of this._activationInputs(operation)) {
+        const operand = operands[inputs[k]];
+        if (operand.lifetime === OperandLifetime.CONSTANT_REFERENCE) {
+          ranges.set(inputs[k], valueRange(operand.value));
+        }
+      }
+      switch (type) {
+        case OperationCode.AVERAGE_POOL_2D:
+        case OperationCode.MAX_POOL_2D:
+        case OperationCode.RESHAPE:
+        case OperationCode.PRELU:
+          tie(inputs[0], outputs[0]);
+          break;
+        case OperationCode.CONCATENATION:
+          concatenations.push(operation);
+          break;
+        case OperationCode.SOFTMAX:
+        case OperationCode.LOGISTIC:
+          fixed.push(outputs[0]);
+          break;
+      }
+    });
+    // in model order, so the inputs' groups are complete
+    const isFixed = (index) => fixed.some(f => find(f) === find(index));
+    for (const {inputs, outputs} of concatenations) {
+      const tensors = inputs.slice(0, -1);
+      const allFixed = tensors.every(isFixed);
+      tensors.filter(input => allFixed || !isFixed(input)).forEach(input => tie(input, outputs[0]));
+    }
+
+    const groupRanges = new Map();
+    for (const [index, [min, max]] of ranges) {
+      const root = find(index);
+      const range = groupRanges.get(root);
+      if (range) {
+        range[0] = Math.min(range[0], min);
+        range[1] = Math.max(range[1], max);
+      } else {
+        groupRanges.set(root, [min, max]);
+      }
+    }
+    const groupParams = new Map();
+    for (const index of fixed) {
+      groupParams.set(find(index), {scale: 1 / 256, zeroPoint: 0});
+    }
+    return (index) => {
+      const root = find(index);
+      if (!groupParams.has(root)) {
+        groupParams.set(root, asymmetricParams(groupRanges.get(root) || [0, 0]));
+      }
+      return groupParams.get(root);
+    };
+  }
+}
+
+function valueRange(values) {
+  let min = Infinity, max = -Infinity;
+  for (let i = 0; i < values.length; ++i) {
+    min = Math.min(min, values[i]);
+    max = Math.max(max, values[i]);
+  }
+  return [min, max];
+}
+
+// uint8 quantization of [min, max] widened to include zero, so zero padding
+// and ReLU bounds are exact. The scale is rounded to float32, which is how
+// the kernels see it.
+function asymmetricParams([min, max]) {
+  min = Math.min(min, 0);
+  max = Math.max(max, 0);
+  if (!(max > min) || !Number.isFinite(max - min)) {
+    return {scale: 1, zeroPoint: 0};
+  }
+  const scale = Math.fround((max - min) / 255);
+  const zeroPoint = Math.min(255, Math.max(0, Math.round(-min / scale)));
+  return {scale: scale, zeroPoint: zeroPoint};
+}
+
+function quantizeValues(values, {scale, zeroPoint}) {
+  return Uint8Array.from(values, v => Math.min(255, Math.max(0, Math.round(v / scale) + zeroPoint)));
+}
+
+// Symmetric int8 quantization with one scale per index of `channelDim`,
+// the largest magnitude of the channel mapping to 127.
+function quantizePerChannel(values, dimensions, channelDim) {
+  const channels = dimensions[channelDim];
+  const inner = dimensions.slice(channelDim + 1).reduce((a, b) => a * b, 1);
+  const channelOf = (i) => Math.floor(i / inner) % channels;
+  const maxAbs = new Float32Array(channels);
+  values.forEach((v, i) => {
+    const c = channelOf(i);
+    maxAbs[c] = Math.max(maxAbs[c], Math.abs(v));
+  });
+  const scales = maxAbs.map(m => m > 0 ? m / 127 : 1);
+  return {
+    values: Int8Array.from(values, (v, i) =>
+        Math.min(127, Math.max(-127, Math.round(v / scales[channelOf(i)])))),
+    scales: scales
+  };
+}
+
+function quantizeBias(value, scale) {
+  return Math.min(2147483647, Math.max(-2147483648, Math.round(value / scale)));
+}
@@ -0,0 +1,1039 @@
+// Micro-benchmarks of the nn_ops kernels, built natively (see README.md).
+//
+// Every wrapper exported to JavaScript is timed on layer shapes taken from
+// the models the examples ship: MobileNet v1 0.25 (224 float, 128
+// quantized), SSD MobileNet v1 300 and face-detection-retail-0005. Each case
+// reports the mean time per call, the arithmetic throughput and the
+// compulsory memory traffic (every input read and every output written
+// once), so a regression can be told apart from a shape that is simply
+// memory bound.
+//
+//   nn_ops_bench [--filter=<substring>] [--threads=<n>] [--min_time=<seconds>]
+
+#include "bind/src/nn_kernels.h"
+
+#include "tensorflow/lite/kernels/internal/common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace binding_utils;
+
+namespace {
+  enum ElementType { kFloat32, kUint8, kInt8, kInt32 };
+
+  size_t ElementSize(ElementType type) {
+    return type == kFloat32 || type == kInt32 ? 4 : 1;
+  }
+
+  struct Tensor {
+    RuntimeShape shape;
+    std::vector<uint8_t> storage;
+
+    intptr_t data() { return reinterpret_cast<intptr_t>(storage.data()); }
+  };
+
+  typedef std::shared_ptr<Tensor> TensorPtr;
+
+  std::mt19937 random_engine(2020);
+
+  // Tensors of one benchmark case. Every tensor created here is counted as
+  // traffic; tensors filled by value() are parameters and are not.
+  class Case {
+   public:
+    // Random contents in a range every kernel accepts: floats in [-1, 1],
+    // int32 (biases) in [-1024, 1024], any 8-bit value.
+    TensorPtr tensor(const std::vector<int32_t>& dims, ElementType type) {
+      TensorPtr t = allocate(dims, type);
+      bytes_ += t->storage.size();
+      if (type == kFloat32) {
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        float* p = reinterpret_cast<float*>(t->storage.data());
+        for (size_t i = 0; i < t->storage.size() / 4; ++i) p[i] = dist(random_engine);
+      } else if (type == kInt32) {
+        std::uniform_int_distribution<int32_t> dist(-1024, 1024);
+        int32_t* p = reinterpret_cast<int32_t*>(t->storage.data());
+        for (size_t i = 0; i < t->storage.size() / 4; ++i) p[i] = dist(random_engine);
+      } else {
+        std::uniform_int_distribution<int> dist(0, 255);
+        for (auto& b : t->storage) b = dist(random_engine);
+      }
+      return t;
+    }
+
+    TensorPtr value(const std::vector<int32_t>& dims, const std::vector<int32_t>& values) {
+      TensorPtr t = allocate(dims, kInt32);
+      int32_t* p = reinterpret_cast<int32_t*>(t->storage.data());
+      for (size_t i = 0; i < t->storage.size() / 4; ++i) {
+        p[i] = values.size() == 1 ? values[0] : values[i];
+      }
+      return t;
+    }
+
+    double bytes() const { return bytes_; }
+
+   private:
+    TensorPtr allocate(const std::vector<int32_t>& dims, ElementType type) {
+      TensorPtr t = std::make_shared<Tensor>();
+      t->shape.ReplaceWith(dims.size(), dims.data());
+      size_t count = 1;
+      for (int32_t d : dims) count *= d;
+      t->storage.resize(count * ElementSize(type));
+      return t;
+    }
+
+    double bytes_ = 0;
+  };
+
+  struct Benchmark {
+    std::string name;
+    // Arithmetic operations per call, 0 for data movement kernels.
+    double flops;
+    // Allocates the tensors of the case and returns the timed call.
+    std::function<std::function<void()>(Case*)> setup;
+  };
+
+  std::vector<Benchmark> benchmarks;
+
+  void Register(const std::string& name, double flops,
+                std::function<std::function<void()>(Case*)> setup) {
+    benchmarks.push_back(Benchmark{name, flops, setup});
+  }
+
+  std::string Dims(const std::vector<int32_t>& dims) {
+    std::string s;
+    for (size_t i = 0; i < dims.size(); ++i) {
+      s += (i ? "x" : "") + std::to_string(dims[i]);
+    }
+    return s;
+  }
+
+  double Count(const std::vector<int32_t>& dims) {
+    double n = 1;
+    for (int32_t d : dims) n *= d;
+    return n;
+  }
+
+  int SameOutput(int size, int stride) { return (size + stride - 1) / stride; }
+
+  int SamePadding(int size, int filter, int stride) {
+    return std::max((SameOutput(size, stride) - 1) * stride + filter - size, 0) / 2;
+  }
+
+  // Quantization used by every 8-bit case: zero point 128 for uint8 and 0
+  // for int8 tensors, a right shift of 8 when requantizing.
+  constexpr int32_t kOutputMultiplier = 1 << 30;
+  constexpr int32_t kOutputShift = -8;
+
+  int32_t ZeroPoint(ElementType type) { return type == kUint8 ? 128 : 0; }
+  int32_t ActivationMin(ElementType type) { return type == kUint8 ? 0 : -128; }
+  int32_t ActivationMax(ElementType type) { return type == kUint8 ? 255 : 127; }
+
+  struct ConvShape {
+    const char* model;
+    int height, width, inputDepth, outputDepth, filterSize, stride;
+  };
+
+  // Conv layers of the three models, SAME padding.
+  const ConvShape kConvShapes[] = {
+    {"mobilenet", 224, 224, 3, 8, 3, 2},
+    {"mobilenet", 112, 112, 8, 16, 1, 1},
+    {"mobilenet", 28, 28, 64, 64, 1, 1},
+    {"mobilenet", 7, 7, 256, 256, 1, 1},
+    {"mobilenet", 1, 1, 256, 1001, 1, 1},
+    {"ssd", 19, 19, 512, 512, 1, 1},
+    {"ssd", 19, 19, 512, 12, 1, 1},
+    {"ssd", 19, 19, 512, 273, 1, 1},
+    {"ssd", 10, 10, 256, 512, 3, 2},
+    {"face", 300, 300, 3, 32, 3, 2},
+    {"face", 150, 150, 32, 16, 1, 1},
+    {"face", 75, 75, 24, 144, 1, 1},
+    {"face", 19, 19, 96, 576, 1, 1},
+  };
+
+  // Dense 3x3 stride 1 layers, which convFloat32 runs as a Winograd conv.
+  // The 3x3 stride 1 layers of the three models are all depthwise, so these
+  // are the shapes of a small segmentation head instead.
+  const ConvShape kDense3x3Shapes[] = {
+    {"dense3x3", 75, 75, 32, 32, 3, 1},
+    {"dense3x3", 38, 38, 64, 64, 3, 1},
+    {"dense3x3", 19, 19, 128, 128, 3, 1},
+    {"dense3x3", 19, 19, 256, 256, 3, 1},
+  };
+
+  struct DepthwiseShape {
+    const char* model;
+    int height, width, depth, filterSize, stride;
+  };
+
+  const DepthwiseShape kDepthwiseShapes[] = {
+    {"mobilenet", 112, 112, 8, 3, 1},
+    {"mobilenet", 112, 112, 16, 3, 2},
+    {"mobilenet", 28, 28, 64, 3, 1},
+    {"mobilenet", 7, 7, 256, 3, 1},
+    {"ssd", 19, 19, 512, 3, 1},
+    {"ssd", 38, 38, 256, 3, 2},
+    {"face", 150, 150, 32, 3, 1},
+    {"face", 75, 75, 144, 3, 2},
+    {"face", 38, 38, 192, 3, 1},
+  };
+
+  // The scalar loops the per-channel wrappers ran before they moved to the
+  // blocked quantized kernels, kept only as the baseline of the *Loop cases:
+  // one output value at a time, every filter tap bounds-checked. Shifts
+  // follow the tflite convention, as for the wrappers.
+  template <typename T>
+  void LoopConvPerChannel(const ConvParams& p, const intptr_t multiplierData,
+                          const intptr_t shiftData, const RuntimeShape& inputShape,
+                          const intptr_t inputData, const RuntimeShape& filterShape,
+                          const intptr_t filterData, const RuntimeShape& biasShape,
+                          const intptr_t biasData, const RuntimeShape& outputShape,
+                          intptr_t outputData) {
+    const int32_t* multipliers = reinterpret_cast<const int32_t*>(multiplierData);
+    const int32_t* shifts = reinterpret_cast<const int32_t*>(shiftData);
+    const T* input = reinterpret_cast<const T*>(inputData);
+    const int8_t* filter = reinterpret_cast<const int8_t*>(filterData);
+    const int32_t* bias = reinterpret_cast<const int32_t*>(biasData);
+    T* output = reinterpret_cast<T*>(outputData);
+    const int inputHeight = inputShape.Dims(1), inputWidth = inputShape.Dims(2);
+    const int inputDepth = inputShape.Dims(3);
+    const int filterHeight = filterShape.Dims(1), filterWidth = filterShape.Dims(2);
+    const int outputHeight = outputShape.Dims(1), outputWidth = outputShape.Dims(2);
+    const int outputDepth = outputShape.Dims(3);
+    for (int b = 0; b < outputShape.Dims(0); ++b) {
+      for (int y = 0; y < outputHeight; ++y) {
+        for (int x = 0; x < outputWidth; ++x) {
+          for (int oc = 0; oc < outputDepth; ++oc) {
+            int32_t sum = 0;
+            for (int fy = 0; fy < filterHeight; ++fy) {
+              for (int fx = 0; fx < filterWidth; ++fx) {
+                for (int ic = 0; ic < inputDepth; ++ic) {
+                  const int inY = y * p.stride_height - p.padding_values.height +
+                                  p.dilation_height_factor * fy;
+                  const int inX = x * p.stride_width - p.padding_values.width +
+                                  p.dilation_width_factor * fx;
+                  if (inY >= 0 && inY < inputHeight && inX >= 0 && inX < inputWidth) {
+                    sum += filter[((oc * filterHeight + fy) * filterWidth + fx) * inputDepth + ic] *
+                           (input[((b * inputHeight + inY) * inputWidth + inX) * inputDepth + ic] +
+                            p.input_offset);
+                  }
+                }
+              }
+            }
+            sum = MultiplyByQuantizedMultiplier(sum + bias[oc], multipliers[oc], shifts[oc]);
+            sum = std::min(std::max(sum + p.output_offset, p.quantized_activation_min),
+                           p.quantized_activation_max);
+            output[((b * outputHeight + y) * outputWidth + x) * outputDepth + oc] =
+                static_cast<T>(sum);
+          }
+        }
+      }
+    }
+  }
+
+  template <typename T>
+  void LoopDepthwiseConvPerChannel(const DepthwiseParams& p, const intptr_t multiplierData,
+                                   const intptr_t shiftData, const RuntimeShape& inputShape,
+                                   const intptr_t inputData, const RuntimeShape& filterShape,
+                                   const intptr_t filterData, const RuntimeShape& biasShape,
+                                   const intptr_t biasData, const RuntimeShape& outputShape,
+                                   intptr_t outputData) {
+    const int32_t* multipliers = reinterpret_cast<const int32_t*>(multiplierData);
+    const int32_t* shifts = reinterpret_cast<const int32_t*>(shiftData);
+    const T* input = reinterpret_cast<const T*>(inputData);
+    const int8_t* filter = reinterpret_cast<const int8_t*>(filterData);
+    const int32_t* bias = reinterpret_cast<const int32_t*>(biasData);
+    T* output = reinterpret_cast<T*>(outputData);
+    const int inputHeight = inputShape.Dims(1), inputWidth = inputShape.Dims(2);
+    const int inputDepth = inputShape.Dims(3);
+    const int filterHeight = filterShape.Dims(1), filterWidth = filterShape.Dims(2);
+    const int outputHeight = outputShape.Dims(1), outputWidth = outputShape.Dims(2);
+    const int outputDepth = outputShape.Dims(3);
+    for (int b = 0; b < outputShape.Dims(0); ++b) {
+      for (int y = 0; y < outputHeight; ++y) {
+        for (int x = 0; x < outputWidth; ++x) {
+          for (int ic = 0; ic < inputDepth; ++ic) {
+            for (int m = 0; m < p.depth_multiplier; ++m) {
+              const int oc = ic * p.depth_multiplier + m;
+              int32_t sum = 0;
+              for (int fy = 0; fy < filterHeight; ++fy) {
+                for (int fx = 0; fx < filterWidth; ++fx) {
+                  const int inY = y * p.stride_height - p.padding_values.height +
+                                  p.dilation_height_factor * fy;
+                  const int inX = x * p.stride_width - p.padding_values.width +
+                                  p.dilation_width_factor * fx;
+                  if (inY >= 0 && inY < inputHeight && inX >= 0 && inX < inputWidth) {
+                    sum += filter[(fy * filterWidth + fx) * outputDepth + oc] *
+                           (input[((b * inputHeight + inY) * inputWidth + inX) * inputDepth + ic] +
+                            p.input_offset);
+                  }
+                }
+              }
+              sum = MultiplyByQuantizedMultiplier(sum + bias[oc], multipliers[oc], shifts[oc]);
+              sum = std::min(std::max(sum + p.output_offset, p.quantized_activation_min),
+                             p.quantized_activation_max);
+              output[((b * outputHeight + y) * outputWidth + x) * outputDepth + oc] =
+                  static_cast<T>(sum);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Conv wrappers: float32, uint8 (uint8 filter) and int8 take the
+  // per-tensor multiplier from the params, the per-channel flavours an int8
+  // filter and one multiplier per output channel.
+  void RegisterConv(const ConvShape& s) {
+    const int outHeight = SameOutput(s.height, s.stride);
+    const int outWidth = SameOutput(s.width, s.stride);
+    const std::vector<int32_t> inputDims = {1, s.height, s.width, s.inputDepth};
+    const std::vector<int32_t> filterDims = {s.outputDepth, s.filterSize, s.filterSize, s.inputDepth};
+    const std::vector<int32_t> outputDims = {1, outHeight, outWidth, s.outputDepth};
+    const double flops = 2.0 * Count(outputDims) * s.filterSize * s.filterSize * s.inputDepth;
+    const std::string suffix = std::string("/") + s.model + "/" + Dims(inputDims) + "->" +
+        std::to_string(s.outputDepth) + " k" + std::to_string(s.filterSize) +
+        "s" + std::to_string(s.stride);
+
+    auto params = [=](ElementType inputType, int32_t weightsOffset) {
+      ConvParams p = ConvParams();
+      p.padding_values.height = SamePadding(s.height, s.filterSize, s.stride);
+      p.padding_values.width = SamePadding(s.width, s.filterSize, s.stride);
+      p.stride_height = p.stride_width = s.stride;
+      p.dilation_height_factor = p.dilation_width_factor = 1;
+      p.float_activation_min = std::numeric_limits<float>::lowest();
+      p.float_activation_max = std::numeric_limits<float>::max();
+      p.input_offset = -ZeroPoint(inputType);
+      p.weights_offset = weightsOffset;
+      p.output_offset = ZeroPoint(inputType);
+      p.output_multiplier = kOutputMultiplier;
+      p.output_shift = kOutputShift;
+      p.quantized_activation_min = ActivationMin(inputType);
+      p.quantized_activation_max = ActivationMax(inputType);
+      return p;
+    };
+
+    typedef void (*ConvWrapper)(const ConvParams&, const RuntimeShape&, const intptr_t,
+                                const RuntimeShape&, const intptr_t, const RuntimeShape&,
+                                const intptr_t, const RuntimeShape&, intptr_t);
+    auto perTensor = [=](const char* name, ConvWrapper wrapper, ElementType type,
+                         ElementType filterType, int32_t weightsOffset) {
+      const ConvParams p = params(type, weightsOffset);
+      Register(name + suffix, flops, [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor(inputDims, type);
+        TensorPtr filter = c->tensor(filterDims, filterType);
+        TensorPtr bias = c->tensor({s.outputDepth}, type == kFloat32 ? kFloat32 : kInt32);
+        TensorPtr output = c->tensor(outputDims, type);
+        return [=]() {
+          wrapper(p, input->shape, input->data(), filter->shape, filter->data(),
+                  bias->shape, bias->data(), output->shape, output->data());
+        };
+      });
+    };
+    perTensor("convFloat32", convFloat32Wrapper, kFloat32, kFloat32, 0);
+    perTensor("convUint8", convUint8Wrapper, kUint8, kUint8, -128);
+    perTensor("convInt8", convInt8Wrapper, kInt8, kInt8, 0);
+
+    typedef void (*PerChannelConvWrapper)(const ConvParams&, const intptr_t, const intptr_t,
+                                          const RuntimeShape&, const intptr_t,
+                                          const RuntimeShape&, const intptr_t,
+                                          const RuntimeShape&, const intptr_t,
+                                          const RuntimeShape&, intptr_t);
+    auto perChannel = [=](const char* name, PerChannelConvWrapper wrapper, ElementType type) {
+      const ConvParams p = params(type, 0);
+      Register(name + suffix, flops, [=](Case* c) -> std::function<void()> {
+        TensorPtr multipliers = c->value({s.outputDepth}, {kOutputMultiplier});
+        TensorPtr shifts = c->value({s.outputDepth}, {kOutputShift});
+        TensorPtr input = c->tensor(inputDims, type);
+        TensorPtr filter = c->tensor(filterDims, kInt8);
+        TensorPtr bias = c->tensor({s.outputDepth}, kInt32);
+        TensorPtr output = c->tensor(outputDims, type);
+        return [=]() {
+          wrapper(p, multipliers->data(), shifts->data(),
+                  input->shape, input->data(), filter->shape, filter->data(),
+                  bias->shape, bias->data(), output->shape, output->data());
+        };
+      });
+    };
+    perChannel("convUint8PerChannel", convUint8PerChannelWrapper, kUint8);
+    perChannel("convInt8PerChannel", convInt8PerChannelWrapper, kInt8);
+    perChannel("convUint8PerChannelLoop", LoopConvPerChannel<uint8_t>, kUint8);
+    perChannel("convInt8PerChannelLoop", LoopConvPerChannel<int8_t>, kInt8);
+  }
+
+  // Both paths of convFloat32 on 3x3 stride 1 layers of growing depth, with
+  // the Winograd filter transformed at setup as a plan does. Where the
+  // Winograd columns overtake im2col is where kWinogradMinChannels belongs.
+  void RegisterWinogradCutoff() {
+    const int sizes[] = {38, 19};
+    const int depths[] = {4, 8, 12, 16, 24, 32, 64};
+    for (int size : sizes) {
+      for (int depth : depths) {
+        const std::vector<int32_t> inputDims = {1, size, size, depth};
+        const std::vector<int32_t> filterDims = {depth, 3, 3, depth};
+        const double flops = 2.0 * Count(inputDims) * 9 * depth;
+        const std::string suffix = "/cutoff/" + Dims(inputDims) + "->" + std::to_string(depth) +
+                                   " k3s1";
+        ConvParams p = ConvParams();
+        p.padding_values.height = p.padding_values.width = 1;
+        p.stride_height = p.stride_width = 1;
+        p.dilation_height_factor = p.dilation_width_factor = 1;
+        p.float_activation_min = std::numeric_limits<float>::lowest();
+        p.float_activation_max = std::numeric_limits<float>::max();
+        Register("convFloat32Im2col" + suffix, flops, [=](Case* c) -> std::function<void()> {
+          TensorPtr input = c->tensor(inputDims, kFloat32);
+          TensorPtr filter = c->tensor(filterDims, kFloat32);
+          TensorPtr bias = c->tensor({depth}, kFloat32);
+          TensorPtr output = c->tensor(inputDims, kFloat32);
+          return [=]() {
+            Im2colConvFloat32(p, input->shape, (const float*)input->data(),
+                              filter->shape, (const float*)filter->data(),
+                              bias->shape, (const float*)bias->data(),
+                              output->shape, (float*)output->data());
+          };
+        });
+        for (int tile = 2; tile <= 4; tile += 2) {
+          Register("convFloat32Winograd" + std::to_string(tile) + suffix, flops,
+                   [=](Case* c) -> std::function<void()> {
+            TensorPtr input = c->tensor(inputDims, kFloat32);
+            TensorPtr filter = c->tensor(filterDims, kFloat32);
+            TensorPtr bias = c->tensor({depth}, kFloat32);
+            TensorPtr output = c->tensor(inputDims, kFloat32);
+            std::shared_ptr<WinogradFilter> transformed = std::make_shared<WinogradFilter>();
+            TransformWinogradFilter(filter->shape, (const float*)filter->data(), tile,
+                                    transformed.get());
+            return [=]() {
+              WinogradConvNhwc(p, input->shape, (const float*)input->data(), *transformed,
+                               (const float*)bias->data(), output->shape, (float*)output->data());
+            };
+          });
+        }
+      }
+    }
+  }
+
+  void RegisterDepthwiseConv(const DepthwiseShape& s) {
+    const int outHeight = SameOutput(s.height, s.stride);
+    const int outWidth = SameOutput(s.width, s.stride);
+    const std::vector<int32_t> inputDims = {1, s.height, s.width, s.depth};
+    const std::vector<int32_t> filterDims = {1, s.filterSize, s.filterSize, s.depth};
+    const std::vector<int32_t> outputDims = {1, outHeight, outWidth, s.depth};
+    const double flops = 2.0 * Count(outputDims) * s.filterSize * s.filterSize;
+    const std::string suffix = std::string("/") + s.model + "/" + Dims(inputDims) +
+        " k" + std::to_string(s.filterSize) + "s" + std::to_string(s.stride);
+
+    auto params = [=](ElementType inputType, int32_t weightsOffset) {
+      DepthwiseParams p = DepthwiseParams();
+      p.padding_values.height = SamePadding(s.height, s.filterSize, s.stride);
+      p.padding_values.width = SamePadding(s.width, s.filterSize, s.stride);
+      p.stride_height = p.stride_width = s.stride;
+      p.dilation_height_factor = p.dilation_width_factor = 1;
+      p.depth_multiplier = 1;
+      p.float_activation_min = std::numeric_limits<float>::lowest();
+      p.float_activation_max = std::numeric_limits<float>::max();
+      p.input_offset = -ZeroPoint(inputType);
+      p.weights_offset = weightsOffset;
+      p.output_offset = ZeroPoint(inputType);
+      p.output_multiplier = kOutputMultiplier;
+      p.output_shift = kOutputShift;
+      p.quantized_activation_min = ActivationMin(inputType);
+      p.quantized_activation_max = ActivationMax(inputType);
+      return p;
+    };
+
+    typedef void (*DepthwiseWrapper)(const DepthwiseParams&, const RuntimeShape&, const intptr_t,
+                                     const RuntimeShape&, const intptr_t, const RuntimeShape&,
+                                     const intptr_t, const RuntimeShape&, intptr_t);
+    auto perTensor = [=](const char* name, DepthwiseWrapper wrapper, ElementType type,
+                         ElementType filterType, int32_t weightsOffset) {
+      const DepthwiseParams p = params(type, weightsOffset);
+      Register(name + suffix, flops, [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor(inputDims, type);
+        TensorPtr filter = c->tensor(filterDims, filterType);
+        TensorPtr bias = c->tensor({s.depth}, type == kFloat32 ? kFloat32 : kInt32);
+        TensorPtr output = c->tensor(outputDims, type);
+        return [=]() {
+          wrapper(p, input->shape, input->data(), filter->shape, filter->data(),
+                  bias->shape, bias->data(), output->shape, output->data());
+        };
+      });
+    };
+    perTensor("depthwiseConvFloat32", depthwiseConvFloat32Wrapper, kFloat32, kFloat32, 0);
+    perTensor("depthwiseConvUint8", depthwiseConvUint8Wrapper, kUint8, kUint8, -128);
+    perTensor("depthwiseConvInt8", depthwiseConvInt8Wrapper, kInt8, kInt8, 0);
+
+    typedef void (*PerChannelDepthwiseWrapper)(const DepthwiseParams&, const intptr_t,
+                                               const intptr_t, const RuntimeShape&,
+                                               const intptr_t, const RuntimeShape&,
+                                               const intptr_t, const RuntimeShape&,
+                                               const intptr_t, const RuntimeShape&, intptr_t);
+    auto perChannel = [=](const char* name, PerChannelDepthwiseWrapper wrapper, ElementType type) {
+      const DepthwiseParams p = params(type, 0);
+      Register(name + suffix, flops, [=](Case* c) -> std::function<void()> {
+        TensorPtr multipliers = c->value({s.depth}, {kOutputMultiplier});
+        TensorPtr shifts = c->value({s.depth}, {kOutputShift});
+        TensorPtr input = c->tensor(inputDims, type);
+        TensorPtr filter = c->tensor(filterDims, kInt8);
+        TensorPtr bias = c->tensor({s.depth}, kInt32);
+        TensorPtr output = c->tensor(outputDims, type);
+        return [=]() {
+          wrapper(p, multipliers->data(), shifts->data(),
+                  input->shape, input->data(), filter->shape, filter->data(),
+                  bias->shape, bias->data(), output->shape, output->data());
+        };
+      });
+    };
+    perChannel("depthwiseConvUint8PerChannel", depthwiseConvUint8PerChannelWrapper, kUint8);
+    perChannel("depthwiseConvInt8PerChannel", depthwiseConvInt8PerChannelWrapper, kInt8);
+    perChannel("depthwiseConvUint8PerChannelLoop", LoopDepthwiseConvPerChannel<uint8_t>, kUint8);
+    perChannel("depthwiseConvInt8PerChannelLoop", LoopDepthwiseConvPerChannel<int8_t>, kInt8);
+  }
+
+  void RegisterPools() {
+    struct PoolShape {
+      const char* model;
+      int height, width, depth, filterSize, stride;
+    };
+    const PoolShape averageShapes[] = {
+      {"mobilenet", 7, 7, 256, 7, 1},
+      {"mobilenet", 4, 4, 256, 4, 1},
+      {"face", 10, 10, 128, 10, 1},
+    };
+    const PoolShape maxShapes[] = {
+      {"ssd", 38, 38, 256, 2, 2},
+      {"face", 150, 150, 32, 2, 2},
+    };
+    typedef void (*PoolWrapper)(const PoolParams, const RuntimeShape&, const intptr_t,
+                                const RuntimeShape&, intptr_t);
+    auto pool = [](const char* name, PoolWrapper wrapper, ElementType type, const PoolShape& s) {
+      const std::vector<int32_t> inputDims = {1, s.height, s.width, s.depth};
+      const std::vector<int32_t> outputDims = {1, (s.height - s.filterSize) / s.stride + 1,
+                                               (s.width - s.filterSize) / s.stride + 1, s.depth};
+      PoolParams p = PoolParams();
+      p.stride_height = p.stride_width = s.stride;
+      p.filter_height = p.filter_width = s.filterSize;
+      p.float_activation_min = std::numeric_limits<float>::lowest();
+      p.float_activation_max = std::numeric_limits<float>::max();
+      p.quantized_activation_min = ActivationMin(type);
+      p.quantized_activation_max = ActivationMax(type);
+      Register(std::string(name) + "/" + s.model + "/" + Dims(inputDims) + " k" +
+                   std::to_string(s.filterSize),
+               Count(outputDims) * s.filterSize * s.filterSize,
+               [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor(inputDims, type);
+        TensorPtr output = c->tensor(outputDims, type);
+        return [=]() { wrapper(p, input->shape, input->data(), output->shape, output->data()); };
+      });
+    };
+    for (const PoolShape& s : averageShapes) {
+      pool("averagePoolFloat32", averagePoolFloat32Wrapper, kFloat32, s);
+      pool("averagePoolUint8", averagePoolUint8Wrapper, kUint8, s);
+      pool("averagePoolInt8", averagePoolInt8Wrapper, kInt8, s);
+    }
+    for (const PoolShape& s : maxShapes) {
+      pool("maxPoolFloat32", maxPoolFloat32Wrapper, kFloat32, s);
+      pool("maxPoolUint8", maxPoolUint8Wrapper, kUint8, s);
+    }
+  }
+
+  // Wrappers taking one input and one output of the same shape.
+  typedef void (*UnaryWrapper)(const RuntimeShape&, const intptr_t, const RuntimeShape&, intptr_t);
+
+  void RegisterUnary(const char* name, UnaryWrapper wrapper, ElementType type,
+                     const char* model, const std::vector<int32_t>& dims,
+                     double flopsPerValue) {
+    Register(std::string(name) + "/" + model + "/" + Dims(dims), flopsPerValue * Count(dims),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor(dims, type);
+      TensorPtr output = c->tensor(dims, type);
+      return [=]() { wrapper(input->shape, input->data(), output->shape, output->data()); };
+    });
+  }
+
+  typedef void (*ArithmeticWrapper)(const ArithmeticParams&, const RuntimeShape&, const intptr_t,
+                                    const RuntimeShape&, const intptr_t,
+                                    const RuntimeShape&, intptr_t);
+
+  void RegisterArithmetic(const char* name, ArithmeticWrapper wrapper, ElementType type,
+                          const char* model, const std::vector<int32_t>& dims1,
+                          const std::vector<int32_t>& dims2) {
+    ArithmeticParams p = ArithmeticParams();
+    p.float_activation_min = std::numeric_limits<float>::lowest();
+    p.float_activation_max = std::numeric_limits<float>::max();
+    p.input1_offset = p.input2_offset = -ZeroPoint(type);
+    p.output_offset = ZeroPoint(type);
+    p.left_shift = 20;
+    p.input1_multiplier = p.input2_multiplier = kOutputMultiplier;
+    p.input1_shift = p.input2_shift = -1;
+    p.output_multiplier = kOutputMultiplier;
+    p.output_shift = -20;
+    p.quantized_activation_min = ActivationMin(type);
+    p.quantized_activation_max = ActivationMax(type);
+    Register(std::string(name) + "/" + model + "/" + Dims(dims1) + "," + Dims(dims2),
+             Count(dims1), [=](Case* c) -> std::function<void()> {
+      TensorPtr input1 = c->tensor(dims1, type);
+      TensorPtr input2 = c->tensor(dims2, type);
+      TensorPtr output = c->tensor(dims1, type);
+      return [=]() {
+        wrapper(p, input1->shape, input1->data(), input2->shape, input2->data(),
+                output->shape, output->data());
+      };
+    });
+  }
+
+  void RegisterElementwise() {
+    const std::vector<int32_t> residual = {1, 75, 75, 24};
+    const std::vector<int32_t> channels = {1, 1, 1, 24};
+    RegisterArithmetic("addFloat32", addFloat32Wrapper, kFloat32, "face", residual, residual);
+    RegisterArithmetic("addUint8", addUint8Wrapper, kUint8, "face", residual, residual);
+    RegisterArithmetic("broadCastAddFloat32", broadCastAddFloat32Wrapper, kFloat32, "face",
+                       residual, channels);
+    RegisterArithmetic("mulFloat32", mulFloat32Wrapper, kFloat32, "face", residual, residual);
+    RegisterArithmetic("broadCastMulFloat32", broadCastMulFloat32Wrapper, kFloat32, "face",
+                       residual, channels);
+    RegisterUnary("floorFloat32", floorFloat32Wrapper, kFloat32, "face", residual, 1);
+    RegisterUnary("tanhFloat32", tanhFloat32Wrapper, kFloat32, "face", {1, 38, 38, 128}, 1);
+    RegisterUnary("logisticFloat32", logisticFloat32Wrapper, kFloat32, "ssd", {1, 1917, 91}, 1);
+
+    const std::vector<int32_t> scores = {1, 1917, 91};
+    LogisticParams logistic = LogisticParams();
+    logistic.input_zero_point = 128;
+    logistic.input_range_radius = 127;
+    logistic.input_multiplier = kOutputMultiplier;
+    logistic.input_left_shift = 4;
+    Register("logisticUint8/ssd/" + Dims(scores), Count(scores),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor(scores, kUint8);
+      TensorPtr output = c->tensor(scores, kUint8);
+      return [=]() {
+        logisticUint8Wrapper(logistic, input->shape, input->data(), output->shape, output->data());
+      };
+    });
+
+    const std::vector<int32_t> activations = {1, 75, 75, 32};
+    Register("maximumFloat32/face/" + Dims(activations), Count(activations),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input1 = c->tensor(activations, kFloat32);
+      TensorPtr input2 = c->tensor(activations, kFloat32);
+      TensorPtr output = c->tensor(activations, kFloat32);
+      return [=]() {
+        maximumFloat32Wrapper(input1->shape, input1->data(), input2->shape, input2->data(),
+                              output->shape, output->data());
+      };
+    });
+
+    Register("preluFloat32/face/" + Dims(activations), 2 * Count(activations),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor(activations, kFloat32);
+      TensorPtr alpha = c->tensor({32}, kFloat32);
+      TensorPtr output = c->tensor(activations, kFloat32);
+      return [=]() {
+        preluFloat32Wrapper(input->shape, input->data(), alpha->shape, alpha->data(),
+                            output->shape, output->data());
+      };
+    });
+
+    PreluParams prelu = PreluParams();
+    prelu.input_offset = -128;
+    prelu.alpha_offset = -128;
+    prelu.output_offset = 128;
+    prelu.output_multiplier = kOutputMultiplier;
+    prelu.output_shift = kOutputShift;
+    Register("preluUint8/face/" + Dims(activations), 2 * Count(activations),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor(activations, kUint8);
+      TensorPtr alpha = c->tensor({1, 1, 1, 32}, kUint8);
+      TensorPtr output = c->tensor(activations, kUint8);
+      return [=]() {
+        preluUint8Wrapper(prelu, input->shape, input->data(), alpha->shape, alpha->data(),
+                          output->shape, output->data());
+      };
+    });
+  }
+
+  void RegisterClassifiers() {
+    const std::vector<int32_t> logits = {1, 1001};
+    const std::vector<int32_t> scores = {1917, 91};
+
+    SoftmaxParams softmax = SoftmaxParams();
+    softmax.beta = 1.0;
+    softmax.input_multiplier = kOutputMultiplier;
+    softmax.input_left_shift = 2;
+    softmax.diff_min = -248;
+    for (const auto& dims : {logits, scores}) {
+      const char* model = dims == logits ? "mobilenet" : "ssd";
+      Register("softmaxFloat32/" + std::string(model) + "/" + Dims(dims), 3 * Count(dims),
+               [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor(dims, kFloat32);
+        TensorPtr output = c->tensor(dims, kFloat32);
+        return [=]() {
+          softmaxFloat32Wrapper(softmax, input->shape, input->data(), output->shape, output->data());
+        };
+      });
+      Register("softmaxUint8/" + std::string(model) + "/" + Dims(dims), 3 * Count(dims),
+               [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor(dims, kUint8);
+        TensorPtr output = c->tensor(dims, kUint8);
+        return [=]() {
+          softmaxUint8Wrapper(softmax, input->shape, input->data(), output->shape, output->data());
+        };
+      });
+    }
+
+    FullyConnectedParams fc = FullyConnectedParams();
+    fc.float_activation_min = std::numeric_limits<float>::lowest();
+    fc.float_activation_max = std::numeric_limits<float>::max();
+    fc.input_offset = -128;
+    fc.weights_offset = -128;
+    fc.output_offset = 128;
+    fc.output_multiplier = kOutputMultiplier;
+    fc.output_shift = kOutputShift;
+    fc.quantized_activation_min = 0;
+    fc.quantized_activation_max = 255;
+    const int inputs = 256, outputs = 1001;
+    for (ElementType type : {kFloat32, kUint8}) {
+      Register(std::string(type == kFloat32 ? "fullyConnectedFloat32" : "fullyConnectedUint8") +
+                   "/mobilenet/" + std::to_string(inputs) + "->" + std::to_string(outputs),
+               2.0 * inputs * outputs, [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor({1, inputs}, type);
+        TensorPtr weights = c->tensor({outputs, inputs}, type);
+        TensorPtr bias = c->tensor({outputs}, type == kFloat32 ? kFloat32 : kInt32);
+        TensorPtr output = c->tensor({1, outputs}, type);
+        auto wrapper = type == kFloat32 ? fullyConnectedFloat32Wrapper : fullyConnectedUint8Wrapper;
+        return [=]() {
+          wrapper(fc, input->shape, input->data(), weights->shape, weights->data(),
+                  bias->shape, bias->data(), output->shape, output->data());
+        };
+      });
+    }
+
+    Register("argMaxFloat32/ssd/1x1917x91", Count({1, 1917, 91}),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 1917, 91}, kFloat32);
+      TensorPtr axis = c->value({1}, {2});
+      TensorPtr output = c->tensor({1, 1917}, kInt32);
+      return [=]() {
+        argMaxFloat32Wrapper(input->shape, input->data(), axis->data(),
+                             output->shape, output->data());
+      };
+    });
+  }
+
+  // Kernels that only move data.
+  void RegisterDataMovement() {
+    // SSD box predictor: [1, 19, 19, 12] -> [1, 1083, 4].
+    Register("reshapeFloat32/ssd/1x19x19x12", 0, [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 19, 19, 12}, kFloat32);
+      TensorPtr output = c->tensor({1, 1083, 4}, kFloat32);
+      return [=]() { reshapeFloat32Wrapper(input->shape, input->data(), output->shape, output->data()); };
+    });
+    Register("reshapeUint8/ssd/1x19x19x12", 0, [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 19, 19, 12}, kUint8);
+      TensorPtr output = c->tensor({1, 1083, 4}, kUint8);
+      return [=]() { reshapeUint8Wrapper(input->shape, input->data(), output->shape, output->data()); };
+    });
+
+    // SSD box encodings of the six feature maps, concatenated along anchors.
+    const std::vector<int32_t> anchors = {1083, 600, 150, 54, 24, 6};
+    for (ElementType type : {kFloat32, kUint8}) {
+      Register(std::string(type == kFloat32 ? "concatenationFloat32" : "concatenationUint8") +
+                   "/ssd/6x[1,N,4]->1x1917x4",
+               0, [=](Case* c) -> std::function<void()> {
+        std::vector<TensorPtr> inputs;
+        for (int32_t n : anchors) {
+          inputs.push_back(c->tensor({1, n, 4}, type));
+        }
+        TensorPtr output = c->tensor({1, 1917, 4}, type);
+        ConcatenationParams p = ConcatenationParams();
+        p.axis = 1;
+        p.inputs_count = inputs.size();
+        p.output_scale = 1.f;
+        p.output_zeropoint = 128;
+        auto descriptor = std::make_shared<ConcatenationInputs>(p);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+          descriptor->setInput(i, inputs[i]->shape, inputs[i]->data(), 1.f, 128);
+        }
+        return [=]() {
+          if (type == kFloat32) {
+            concatenationFloat32Wrapper(*descriptor, output->shape, output->data());
+          } else {
+            concatenationUint8Wrapper(*descriptor, output->shape, output->data());
+          }
+        };
+      });
+    }
+
+    // FPN-style upsampling of the 19x19 SSD feature map.
+    Register("resizeBilinearFloat32/ssd/1x19x19x256->38x38", 8 * Count({1, 38, 38, 256}),
+             [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 19, 19, 256}, kFloat32);
+      TensorPtr outSize = c->value({2}, {38, 38});
+      TensorPtr output = c->tensor({1, 38, 38, 256}, kFloat32);
+      ResizeBilinearParams p = ResizeBilinearParams();
+      p.align_corners = false;
+      return [=]() {
+        resizeBilinearFloat32Wrapper(p, input->shape, input->data(), outSize->shape,
+                                     outSize->data(), output->shape, output->data());
+      };
+    });
+
+    // Space-to-batch form of a dilated conv, block 2.
+    Register("batchToSpaceNDFloat32/face/4x38x38x64", 0, [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({4, 38, 38, 64}, kFloat32);
+      TensorPtr blockShape = c->value({2}, {2, 2});
+      TensorPtr crops = c->value({2, 2}, {0});
+      TensorPtr output = c->tensor({1, 76, 76, 64}, kFloat32);
+      return [=]() {
+        batchToSpaceNDFloat32Wrapper(input->shape, input->data(), blockShape->shape,
+                                     blockShape->data(), crops->shape, crops->data(),
+                                     output->shape, output->data());
+      };
+    });
+
+    // NHWC -> NCHW of a face-detection feature map.
+    Register("transposeFloat32/face/1x75x75x32", 0, [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 75, 75, 32}, kFloat32);
+      TensorPtr output = c->tensor({1, 32, 75, 75}, kFloat32);
+      TransposeParams p = TransposeParams();
+      p.perm_count = 4;
+      p.perm[0] = 0;
+      p.perm[1] = 3;
+      p.perm[2] = 1;
+      p.perm[3] = 2;
+      return [=]() {
+        transposeFloat32Wrapper(p, input->shape, input->data(), output->shape, output->data());
+      };
+    });
+
+    // VGA camera frame to a MobileNet-SSD input, float and uint8.
+    for (ElementType type : {kFloat32, kUint8}) {
+      Register(std::string(type == kFloat32 ? "preprocessRGBAFloat32" : "preprocessRGBAUint8") +
+                   "/ssd/640x480x4->1x300x300x3",
+               10 * Count({1, 300, 300, 3}), [=](Case* c) -> std::function<void()> {
+        TensorPtr input = c->tensor({1, 480, 640, 4}, kUint8);
+        TensorPtr output = c->tensor({1, 300, 300, 3}, type);
+        PreprocessParams p = PreprocessParams();
+        p.src_width = 640;
+        p.src_height = 480;
+        p.crop_width = 640;
+        p.crop_height = 480;
+        p.dst_width = p.draw_width = 300;
+        p.dst_height = p.draw_height = 300;
+        p.channels = 3;
+        p.channel_map = {{0, 1, 2, 3}};
+        const float scale = type == kFloat32 ? 1 / 127.5f : 1.f;
+        const float bias = type == kFloat32 ? -1.f : 0.f;
+        p.scale = {{scale, scale, scale, scale}};
+        p.bias = {{bias, bias, bias, bias}};
+        return [=]() {
+          if (type == kFloat32) {
+            preprocessRGBAFloat32Wrapper(p, input->data(), output->data());
+          } else {
+            preprocessRGBAUint8Wrapper(p, input->data(), output->data());
+          }
+        };
+      });
+    }
+  }
+
+  // Detection post-processing on MobileNet-SSD outputs.
+  void RegisterPostprocessing() {
+    for (ElementType type : {kFloat32, kUint8}) {
+      Register(std::string(type == kFloat32 ? "ssdPostprocessFloat32" : "ssdPostprocessUint8") +
+                   "/ssd/1x1917x4,1x1917x91",
+               0, [=](Case* c) -> std::function<void()> {
+        TensorPtr boxes = c->tensor({1, 1917, 4}, type);
+        TensorPtr scores = c->tensor({1, 1917, 91}, type);
+        TensorPtr anchors = c->tensor({1917, 4}, kFloat32);
+        TensorPtr output = c->tensor({100, 6}, kFloat32);
+        // anchor centres in [0, 1], sizes in [0.05, 0.55]
+        float* anchor = reinterpret_cast<float*>(anchors->data());
+        for (int i = 0; i < 1917 * 4; ++i) {
+          anchor[i] = (i % 4 < 2 ? 0.5f : 0.3f) + anchor[i] * (i % 4 < 2 ? 0.5f : 0.25f);
+        }
+        SsdPostprocessParams p = SsdPostprocessParams();
+        p.num_boxes = 1917;
+        p.num_classes = 91;
+        p.label_offset = 1;
+        p.y_scale = p.x_scale = 10.f;
+        p.h_scale = p.w_scale = 5.f;
+        // about 1% of the scores pass
+        p.score_threshold = type == kFloat32 ? 0.98f : 252.f;
+        p.iou_threshold = 0.5f;
+        p.max_detections = 100;
+        p.max_detections_per_class = 10;
+        p.use_regular_nms = true;
+        p.box_scale = 0.05f;
+        p.box_zero_point = 128;
+        p.score_scale = 1.f;
+        return [=]() {
+          if (type == kFloat32) {
+            ssdPostprocessFloat32Wrapper(p, boxes->data(), scores->data(), anchors->data(),
+                                         output->data());
+          } else {
+            ssdPostprocessUint8Wrapper(p, boxes->data(), scores->data(), anchors->data(),
+                                       output->data());
+          }
+        };
+      });
+    }
+
+    // Tiny YOLOv2 on COCO: 13x13 grid, 5 anchors, 80 classes.
+    Register("yolo2RegionFloat32/yolo/1x13x13x425", 0, [=](Case* c) -> std::function<void()> {
+      TensorPtr input = c->tensor({1, 13, 13, 425}, kFloat32);
+      TensorPtr anchors = c->tensor({5, 2}, kFloat32);
+      TensorPtr output = c->tensor({13 * 13 * 5, 6}, kFloat32);
+      const float anchorSizes[] = {1.08f, 1.19f, 3.42f, 4.41f, 6.63f, 11.38f, 9.42f, 5.11f, 16.62f, 10.52f};
+      std::copy(anchorSizes, anchorSizes + 10, reinterpret_cast<float*>(anchors->data()));
+      Yolo2RegionParams p = Yolo2RegionParams();
+      p.grid_height = 13;
+      p.grid_width = 13;
+      p.num_anchors = 5;
+      p.num_classes = 80;
+      p.obj_threshold = 0.5f;
+      p.nms_threshold = 0.3f;
+      return [=]() {
+        yolo2RegionFloat32Wrapper(p, input->data(), anchors->data(), output->data());
+      };
+    });
+
+    // The bird's-eye lane mask of index 0914.html on a 720p frame. The warp
+    // map is built once, as callers do.
+    Register("laneFeatures/lane/720x1280", 0, [=](Case* c) -> std::function<void()> {
+      LaneFeatureParams p = LaneFeatureParams();
+      p.src_width = 1280;
+      p.src_height = 720;
+      p.dst_width = 1280;
+      p.dst_height = 720;
+      p.src_quad = {{550, 468, 742, 468, 1280, 720, 128, 720}};
+      p.s_threshold = 100;
+      p.sobel_threshold = 15;
+      p.histogram_row = 360;
+      TensorPtr input = c->tensor({720, 1280, 4}, kUint8);
+      TensorPtr map = c->tensor({720, 1280}, kInt32);
+      TensorPtr output = c->tensor({720, 1280}, kUint8);
+      TensorPtr histogram = c->tensor({1280}, kInt32);
+      laneWarpMapWrapper(p, map->data());
+      return [=]() {
+        laneFeaturesWrapper(p, input->data(), map->data(), output->data(), histogram->data());
+      };
+    });
+
+    // Two slightly curved lanes in an otherwise empty warped mask, searched
+    // from scratch on every frame or tracked from the previous fit.
+    for (bool tracked : {false, true}) {
+      Register(std::string(tracked ? "laneTracker/tracked" : "laneTracker/full") + "/720x1280",
+               0, [=](Case* c) -> std::function<void()> {
+        TensorPtr mask = c->tensor({720, 1280}, kUint8);
+        uint8_t* m = reinterpret_cast<uint8_t*>(mask->data());
+        std::fill(m, m + 720 * 1280, 0);
+        for (int y = 0; y < 720; ++y) {
+          for (int lane : {350, 950}) {
+            const int x = lane - y / 8 + (y * y) / 5000;
+            std::fill(m + y * 1280 + x - 6, m + y * 1280 + x + 6, 255);
+          }
+        }
+        LaneTrackerParams p = LaneTrackerParams();
+        p.width = 1280;
+        p.height = 720;
+        p.num_windows = 9;
+        p.margin = 100;
+        p.min_window_pixels = 50;
+        p.min_lane_pixels = 300;
+        p.min_track_ratio = 0.25f;
+        p.histogram_row = 360;
+        std::shared_ptr<LaneTracker> tracker = std::make_shared<LaneTracker>(p);
+        tracker->update(mask->data(), 0);
+        return [=]() {
+          if (!tracked) {
+            tracker->reset();
+          }
+          tracker->update(mask->data(), 0);
+        };
+      });
+    }
+  }
+
+  double NowSeconds() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+int main(int argc, char** argv) {
+  std::string filter;
+  int threads = 1;
+  double minTime = 0.5;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (!strncmp(arg, "--filter=", 9)) {
+      filter = arg + 9;
+    } else if (!strncmp(arg, "--threads=", 10)) {
+      threads = atoi(arg + 10);
+    } else if (!strncmp(arg, "--min_time=", 11)) {
+      minTime = atof(arg + 11);
+    } else {
+      fprintf(stderr, "usage: %s [--filter=<substring>] [--threads=<n>] [--min_time=<seconds>]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  set_gemm_context_threads_num(threads);
+  set_cpu_context_threads_num(threads);
+  set_kernel_threads_num(threads);
+
+  for (const ConvShape& s : kConvShapes) {
+    RegisterConv(s);
+  }
+  for (const ConvShape& s : kDense3x3Shapes) {
+    RegisterConv(s);
+  }
+  RegisterWinogradCutoff();
+  for (const DepthwiseShape& s : kDepthwiseShapes) {
+    RegisterDepthwiseConv(s);
+  }
+  RegisterPools();
+  RegisterElementwise();
+  RegisterClassifiers();
+  RegisterDataMovement();
+  RegisterPostprocessing();
+
+  printf("%-72s %12s %10s %10s %10s\n", "Benchmark", "Time (ms)", "Iterations", "GFLOP/s", "GB/s");
+  for (const Benchmark& b : benchmarks) {
+    if (b.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    try {
+      Case c;
+      std::function<void()> run = b.setup(&c);
+      // Warm-up call, also sizes the scratch buffers.
+      run();
+      int iterations = 0;
+      const double start = NowSeconds();
+      double elapsed = 0;
+      do {
+        run();
+        ++iterations;
+        elapsed = NowSeconds() - start;
+      } while (elapsed < minTime);
+      const double seconds = elapsed / iterations;
+      char gflops[16] = "-";
+      if (b.flops > 0) {
+        snprintf(gflops, sizeof(gflops), "%.2f", b.flops / seconds * 1e-9);
+      }
+      printf("%-72s %12.4f %10d %10s %10.2f\n", b.name.c_str(), seconds * 1e3, iterations,
+             gflops, c.bytes() / seconds * 1e-9);
+    } catch (const std::string& error) {
+      printf("%-72s failed: %s\n", b.name.c_str(), error.c_str());
+    }
+  }
+  return 0;
+}
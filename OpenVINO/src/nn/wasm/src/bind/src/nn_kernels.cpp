@@ -0,0 +1,4812 @@
+#include "nn_kernels.h"
+
+#include "external/tensorflow/tensorflow/lite/kernels/cpu_backend_context.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/types.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/optimized/cpu_check.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/optimized/optimized_ops.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/optimized/depthwiseconv_float.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/optimized/depthwiseconv_uint8.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/optimized/legacy_optimized_ops.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/reference/prelu.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/reference/reference_ops.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/reference/binary_function.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+#include "external/tensorflow/tensorflow/lite/kernels/internal/reference/integer_ops/pooling.h"
+#include "fixedpoint/fixedpoint.h"
+#include "public/gemmlowp.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// The hand-written kernels run on a thread pool in the pthreads flavours of
+// nn_ops and in native builds.
+#if defined(__EMSCRIPTEN_PTHREADS__) || !defined(__EMSCRIPTEN__)
+#define NN_KERNELS_THREADS
+#endif
+
+#ifdef NN_KERNELS_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+#include <functional>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <emscripten/threading.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+using namespace tflite;
+
+namespace binding_utils {
+  // Operation Implements.	
+  template<typename T>
+  void Maximum(const RuntimeShape& input1_shape, const T* input1_data,
+               const T* input2_data, const RuntimeShape& output_shape,
+               T* output_data) {
+    auto input1_map = optimized_ops::MapAsVector(input1_data, input1_shape);
+    auto input2_map = optimized_ops::MapAsVector(input2_data, output_shape);
+    auto output_map = optimized_ops::MapAsVector(output_data, output_shape);
+    output_map.array() = input1_map.array().max(input2_map.array());
+  }
+
+#ifdef __wasm_simd128__
+  // Eigen has no wasm SIMD packet types, so the float case is written
+  // against the intrinsics directly.
+  inline void Maximum(const RuntimeShape& input1_shape, const float* input1_data,
+                      const float* input2_data, const RuntimeShape& output_shape,
+                      float* output_data) {
+    const int size = output_shape.FlatSize();
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+      wasm_v128_store(output_data + i,
+                      wasm_f32x4_max(wasm_v128_load(input1_data + i),
+                                     wasm_v128_load(input2_data + i)));
+    }
+    for (; i < size; ++i) {
+      output_data[i] = std::max(input1_data[i], input2_data[i]);
+    }
+  }
+#endif
+
+  template <typename T>
+  T ApplyPrelu(T input, T alpha) {
+    return input >= 0.0 ? input : input * alpha;
+  }
+
+  // PReLU whose alpha repeats every `channels` elements of the input, which
+  // covers both per-channel alpha ([C] or [1, 1, 1, C]) and an alpha of the
+  // same shape as the input (channels == size).
+  inline void PreluChannelwise(const float* input, const float* alpha,
+                               int outerSize, int channels, float* output) {
+    for (int o = 0; o < outerSize; ++o) {
+      const float* in = input + o * channels;
+      float* out = output + o * channels;
+      int c = 0;
+#ifdef __wasm_simd128__
+      const v128_t zero = wasm_f32x4_splat(0.0f);
+      for (; c + 4 <= channels; c += 4) {
+        const v128_t x = wasm_v128_load(in + c);
+        const v128_t scaled = wasm_f32x4_mul(x, wasm_v128_load(alpha + c));
+        wasm_v128_store(out + c, wasm_v128_bitselect(x, scaled, wasm_f32x4_ge(x, zero)));
+      }
+#endif
+      for (; c < channels; ++c) {
+        out[c] = ApplyPrelu(in[c], alpha[c]);
+      }
+    }
+  }
+
+  struct KernelContext;
+
+  // Worker threads for the hand-written kernels. ParallelFor splits [0, count)
+  // into one contiguous chunk per thread and runs fn(begin, end, thread) on
+  // each; chunk 0 runs on the calling thread. Without pthreads support every
+  // call runs inline.
+  class WorkerPool {
+   public:
+    explicit WorkerPool(KernelContext* owner) : owner_(owner) {}
+    ~WorkerPool() { SetNumThreads(1); }
+
+    int NumThreads() const { return num_threads_; }
+
+    void SetNumThreads(int num_threads) {
+      num_threads = std::max(num_threads, 1);
+#ifdef NN_KERNELS_THREADS
+      if (num_threads == num_threads_) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (auto& worker : workers_) {
+        worker.join();
+      }
+      workers_.clear();
+      stop_ = false;
+      num_threads_ = num_threads;
+      for (int i = 1; i < num_threads_; ++i) {
+        workers_.emplace_back(&WorkerPool::WorkerLoop, this, i, generation_);
+      }
+#else
+      num_threads_ = 1;
+#endif
+      scratch_.resize(num_threads_);
+      scratch_size_.resize(num_threads_, 0);
+    }
+
+    // Make sure every thread owns at least `bytes` of scratch memory. Must be
+    // called from the calling thread, before ParallelFor, so allocation
+    // failures surface as exceptions there.
+    void ReserveScratch(size_t bytes) {
+      for (int i = 0; i < num_threads_; ++i) {
+        GrowScratch(i, bytes);
+      }
+    }
+
+    // Scratch of the calling thread for data shared by all threads of the
+    // next ParallelFor, whose tasks must then not use Scratch() themselves.
+    char* ReserveSharedScratch(size_t bytes) {
+      GrowScratch(0, bytes);
+      return scratch_[0].get();
+    }
+
+    char* Scratch(int thread) { return scratch_[thread].get(); }
+
+    // Memory kernels keep across calls, see get_scratch_allocations.
+    void CountAllocation() { ++allocations_; }
+    int Allocations() const { return allocations_; }
+
+    size_t ScratchBytes() const {
+      size_t bytes = 0;
+      for (size_t size : scratch_size_) {
+        bytes += size;
+      }
+      return bytes;
+    }
+
+    // The task is passed on by reference, so capturing lambdas are not
+    // copied into a heap-allocated std::function.
+    template <typename Fn>
+    void ParallelFor(int count, const Fn& fn) {
+      if (std::min(num_threads_, count) <= 1) {
+        fn(0, count, 0);
+        return;
+      }
+      Run(count, std::function<void(int, int, int)>(std::cref(fn)));
+    }
+
+   private:
+    void Run(int count, const std::function<void(int, int, int)>& fn) {
+#ifdef NN_KERNELS_THREADS
+      const int chunks = std::min(num_threads_, count);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &fn;
+        task_count_ = count;
+        task_chunks_ = chunks;
+        pending_ = chunks - 1;
+        ++generation_;
+      }
+      wake_.notify_all();
+      fn(0, count / chunks, 0);
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this] { return pending_ == 0; });
+      task_ = nullptr;
+#endif
+    }
+
+    void GrowScratch(int thread, size_t bytes) {
+      if (scratch_size_[thread] >= bytes) {
+        return;
+      }
+      // Release first so the old and new regions never coexist.
+      scratch_[thread].reset();
+      scratch_size_[thread] = 0;
+      scratch_[thread].reset(new (std::nothrow) char[bytes]);
+      if (scratch_[thread] == nullptr) {
+        throw std::string("Scratch size is too large, not enough memory");
+      }
+      scratch_size_[thread] = bytes;
+      ++allocations_;
+    }
+
+#ifdef NN_KERNELS_THREADS
+    void WorkerLoop(int index, uint64_t seen);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(int, int, int)>* task_ = nullptr;
+    int task_count_ = 0;
+    int task_chunks_ = 0;
+    int pending_ = 0;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+#endif
+    KernelContext* owner_;
+    int num_threads_ = 1;
+    std::vector<std::unique_ptr<char[]>> scratch_ = std::vector<std::unique_ptr<char[]>>(1);
+    std::vector<size_t> scratch_size_ = std::vector<size_t>(1, 0);
+    int allocations_ = 0;
+  };
+
+  // A box that passed the score threshold for class column `label`.
+  struct DetectionCandidate {
+    float score;
+    int box;
+    int label;
+  };
+
+  // Everything the kernels keep between calls: the worker pool with its
+  // scratch, the gemmlowp and ruy contexts, the filters the standalone
+  // wrappers pack and the buffers of the detection postprocessing. Only one
+  // thread may use a context at a time.
+  struct KernelContext {
+    KernelContext() : pool(this) {}
+
+    WorkerPool pool;
+    gemmlowp::GemmContext gemm;
+    CpuBackendContext cpu;
+    CpuFlags cpuFlags;
+    // The standalone conv wrappers pack their filter on every call, into
+    // these buffers so only a larger filter allocates. ExecutionPlan records
+    // pack constant filters once, at prepare time.
+    PackedConvFilter<int8_t> convFilter;
+    PackedDepthwiseFilter depthwiseFilter;
+    WinogradFilter winogradFilter;
+    // Decoded boxes, candidates and survivors of SsdPostprocess and of the
+    // YOLOv2 region, and the class probabilities of a region cell, kept so a
+    // frame only allocates when it has more of them than any before.
+    std::vector<float> detectionBoxes;
+    std::vector<DetectionCandidate> detectionCandidates;
+    std::vector<DetectionCandidate> detectionSelected;
+    std::vector<float> detectionProbabilities;
+    // Thread counts last set, 0 before the first set.
+    int gemmThreads = 0;
+    int cpuThreads = 0;
+  };
+
+  // The context configured by the set_*_threads_num functions below.
+  static KernelContext kernel_context;
+
+#ifdef NN_KERNELS_THREADS
+  // A started ExecutionPlan runs on kernel_context from its own thread, so
+  // while one is running the other threads (the page) get a context of
+  // their own with one thread, created on first use. Pool workers and the
+  // plan thread set current_context to the context they serve.
+  static std::unique_ptr<KernelContext> caller_context;
+  static std::atomic<int> started_plans(0);
+  static thread_local KernelContext* current_context = nullptr;
+
+  void WorkerPool::WorkerLoop(int index, uint64_t seen) {
+    current_context = owner_;
+    for (;;) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      if (index >= task_chunks_) {
+        continue;
+      }
+      const std::function<void(int, int, int)>* task = task_;
+      const int begin = static_cast<int>(int64_t(task_count_) * index / task_chunks_);
+      const int end = static_cast<int>(int64_t(task_count_) * (index + 1) / task_chunks_);
+      lock.unlock();
+      (*task)(begin, end, index);
+      lock.lock();
+      if (--pending_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+#endif
+
+  // The context of the calling thread.
+  inline KernelContext& Context() {
+#ifdef NN_KERNELS_THREADS
+    if (current_context != nullptr) {
+      return *current_context;
+    }
+    if (started_plans.load() > 0) {
+      if (!caller_context) {
+        caller_context.reset(new KernelContext);
+        caller_context->gemm.set_max_num_threads(1);
+        caller_context->cpu.SetMaxNumThreads(1);
+        caller_context->gemmThreads = caller_context->cpuThreads = 1;
+      }
+      return *caller_context;
+    }
+#endif
+    return kernel_context;
+  }
+
+  inline WorkerPool& Pool() { return Context().pool; }
+
+  // The pool and contexts of a running plan cannot be reconfigured under it,
+  // so changing a thread count while one is started throws.
+  static void CheckNoStartedPlan() {
+#ifdef NN_KERNELS_THREADS
+    if (started_plans.load() > 0) {
+      throw std::string("Thread counts cannot change while an ExecutionPlan is started");
+    }
+#endif
+  }
+
+  // help functions
+  void set_gemm_context_threads_num(int threads_num) {
+    if (threads_num != kernel_context.gemmThreads) {
+      CheckNoStartedPlan();
+      kernel_context.gemm.set_max_num_threads(threads_num);
+      kernel_context.gemmThreads = threads_num;
+    }
+  }
+
+  void set_cpu_context_threads_num(int max_num_threads) {
+    if (max_num_threads != kernel_context.cpuThreads) {
+      CheckNoStartedPlan();
+      kernel_context.cpu.SetMaxNumThreads(max_num_threads);
+      kernel_context.cpuThreads = max_num_threads;
+    }
+  }
+
+  void set_kernel_threads_num(int threads_num) {
+    if (std::max(threads_num, 1) != kernel_context.pool.NumThreads()) {
+      CheckNoStartedPlan();
+      kernel_context.pool.SetNumThreads(threads_num);
+    }
+  }
+
+  int get_scratch_allocations() {
+    int allocations = kernel_context.pool.Allocations();
+#ifdef NN_KERNELS_THREADS
+    if (caller_context) {
+      allocations += caller_context->pool.Allocations();
+    }
+#endif
+    return allocations;
+  }
+
+  int get_scratch_bytes() {
+    size_t bytes = kernel_context.pool.ScratchBytes();
+#ifdef NN_KERNELS_THREADS
+    if (caller_context) {
+      bytes += caller_context->pool.ScratchBytes();
+    }
+#endif
+    return static_cast<int>(bytes);
+  }
+
+  // Scratch bytes of the im2col buffer of the float and uint8 conv wrappers.
+  inline uint64_t Im2colBytes(const RuntimeShape& inputShape, const RuntimeShape& filterShape,
+                              const RuntimeShape& outputShape, size_t elementSize) {
+    return elementSize * uint64_t(outputShape.Dims(0)) * outputShape.Dims(1) *
+           outputShape.Dims(2) * inputShape.Dims(3) * filterShape.Dims(1) * filterShape.Dims(2);
+  }
+
+  #define CONV_PARAMETERS(Type)                                               \
+    uint32_t height = inputShape.Dims(1);                                     \
+    uint32_t width = inputShape.Dims(2);                                      \
+    uint32_t filterHeight = filterShape.Dims(1);                              \
+    uint32_t filterWidth = filterShape.Dims(2);                               \
+    uint32_t outHeight = outputShape.Dims(1);                                 \
+    uint32_t outWidth = outputShape.Dims(2);                                  \
+    uint32_t inDepth = inputShape.Dims(3);                                    \
+                                                                              \
+    uint32_t paddingHeight = (uint32_t)convParams.padding_values.height;      \
+    uint32_t paddingWidth = (uint32_t)convParams.padding_values.width;        \
+                                                                              \
+    tflite::RuntimeShape im2colDim(4);                                        \
+    im2colDim.SetDim(0, (int)outputShape.Dims(0));                            \
+    im2colDim.SetDim(1, (int)outputShape.Dims(1));                            \
+    im2colDim.SetDim(2, (int)outputShape.Dims(2));                            \
+    im2colDim.SetDim(3, (int)inDepth * filterHeight * filterWidth);           \
+                                                                              \
+    const uint64_t im2colByteSize =                                           \
+        Im2colBytes(inputShape, filterShape, outputShape, sizeof(Type));      \
+    /* http://b/77982879, tflite::optimized_ops::Conv uses int for offsets */ \
+    if (im2colByteSize >= 0x7fffffff) {                                       \
+        throw std::string("Conv size is too large, not enough memory");       \
+    }                                                                         \
+    Type* im2colData = reinterpret_cast<Type*>(                               \
+        Pool().ReserveSharedScratch(im2colByteSize));
+ 
+  // Requantize an int32 accumulator to the output type. `outputShift` follows
+  // the tflite convention, i.e. a positive value is a left shift.
+  template <typename T>
+  inline T RequantizeAccumulator(int32_t acc, int32_t outputMultiplier,
+                                 int32_t outputShift, int32_t outputOffset,
+                                 int32_t activationMin, int32_t activationMax) {
+    acc = tflite::MultiplyByQuantizedMultiplier(acc, outputMultiplier, outputShift);
+    acc += outputOffset;
+    acc = std::max(std::min(acc, activationMax), activationMin);
+    return static_cast<T>(acc);
+  }
+
+  // First and one-past-last output coordinate whose receptive field lies
+  // completely inside the input along one axis. Pixels in [begin, end) can
+  // be computed without any bounds check.
+  inline void InteriorRange(int inputSize, int outputSize, int filterSize,
+                            int stride, int dilation, int pad,
+                            int* begin, int* end) {
+    const int extent = dilation * (filterSize - 1);
+    *begin = std::min(outputSize, (pad + stride - 1) / stride);
+    const int last = inputSize - 1 - extent + pad;
+    *end = last < 0 ? 0 : std::min(outputSize, last / stride + 1);
+    if (*end < *begin) {
+      *end = *begin;
+    }
+  }
+
+  // Number of output pixels whose patches are gathered and multiplied
+  // together by QuantizedConvNhwc. Each filter load is reused across the
+  // tile and each patch load across four output channels.
+  constexpr int kConvPixelTile = 4;
+
+#ifdef __wasm_simd128__
+  // Load eight 8-bit values and widen them to int16 lanes.
+  inline v128_t LoadWiden8(const int8_t* p) { return wasm_i16x8_load8x8(p); }
+  inline v128_t LoadWiden8(const uint8_t* p) { return wasm_u16x8_load8x8(p); }
+
+  inline int32_t HorizontalSum(v128_t v) {
+    return wasm_i32x4_extract_lane(v, 0) + wasm_i32x4_extract_lane(v, 1) +
+           wasm_i32x4_extract_lane(v, 2) + wasm_i32x4_extract_lane(v, 3);
+  }
+#endif
+
+  template <typename FilterT>
+  void PackConvFilter(const RuntimeShape& filterShape, const FilterT* filterData,
+                      PackedConvFilter<FilterT>* packed) {
+    const int outputDepth = filterShape.Dims(0);
+    const int patchSize = filterShape.Dims(1) * filterShape.Dims(2) * filterShape.Dims(3);
+    const int packedPatchSize =
+        (patchSize + kConvPackedDepth - 1) / kConvPackedDepth * kConvPackedDepth;
+    const int blocks = (outputDepth + 3) / 4;
+    packed->outputDepth = outputDepth;
+    packed->patchSize = patchSize;
+    packed->packedPatchSize = packedPatchSize;
+    if (size_t(blocks * 4 * packedPatchSize) > packed->data.capacity()) {
+      Pool().CountAllocation();
+    }
+    packed->data.assign(blocks * 4 * packedPatchSize, 0);
+    packed->rowSums.assign(blocks * 4, 0);
+    for (int oc = 0; oc < outputDepth; ++oc) {
+      const FilterT* row = filterData + oc * patchSize;
+      FilterT* block = packed->data.data() + (oc / 4) * 4 * packedPatchSize;
+      int32_t sum = 0;
+      for (int k = 0; k < patchSize; ++k) {
+        block[(k / kConvPackedDepth) * 4 * kConvPackedDepth +
+              (oc % 4) * kConvPackedDepth + k % kConvPackedDepth] = row[k];
+        sum += row[k];
+      }
+      packed->rowSums[oc] = sum;
+    }
+  }
+
+  // acc[i][t] = dot(filter row i, patch t) for the four rows of one block of
+  // a PackedConvFilter and the kConvPixelTile patches in `x`. Patches must be
+  // readable up to `packedPatchSize`; the padding taps have zero weights.
+  template <typename InputT, typename FilterT>
+  inline void ConvMicroKernel4x4(const FilterT* block, int packedPatchSize,
+                                 InputT* const* x,
+                                 int32_t acc[4][kConvPixelTile]) {
+    const InputT* x0 = x[0];
+    const InputT* x1 = x[1];
+    const InputT* x2 = x[2];
+    const InputT* x3 = x[3];
+#ifdef __wasm_simd128__
+    // Widened to int16, eight taps per row are reduced pairwise into i32
+    // lanes by i32x4.dot_i16x8; 8-bit products cannot overflow it.
+    v128_t vacc[4][kConvPixelTile];
+    for (int i = 0; i < 4; ++i) {
+      for (int t = 0; t < kConvPixelTile; ++t) {
+        vacc[i][t] = wasm_i32x4_splat(0);
+      }
+    }
+    for (int k = 0; k < packedPatchSize; k += kConvPackedDepth) {
+      const FilterT* w = block + 4 * k;
+      const v128_t a[4] = {LoadWiden8(w), LoadWiden8(w + 8),
+                           LoadWiden8(w + 16), LoadWiden8(w + 24)};
+      const v128_t b[kConvPixelTile] = {LoadWiden8(x0 + k), LoadWiden8(x1 + k),
+                                        LoadWiden8(x2 + k), LoadWiden8(x3 + k)};
+      for (int i = 0; i < 4; ++i) {
+        for (int t = 0; t < kConvPixelTile; ++t) {
+          vacc[i][t] = wasm_i32x4_add(vacc[i][t], wasm_i32x4_dot_i16x8(a[i], b[t]));
+        }
+      }
+    }
+    for (int i = 0; i < 4; ++i) {
+      for (int t = 0; t < kConvPixelTile; ++t) {
+        acc[i][t] = HorizontalSum(vacc[i][t]);
+      }
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+      for (int t = 0; t < kConvPixelTile; ++t) {
+        acc[i][t] = 0;
+      }
+    }
+    for (int k = 0; k < packedPatchSize; k += kConvPackedDepth) {
+      const FilterT* w = block + 4 * k;
+      for (int j = 0; j < kConvPackedDepth; ++j) {
+        const int32_t a0 = w[j], a1 = w[j + 8], a2 = w[j + 16], a3 = w[j + 24];
+        const int32_t b0 = x0[k + j], b1 = x1[k + j], b2 = x2[k + j], b3 = x3[k + j];
+        acc[0][0] += a0 * b0; acc[0][1] += a0 * b1; acc[0][2] += a0 * b2; acc[0][3] += a0 * b3;
+        acc[1][0] += a1 * b0; acc[1][1] += a1 * b1; acc[1][2] += a1 * b2; acc[1][3] += a1 * b3;
+        acc[2][0] += a2 * b0; acc[2][1] += a2 * b1; acc[2][2] += a2 * b2; acc[2][3] += a2 * b3;
+        acc[3][0] += a3 * b0; acc[3][1] += a3 * b1; acc[3][2] += a3 * b2; acc[3][3] += a3 * b3;
+      }
+    }
+#endif
+  }
+
+  // Scratch bytes per thread of QuantizedConvNhwc.
+  inline size_t QuantizedConvScratchBytes(int outputDepth, int packedPatchSize, size_t inputSize) {
+    const size_t sumsBytes = (outputDepth * sizeof(int32_t) + 15) & ~size_t(15);
+    const size_t patchStride = (packedPatchSize * inputSize + 15) & ~size_t(15);
+    return sumsBytes + patchStride * kConvPixelTile;
+  }
+
+  // Quantized NHWC convolution shared by the uint8 and int8 wrappers.
+  //
+  // Output pixels are processed in tiles of kConvPixelTile. The receptive
+  // field of each pixel is gathered into a contiguous patch of
+  // K = filterHeight * filterWidth * inDepth values (an im2col row). Taps
+  // that fall into the padding are filled with -inputOffset so they add
+  // nothing to the accumulator; pixels in the interior region are gathered
+  // with whole-row copies and no bounds checks. The tile of patches is then
+  // multiplied with the packed filter by a 4x4 (channels x pixels)
+  // register-blocked micro-kernel:
+  //
+  //   sum((w + wo) * (x + xo)) = sum(w * x) + xo * sum(w) + wo * sum(x) + K * wo * xo
+  //
+  // sum(w) comes with the packed filter and sum(x) is computed once per
+  // pixel, so the inner loop is a plain 8-bit multiply-accumulate.
+  // `multiplierStride` is 0 for per-tensor and 1 for per-channel quantization.
+  template <typename InputT, typename FilterT, typename OutputT>
+  void QuantizedConvNhwc(const ConvParams& params,
+                         const int32_t* outputMultiplier,
+                         const int32_t* outputShift,
+                         int multiplierStride,
+                         const RuntimeShape& inputShape, const InputT* inputData,
+                         const RuntimeShape& filterShape,
+                         const PackedConvFilter<FilterT>& filter,
+                         const int32_t* biasData,
+                         const RuntimeShape& outputShape, OutputT* outputData) {
+    const int batches = inputShape.Dims(0);
+    const int inputHeight = inputShape.Dims(1);
+    const int inputWidth = inputShape.Dims(2);
+    const int inputDepth = inputShape.Dims(3);
+    const int filterHeight = filterShape.Dims(1);
+    const int filterWidth = filterShape.Dims(2);
+    const int outputHeight = outputShape.Dims(1);
+    const int outputWidth = outputShape.Dims(2);
+    const int outputDepth = outputShape.Dims(3);
+    const int strideWidth = params.stride_width;
+    const int strideHeight = params.stride_height;
+    const int dilationWidth = params.dilation_width_factor;
+    const int dilationHeight = params.dilation_height_factor;
+    const int padWidth = params.padding_values.width;
+    const int padHeight = params.padding_values.height;
+    const int32_t inputOffset = params.input_offset;
+    const int32_t weightsOffset = params.weights_offset;
+    const int32_t outputOffset = params.output_offset;
+    const int32_t activationMin = params.quantized_activation_min;
+    const int32_t activationMax = params.quantized_activation_max;
+    const int patchSize = filter.patchSize;
+    const int packedPatchSize = filter.packedPatchSize;
+    const int rowSize = filterWidth * inputDepth;
+
+    // Scratch layout per thread: [filterSums (int32_t, thread 0 only) |
+    // patches (kConvPixelTile x InputT[packed K])].
+    const size_t sumsBytes = (outputDepth * sizeof(int32_t) + 15) & ~size_t(15);
+    const size_t patchStride = (packedPatchSize * sizeof(InputT) + 15) & ~size_t(15);
+    WorkerPool& pool = Pool();
+    pool.ReserveScratch(
+        QuantizedConvScratchBytes(outputDepth, packedPatchSize, sizeof(InputT)));
+    int32_t* filterSums = reinterpret_cast<int32_t*>(pool.Scratch(0));
+
+    // Constant part of the expansion folded into one per-channel term.
+    for (int oc = 0; oc < outputDepth; ++oc) {
+      filterSums[oc] = filter.rowSums[oc] * inputOffset +
+                       patchSize * weightsOffset * inputOffset +
+                       (biasData ? biasData[oc] : 0);
+    }
+
+    int xBegin, xEnd, yBegin, yEnd;
+    InteriorRange(inputWidth, outputWidth, filterWidth, strideWidth,
+                  dilationWidth, padWidth, &xBegin, &xEnd);
+    InteriorRange(inputHeight, outputHeight, filterHeight, strideHeight,
+                  dilationHeight, padHeight, &yBegin, &yEnd);
+
+    // Output rows (over all batches) are split across the worker pool; each
+    // thread gathers into its own patches.
+    const InputT padValue = static_cast<InputT>(-inputOffset);
+    pool.ParallelFor(batches * outputHeight, [&](int rowBegin, int rowEnd, int thread) {
+      char* scratch = pool.Scratch(thread) + sumsBytes;
+      InputT* patches[kConvPixelTile];
+      for (int t = 0; t < kConvPixelTile; ++t) {
+        patches[t] = reinterpret_cast<InputT*>(scratch + t * patchStride);
+        // The padding taps meet zero weights; keep them defined anyway.
+        std::fill(patches[t] + patchSize, patches[t] + packedPatchSize, InputT(0));
+      }
+      for (int row = rowBegin; row < rowEnd; ++row) {
+        const int b = row / outputHeight;
+        const int outY = row % outputHeight;
+        const InputT* inputBase = inputData + b * inputHeight * inputWidth * inputDepth;
+        OutputT* outputBase = outputData + b * outputHeight * outputWidth * outputDepth;
+        const int inYOrigin = outY * strideHeight - padHeight;
+        const bool rowInterior = outY >= yBegin && outY < yEnd;
+        for (int outX = 0; outX < outputWidth; outX += kConvPixelTile) {
+          const int tile = std::min(kConvPixelTile, outputWidth - outX);
+          int32_t pixelTerms[kConvPixelTile];
+
+          for (int t = 0; t < tile; ++t) {
+            const int inXOrigin = (outX + t) * strideWidth - padWidth;
+            InputT* dst = patches[t];
+            if (rowInterior && outX + t >= xBegin && outX + t < xEnd) {
+              for (int fy = 0; fy < filterHeight; ++fy) {
+                const InputT* src = inputBase +
+                    ((inYOrigin + dilationHeight * fy) * inputWidth + inXOrigin) * inputDepth;
+                if (dilationWidth == 1) {
+                  memcpy(dst, src, rowSize * sizeof(InputT));
+                } else {
+                  for (int fx = 0; fx < filterWidth; ++fx) {
+                    memcpy(dst + fx * inputDepth, src + fx * dilationWidth * inputDepth,
+                           inputDepth * sizeof(InputT));
+                  }
+                }
+                dst += rowSize;
+              }
+            } else {
+              for (int fy = 0; fy < filterHeight; ++fy) {
+                const int inY = inYOrigin + dilationHeight * fy;
+                const bool rowInside = inY >= 0 && inY < inputHeight;
+                for (int fx = 0; fx < filterWidth; ++fx) {
+                  const int inX = inXOrigin + dilationWidth * fx;
+                  if (rowInside && inX >= 0 && inX < inputWidth) {
+                    memcpy(dst, inputBase + (inY * inputWidth + inX) * inputDepth,
+                           inputDepth * sizeof(InputT));
+                  } else {
+                    std::fill(dst, dst + inputDepth, padValue);
+                  }
+                  dst += inputDepth;
+                }
+              }
+            }
+            int32_t patchSum = 0;
+            for (int k = 0; k < patchSize; ++k) {
+              patchSum += patches[t][k];
+            }
+            pixelTerms[t] = weightsOffset * patchSum;
+          }
+          // Partial tiles reuse the first patch; their results are dropped.
+          for (int t = tile; t < kConvPixelTile; ++t) {
+            patches[t] = patches[0];
+          }
+
+          OutputT* outPtr = outputBase + (outY * outputWidth + outX) * outputDepth;
+          for (int oc = 0; oc < outputDepth; oc += 4) {
+            int32_t acc[4][kConvPixelTile];
+            ConvMicroKernel4x4(filter.data.data() + oc * packedPatchSize, packedPatchSize,
+                               patches, acc);
+            // Rows past outputDepth are padding.
+            const int count = std::min(4, outputDepth - oc);
+            for (int i = 0; i < count; ++i) {
+              const int c = oc + i;
+              const int32_t multiplier = outputMultiplier[c * multiplierStride];
+              const int32_t shift = outputShift[c * multiplierStride];
+              for (int t = 0; t < tile; ++t) {
+                outPtr[t * outputDepth + c] = RequantizeAccumulator<OutputT>(
+                    acc[i][t] + filterSums[c] + pixelTerms[t],
+                    multiplier, shift, outputOffset, activationMin, activationMax);
+              }
+            }
+          }
+          for (int t = 0; t < kConvPixelTile; ++t) {
+            patches[t] = reinterpret_cast<InputT*>(scratch + t * patchStride);
+          }
+        }
+      }
+    });
+  }
+
+  template <typename FilterT>
+  void PackDepthwiseFilter(const RuntimeShape& filterShape, const FilterT* filterData,
+                           int32_t weightsOffset, PackedDepthwiseFilter* packed) {
+    const int size = filterShape.FlatSize();
+    packed->weightsOffset = weightsOffset;
+    if (size_t(size) > packed->taps.capacity()) {
+      Pool().CountAllocation();
+    }
+    packed->taps.resize(size);
+    for (int i = 0; i < size; ++i) {
+      packed->taps[i] = static_cast<int16_t>(filterData[i] + weightsOffset);
+    }
+  }
+
+  // Accumulate one packed filter tap of a depthwise convolution into `acc`.
+  template <typename InputT>
+  inline void DepthwiseAccumulateTap(const InputT* in, const int16_t* w,
+                                     int inputDepth, int depthMultiplier,
+                                     int32_t inputOffset, int32_t* acc) {
+    if (depthMultiplier == 1) {
+      int c = 0;
+#ifdef __wasm_simd128__
+      // (w + wo) and (x + xo) both fit in int16, so eight channels are
+      // multiplied in i16 lanes into two i32x4 halves.
+      const v128_t inputOffsetVec = wasm_i16x8_splat(inputOffset);
+      for (; c + 8 <= inputDepth; c += 8) {
+        const v128_t w16 = wasm_v128_load(w + c);
+        const v128_t x16 = wasm_i16x8_add(LoadWiden8(in + c), inputOffsetVec);
+        wasm_v128_store(acc + c, wasm_i32x4_add(wasm_v128_load(acc + c),
+                                                wasm_i32x4_extmul_low_i16x8(w16, x16)));
+        wasm_v128_store(acc + c + 4, wasm_i32x4_add(wasm_v128_load(acc + c + 4),
+                                                    wasm_i32x4_extmul_high_i16x8(w16, x16)));
+      }
+#endif
+      for (; c < inputDepth; ++c) {
+        acc[c] += w[c] * (static_cast<int32_t>(in[c]) + inputOffset);
+      }
+    } else {
+      for (int ic = 0; ic < inputDepth; ++ic) {
+        const int32_t x = static_cast<int32_t>(in[ic]) + inputOffset;
+        for (int m = 0; m < depthMultiplier; ++m) {
+          const int oc = ic * depthMultiplier + m;
+          acc[oc] += w[oc] * x;
+        }
+      }
+    }
+  }
+
+  DepthwiseKernel SelectDepthwiseKernel(const DepthwiseParams& params,
+                                        const RuntimeShape& filterShape) {
+    if (filterShape.Dims(1) != 3 || filterShape.Dims(2) != 3 || params.depth_multiplier != 1 ||
+        params.dilation_width_factor != 1 || params.dilation_height_factor != 1 ||
+        params.stride_width != params.stride_height) {
+      return kDepthwiseGeneric;
+    }
+    if (params.stride_width == 1) {
+      return kDepthwise3x3Stride1;
+    }
+    return params.stride_width == 2 ? kDepthwise3x3Stride2 : kDepthwiseGeneric;
+  }
+
+  // `count` interior output pixels of one row of a 3x3 depthwise conv with
+  // depth multiplier 1, `in` pointing at the top-left tap of the first one.
+  // Each block of channels goes through all nine taps in registers and is
+  // requantized right away, so nothing round-trips through an accumulator
+  // row; the tap offsets and the step between pixels are constants.
+  template <int Stride, typename InputT, typename OutputT>
+  void QuantizedDepthwise3x3Row(const InputT* in, int inputWidth, int depth,
+                                const int16_t* taps, const int32_t* biasData,
+                                const int32_t* outputMultiplier, const int32_t* outputShift,
+                                int multiplierStride, int32_t inputOffset, int32_t outputOffset,
+                                int32_t activationMin, int32_t activationMax,
+                                int count, OutputT* out) {
+    const int rowStride = inputWidth * depth;
+    for (int x = 0; x < count; ++x, in += Stride * depth, out += depth) {
+      int c = 0;
+#ifdef __wasm_simd128__
+      const v128_t inputOffsetVec = wasm_i16x8_splat(inputOffset);
+      for (; c + 8 <= depth; c += 8) {
+        v128_t lo = biasData ? wasm_v128_load(biasData + c) : wasm_i32x4_splat(0);
+        v128_t hi = biasData ? wasm_v128_load(biasData + c + 4) : wasm_i32x4_splat(0);
+        for (int fy = 0; fy < 3; ++fy) {
+          for (int fx = 0; fx < 3; ++fx) {
+            const v128_t w16 = wasm_v128_load(taps + (fy * 3 + fx) * depth + c);
+            const v128_t x16 = wasm_i16x8_add(LoadWiden8(in + fy * rowStride + fx * depth + c),
+                                              inputOffsetVec);
+            lo = wasm_i32x4_add(lo, wasm_i32x4_extmul_low_i16x8(w16, x16));
+            hi = wasm_i32x4_add(hi, wasm_i32x4_extmul_high_i16x8(w16, x16));
+          }
+        }
+        int32_t acc[8];
+        wasm_v128_store(acc, lo);
+        wasm_v128_store(acc + 4, hi);
+        for (int k = 0; k < 8; ++k) {
+          out[c + k] = RequantizeAccumulator<OutputT>(
+              acc[k], outputMultiplier[(c + k) * multiplierStride],
+              outputShift[(c + k) * multiplierStride],
+              outputOffset, activationMin, activationMax);
+        }
+      }
+#endif
+      for (; c < depth; ++c) {
+        int32_t acc = biasData ? biasData[c] : 0;
+        for (int fy = 0; fy < 3; ++fy) {
+          for (int fx = 0; fx < 3; ++fx) {
+            acc += taps[(fy * 3 + fx) * depth + c] *
+                   (static_cast<int32_t>(in[fy * rowStride + fx * depth + c]) + inputOffset);
+          }
+        }
+        out[c] = RequantizeAccumulator<OutputT>(
+            acc, outputMultiplier[c * multiplierStride], outputShift[c * multiplierStride],
+            outputOffset, activationMin, activationMax);
+      }
+    }
+  }
+
+  // Quantized NHWC depthwise convolution shared by the uint8 and int8
+  // wrappers. The loops walk output pixel -> filter tap -> channel so the
+  // channel loop runs over contiguous input, filter and accumulator rows.
+  // Pixels in the interior region skip the bounds checks entirely; border
+  // pixels check once per tap. With a specialized `kernel`, runs of interior
+  // pixels go to its QuantizedDepthwise3x3Row instead.
+  template <typename InputT, typename OutputT>
+  void QuantizedDepthwiseConvNhwc(const DepthwiseParams& params,
+                                  DepthwiseKernel kernel,
+                                  const int32_t* outputMultiplier,
+                                  const int32_t* outputShift,
+                                  int multiplierStride,
+                                  const RuntimeShape& inputShape, const InputT* inputData,
+                                  const RuntimeShape& filterShape,
+                                  const PackedDepthwiseFilter& filter,
+                                  const int32_t* biasData,
+                                  const RuntimeShape& outputShape, OutputT* outputData) {
+    const int batches = inputShape.Dims(0);
+    const int inputHeight = inputShape.Dims(1);
+    const int inputWidth = inputShape.Dims(2);
+    const int inputDepth = inputShape.Dims(3);
+    const int filterHeight = filterShape.Dims(1);
+    const int filterWidth = filterShape.Dims(2);
+    const int outputHeight = outputShape.Dims(1);
+    const int outputWidth = outputShape.Dims(2);
+    const int outputDepth = outputShape.Dims(3);
+    const int depthMultiplier = params.depth_multiplier;
+    const int strideWidth = params.stride_width;
+    const int strideHeight = params.stride_height;
+    const int dilationWidth = params.dilation_width_factor;
+    const int dilationHeight = params.dilation_height_factor;
+    const int padWidth = params.padding_values.width;
+    const int padHeight = params.padding_values.height;
+    const int32_t inputOffset = params.input_offset;
+    const int32_t outputOffset = params.output_offset;
+    const int32_t activationMin = params.quantized_activation_min;
+    const int32_t activationMax = params.quantized_activation_max;
+    const int16_t* filterData = filter.taps.data();
+    if (filter.weightsOffset != params.weights_offset) {
+      throw std::string("DepthwiseConv filter was packed with another weights offset");
+    }
+
+    WorkerPool& pool = Pool();
+    pool.ReserveScratch(outputDepth * sizeof(int32_t));
+
+    int xBegin, xEnd, yBegin, yEnd;
+    InteriorRange(inputWidth, outputWidth, filterWidth, strideWidth,
+                  dilationWidth, padWidth, &xBegin, &xEnd);
+    InteriorRange(inputHeight, outputHeight, filterHeight, strideHeight,
+                  dilationHeight, padHeight, &yBegin, &yEnd);
+
+    typedef void (*InteriorRow)(const InputT*, int, int, const int16_t*, const int32_t*,
+                                const int32_t*, const int32_t*, int, int32_t, int32_t,
+                                int32_t, int32_t, int, OutputT*);
+    static const InteriorRow kInteriorRows[] = {
+      nullptr,
+      &QuantizedDepthwise3x3Row<1, InputT, OutputT>,
+      &QuantizedDepthwise3x3Row<2, InputT, OutputT>,
+    };
+    const InteriorRow interiorRow = kInteriorRows[kernel];
+
+    // Output rows (over all batches) are split across the worker pool; each
+    // thread accumulates into its own row of `acc`.
+    pool.ParallelFor(batches * outputHeight, [&](int rowBegin, int rowEnd, int thread) {
+      int32_t* acc = reinterpret_cast<int32_t*>(pool.Scratch(thread));
+      OutputT* outPtr = outputData + rowBegin * outputWidth * outputDepth;
+      for (int row = rowBegin; row < rowEnd; ++row) {
+        const int b = row / outputHeight;
+        const int outY = row % outputHeight;
+        const InputT* inputBase = inputData + b * inputHeight * inputWidth * inputDepth;
+        const int inYOrigin = outY * strideHeight - padHeight;
+        const bool rowInterior = outY >= yBegin && outY < yEnd;
+        for (int outX = 0; outX < outputWidth; ++outX) {
+          const int inXOrigin = outX * strideWidth - padWidth;
+          if (interiorRow && rowInterior && outX == xBegin && xEnd > xBegin) {
+            interiorRow(inputBase + (inYOrigin * inputWidth + inXOrigin) * inputDepth,
+                        inputWidth, inputDepth, filterData, biasData,
+                        outputMultiplier, outputShift, multiplierStride,
+                        inputOffset, outputOffset, activationMin, activationMax,
+                        xEnd - xBegin, outPtr);
+            outPtr += (xEnd - xBegin) * outputDepth;
+            outX = xEnd - 1;
+            continue;
+          }
+          for (int oc = 0; oc < outputDepth; ++oc) {
+            acc[oc] = biasData ? biasData[oc] : 0;
+          }
+          if (rowInterior && outX >= xBegin && outX < xEnd) {
+            for (int fy = 0; fy < filterHeight; ++fy) {
+              const InputT* in = inputBase +
+                  ((inYOrigin + dilationHeight * fy) * inputWidth + inXOrigin) * inputDepth;
+              const int16_t* w = filterData + fy * filterWidth * outputDepth;
+              for (int fx = 0; fx < filterWidth; ++fx) {
+                DepthwiseAccumulateTap(in + fx * dilationWidth * inputDepth,
+                                       w + fx * outputDepth,
+                                       inputDepth, depthMultiplier,
+                                       inputOffset, acc);
+              }
+            }
+          } else {
+            for (int fy = 0; fy < filterHeight; ++fy) {
+              const int inY = inYOrigin + dilationHeight * fy;
+              if (inY < 0 || inY >= inputHeight) {
+                continue;
+              }
+              for (int fx = 0; fx < filterWidth; ++fx) {
+                const int inX = inXOrigin + dilationWidth * fx;
+                if (inX < 0 || inX >= inputWidth) {
+                  continue;
+                }
+                DepthwiseAccumulateTap(inputBase + (inY * inputWidth + inX) * inputDepth,
+                                       filterData + (fy * filterWidth + fx) * outputDepth,
+                                       inputDepth, depthMultiplier,
+                                       inputOffset, acc);
+              }
+            }
+          }
+          for (int oc = 0; oc < outputDepth; ++oc) {
+            outPtr[oc] = RequantizeAccumulator<OutputT>(
+                acc[oc], outputMultiplier[oc * multiplierStride],
+                outputShift[oc * multiplierStride],
+                outputOffset, activationMin, activationMax);
+          }
+          outPtr += outputDepth;
+        }
+      }
+    });
+  }
+
+  // Float counterpart of QuantizedDepthwise3x3Row: blocks of channels go
+  // through the nine taps in registers, get the bias and are clamped.
+  template <int Stride>
+  void FloatDepthwise3x3Row(const float* in, int inputWidth, int depth,
+                            const float* filterData, const float* biasData,
+                            float activationMin, float activationMax,
+                            int count, float* out) {
+    const int rowStride = inputWidth * depth;
+    for (int x = 0; x < count; ++x, in += Stride * depth, out += depth) {
+      int c = 0;
+#ifdef __wasm_simd128__
+      const v128_t minVec = wasm_f32x4_splat(activationMin);
+      const v128_t maxVec = wasm_f32x4_splat(activationMax);
+      for (; c + 8 <= depth; c += 8) {
+        v128_t lo = biasData ? wasm_v128_load(biasData + c) : wasm_f32x4_splat(0.f);
+        v128_t hi = biasData ? wasm_v128_load(biasData + c + 4) : wasm_f32x4_splat(0.f);
+        for (int fy = 0; fy < 3; ++fy) {
+          for (int fx = 0; fx < 3; ++fx) {
+            const float* w = filterData + (fy * 3 + fx) * depth + c;
+            const float* x0 = in + fy * rowStride + fx * depth + c;
+            lo = wasm_f32x4_add(lo, wasm_f32x4_mul(wasm_v128_load(w), wasm_v128_load(x0)));
+            hi = wasm_f32x4_add(hi, wasm_f32x4_mul(wasm_v128_load(w + 4), wasm_v128_load(x0 + 4)));
+          }
+        }
+        wasm_v128_store(out + c, wasm_f32x4_min(wasm_f32x4_max(lo, minVec), maxVec));
+        wasm_v128_store(out + c + 4, wasm_f32x4_min(wasm_f32x4_max(hi, minVec), maxVec));
+      }
+#endif
+      for (; c < depth; ++c) {
+        float acc = biasData ? biasData[c] : 0.f;
+        for (int fy = 0; fy < 3; ++fy) {
+          for (int fx = 0; fx < 3; ++fx) {
+            acc += filterData[(fy * 3 + fx) * depth + c] * in[fy * rowStride + fx * depth + c];
+          }
+        }
+        out[c] = std::min(std::max(acc, activationMin), activationMax);
+      }
+    }
+  }
+
+  // Float NHWC depthwise convolution for the specialized kernels only; the
+  // generic layers stay on optimized_ops::DepthwiseConv. Laid out like
+  // QuantizedDepthwiseConvNhwc: interior runs go to FloatDepthwise3x3Row,
+  // border pixels accumulate the taps inside the input into a row of `acc`.
+  void FloatDepthwiseConvNhwc(const DepthwiseParams& params, DepthwiseKernel kernel,
+                              const RuntimeShape& inputShape, const float* inputData,
+                              const float* filterData, const float* biasData,
+                              const RuntimeShape& outputShape, float* outputData) {
+    const int batches = inputShape.Dims(0);
+    const int inputHeight = inputShape.Dims(1);
+    const int inputWidth = inputShape.Dims(2);
+    const int depth = inputShape.Dims(3);
+    const int outputHeight = outputShape.Dims(1);
+    const int outputWidth = outputShape.Dims(2);
+    const int stride = kernel == kDepthwise3x3Stride1 ? 1 : 2;
+    const int padWidth = params.padding_values.width;
+    const int padHeight = params.padding_values.height;
+    const float activationMin = params.float_activation_min;
+    const float activationMax = params.float_activation_max;
+    if (kernel == kDepthwiseGeneric || outputShape.Dims(3) != depth) {
+      throw std::string("DepthwiseConv has no specialized float kernel for this layer");
+    }
+
+    WorkerPool& pool = Pool();
+    pool.ReserveScratch(depth * sizeof(float));
+
+    int xBegin, xEnd, yBegin, yEnd;
+    InteriorRange(inputWidth, outputWidth, 3, stride, 1, padWidth, &xBegin, &xEnd);
+    InteriorRange(inputHeight, outputHeight, 3, stride, 1, padHeight, &yBegin, &yEnd);
+    const auto interiorRow = kernel == kDepthwise3x3Stride1 ? &FloatDepthwise3x3Row<1>
+                                                            : &FloatDepthwise3x3Row<2>;
+
+    pool.ParallelFor(batches * outputHeight, [&](int rowBegin, int rowEnd, int thread) {
+      float* acc = reinterpret_cast<float*>(pool.Scratch(thread));
+      float* outPtr = outputData + rowBegin * outputWidth * depth;
+      for (int row = rowBegin; row < rowEnd; ++row) {
+        const int b = row / outputHeight;
+        const int outY = row % outputHeight;
+        const float* inputBase = inputData + b * inputHeight * inputWidth * depth;
+        const int inYOrigin = outY * stride - padHeight;
+        const bool rowInterior = outY >= yBegin && outY < yEnd;
+        for (int outX = 0; outX < outputWidth; ++outX) {
+          const int inXOrigin = outX * stride - padWidth;
+          if (rowInterior && outX == xBegin && xEnd > xBegin) {
+            interiorRow(inputBase + (inYOrigin * inputWidth + inXOrigin) * depth,
+                        inputWidth, depth, filterData, biasData,
+                        activationMin, activationMax, xEnd - xBegin, outPtr);
+            outPtr += (xEnd - xBegin) * depth;
+            outX = xEnd - 1;
+            continue;
+          }
+          for (int c = 0; c < depth; ++c) {
+            acc[c] = biasData ? biasData[c] : 0.f;
+          }
+          for (int fy = 0; fy < 3; ++fy) {
+            const int inY = inYOrigin + fy;
+            if (inY < 0 || inY >= inputHeight) {
+              continue;
+            }
+            for (int fx = 0; fx < 3; ++fx) {
+              const int inX = inXOrigin + fx;
+              if (inX < 0 || inX >= inputWidth) {
+                continue;
+              }
+              const float* in = inputBase + (inY * inputWidth + inX) * depth;
+              const float* w = filterData + (fy * 3 + fx) * depth;
+              for (int c = 0; c < depth; ++c) {
+                acc[c] += w[c] * in[c];
+              }
+            }
+          }
+          for (int c = 0; c < depth; ++c) {
+            outPtr[c] = std::min(std::max(acc[c], activationMin), activationMax);
+          }
+          outPtr += depth;
+        }
+      }
+    });
+  }
+
+  // Winograd F(m x m, 3x3) convolution (Lavin & Gray, "Fast Algorithms for
+  // Convolutional Neural Networks"). Every tile of alpha x alpha input pixels,
+  // alpha = m + 2, is transformed to V = B^T d B, multiplied per position with
+  // the filter transformed to U = G g G^T and transformed back to the m x m
+  // outputs Y = A^T (U . V) A. The 9 multiplies per output and channel pair
+  // of a direct 3x3 conv drop to alpha^2 / m^2: 4 for F(2x2, 3x3) and 2.25
+  // for F(4x4, 3x3), whose points 0, +-1, +-2 keep the float error small.
+  constexpr int kWinogradMaxAlpha = 6;
+
+  const float kWinogradBt2[4 * 4] = {
+    1, 0, -1, 0,
+    0, 1, 1, 0,
+    0, -1, 1, 0,
+    0, 1, 0, -1,
+  };
+  const float kWinogradG2[4 * 3] = {
+    1, 0, 0,
+    0.5f, 0.5f, 0.5f,
+    0.5f, -0.5f, 0.5f,
+    0, 0, 1,
+  };
+  const float kWinogradAt2[2 * 4] = {
+    1, 1, 1, 0,
+    0, 1, -1, -1,
+  };
+
+  const float kWinogradBt4[6 * 6] = {
+    4, 0, -5, 0, 1, 0,
+    0, -4, -4, 1, 1, 0,
+    0, 4, -4, -1, 1, 0,
+    0, -2, -1, 2, 1, 0,
+    0, 2, -1, -2, 1, 0,
+    0, 4, 0, -5, 0, 1,
+  };
+  const float kWinogradG4[6 * 3] = {
+    1 / 4.f, 0, 0,
+    -1 / 6.f, -1 / 6.f, -1 / 6.f,
+    -1 / 6.f, 1 / 6.f, -1 / 6.f,
+    1 / 24.f, 1 / 12.f, 1 / 6.f,
+    1 / 24.f, -1 / 12.f, 1 / 6.f,
+    0, 0, 1,
+  };
+  const float kWinogradAt4[4 * 6] = {
+    1, 1, 1, 1, 1, 0,
+    0, 1, -1, 2, -2, 0,
+    0, 1, 1, 4, 4, 0,
+    0, 1, -1, 8, -8, 1,
+  };
+
+  // Input and output channels from which the transforms cost less than the
+  // multiplies they save: the per-tile input and output transforms are
+  // amortized over a [tiles x inputDepth] by [inputDepth x outputDepth]
+  // product, which only dominates with enough channels. The /cutoff/ cases
+  // of nn_ops_bench put the crossover with im2col between 12 and 16.
+  constexpr int kWinogradMinChannels = 16;
+
+  // Tiles transformed together; every position of the transformed filter is
+  // read once per block and applied to all of them.
+  constexpr int kWinogradTileBlock = 16;
+
+  struct WinogradTransform {
+    int alpha;
+    const float* bt;
+    const float* g;
+    const float* at;
+  };
+
+  inline WinogradTransform GetWinogradTransform(int tile) {
+    if (tile == 2) {
+      return WinogradTransform{4, kWinogradBt2, kWinogradG2, kWinogradAt2};
+    }
+    return WinogradTransform{6, kWinogradBt4, kWinogradG4, kWinogradAt4};
+  }
+
+  // Output tile of the Winograd path for a float conv, 0 if it does not
+  // apply: 3x3 filters, stride and dilation 1, kWinogradMinChannels input
+  // and output channels. F(4x4, 3x3) is used once the output is 8 pixels
+  // wide and high; smaller maps would waste most of its tiles.
+  int WinogradTileSize(const ConvParams& params, const RuntimeShape& inputShape,
+                       const RuntimeShape& filterShape, const RuntimeShape& outputShape) {
+    if (filterShape.Dims(1) != 3 || filterShape.Dims(2) != 3 ||
+        params.stride_height != 1 || params.stride_width != 1 ||
+        params.dilation_height_factor != 1 || params.dilation_width_factor != 1 ||
+        inputShape.Dims(3) < kWinogradMinChannels || filterShape.Dims(0) < kWinogradMinChannels) {
+      return 0;
+    }
+    return outputShape.Dims(1) >= 8 && outputShape.Dims(2) >= 8 ? 4 : 2;
+  }
+
+  void TransformWinogradFilter(const RuntimeShape& filterShape, const float* filterData,
+                               int tile, WinogradFilter* transformed) {
+    const WinogradTransform w = GetWinogradTransform(tile);
+    const int alpha = w.alpha;
+    const int outputDepth = filterShape.Dims(0);
+    const int inputDepth = filterShape.Dims(3);
+    const size_t size = size_t(alpha) * alpha * inputDepth * outputDepth;
+    transformed->tile = tile;
+    transformed->inputDepth = inputDepth;
+    transformed->outputDepth = outputDepth;
+    if (size > transformed->data.capacity()) {
+      Pool().CountAllocation();
+    }
+    transformed->data.resize(size);
+    // Output channels innermost, so the stores stream through each matrix.
+    for (int ic = 0; ic < inputDepth; ++ic) {
+      for (int oc = 0; oc < outputDepth; ++oc) {
+        const float* g = filterData + oc * 9 * inputDepth + ic;
+        // G g, then (G g) G^T.
+        float rows[kWinogradMaxAlpha][3];
+        for (int i = 0; i < alpha; ++i) {
+          for (int j = 0; j < 3; ++j) {
+            rows[i][j] = w.g[i * 3] * g[j * inputDepth] +
+                         w.g[i * 3 + 1] * g[(3 + j) * inputDepth] +
+                         w.g[i * 3 + 2] * g[(6 + j) * inputDepth];
+          }
+        }
+        for (int i = 0; i < alpha; ++i) {
+          for (int j = 0; j < alpha; ++j) {
+            const float u = rows[i][0] * w.g[j * 3] + rows[i][1] * w.g[j * 3 + 1] +
+                            rows[i][2] * w.g[j * 3 + 2];
+            transformed->data[(size_t(i * alpha + j) * inputDepth + ic) * outputDepth + oc] = u;
+          }
+        }
+      }
+    }
+  }
+
+  // Scratch bytes per thread of WinogradConvNhwc.
+  inline size_t WinogradScratchBytes(int tile, int inputDepth, int outputDepth) {
+    const size_t positions = (tile + 2) * (tile + 2);
+    return sizeof(float) * (positions * kWinogradTileBlock * (inputDepth + outputDepth) +
+                            2 * positions * inputDepth + (tile * (tile + 2) + 1) * outputDepth);
+  }
+
+  // y[0, n) += a * x[0, n).
+  inline void WinogradAxpy(float a, const float* x, float* y, int n) {
+    int i = 0;
+#ifdef __wasm_simd128__
+    const v128_t va = wasm_f32x4_splat(a);
+    for (; i + 4 <= n; i += 4) {
+      wasm_v128_store(y + i, wasm_f32x4_add(wasm_v128_load(y + i),
+                                            wasm_f32x4_mul(va, wasm_v128_load(x + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+      y[i] += a * x[i];
+    }
+  }
+
+  // c[t][j] = sum_k a[t][k] * b[k][j] for the four tiles t of one group of
+  // the per-position product, where `b` is depth x n and rows of `a` and
+  // `c` may repeat. The accumulators of four tiles and a few output
+  // channels stay in registers, so every row of `b` is loaded once per group.
+  inline void WinogradGemm4(const float* const* a, const float* b, int depth, int n,
+                            float* const* c) {
+    int j = 0;
+#ifdef __wasm_simd128__
+    for (; j + 8 <= n; j += 8) {
+      v128_t acc[4][2];
+      for (int t = 0; t < 4; ++t) {
+        acc[t][0] = acc[t][1] = wasm_f32x4_splat(0.f);
+      }
+      for (int k = 0; k < depth; ++k) {
+        const v128_t b0 = wasm_v128_load(b + k * n + j);
+        const v128_t b1 = wasm_v128_load(b + k * n + j + 4);
+        for (int t = 0; t < 4; ++t) {
+          const v128_t at = wasm_f32x4_splat(a[t][k]);
+          acc[t][0] = wasm_f32x4_add(acc[t][0], wasm_f32x4_mul(at, b0));
+          acc[t][1] = wasm_f32x4_add(acc[t][1], wasm_f32x4_mul(at, b1));
+        }
+      }
+      for (int t = 0; t < 4; ++t) {
+        wasm_v128_store(c[t] + j, acc[t][0]);
+        wasm_v128_store(c[t] + j + 4, acc[t][1]);
+      }
+    }
+#else
+    for (; j + 4 <= n; j += 4) {
+      float acc[4][4] = {};
+      for (int k = 0; k < depth; ++k) {
+        const float* bk = b + k * n + j;
+        for (int t = 0; t < 4; ++t) {
+          const float at = a[t][k];
+          acc[t][0] += at * bk[0];
+          acc[t][1] += at * bk[1];
+          acc[t][2] += at * bk[2];
+          acc[t][3] += at * bk[3];
+        }
+      }
+      for (int t = 0; t < 4; ++t) {
+        std::copy(acc[t], acc[t] + 4, c[t] + j);
+      }
+    }
+#endif
+    for (; j < n; ++j) {
+      float acc[4] = {};
+      for (int k = 0; k < depth; ++k) {
+        for (int t = 0; t < 4; ++t) {
+          acc[t] += a[t][k] * b[k * n + j];
+        }
+      }
+      for (int t = 0; t < 4; ++t) {
+        c[t][j] = acc[t];
+      }
+    }
+  }
+
+  // dst(i, j) = sum_k mat[i][k] * src(k, j) for an r x n matrix, where
+  // (i, j) addresses a row of `depth` channels (i * cols + j) * stride floats
+  // from the base.
+  inline void WinogradMultiplyLeft(const float* mat, int r, int n, int cols, int depth,
+                                   const float* src, int srcStride, float* dst, int dstStride) {
+    for (int i = 0; i < r; ++i) {
+      for (int j = 0; j < cols; ++j) {
+        float* out = dst + (i * cols + j) * dstStride;
+        std::fill(out, out + depth, 0.f);
+        for (int k = 0; k < n; ++k) {
+          if (mat[i * n + k] != 0) {
+            WinogradAxpy(mat[i * n + k], src + (k * cols + j) * srcStride, out, depth);
+          }
+        }
+      }
+    }
+  }
+
+  // dst(i, j) = sum_k src(i, k) * mat[j][k], i.e. the product with the
+  // transpose of an r x n matrix, addressed as in WinogradMultiplyLeft.
+  inline void WinogradMultiplyRight(const float* mat, int r, int n, int rows, int depth,
+                                    const float* src, int srcStride, float* dst, int dstStride) {
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < r; ++j) {
+        float* out = dst + (i * r + j) * dstStride;
+        std::fill(out, out + depth, 0.f);
+        for (int k = 0; k < n; ++k) {
+          if (mat[j * n + k] != 0) {
+            WinogradAxpy(mat[j * n + k], src + (i * n + k) * srcStride, out, depth);
+          }
+        }
+      }
+    }
+  }
+
+  // Float NHWC 3x3 stride 1 convolution on a filter transformed by
+  // TransformWinogradFilter. Output tiles over all batches are processed in
+  // blocks of kWinogradTileBlock, split across the worker pool: each thread
+  // gathers and transforms the input tiles of its block, multiplies them
+  // with the filter one position at a time (a [tiles x inputDepth] by
+  // [inputDepth x outputDepth] product) and transforms the results back,
+  // adding the bias and clamping while storing the pixels inside the output.
+  void WinogradConvNhwc(const ConvParams& params,
+                        const RuntimeShape& inputShape, const float* inputData,
+                        const WinogradFilter& filter, const float* biasData,
+                        const RuntimeShape& outputShape, float* outputData) {
+    const int batches = inputShape.Dims(0);
+    const int inputHeight = inputShape.Dims(1);
+    const int inputWidth = inputShape.Dims(2);
+    const int inputDepth = inputShape.Dims(3);
+    const int outputHeight = outputShape.Dims(1);
+    const int outputWidth = outputShape.Dims(2);
+    const int outputDepth = outputShape.Dims(3);
+    if (filter.inputDepth != inputDepth || filter.outputDepth != outputDepth) {
+      throw std::string("Conv filter was transformed for other channels");
+    }
+    const int padHeight = params.padding_values.height;
+    const int padWidth = params.padding_values.width;
+    const float activationMin = params.float_activation_min;
+    const float activationMax = params.float_activation_max;
+    const int m = filter.tile;
+    const WinogradTransform w = GetWinogradTransform(m);
+    const int alpha = w.alpha;
+    const int positions = alpha * alpha;
+    const int tilesY = (outputHeight + m - 1) / m;
+    const int tilesX = (outputWidth + m - 1) / m;
+    const int tiles = batches * tilesY * tilesX;
+    const int blocks = (tiles + kWinogradTileBlock - 1) / kWinogradTileBlock;
+    const float* transformedFilter = filter.data.data();
+
+    WorkerPool& pool = Pool();
+    pool.ReserveScratch(WinogradScratchBytes(m, inputDepth, outputDepth));
+    pool.ParallelFor(blocks, [&](int blockBegin, int blockEnd, int thread) {
+      // Scratch layout per thread: [V (positions x block x inputDepth) |
+      // products (positions x block x outputDepth) | input tile and its row
+      // transform (positions x inputDepth each) | row transform of one output
+      // tile (m x alpha x outputDepth) | one output pixel].
+      float* v = reinterpret_cast<float*>(pool.Scratch(thread));
+      float* products = v + positions * kWinogradTileBlock * inputDepth;
+      float* patch = products + positions * kWinogradTileBlock * outputDepth;
+      float* patchRows = patch + positions * inputDepth;
+      float* outputRows = patchRows + positions * inputDepth;
+      float* pixel = outputRows + m * alpha * outputDepth;
+      for (int block = blockBegin; block < blockEnd; ++block) {
+        const int first = block * kWinogradTileBlock;
+        const int count = std::min(kWinogradTileBlock, tiles - first);
+
+        for (int t = 0; t < count; ++t) {
+          const int b = (first + t) / (tilesY * tilesX);
+          const int tileY = (first + t) / tilesX % tilesY;
+          const int tileX = (first + t) % tilesX;
+          const float* inputBase = inputData + b * inputHeight * inputWidth * inputDepth;
+          for (int i = 0; i < alpha; ++i) {
+            const int inY = tileY * m - padHeight + i;
+            for (int j = 0; j < alpha; ++j) {
+              const int inX = tileX * m - padWidth + j;
+              float* dst = patch + (i * alpha + j) * inputDepth;
+              if (inY >= 0 && inY < inputHeight && inX >= 0 && inX < inputWidth) {
+                memcpy(dst, inputBase + (inY * inputWidth + inX) * inputDepth,
+                       inputDepth * sizeof(float));
+              } else {
+                std::fill(dst, dst + inputDepth, 0.f);
+              }
+            }
+          }
+          WinogradMultiplyLeft(w.bt, alpha, alpha, alpha, inputDepth,
+                               patch, inputDepth, patchRows, inputDepth);
+          WinogradMultiplyRight(w.bt, alpha, alpha, alpha, inputDepth,
+                                patchRows, inputDepth, v + t * inputDepth,
+                                kWinogradTileBlock * inputDepth);
+        }
+
+        for (int p = 0; p < positions; ++p) {
+          const float* u = transformedFilter + size_t(p) * inputDepth * outputDepth;
+          const float* vp = v + p * kWinogradTileBlock * inputDepth;
+          float* product = products + p * kWinogradTileBlock * outputDepth;
+          for (int t = 0; t < count; t += 4) {
+            // A short last group repeats its first tile.
+            const float* a[4];
+            float* c[4];
+            for (int k = 0; k < 4; ++k) {
+              const int tile = t + k < count ? t + k : t;
+              a[k] = vp + tile * inputDepth;
+              c[k] = product + tile * outputDepth;
+            }
+            WinogradGemm4(a, u, inputDepth, outputDepth, c);
+          }
+        }
+
+        for (int t = 0; t < count; ++t) {
+          const int b = (first + t) / (tilesY * tilesX);
+          const int tileY = (first + t) / tilesX % tilesY;
+          const int tileX = (first + t) % tilesX;
+          WinogradMultiplyLeft(w.at, m, alpha, alpha, outputDepth,
+                               products + t * outputDepth, kWinogradTileBlock * outputDepth,
+                               outputRows, outputDepth);
+          for (int i = 0; i < m && tileY * m + i < outputHeight; ++i) {
+            for (int j = 0; j < m && tileX * m + j < outputWidth; ++j) {
+              WinogradMultiplyRight(w.at + j * alpha, 1, alpha, 1, outputDepth,
+                                    outputRows + i * alpha * outputDepth, outputDepth,
+                                    pixel, outputDepth);
+              float* out = outputData +
+                  ((b * outputHeight + tileY * m + i) * outputWidth + tileX * m + j) * outputDepth;
+              for (int oc = 0; oc < outputDepth; ++oc) {
+                const float value = pixel[oc] + (biasData ? biasData[oc] : 0.f);
+                out[oc] = std::min(std::max(value, activationMin), activationMax);
+              }
+            }
+          }
+        }
+      }
+    });
+  }
+
+  // Operation wrappers.
+  void addFloat32Wrapper(const ArithmeticParams& op_params,
+                         const RuntimeShape& input1_shape, 
+                         const intptr_t input1_data, 
+                         const RuntimeShape& input2_shape, 
+                         const intptr_t input2_data, 
+                         const RuntimeShape& output_shape, 
+                         intptr_t output_data) {
+    optimized_ops::Add(op_params,
+                       input1_shape, (const float*) input1_data,
+                       input2_shape, (const float*) input2_data,
+                       output_shape, (float*) output_data);
+  }
+
+  void addUint8Wrapper(const ArithmeticParams& op_params,
+                       const RuntimeShape& input1_shape, 
+                       const intptr_t input1_data, 
+                       const RuntimeShape& input2_shape, 
+                       const intptr_t input2_data, 
+                       const RuntimeShape& output_shape, 
+                       intptr_t output_data) {
+    optimized_ops::Add(op_params,
+                       input1_shape, (const uint8_t*) input1_data,
+                       input2_shape, (const uint8_t*) input2_data,
+                       output_shape, (uint8_t*) output_data);
+  }
+
+  void broadCastAddFloat32Wrapper(const ArithmeticParams& op_params,
+                                  const RuntimeShape& input1_shape, 
+                                  const intptr_t input1_data, 
+                                  const RuntimeShape& input2_shape, 
+                                  const intptr_t input2_data, 
+                                  const RuntimeShape& output_shape, 
+                                  intptr_t output_data) {
+    optimized_ops::BroadcastAdd4DSlow(op_params,
+                                      input1_shape, (const float*) input1_data,
+                                      input2_shape, (const float*) input2_data,
+                                      output_shape, (float*) output_data);
+  }
+
+  void mulFloat32Wrapper(const ArithmeticParams& op_params,
+                         const RuntimeShape& input1_shape, 
+                         const intptr_t input1_data, 
+                         const RuntimeShape& input2_shape, 
+                         const intptr_t input2_data, 
+                         const RuntimeShape& output_shape, 
+                         intptr_t output_data) {
+    optimized_ops::Mul(op_params,
+                       input1_shape, (const float*) input1_data,
+                       input2_shape, (const float*) input2_data,
+                       output_shape, (float*) output_data);
+  }
+
+  void broadCastMulFloat32Wrapper(const ArithmeticParams& op_params,
+                                  const RuntimeShape& input1_shape, 
+                                  const intptr_t input1_data, 
+                                  const RuntimeShape& input2_shape, 
+                                  const intptr_t input2_data, 
+                                  const RuntimeShape& output_shape, 
+                                  intptr_t output_data) {
+    optimized_ops::BroadcastMul4DSlow(op_params,
+                                      input1_shape, (const float*) input1_data,
+                                      input2_shape, (const float*) input2_data,
+                                      output_shape, (float*) output_data);
+  }
+
+  void floorFloat32Wrapper(const RuntimeShape& input_shape, 
+                           const intptr_t inputData, 
+                           const RuntimeShape& output_shape, 
+                           intptr_t outputData) {
+    optimized_ops::Floor(input_shape, (const float*)inputData,
+                         output_shape, (float*)outputData);
+  }
+
+  void depthwiseConvFloat32Wrapper(const DepthwiseParams& convParams,
+                                   const RuntimeShape& inputShape, 
+                                   const intptr_t inputData, 
+                                   const RuntimeShape& filterShape, 
+                                   const intptr_t filterData, 
+                                   const RuntimeShape& biasShape, 
+                                   const intptr_t biasData, 
+                                   const RuntimeShape& outputShape, 
+                                   intptr_t outputData) {
+    const DepthwiseKernel kernel = SelectDepthwiseKernel(convParams, filterShape);
+    if (kernel != kDepthwiseGeneric) {
+      FloatDepthwiseConvNhwc(convParams, kernel, inputShape, (const float*)inputData,
+                             (const float*)filterData, (const float*)biasData,
+                             outputShape, (float*)outputData);
+      return;
+    }
+    KernelContext& context = Context();
+    tflite::GetCpuFlags(&context.cpu, &context.cpuFlags);
+    optimized_ops::DepthwiseConv(convParams, inputShape,
+                                 (const float*)inputData, filterShape,
+                                 (const float*)filterData, biasShape,
+                                 (const float*)biasData, outputShape,
+                                 (float*)outputData, context.cpuFlags);
+  }
+
+  void depthwiseConvUint8Wrapper(const DepthwiseParams& convParams,
+                                 const RuntimeShape& inputShape,
+                                 const intptr_t inputData,
+                                 const RuntimeShape& filterShape,
+                                 const intptr_t filterData,
+                                 const RuntimeShape& biasShape,
+                                 const intptr_t biasData,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData) {
+    optimized_ops::DepthwiseConv(convParams, inputShape,
+                                 (const uint8_t*)inputData, filterShape,
+                                 (const uint8_t*)filterData, biasShape,
+                                 (const int32_t*)biasData, outputShape,
+                                 (uint8_t*)outputData, &Context().gemm);
+  }
+
+  void depthwiseConvInt8Wrapper(const DepthwiseParams& convParams,
+                                const RuntimeShape& inputShape,
+                                const intptr_t inputData,
+                                const RuntimeShape& filterShape,
+                                const intptr_t filterData,
+                                const RuntimeShape& biasShape,
+                                const intptr_t biasData,
+                                const RuntimeShape& outputShape,
+                                intptr_t outputData) {
+    const int32_t outputMultiplier = convParams.output_multiplier;
+    const int32_t outputShift = convParams.output_shift;
+    PackedDepthwiseFilter& packed = Context().depthwiseFilter;
+    PackDepthwiseFilter(filterShape, (const int8_t*)filterData, convParams.weights_offset,
+                        &packed);
+    QuantizedDepthwiseConvNhwc(convParams, SelectDepthwiseKernel(convParams, filterShape),
+                               &outputMultiplier, &outputShift, 0,
+                               inputShape, (const int8_t*)inputData,
+                               filterShape, packed,
+                               (const int32_t*)biasData,
+                               outputShape, (int8_t*)outputData);
+  }
+
+  void depthwiseConvUint8PerChannelWrapper(const DepthwiseParams& convParams,
+                                           const intptr_t outputMultiplierData,
+                                           const intptr_t outputShiftData,
+                                           const RuntimeShape& inputShape,
+                                           const intptr_t inputData,
+                                           const RuntimeShape& filterShape,
+                                           const intptr_t filterData,
+                                           const RuntimeShape& biasShape,
+                                           const intptr_t biasData,
+                                           const RuntimeShape& outputShape,
+                                           intptr_t outputData) {
+    PackedDepthwiseFilter& packed = Context().depthwiseFilter;
+    PackDepthwiseFilter(filterShape, (const int8_t*)filterData, convParams.weights_offset,
+                        &packed);
+    QuantizedDepthwiseConvNhwc(convParams, SelectDepthwiseKernel(convParams, filterShape),
+                               (const int32_t*)outputMultiplierData,
+                               (const int32_t*)outputShiftData, 1,
+                               inputShape, (const uint8_t*)inputData,
+                               filterShape, packed,
+                               (const int32_t*)biasData,
+                               outputShape, (uint8_t*)outputData);
+  }
+
+  void depthwiseConvInt8PerChannelWrapper(const DepthwiseParams& convParams,
+                                          const intptr_t outputMultiplierData,
+                                          const intptr_t outputShiftData,
+                                          const RuntimeShape& inputShape,
+                                          const intptr_t inputData,
+                                          const RuntimeShape& filterShape,
+                                          const intptr_t filterData,
+                                          const RuntimeShape& biasShape,
+                                          const intptr_t biasData,
+                                          const RuntimeShape& outputShape,
+                                          intptr_t outputData) {
+    PackedDepthwiseFilter& packed = Context().depthwiseFilter;
+    PackDepthwiseFilter(filterShape, (const int8_t*)filterData, convParams.weights_offset,
+                        &packed);
+    QuantizedDepthwiseConvNhwc(convParams, SelectDepthwiseKernel(convParams, filterShape),
+                               (const int32_t*)outputMultiplierData,
+                               (const int32_t*)outputShiftData, 1,
+                               inputShape, (const int8_t*)inputData,
+                               filterShape, packed,
+                               (const int32_t*)biasData,
+                               outputShape, (int8_t*)outputData);
+  }
+
+  void Im2colConvFloat32(const ConvParams& convParams,
+                         const RuntimeShape& inputShape, const float* inputData,
+                         const RuntimeShape& filterShape, const float* filterData,
+                         const RuntimeShape& biasShape, const float* biasData,
+                         const RuntimeShape& outputShape, float* outputData) {
+    CONV_PARAMETERS(float);
+    optimized_ops::Conv(convParams, inputShape, inputData, filterShape, filterData,
+                        biasShape, biasData, outputShape, outputData,
+                        im2colDim, im2colData, &Context().cpu);
+  }
+
+  void convFloat32Wrapper(const ConvParams& convParams,
+                          const RuntimeShape& inputShape,
+                          const intptr_t inputData,
+                          const RuntimeShape& filterShape,
+                          const intptr_t filterData,
+                          const RuntimeShape& biasShape,
+                          const intptr_t biasData,
+                          const RuntimeShape& outputShape,
+                          intptr_t outputData) {
+    const int tile = WinogradTileSize(convParams, inputShape, filterShape, outputShape);
+    if (tile > 0) {
+      WinogradFilter& transformed = Context().winogradFilter;
+      TransformWinogradFilter(filterShape, (const float*)filterData, tile, &transformed);
+      WinogradConvNhwc(convParams, inputShape, (const float*)inputData, transformed,
+                       (const float*)biasData, outputShape, (float*)outputData);
+      return;
+    }
+    Im2colConvFloat32(convParams, inputShape, (const float*)inputData,
+                      filterShape, (const float*)filterData,
+                      biasShape, (const float*)biasData,
+                      outputShape, (float*)outputData);
+  }
+
+  void convUint8Wrapper(const ConvParams& convParams,
+                        const RuntimeShape& inputShape, 
+                        const intptr_t inputData,
+                        const RuntimeShape& filterShape,
+                        const intptr_t filterData,
+                        const RuntimeShape& biasShape,
+                        const intptr_t biasData,
+                        const RuntimeShape& outputShape,
+                        intptr_t outputData) {
+    CONV_PARAMETERS(uint8_t);
+    optimized_ops::Conv(convParams, inputShape,
+                        (const uint8_t*)inputData, filterShape,
+                        (const uint8_t*)filterData, biasShape,
+                        (const int32_t*)biasData, outputShape,
+                        (uint8_t*)outputData, im2colDim,
+                        (uint8_t*)im2colData, &Context().cpu);
+  }
+
+  void convInt8Wrapper(const ConvParams& convParams,
+                       const RuntimeShape& inputShape, 
+                       const intptr_t inputData,
+                       const RuntimeShape& filterShape,
+                       const intptr_t filterData,
+                       const RuntimeShape& biasShape,
+                       const intptr_t biasData,
+                       const RuntimeShape& outputShape,
+                       intptr_t outputData) {
+    const int32_t outputMultiplier = convParams.output_multiplier;
+    const int32_t outputShift = convParams.output_shift;
+    PackedConvFilter<int8_t>& packed = Context().convFilter;
+    PackConvFilter(filterShape, (const int8_t*)filterData, &packed);
+    QuantizedConvNhwc(convParams, &outputMultiplier, &outputShift, 0,
+                      inputShape, (const int8_t*)inputData,
+                      filterShape, packed,
+                      (const int32_t*)biasData,
+                      outputShape, (int8_t*)outputData);
+  }
+
+  void convUint8PerChannelWrapper(const ConvParams& convParams,
+                                  const intptr_t outputMultiplierData,
+                                  const intptr_t outputShiftData,
+                                  const RuntimeShape& inputShape,
+                                  const intptr_t inputData,
+                                  const RuntimeShape& filterShape,
+                                  const intptr_t filterData,
+                                  const RuntimeShape& biasShape,
+                                  const intptr_t biasData,
+                                  const RuntimeShape& outputShape,
+                                  intptr_t outputData) {
+    PackedConvFilter<int8_t>& packed = Context().convFilter;
+    PackConvFilter(filterShape, (const int8_t*)filterData, &packed);
+    QuantizedConvNhwc(convParams,
+                      (const int32_t*)outputMultiplierData,
+                      (const int32_t*)outputShiftData, 1,
+                      inputShape, (const uint8_t*)inputData,
+                      filterShape, packed,
+                      (const int32_t*)biasData,
+                      outputShape, (uint8_t*)outputData);
+  }
+
+  void convInt8PerChannelWrapper(const ConvParams& convParams,
+                                 const intptr_t outputMultiplierData,
+                                 const intptr_t outputShiftData,
+                                 const RuntimeShape& inputShape,
+                                 const intptr_t inputData,
+                                 const RuntimeShape& filterShape,
+                                 const intptr_t filterData,
+                                 const RuntimeShape& biasShape,
+                                 const intptr_t biasData,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData) {
+    PackedConvFilter<int8_t>& packed = Context().convFilter;
+    PackConvFilter(filterShape, (const int8_t*)filterData, &packed);
+    QuantizedConvNhwc(convParams,
+                      (const int32_t*)outputMultiplierData,
+                      (const int32_t*)outputShiftData, 1,
+                      inputShape, (const int8_t*)inputData,
+                      filterShape, packed,
+                      (const int32_t*)biasData,
+                      outputShape, (int8_t*)outputData);
+  }
+
+  void averagePoolFloat32Wrapper(const PoolParams op_params,
+                                 const RuntimeShape& inputShape, 
+                                 const intptr_t inputData, 
+                                 const RuntimeShape& outputShape, 
+                                 intptr_t outputData) {
+    optimized_ops::AveragePool(op_params,
+                               inputShape, (const float*)inputData,
+                               outputShape, (float*)outputData);
+  }
+  
+  void averagePoolUint8Wrapper(const PoolParams op_params,
+                               const RuntimeShape& inputShape, 
+                               const intptr_t inputData, 
+                               const RuntimeShape& outputShape, 
+                               intptr_t outputData) {
+    optimized_ops::AveragePool(op_params,
+                               inputShape, (const uint8_t*)inputData,
+                               outputShape, (uint8_t*)outputData);
+  }
+
+  void averagePoolInt8Wrapper(const PoolParams op_params,
+                              const RuntimeShape& inputShape,
+                              const intptr_t inputData,
+                              const RuntimeShape& outputShape,
+                              intptr_t outputData) {
+    tflite::reference_integer_ops::AveragePool(op_params,
+                                               inputShape,
+                                               (const int8_t*)inputData,
+                                               outputShape,
+                                               (int8_t*)outputData);
+  }
+
+  void maxPoolFloat32Wrapper(const PoolParams op_params,
+                             const RuntimeShape& inputShape, 
+                             const intptr_t inputData, 
+                             const RuntimeShape& outputShape, 
+                             intptr_t outputData) {
+    optimized_ops::MaxPool(op_params,
+                           inputShape, (const float*)inputData,
+                           outputShape, (float*)outputData);
+  }
+
+  void maxPoolUint8Wrapper(const PoolParams op_params,
+                           const RuntimeShape& inputShape, 
+                           const intptr_t inputData, 
+                           const RuntimeShape& outputShape, 
+                           intptr_t outputData) {
+    optimized_ops::MaxPool(op_params,
+                           inputShape, (const uint8_t*)inputData,
+                           outputShape, (uint8_t*)outputData);
+  }
+
+  void softmaxFloat32Wrapper(const SoftmaxParams op_params,
+                             const RuntimeShape& inputShape, 
+                             const intptr_t inputData, 
+                             const RuntimeShape& outputShape, 
+                             intptr_t outputData) {
+    optimized_ops::Softmax(op_params, inputShape, (const float*)inputData,
+                           outputShape, (float*)outputData);
+  }
+
+  void softmaxUint8Wrapper(const SoftmaxParams op_params,
+                           const RuntimeShape& inputShape, 
+                           const intptr_t inputData, 
+                           const RuntimeShape& outputShape, 
+                           intptr_t outputData) {
+    optimized_ops::Softmax(op_params, inputShape, (const uint8_t*)inputData,
+                           outputShape, (uint8_t*)outputData);
+  }
+
+  void reshapeFloat32Wrapper(const RuntimeShape& inputShape, 
+                             const intptr_t inputData, 
+                             const RuntimeShape& outputShape, 
+                             intptr_t outputData) {
+    // implement it by self due to no reshape op in tflite::optimized_ops
+    uint32_t size_count = (uint32_t)(inputShape.FlatSize() * sizeof(float));
+    memcpy((float*)outputData, (const float*)inputData, size_count);
+  }
+
+  void reshapeUint8Wrapper(const RuntimeShape& inputShape, 
+                           const intptr_t inputData, 
+                           const RuntimeShape& outputShape, 
+                           intptr_t outputData) {
+    // implement it by self due to no reshape op in tflite::optimized_ops
+    uint32_t size_count = (uint32_t)(inputShape.FlatSize() * sizeof(uint8_t));
+    memcpy((uint8_t*)outputData, (const uint8_t*)inputData, size_count);
+  }
+
+  ConcatenationInputs::ConcatenationInputs(const ConcatenationParams& params)
+      : params_(params),
+        shapes_(params.inputs_count),
+        shapePointers_(params.inputs_count),
+        floatData_(params.inputs_count, nullptr),
+        uint8Data_(params.inputs_count, nullptr),
+        scales_(params.inputs_count, 0.f),
+        zeroPoints_(params.inputs_count, 0) {
+    if (params.inputs_count < 1) {
+      throw std::string("ConcatenationInputs: no inputs");
+    }
+    for (size_t i = 0; i < shapes_.size(); ++i) {
+      shapePointers_[i] = &shapes_[i];
+    }
+    params_.input_scale = scales_.data();
+    params_.input_zeropoint = zeroPoints_.data();
+  }
+
+  void ConcatenationInputs::setInput(int index, const RuntimeShape& shape, intptr_t data,
+                                     float scale, int32_t zeroPoint) {
+    checkIndex(index);
+    shapes_[index].ReplaceWith(shape.DimensionsCount(), shape.DimsData());
+    setInputData(index, data);
+    scales_[index] = scale;
+    zeroPoints_[index] = zeroPoint;
+  }
+
+  void ConcatenationInputs::setInputData(int index, intptr_t data) {
+    checkIndex(index);
+    floatData_[index] = reinterpret_cast<const float*>(data);
+    uint8Data_[index] = reinterpret_cast<const uint8_t*>(data);
+  }
+
+  void ConcatenationInputs::checkIndex(int index) const {
+    if (index < 0 || index >= params_.inputs_count) {
+      throw std::string("ConcatenationInputs: invalid input index");
+    }
+  }
+
+  void concatenationFloat32Wrapper(const ConcatenationInputs& inputs,
+                                   const RuntimeShape& outputShape,
+                                   intptr_t outputData) {
+    optimized_ops::Concatenation<float>(inputs.params(), inputs.shapes(), inputs.floatData(),
+                                        outputShape, (float*)outputData);
+  }
+
+  void concatenationUint8Wrapper(const ConcatenationInputs& inputs,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData) {
+    optimized_ops::ConcatenationWithScaling(inputs.params(), inputs.shapes(), inputs.uint8Data(),
+                                            outputShape, (uint8_t*)outputData);
+  }
+
+  void fullyConnectedFloat32Wrapper(const FullyConnectedParams op_params,
+                                    const RuntimeShape& inputShape, 
+                                    const intptr_t inputData, 
+                                    const RuntimeShape& weightsShape, 
+                                    const intptr_t weightsData, 
+                                    const RuntimeShape& biasShape, 
+                                    const intptr_t biasData, 
+                                    const RuntimeShape& outputShape, 
+                                    intptr_t outputData) {
+    optimized_ops::FullyConnected(op_params, inputShape,
+                                  (const float*)inputData, weightsShape,
+                                  (const float*)weightsData, biasShape,
+                                  (const float*)biasData, outputShape,
+                                  (float*)outputData, &Context().cpu);
+  }
+
+  void fullyConnectedUint8Wrapper(const FullyConnectedParams op_params,
+                                  const RuntimeShape& inputShape, 
+                                  const intptr_t inputData, 
+                                  const RuntimeShape& weightsShape, 
+                                  const intptr_t weightsData, 
+                                  const RuntimeShape& biasShape, 
+                                  const intptr_t biasData, 
+                                  const RuntimeShape& outputShape, 
+                                  intptr_t outputData) {
+    optimized_ops::FullyConnected(op_params, inputShape,
+                                  (const uint8_t*)inputData, weightsShape,
+                                  (const uint8_t*)weightsData, biasShape,
+                                  (const int32_t*)biasData, outputShape,
+                                  (uint8_t*)outputData, &Context().cpu);
+  }
+
+  void resizeBilinearFloat32Wrapper(const ResizeBilinearParams op_params,
+                                    const RuntimeShape& inputShape, 
+                                    const intptr_t inputData, 
+                                    const RuntimeShape& outSizeShape, 
+                                    const intptr_t outSizeData,
+                                    const RuntimeShape& outputShape, 
+                                    intptr_t outputData) {
+    optimized_ops::ResizeBilinear(op_params, 
+                                  inputShape, (const float*)inputData, 
+                                  outSizeShape, (const int32_t*)outSizeData, 
+                                  outputShape, (float*)outputData);
+  }
+
+  void tanhFloat32Wrapper(const RuntimeShape& inputShape, 
+                          const intptr_t inputData, 
+                          const RuntimeShape& outputShape, 
+                          intptr_t outputData) {
+    optimized_ops::Tanh(inputShape, (const float*)inputData, 
+                        outputShape, (float*)outputData);
+  }
+
+  void maximumFloat32Wrapper(const RuntimeShape& input1_shape, 
+                             const intptr_t input1_data,
+                             const RuntimeShape& input2_shape,
+                             const intptr_t input2_data, 
+                             const RuntimeShape& output_shape,
+                             intptr_t output_data) {
+    binding_utils::Maximum(input1_shape, (const float*)input1_data,
+                           (const float*)input2_data,
+                           output_shape, (float*) output_data);
+  }
+
+  void batchToSpaceNDFloat32Wrapper(const RuntimeShape& unextended_input1_shape, 
+                                    const intptr_t input1_data,
+                                    const RuntimeShape& unextended_input2_shape, 
+                                    const intptr_t block_shape_data,
+                                    const RuntimeShape& unextended_input3_shape, 
+                                    const intptr_t crops_data,
+                                    const RuntimeShape& unextended_output_shape, 
+                                    intptr_t output_data) {
+    optimized_ops::BatchToSpaceND(unextended_input1_shape, (const float*) input1_data,
+                                  unextended_input2_shape, (const int32_t*) block_shape_data,
+                                  unextended_input3_shape, (const int32_t*) crops_data,
+                                  unextended_output_shape, (float*) output_data);
+  }
+
+  void transposeFloat32Wrapper(const TransposeParams& op_params,
+                               const RuntimeShape& unextended_input_shape, 
+                               const intptr_t input_data,
+                               const RuntimeShape& unextended_output_shape, 
+                               intptr_t output_data) {
+    optimized_ops::Transpose(op_params,
+                             unextended_input_shape, (const float*) input_data,
+                             unextended_output_shape, (float*) output_data);
+  }
+
+  void argMaxFloat32Wrapper(const RuntimeShape& input1_shape,
+                            const intptr_t input1_data,
+                            const intptr_t input2_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data) {
+    optimized_ops::ArgMax(input1_shape, (const float*) input1_data,
+                          (const int32_t*) input2_data, output_shape,
+                          (int32_t*) output_data);
+  }
+
+  void logisticFloat32Wrapper(const RuntimeShape& input_shape,
+                              const intptr_t inputData,
+                              const RuntimeShape& output_shape,
+                              intptr_t outputData) {
+    optimized_ops::Logistic(input_shape, (const float*) inputData,
+                            output_shape, (float*) outputData);                            
+  }
+
+  void logisticUint8Wrapper(const LogisticParams& params,
+                            const RuntimeShape& input_shape,
+                            const intptr_t input_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data) {
+    optimized_ops::Logistic(params, input_shape, (const uint8_t*) input_data,
+                            output_shape, (uint8_t*) output_data);
+  }
+
+  void preluFloat32Wrapper(const RuntimeShape& input_shape,
+                           const intptr_t input_data,
+                           const RuntimeShape& alpha_shape,
+                           const intptr_t alpha_data,
+                           const RuntimeShape& output_shape,
+                           intptr_t output_data) {
+    const int inputSize = input_shape.FlatSize();
+    const int alphaSize = alpha_shape.FlatSize();
+    const int channels = input_shape.Dims(input_shape.DimensionsCount() - 1);
+    const bool alphaPerChannel =
+        alphaSize == channels &&
+        alpha_shape.Dims(alpha_shape.DimensionsCount() - 1) == channels;
+    if (output_shape.FlatSize() == inputSize &&
+        (alphaPerChannel || alphaSize == inputSize)) {
+      PreluChannelwise((const float*) input_data, (const float*) alpha_data,
+                       inputSize / alphaSize, alphaSize, (float*) output_data);
+      return;
+    }
+    reference_ops::BroadcastBinaryFunction4DSlow<float, float, float>(
+                           input_shape, (const float*) input_data, 
+                           alpha_shape, (const float*) alpha_data, 
+                           output_shape, (float*) output_data, ApplyPrelu<float>);
+  }
+
+  void preluUint8Wrapper(const PreluParams& params,
+                         const RuntimeShape& input_shape,
+                         const intptr_t input_data,
+                         const RuntimeShape& alpha_shape,
+                         const intptr_t alpha_data,
+                         const RuntimeShape& output_shape,
+                         intptr_t output_data) {
+    reference_ops::BroadcastPrelu4DSlow(params, 
+                         input_shape, (const uint8_t*) input_data, 
+                         alpha_shape, (const uint8_t*) alpha_data, 
+                         output_shape, (uint8_t*) output_data);
+  }
+
+  // Values converted per ParallelFor chunk by the quantize and dequantize
+  // wrappers.
+  constexpr int kConvertBlock = 16384;
+
+  void quantizeUint8Wrapper(const QuantizeParams& params,
+                            const RuntimeShape& input_shape,
+                            const intptr_t input_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data) {
+    const int size = input_shape.FlatSize();
+    if (output_shape.FlatSize() != size) {
+      throw std::string("Quantize: input and output sizes differ");
+    }
+    const float* input = reinterpret_cast<const float*>(input_data);
+    uint8_t* output = reinterpret_cast<uint8_t*>(output_data);
+    const float inverseScale = 1.0f / params.scale;
+    const float zeroPoint = params.zero_point;
+    const int blocks = (size + kConvertBlock - 1) / kConvertBlock;
+    Pool().ParallelFor(blocks, [&](int blockBegin, int blockEnd, int) {
+      const int end = std::min(size, blockEnd * kConvertBlock);
+      for (int i = blockBegin * kConvertBlock; i < end; ++i) {
+        const float q = std::round(input[i] * inverseScale) + zeroPoint;
+        output[i] = static_cast<uint8_t>(std::min(std::max(q, 0.0f), 255.0f));
+      }
+    });
+  }
+
+  void dequantizeUint8Wrapper(const QuantizeParams& params,
+                              const RuntimeShape& input_shape,
+                              const intptr_t input_data,
+                              const RuntimeShape& output_shape,
+                              intptr_t output_data) {
+    const int size = input_shape.FlatSize();
+    if (output_shape.FlatSize() != size) {
+      throw std::string("Dequantize: input and output sizes differ");
+    }
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(input_data);
+    float* output = reinterpret_cast<float*>(output_data);
+    const float scale = params.scale;
+    const int32_t zeroPoint = params.zero_point;
+    const int blocks = (size + kConvertBlock - 1) / kConvertBlock;
+    Pool().ParallelFor(blocks, [&](int blockBegin, int blockEnd, int) {
+      const int end = std::min(size, blockEnd * kConvertBlock);
+      for (int i = blockBegin * kConvertBlock; i < end; ++i) {
+        output[i] = scale * (input[i] - zeroPoint);
+      }
+    });
+  }
+
+  // Source offsets and weight of one output row or column of PreprocessRGBA.
+  struct ResizeTap {
+    int offset0;
+    int offset1;
+    float weight;
+  };
+
+  // Bilinear tap with half-pixel centres, as canvas drawImage samples,
+  // clamped to the [begin, begin + size) crop. Offsets are in units of `step`.
+  inline ResizeTap BilinearTap(int out, int outSize, int begin, int size, int step) {
+    const float position = (out + 0.5f) * size / outSize - 0.5f;
+    const float clamped = std::min(std::max(position, 0.0f), static_cast<float>(size - 1));
+    const int i0 = static_cast<int>(clamped);
+    const int i1 = std::min(i0 + 1, size - 1);
+    return {(begin + i0) * step, (begin + i1) * step, clamped - i0};
+  }
+
+  // Interpolates the four channels of one RGBA pixel from rows row0 and row1.
+  inline void BilinearRGBA(const uint8_t* row0, const uint8_t* row1,
+                           const ResizeTap& x, float yWeight, float* pixel) {
+#ifdef __wasm_simd128__
+    auto load = [](const uint8_t* p) {
+      return wasm_f32x4_convert_u32x4(wasm_u32x4_extend_low_u16x8(
+          wasm_u16x8_extend_low_u8x16(wasm_v128_load32_zero(p))));
+    };
+    const v128_t wx = wasm_f32x4_splat(x.weight);
+    const v128_t p00 = load(row0 + x.offset0);
+    const v128_t p10 = load(row1 + x.offset0);
+    const v128_t top = wasm_f32x4_add(p00, wasm_f32x4_mul(wasm_f32x4_sub(load(row0 + x.offset1), p00), wx));
+    const v128_t bottom = wasm_f32x4_add(p10, wasm_f32x4_mul(wasm_f32x4_sub(load(row1 + x.offset1), p10), wx));
+    wasm_v128_store(pixel, wasm_f32x4_add(top, wasm_f32x4_mul(wasm_f32x4_sub(bottom, top),
+                                                              wasm_f32x4_splat(yWeight))));
+#else
+    for (int c = 0; c < 4; ++c) {
+      const float top = row0[x.offset0 + c] + (row0[x.offset1 + c] - row0[x.offset0 + c]) * x.weight;
+      const float bottom = row1[x.offset0 + c] + (row1[x.offset1 + c] - row1[x.offset0 + c]) * x.weight;
+      pixel[c] = top + (bottom - top) * yWeight;
+    }
+#endif
+  }
+
+  template <typename T>
+  inline T PreprocessCast(float value) {
+    return value;
+  }
+
+  template <>
+  inline uint8_t PreprocessCast<uint8_t>(float value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+  }
+
+  // Resize, channel selection, normalization and layout of one RGBA frame in
+  // a single pass over the output, see PreprocessParams.
+  template <typename T>
+  void PreprocessRGBA(const PreprocessParams& params, const uint8_t* input, T* output) {
+    const int channels = params.channels;
+    if (channels < 1 || channels > 4) {
+      throw std::string("PreprocessRGBA: invalid channels");
+    }
+    for (int c = 0; c < channels; ++c) {
+      if (params.channel_map[c] < -1 || params.channel_map[c] > 3) {
+        throw std::string("PreprocessRGBA: invalid channel map");
+      }
+    }
+    if (params.crop_x < 0 || params.crop_y < 0 ||
+        params.crop_width < 1 || params.crop_height < 1 ||
+        params.crop_x + params.crop_width > params.src_width ||
+        params.crop_y + params.crop_height > params.src_height) {
+      throw std::string("PreprocessRGBA: crop is out of the source image");
+    }
+    if (params.draw_width < 1 || params.draw_height < 1 ||
+        params.draw_width > params.dst_width || params.draw_height > params.dst_height) {
+      throw std::string("PreprocessRGBA: draw size is out of the output");
+    }
+
+    ResizeTap* xTaps = reinterpret_cast<ResizeTap*>(
+        Pool().ReserveSharedScratch(params.draw_width * sizeof(ResizeTap)));
+    for (int x = 0; x < params.draw_width; ++x) {
+      xTaps[x] = BilinearTap(x, params.draw_width, params.crop_x, params.crop_width, 4);
+    }
+    const int pixelStride = params.nchw ? 1 : channels;
+    const int channelStride = params.nchw ? params.dst_width * params.dst_height : 1;
+
+    Pool().ParallelFor(params.dst_height, [&](int rowBegin, int rowEnd, int) {
+      alignas(16) float pixel[4];
+      for (int y = rowBegin; y < rowEnd; ++y) {
+        T* out = output + y * params.dst_width * pixelStride;
+        int x = 0;
+        if (y < params.draw_height) {
+          const ResizeTap yTap = BilinearTap(y, params.draw_height, params.crop_y,
+                                             params.crop_height, params.src_width * 4);
+          const uint8_t* row0 = input + yTap.offset0;
+          const uint8_t* row1 = input + yTap.offset1;
+          for (; x < params.draw_width; ++x, out += pixelStride) {
+            BilinearRGBA(row0, row1, xTaps[x], yTap.weight, pixel);
+            for (int c = 0; c < channels; ++c) {
+              const int source = params.channel_map[c];
+              const float value = source < 0 ? (pixel[0] + pixel[1] + pixel[2]) / 3.0f
+                                             : pixel[source];
+              out[c * channelStride] = PreprocessCast<T>(value * params.scale[c] + params.bias[c]);
+            }
+          }
+        }
+        for (; x < params.dst_width; ++x, out += pixelStride) {
+          for (int c = 0; c < channels; ++c) {
+            out[c * channelStride] = PreprocessCast<T>(params.bias[c]);
+          }
+        }
+      }
+    });
+  }
+
+  void preprocessRGBAFloat32Wrapper(const PreprocessParams& params,
+                                    const intptr_t input_data,
+                                    intptr_t output_data) {
+    PreprocessRGBA(params, (const uint8_t*) input_data, (float*) output_data);
+  }
+
+  void preprocessRGBAUint8Wrapper(const PreprocessParams& params,
+                                  const intptr_t input_data,
+                                  intptr_t output_data) {
+    PreprocessRGBA(params, (const uint8_t*) input_data, (uint8_t*) output_data);
+  }
+
+  // Decreasing score; ties go to the lower class, then to the lower box.
+  inline bool DetectionBefore(const DetectionCandidate& a, const DetectionCandidate& b) {
+    if (a.score != b.score) {
+      return a.score > b.score;
+    }
+    return a.label != b.label ? a.label < b.label : a.box < b.box;
+  }
+
+  inline float SsdDequantize(float value, float, int32_t) {
+    return value;
+  }
+
+  inline float SsdDequantize(uint8_t value, float scale, int32_t zeroPoint) {
+    return (static_cast<int32_t>(value) - zeroPoint) * scale;
+  }
+
+  // Intersection over union of two [ymin, xmin, ymax, xmax] boxes. Boxes
+  // without area overlap nothing, as in TFLite.
+  inline float IntersectionOverUnion(const float* a, const float* b) {
+    const float areaA = (a[2] - a[0]) * (a[3] - a[1]);
+    const float areaB = (b[2] - b[0]) * (b[3] - b[1]);
+    if (areaA <= 0 || areaB <= 0) {
+      return 0.0f;
+    }
+    const float height = std::max(0.0f, std::min(a[2], b[2]) - std::max(a[0], b[0]));
+    const float width = std::max(0.0f, std::min(a[3], b[3]) - std::max(a[1], b[1]));
+    const float intersection = height * width;
+    return intersection / (areaA + areaB - intersection);
+  }
+
+  // Greedy NMS over the candidates [first, last), sorted by DetectionBefore.
+  // Appends at most `limit` survivors to `selected`; a candidate is only
+  // compared with the survivors of its own call.
+  inline void NonMaxSuppression(const DetectionCandidate* first, const DetectionCandidate* last,
+                                const float* boxes, float iouThreshold, int limit,
+                                std::vector<DetectionCandidate>* selected) {
+    const size_t begin = selected->size();
+    for (const DetectionCandidate* candidate = first; candidate != last; ++candidate) {
+      if (static_cast<int>(selected->size() - begin) >= limit) {
+        break;
+      }
+      const float* box = boxes + 4 * candidate->box;
+      bool suppressed = false;
+      for (size_t k = begin; k < selected->size() && !suppressed; ++k) {
+        suppressed = IntersectionOverUnion(box, boxes + 4 * (*selected)[k].box) > iouThreshold;
+      }
+      if (!suppressed) {
+        selected->push_back(*candidate);
+      }
+    }
+  }
+
+#ifdef __wasm_simd128__
+  // exp() of four floats as in Cephes' expf: x = n ln2 + r with |r| <= ln2/2,
+  // a degree 5 polynomial for e^r and n added to the exponent bits. Within
+  // 1 ulp of std::exp; inputs are clamped to [-87.3, 88.3], where the result
+  // stays a normal float.
+  inline v128_t ExpF32x4(v128_t x) {
+    x = wasm_f32x4_min(wasm_f32x4_max(x, wasm_f32x4_splat(-87.3f)), wasm_f32x4_splat(88.3f));
+    const v128_t n = wasm_f32x4_nearest(wasm_f32x4_mul(x, wasm_f32x4_splat(1.44269504f)));
+    v128_t r = wasm_f32x4_sub(x, wasm_f32x4_mul(n, wasm_f32x4_splat(0.693359375f)));
+    r = wasm_f32x4_add(r, wasm_f32x4_mul(n, wasm_f32x4_splat(2.12194440e-4f)));
+    const float coefficients[] = {1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f,
+                                  1.6666665459e-1f, 5.0000001201e-1f};
+    v128_t p = wasm_f32x4_splat(1.9875691500e-4f);
+    for (float c : coefficients) {
+      p = wasm_f32x4_add(wasm_f32x4_mul(p, r), wasm_f32x4_splat(c));
+    }
+    const v128_t y = wasm_f32x4_add(wasm_f32x4_add(wasm_f32x4_mul(wasm_f32x4_mul(p, r), r), r),
+                                    wasm_f32x4_splat(1.0f));
+    const v128_t exponent = wasm_i32x4_shl(
+        wasm_i32x4_add(wasm_i32x4_trunc_sat_f32x4(n), wasm_i32x4_splat(127)), 23);
+    return wasm_f32x4_mul(y, exponent);
+  }
+
+  // The four values of a box encoding, dequantized.
+  inline v128_t SsdLoadEncoding(const float* encoding, float, int32_t) {
+    return wasm_v128_load(encoding);
+  }
+
+  inline v128_t SsdLoadEncoding(const uint8_t* encoding, float scale, int32_t zeroPoint) {
+    const v128_t q = wasm_u32x4_extend_low_u16x8(
+        wasm_u16x8_extend_low_u8x16(wasm_v128_load32_zero(encoding)));
+    return wasm_f32x4_mul(wasm_f32x4_convert_i32x4(wasm_i32x4_sub(q, wasm_i32x4_splat(zeroPoint))),
+                          wasm_f32x4_splat(scale));
+  }
+#endif
+
+  // Writes the [ymin, xmin, ymax, xmax] box of an encoding (ty, tx, th, tw)
+  // of `anchor` (ycenter, xcenter, h, w). The SIMD build decodes the four
+  // coordinates in one vector, with both exp() in one ExpF32x4.
+  template <typename T>
+  inline void DecodeSsdBox(const SsdPostprocessParams& params, const T* encoding,
+                           const float* anchor, float* box) {
+#ifdef __wasm_simd128__
+    const v128_t t = wasm_f32x4_div(
+        SsdLoadEncoding(encoding, params.box_scale, params.box_zero_point),
+        wasm_f32x4_make(params.y_scale, params.x_scale, params.h_scale, params.w_scale));
+    const v128_t a = wasm_v128_load(anchor);
+    const v128_t size = wasm_i32x4_shuffle(a, a, 2, 3, 2, 3);
+    const v128_t center = wasm_f32x4_add(wasm_f32x4_mul(wasm_i32x4_shuffle(t, t, 0, 1, 0, 1), size),
+                                         wasm_i32x4_shuffle(a, a, 0, 1, 0, 1));
+    const v128_t half = wasm_f32x4_mul(wasm_f32x4_mul(ExpF32x4(wasm_i32x4_shuffle(t, t, 2, 3, 2, 3)), size),
+                                       wasm_f32x4_make(-0.5f, -0.5f, 0.5f, 0.5f));
+    wasm_v128_store(box, wasm_f32x4_add(center, half));
+#else
+    const float ty = SsdDequantize(encoding[0], params.box_scale, params.box_zero_point) / params.y_scale;
+    const float tx = SsdDequantize(encoding[1], params.box_scale, params.box_zero_point) / params.x_scale;
+    const float th = SsdDequantize(encoding[2], params.box_scale, params.box_zero_point) / params.h_scale;
+    const float tw = SsdDequantize(encoding[3], params.box_scale, params.box_zero_point) / params.w_scale;
+    const float yCenter = ty * anchor[2] + anchor[0];
+    const float xCenter = tx * anchor[3] + anchor[1];
+    const float halfHeight = 0.5f * std::exp(th) * anchor[2];
+    const float halfWidth = 0.5f * std::exp(tw) * anchor[3];
+    box[0] = yCenter - halfHeight;
+    box[1] = xCenter - halfWidth;
+    box[2] = yCenter + halfHeight;
+    box[3] = xCenter + halfWidth;
+#endif
+  }
+
+  template <typename T>
+  int SsdPostprocess(const SsdPostprocessParams& params, const T* boxData,
+                     const T* scoreData, const float* anchors, float* output) {
+    const int numBoxes = params.num_boxes;
+    const int numClasses = params.num_classes;
+    const int labelOffset = params.label_offset;
+    const int numLabels = numClasses - labelOffset;
+    if (numBoxes < 0 || labelOffset < 0 || numLabels < 1) {
+      throw std::string("SsdPostprocess: invalid number of boxes or classes");
+    }
+    if (params.max_detections < 0 || params.max_detections_per_class < 1) {
+      throw std::string("SsdPostprocess: invalid detection limits");
+    }
+    const float threshold = params.score_threshold;
+    const bool regular = params.use_regular_nms;
+
+    // Threshold first: only boxes with a score above it are decoded, and
+    // their candidates are collected in one pass over the scores. Regular
+    // NMS then sorts them by class, so each class is one run.
+    KernelContext& context = Context();
+    std::vector<float>& boxes = context.detectionBoxes;
+    std::vector<DetectionCandidate>& candidates = context.detectionCandidates;
+    std::vector<DetectionCandidate>& selected = context.detectionSelected;
+    const size_t capacity = boxes.capacity() + candidates.capacity() + selected.capacity();
+    boxes.resize(4 * numBoxes);
+    candidates.clear();
+    selected.clear();
+    for (int b = 0; b < numBoxes; ++b) {
+      const T* row = scoreData + b * numClasses + labelOffset;
+      T rowMax = row[0];
+      for (int l = 1; l < numLabels; ++l) {
+        rowMax = std::max(rowMax, row[l]);
+      }
+      const float bestScore = SsdDequantize(rowMax, params.score_scale, params.score_zero_point);
+      if (!(bestScore > threshold)) {
+        continue;
+      }
+      if (regular) {
+        for (int l = 0; l < numLabels; ++l) {
+          const float score = SsdDequantize(row[l], params.score_scale, params.score_zero_point);
+          if (score > threshold) {
+            candidates.push_back({score, b, l + labelOffset});
+          }
+        }
+      } else {
+        const int best = std::find(row, row + numLabels, rowMax) - row;
+        candidates.push_back({bestScore, b, best + labelOffset});
+      }
+      DecodeSsdBox(params, boxData + 4 * b, anchors + 4 * b, boxes.data() + 4 * b);
+    }
+
+    const int limit = regular ? params.max_detections_per_class : params.max_detections;
+    std::sort(candidates.begin(), candidates.end(),
+              [regular](const DetectionCandidate& a, const DetectionCandidate& b) {
+      if (regular && a.label != b.label) {
+        return a.label < b.label;
+      }
+      return DetectionBefore(a, b);
+    });
+    for (size_t first = 0; first < candidates.size();) {
+      size_t last = first + 1;
+      while (last < candidates.size() &&
+             (!regular || candidates[last].label == candidates[first].label)) {
+        ++last;
+      }
+      NonMaxSuppression(candidates.data() + first, candidates.data() + last, boxes.data(),
+                        params.iou_threshold, limit, &selected);
+      first = last;
+    }
+    if (boxes.capacity() + candidates.capacity() + selected.capacity() != capacity) {
+      context.pool.CountAllocation();
+    }
+
+    const int count = std::min(static_cast<int>(selected.size()), params.max_detections);
+    std::partial_sort(selected.begin(), selected.begin() + count, selected.end(), DetectionBefore);
+    for (int i = 0; i < count; ++i) {
+      const float* box = boxes.data() + 4 * selected[i].box;
+      float* detection = output + 6 * i;
+      std::copy(box, box + 4, detection);
+      detection[4] = static_cast<float>(selected[i].label);
+      detection[5] = selected[i].score;
+    }
+    return count;
+  }
+
+  int ssdPostprocessFloat32Wrapper(const SsdPostprocessParams& params,
+                                   const intptr_t box_data,
+                                   const intptr_t score_data,
+                                   const intptr_t anchor_data,
+                                   intptr_t output_data) {
+    return SsdPostprocess(params, (const float*) box_data, (const float*) score_data,
+                          (const float*) anchor_data, (float*) output_data);
+  }
+
+  int ssdPostprocessUint8Wrapper(const SsdPostprocessParams& params,
+                                 const intptr_t box_data,
+                                 const intptr_t score_data,
+                                 const intptr_t anchor_data,
+                                 intptr_t output_data) {
+    return SsdPostprocess(params, (const uint8_t*) box_data, (const uint8_t*) score_data,
+                          (const float*) anchor_data, (float*) output_data);
+  }
+
+  inline float Sigmoid(float x) {
+    return 1.0f / (1.0f + std::exp(-x));
+  }
+
+  int yolo2RegionFloat32Wrapper(const Yolo2RegionParams& params,
+                                const intptr_t input_data,
+                                const intptr_t anchor_data,
+                                intptr_t output_data) {
+    const int numCells = params.grid_height * params.grid_width * params.num_anchors;
+    const int numClasses = params.num_classes;
+    const int cellSize = 5 + numClasses;
+    if (numCells < 0 || numClasses < 1) {
+      throw std::string("Yolo2Region: invalid grid or classes");
+    }
+    const float* input = (const float*) input_data;
+    const float* anchors = (const float*) anchor_data;
+    float* output = (float*) output_data;
+    const float threshold = params.obj_threshold;
+
+    // Every class probability is the objectness times a softmax value of at
+    // most 1, so cells whose objectness is below the threshold are skipped
+    // before their softmax. Passing candidates go in one vector, which is
+    // sorted by class for the per-class NMS, as in SsdPostprocess.
+    KernelContext& context = Context();
+    std::vector<float>& boxes = context.detectionBoxes;
+    std::vector<DetectionCandidate>& candidates = context.detectionCandidates;
+    std::vector<DetectionCandidate>& selected = context.detectionSelected;
+    std::vector<float>& probabilities = context.detectionProbabilities;
+    const size_t capacity = boxes.capacity() + candidates.capacity() + selected.capacity() +
+                            probabilities.capacity();
+    boxes.resize(4 * numCells);
+    probabilities.resize(numClasses);
+    candidates.clear();
+    selected.clear();
+    for (int i = 0; i < numCells; ++i) {
+      const float* cell = input + i * cellSize;
+      const float objectness = Sigmoid(cell[4]);
+      if (!(objectness > threshold)) {
+        continue;
+      }
+      const float* logits = cell + 5;
+      const float maxLogit = *std::max_element(logits, logits + numClasses);
+      float sum = 0.0f;
+      for (int c = 0; c < numClasses; ++c) {
+        probabilities[c] = std::exp(logits[c] - maxLogit);
+        sum += probabilities[c];
+      }
+      const float scale = objectness / sum;
+      bool any = false;
+      for (int c = 0; c < numClasses; ++c) {
+        const float score = probabilities[c] * scale;
+        if (score > threshold) {
+          candidates.push_back({score, i, c});
+          any = true;
+        }
+      }
+      if (!any) {
+        continue;
+      }
+
+      const int anchor = i % params.num_anchors;
+      const int col = i / params.num_anchors % params.grid_width;
+      const int row = i / params.num_anchors / params.grid_width;
+      const float x = (col + Sigmoid(cell[0])) / params.grid_width;
+      const float y = (row + Sigmoid(cell[1])) / params.grid_height;
+      const float halfWidth = 0.5f * anchors[2 * anchor] * std::exp(cell[2]) / params.grid_width;
+      const float halfHeight = 0.5f * anchors[2 * anchor + 1] * std::exp(cell[3]) / params.grid_height;
+      float* box = boxes.data() + 4 * i;
+      box[0] = y - halfHeight;
+      box[1] = x - halfWidth;
+      box[2] = y + halfHeight;
+      box[3] = x + halfWidth;
+    }
+
+    // Per-class NMS, then every cell reports its best surviving class.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const DetectionCandidate& a, const DetectionCandidate& b) {
+                return a.label != b.label ? a.label < b.label : DetectionBefore(a, b);
+              });
+    for (size_t first = 0; first < candidates.size();) {
+      size_t last = first + 1;
+      while (last < candidates.size() && candidates[last].label == candidates[first].label) {
+        ++last;
+      }
+      NonMaxSuppression(candidates.data() + first, candidates.data() + last, boxes.data(),
+                        params.nms_threshold, std::numeric_limits<int>::max(), &selected);
+      first = last;
+    }
+    if (boxes.capacity() + candidates.capacity() + selected.capacity() +
+        probabilities.capacity() != capacity) {
+      context.pool.CountAllocation();
+    }
+
+    std::sort(selected.begin(), selected.end(),
+              [](const DetectionCandidate& a, const DetectionCandidate& b) {
+                return a.box != b.box ? a.box < b.box : DetectionBefore(a, b);
+              });
+    int count = 0;
+    for (size_t k = 0; k < selected.size(); ++k) {
+      if (k > 0 && selected[k].box == selected[k - 1].box) {
+        continue;
+      }
+      const float* box = boxes.data() + 4 * selected[k].box;
+      float* detection = output + 6 * count++;
+      detection[0] = static_cast<float>(selected[k].label);
+      detection[1] = 0.5f * (box[1] + box[3]);
+      detection[2] = 0.5f * (box[0] + box[2]);
+      detection[3] = box[3] - box[1];
+      detection[4] = box[2] - box[0];
+      detection[5] = selected[k].score;
+    }
+    return count;
+  }
+
+  // Perspective transform taking the output corners to params.src_quad, the
+  // inverse of cv.getPerspectiveTransform(src_quad, corners) that
+  // cv.warpPerspective samples with. Row-major 3x3 with m[8] = 1.
+  inline std::array<double, 9> LaneWarpTransform(const LaneFeatureParams& params) {
+    const double corners[8] = {0, 0, double(params.dst_width), 0,
+                               double(params.dst_width), double(params.dst_height),
+                               0, double(params.dst_height)};
+    // a * m = b with m = (m0 .. m7), solved by Gaussian elimination.
+    double a[8][9];
+    for (int i = 0; i < 4; ++i) {
+      const double x = corners[2 * i], y = corners[2 * i + 1];
+      const double u = params.src_quad[2 * i], v = params.src_quad[2 * i + 1];
+      double* rowU = a[i];
+      double* rowV = a[i + 4];
+      const double coefficientsU[9] = {x, y, 1, 0, 0, 0, -x * u, -y * u, u};
+      const double coefficientsV[9] = {0, 0, 0, x, y, 1, -x * v, -y * v, v};
+      std::copy(coefficientsU, coefficientsU + 9, rowU);
+      std::copy(coefficientsV, coefficientsV + 9, rowV);
+    }
+    for (int col = 0; col < 8; ++col) {
+      int pivot = col;
+      for (int row = col + 1; row < 8; ++row) {
+        if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) {
+          pivot = row;
+        }
+      }
+      if (std::fabs(a[pivot][col]) < 1e-12) {
+        throw std::string("laneWarpMap: degenerate src_quad");
+      }
+      std::swap_ranges(a[col], a[col] + 9, a[pivot]);
+      for (int row = 0; row < 8; ++row) {
+        if (row != col) {
+          const double factor = a[row][col] / a[col][col];
+          for (int k = col; k < 9; ++k) {
+            a[row][k] -= factor * a[col][k];
+          }
+        }
+      }
+    }
+    std::array<double, 9> m;
+    for (int i = 0; i < 8; ++i) {
+      m[i] = a[i][8] / a[i][i];
+    }
+    m[8] = 1;
+    return m;
+  }
+
+  inline void CheckLaneFeatureParams(const LaneFeatureParams& params) {
+    if (params.src_width < 2 || params.src_height < 2 ||
+        params.dst_width < 1 || params.dst_height < 1) {
+      throw std::string("laneFeatures: invalid image size");
+    }
+  }
+
+  void laneWarpMapWrapper(const LaneFeatureParams& params,
+                          intptr_t map_data) {
+    CheckLaneFeatureParams(params);
+    const std::array<double, 9> m = LaneWarpTransform(params);
+    int32_t* map = (int32_t*) map_data;
+    for (int y = 0; y < params.dst_height; ++y) {
+      for (int x = 0; x < params.dst_width; ++x) {
+        const double w = m[6] * x + m[7] * y + m[8];
+        int32_t source = -1;
+        if (w != 0) {
+          const double u = std::nearbyint((m[0] * x + m[1] * y + m[2]) / w);
+          const double v = std::nearbyint((m[3] * x + m[4] * y + m[5]) / w);
+          if (u >= 0 && u < params.src_width && v >= 0 && v < params.src_height) {
+            source = static_cast<int32_t>(v) * params.src_width + static_cast<int32_t>(u);
+          }
+        }
+        *map++ = source;
+      }
+    }
+  }
+
+  // HLS lightness of an RGBA pixel, with the float arithmetic of
+  // cv.cvtColor(COLOR_RGB2HLS) so ties round the same way.
+  inline uint8_t LaneLightness(const uint8_t* p) {
+    const float maxValue = std::max(std::max(p[0], p[1]), p[2]) * (1.0f / 255.0f);
+    const float minValue = std::min(std::min(p[0], p[1]), p[2]) * (1.0f / 255.0f);
+    return static_cast<uint8_t>(std::lrint((maxValue + minValue) * 0.5f * 255.0f));
+  }
+
+  // Whether the HLS saturation S = 255 * diff / den of an RGBA pixel, rounded,
+  // is above `threshold`, that is 2 * 255 * diff >= (2 * threshold + 1) * den.
+  // Branch free, the outcome is noise on camera frames.
+  inline int LaneSaturationFeature(const uint8_t* p, int threshold) {
+    const int maxValue = std::max(std::max(p[0], p[1]), p[2]);
+    const int minValue = std::min(std::min(p[0], p[1]), p[2]);
+    const int sum = maxValue + minValue;
+    const int den = sum < 255 ? sum : 510 - sum;
+    return (den > 0) & (510 * (maxValue - minValue) >= (2 * threshold + 1) * den);
+  }
+
+  // Whether the 8-bit HSV value of an RGBA pixel is in the [hsv_lower,
+  // hsv_upper] range. Fixed point with the division tables of
+  // cv.cvtColor(COLOR_RGB2HSV), H in [0, 180).
+  inline int LaneHsvFeature(const LaneFeatureParams& params, const uint8_t* p) {
+    constexpr int kShift = 12;
+    struct DivisionTables {
+      int32_t s[256];
+      int32_t h[256];
+      DivisionTables() {
+        s[0] = h[0] = 0;
+        for (int i = 1; i < 256; ++i) {
+          s[i] = static_cast<int32_t>(std::lrint((255 << kShift) / double(i)));
+          h[i] = static_cast<int32_t>(std::lrint((180 << kShift) / (6.0 * i)));
+        }
+      }
+    };
+    static const DivisionTables tables;
+
+    const int r = p[0], g = p[1], b = p[2];
+    const int v = std::max(std::max(r, g), b);
+    const int diff = v - std::min(std::min(r, g), b);
+    const int s = (diff * tables.s[v] + (1 << (kShift - 1))) >> kShift;
+    int h = v == r ? g - b : v == g ? b - r + 2 * diff : r - g + 4 * diff;
+    h = (h * tables.h[diff] + (1 << (kShift - 1))) >> kShift;
+    h += h < 0 ? 180 : 0;
+    return h >= params.hsv_lower[0] && h <= params.hsv_upper[0] &&
+           s >= params.hsv_lower[1] && s <= params.hsv_upper[1] &&
+           v >= params.hsv_lower[2] && v <= params.hsv_upper[2];
+  }
+
+  // Features are computed once per source pixel, on the rows the warp can
+  // sample (those of src_quad, one more for rounding), then gathered through
+  // the map. Lightness is stored with one row of context on each side for
+  // the Sobel taps.
+  void laneFeaturesWrapper(const LaneFeatureParams& params,
+                           const intptr_t input_data,
+                           const intptr_t map_data,
+                           intptr_t output_data,
+                           intptr_t histogram_data) {
+    CheckLaneFeatureParams(params);
+    const uint8_t* input = (const uint8_t*) input_data;
+    const int32_t* map = (const int32_t*) map_data;
+    uint8_t* output = (uint8_t*) output_data;
+    int32_t* histogram = (int32_t*) histogram_data;
+    const int width = params.src_width;
+    const int height = params.src_height;
+
+    float quadTop = params.src_quad[1], quadBottom = params.src_quad[1];
+    for (int i = 1; i < 4; ++i) {
+      quadTop = std::min(quadTop, params.src_quad[2 * i + 1]);
+      quadBottom = std::max(quadBottom, params.src_quad[2 * i + 1]);
+    }
+    const int rowBegin = std::min(std::max(static_cast<int>(std::floor(quadTop)) - 1, 0), height);
+    const int rowEnd = std::min(std::max(static_cast<int>(std::ceil(quadBottom)) + 2, rowBegin), height);
+    const int lightBegin = std::max(rowBegin - 1, 0);
+    const int lightEnd = std::min(rowEnd + 1, height);
+
+    WorkerPool& pool = Pool();
+    // convertScaleAbs saturates the gradient at 255.
+    const int sobelThreshold = params.sobel_threshold < 255 ? params.sobel_threshold
+                                                               : std::numeric_limits<int>::max();
+    const int sThreshold = params.s_threshold;
+    // Lightness rows, then the mask rows.
+    uint8_t* const lightness = reinterpret_cast<uint8_t*>(pool.ReserveSharedScratch(
+        size_t(lightEnd - lightBegin + rowEnd - rowBegin) * width));
+    uint8_t* const mask = lightness + (lightEnd - lightBegin) * width;
+    pool.ParallelFor(lightEnd - lightBegin, [&](int begin, int end, int) {
+      for (int y = begin; y < end; ++y) {
+        const uint8_t* in = input + (lightBegin + y) * width * 4;
+        uint8_t* out = lightness + y * width;
+        for (int x = 0; x < width; ++x, in += 4) {
+          out[x] = LaneLightness(in);
+        }
+      }
+    });
+    pool.ParallelFor(rowEnd - rowBegin, [&](int begin, int end, int) {
+      for (int y = rowBegin + begin; y < rowBegin + end; ++y) {
+        // Borders reflect without repeating the edge, as BORDER_REFLECT_101.
+        const uint8_t* row = lightness + (y - lightBegin) * width;
+        const uint8_t* up = lightness + ((y > 0 ? y - 1 : 1) - lightBegin) * width;
+        const uint8_t* down = lightness + ((y < height - 1 ? y + 1 : y - 1) - lightBegin) * width;
+        const uint8_t* in = input + y * width * 4;
+        uint8_t* out = mask + (y - rowBegin) * width;
+        for (int x = 0; x < width; ++x) {
+          const int left = x > 0 ? x - 1 : 1;
+          const int right = x < width - 1 ? x + 1 : x - 1;
+          const int gradient = up[right] - up[left] + 2 * (row[right] - row[left]) +
+                               down[right] - down[left];
+          out[x] = (std::abs(gradient) > sobelThreshold) |
+                   LaneSaturationFeature(in + x * 4, sThreshold);
+        }
+        if (params.color_mask) {
+          for (int x = 0; x < width; ++x) {
+            out[x] = out[x] || LaneHsvFeature(params, in + x * 4);
+          }
+        }
+      }
+    });
+
+    // Every thread owns a strip of output columns, and so their bins.
+    const int32_t maskBegin = rowBegin * width;
+    const uint32_t maskSize = static_cast<uint32_t>((rowEnd - rowBegin) * width);
+    const int histogramRow = std::max(params.histogram_row, 0);
+    pool.ParallelFor(params.dst_width, [&](int colBegin, int colEnd, int) {
+      std::fill(histogram + colBegin, histogram + colEnd, 0);
+      for (int y = 0; y < params.dst_height; ++y) {
+        const int32_t* sources = map + y * params.dst_width;
+        uint8_t* out = output + y * params.dst_width;
+        const int counted = y >= histogramRow;
+        for (int x = colBegin; x < colEnd; ++x) {
+          // -1 and sources out of the rows wrap to large offsets.
+          const uint32_t offset = static_cast<uint32_t>(sources[x] - maskBegin);
+          const int set = offset < maskSize ? mask[offset] : 0;
+          out[x] = static_cast<uint8_t>(-set);
+          histogram[x] += counted & set;
+        }
+      }
+    });
+  }
+
+  LaneTracker::LaneTracker(const LaneTrackerParams& params) : params_(params) {
+    if (params.width < 2 || params.height < 3 || params.num_windows < 1 ||
+        params.margin < 1 || params.min_lane_pixels < 3) {
+      throw std::string("LaneTracker: invalid params");
+    }
+    if (params.smoothing < 0 || params.smoothing >= 1) {
+      throw std::string("LaneTracker: smoothing must be in [0, 1)");
+    }
+    if (params.min_track_ratio < 0 || params.min_track_ratio > 1) {
+      throw std::string("LaneTracker: min_track_ratio must be in [0, 1]");
+    }
+    histogram_.resize(params.width);
+    reset();
+  }
+
+  void LaneTracker::reset() {
+    tracked_[0] = tracked_[1] = false;
+    searchPixels_[0] = searchPixels_[1] = 0;
+    result_ = Result();
+  }
+
+  void LaneTracker::LaneSums::addRow(double rowT, int count, int sumX) {
+    const double rowT2 = rowT * rowT;
+    n += count;
+    t += count * rowT;
+    t2 += count * rowT2;
+    t3 += count * rowT2 * rowT;
+    t4 += count * rowT2 * rowT2;
+    x += sumX;
+    xt += sumX * rowT;
+    xt2 += sumX * rowT2;
+  }
+
+  int LaneTracker::scanRow(const uint8_t* mask, int y, int begin, int end,
+                           LaneSums* sums, int* sumX) const {
+    begin = std::max(begin, 0);
+    end = std::min(end, params_.width);
+    const uint8_t* row = mask + y * params_.width;
+    int count = 0;
+    int rowSumX = 0;
+    for (int x = begin; x < end; ++x) {
+      const int set = row[x] != 0;
+      count += set;
+      rowSumX += set * x;
+    }
+    if (count > 0) {
+      sums->addRow(double(y) / params_.height, count, rowSumX);
+      *sumX += rowSumX;
+    }
+    return count;
+  }
+
+  bool LaneTracker::fitLane(int lane, const LaneSums& sums, float smoothing) {
+    result_.pixels[lane] = static_cast<int32_t>(sums.n);
+    if (sums.n < params_.min_lane_pixels) {
+      return false;
+    }
+    // Solve [n t t2; t t2 t3; t2 t3 t4] [c b a]' = [x xt xt2]' by Cramer's
+    // rule; pixels on too few rows leave it singular.
+    const double m[3][3] = {{sums.n, sums.t, sums.t2},
+                            {sums.t, sums.t2, sums.t3},
+                            {sums.t2, sums.t3, sums.t4}};
+    const double v[3] = {sums.x, sums.xt, sums.xt2};
+    auto det = [](const double (&a)[3][3]) {
+      return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+             a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+             a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    };
+    const double d = det(m);
+    if (!(std::fabs(d) > 1e-12 * sums.n * sums.n * sums.n)) {
+      return false;
+    }
+    double coefficients[3];
+    for (int k = 0; k < 3; ++k) {
+      double replaced[3][3];
+      for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          replaced[i][j] = j == k ? v[i] : m[i][j];
+        }
+      }
+      coefficients[k] = det(replaced) / d;
+    }
+    // Back from t = y / height to mask rows.
+    const double h = params_.height;
+    const float fit[3] = {static_cast<float>(coefficients[2] / (h * h)),
+                          static_cast<float>(coefficients[1] / h),
+                          static_cast<float>(coefficients[0])};
+    for (int k = 0; k < 3; ++k) {
+      result_.fits[lane][k] = smoothing * result_.fits[lane][k] + (1 - smoothing) * fit[k];
+    }
+    return true;
+  }
+
+  void LaneTracker::fullSearch(const uint8_t* mask, const int32_t* histogram) {
+    const int width = params_.width;
+    const int height = params_.height;
+    if (histogram == nullptr) {
+      std::fill(histogram_.begin(), histogram_.end(), 0);
+      for (int y = std::max(params_.histogram_row, 0); y < height; ++y) {
+        const uint8_t* row = mask + y * width;
+        for (int x = 0; x < width; ++x) {
+          histogram_[x] += row[x] != 0;
+        }
+      }
+      histogram = histogram_.data();
+    }
+
+    const int middle = width / 2;
+    const int bases[2] = {
+        static_cast<int>(std::max_element(histogram, histogram + middle) - histogram),
+        static_cast<int>(std::max_element(histogram + middle, histogram + width) - histogram)};
+    result_.found = 0;
+    for (int lane = 0; lane < 2; ++lane) {
+      tracked_[lane] = false;
+      result_.pixels[lane] = 0;
+      if (histogram[bases[lane]] == 0) {
+        continue;
+      }
+      LaneSums sums = LaneSums();
+      int center = bases[lane];
+      for (int w = 0; w < params_.num_windows; ++w) {
+        const int yEnd = height - int64_t(height) * w / params_.num_windows;
+        const int yBegin = height - int64_t(height) * (w + 1) / params_.num_windows;
+        int count = 0;
+        int sumX = 0;
+        for (int y = yBegin; y < yEnd; ++y) {
+          count += scanRow(mask, y, center - params_.margin, center + params_.margin, &sums, &sumX);
+        }
+        if (count >= std::max(params_.min_window_pixels, 1)) {
+          center = (sumX + count / 2) / count;
+        }
+      }
+      searchPixels_[lane] = static_cast<int32_t>(sums.n);
+      if (fitLane(lane, sums, 0)) {
+        tracked_[lane] = true;
+        result_.found |= 1 << lane;
+      }
+    }
+    result_.full_search = 1;
+  }
+
+  bool LaneTracker::track(const uint8_t* mask) {
+    LaneSums sums[2] = {LaneSums(), LaneSums()};
+    for (int y = 0; y < params_.height; ++y) {
+      for (int lane = 0; lane < 2; ++lane) {
+        const float* fit = result_.fits[lane];
+        const int center = static_cast<int>(std::lrint((fit[0] * y + fit[1]) * y + fit[2]));
+        int sumX = 0;
+        scanRow(mask, y, center - params_.margin, center + params_.margin, &sums[lane], &sumX);
+      }
+    }
+    // Refit only when both lanes hold, so a lost lane re-seeds both.
+    for (int lane = 0; lane < 2; ++lane) {
+      if (sums[lane].n < params_.min_lane_pixels ||
+          sums[lane].n < params_.min_track_ratio * searchPixels_[lane]) {
+        return false;
+      }
+    }
+    const Result previous = result_;
+    if (!fitLane(0, sums[0], params_.smoothing) || !fitLane(1, sums[1], params_.smoothing)) {
+      result_ = previous;
+      return false;
+    }
+    result_.found = 3;
+    result_.full_search = 0;
+    return true;
+  }
+
+  int LaneTracker::update(intptr_t mask_data, intptr_t histogram_data) {
+    const uint8_t* mask = (const uint8_t*) mask_data;
+    if (!(tracked_[0] && tracked_[1] && track(mask))) {
+      fullSearch(mask, (const int32_t*) histogram_data);
+    }
+    return result_.found;
+  }
+
+  // Float add and mul epilogues of fused records: `data` holds `rows` rows of
+  // `rowSize` values and is updated in place; `other` is one row, applied to
+  // every row.
+  inline void EpilogueAddFloat32(const ArithmeticParams& params, float* data,
+                                 const float* other, int rows, int rowSize) {
+    const float activationMin = params.float_activation_min;
+    const float activationMax = params.float_activation_max;
+    for (int r = 0; r < rows; ++r) {
+      float* x = data + r * rowSize;
+      for (int c = 0; c < rowSize; ++c) {
+        x[c] = std::min(std::max(x[c] + other[c], activationMin), activationMax);
+      }
+    }
+  }
+
+  inline void EpilogueMulFloat32(const ArithmeticParams& params, float* data,
+                                 const float* other, int rows, int rowSize) {
+    const float activationMin = params.float_activation_min;
+    const float activationMax = params.float_activation_max;
+    for (int r = 0; r < rows; ++r) {
+      float* x = data + r * rowSize;
+      for (int c = 0; c < rowSize; ++c) {
+        x[c] = std::min(std::max(x[c] * other[c], activationMin), activationMax);
+      }
+    }
+  }
+
+  // Milliseconds from an arbitrary origin, for profiling.
+  inline double NowMs() {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // Images written by ExecutionPlan::save(): a PlanImageHeader, the values
+  // of the constants and the requantization arrays (addressed by image
+  // offset), then from `recordsOffset` the sections load() reads in order.
+  // Every section starts 16 byte aligned within the image.
+  struct PlanImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flavour;
+    uint32_t opSize;
+    uint32_t epilogueSize;
+    uint32_t profiling;
+    uint32_t operandCount;
+    uint32_t dimCount;
+    uint32_t opCount;
+    uint32_t epilogueCount;
+    uint32_t fusedCount;
+    uint32_t listCount;
+    uint32_t concatCount;
+    uint32_t packedConvCount;
+    uint32_t packedDepthwiseCount;
+    uint32_t winogradCount;
+    uint32_t reserved;
+    uint64_t arenaSize;
+    uint64_t recordsOffset;
+    uint64_t imageBytes;
+  };
+
+  constexpr char kPlanImageMagic[8] = "NNPLAN";
+
+  enum PlanImageOperandFlags {
+    kImagePlanned = 1,
+    kImagePinned = 2,
+    kImageConstant = 4,
+  };
+
+  struct PlanImageOperand {
+    int32_t rank;
+    // Index of the first dimension in the dims section.
+    uint32_t dimsBegin;
+    int32_t alias;
+    uint32_t flags;
+    uint64_t bytes;
+    uint64_t aliasOffset;
+    // Arena offset of planned operands, image offset of constants.
+    uint64_t offset;
+  };
+
+  struct PlanImagePackedConv {
+    int32_t outputDepth;
+    int32_t patchSize;
+    int32_t packedPatchSize;
+    int32_t reserved;
+    uint64_t dataCount;
+    uint64_t rowSumsCount;
+  };
+
+  struct PlanImagePackedDepthwise {
+    int32_t weightsOffset;
+    int32_t reserved;
+    uint64_t tapsCount;
+  };
+
+  struct PlanImageWinograd {
+    int32_t tile;
+    int32_t inputDepth;
+    int32_t outputDepth;
+    int32_t reserved;
+    uint64_t dataCount;
+  };
+
+  // Records and packed filters are stored as laid out in memory, so images
+  // only load into builds with the same pointer size and kernels.
+  inline uint32_t PlanImageFlavour() {
+    uint32_t flavour = sizeof(void*);
+#ifdef __wasm_simd128__
+    flavour |= 0x100;
+#endif
+    return flavour;
+  }
+
+  inline size_t AlignImage(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+  }
+
+  // Appends sections to an image; without an image it only counts bytes.
+  class PlanImageWriter {
+   public:
+    explicit PlanImageWriter(char* image) : image_(image) {}
+
+    // Returns the offset `count` values were written at.
+    template <typename T>
+    size_t put(const T* values, size_t count) {
+      const size_t offset = AlignImage(size_);
+      if (image_ != nullptr) {
+        memset(image_ + size_, 0, offset - size_);
+        if (count > 0) {
+          memcpy(image_ + offset, values, count * sizeof(T));
+        }
+      }
+      size_ = offset + count * sizeof(T);
+      return offset;
+    }
+
+    size_t size() const { return size_; }
+
+   private:
+    char* image_;
+    size_t size_ = 0;
+  };
+
+  // Reads the sections of an image, checking they lie within it.
+  class PlanImageReader {
+   public:
+    PlanImageReader(const char* image, size_t size) : image_(image), size_(size) {}
+
+    template <typename T>
+    const T* at(uint64_t offset, uint64_t count) const {
+      if (offset % 16 != 0 || offset > size_ || count > (size_ - offset) / sizeof(T)) {
+        throw std::string("ExecutionPlan: truncated plan image");
+      }
+      return reinterpret_cast<const T*>(image_ + offset);
+    }
+
+    template <typename T>
+    const T* get(uint64_t count) {
+      const size_t offset = AlignImage(position_);
+      const T* values = at<T>(offset, count);
+      position_ = offset + count * sizeof(T);
+      return values;
+    }
+
+    void seek(uint64_t offset) { position_ = offset; }
+
+   private:
+    const char* image_;
+    size_t size_;
+    size_t position_ = 0;
+  };
+
+  constexpr size_t ExecutionPlan::kArenaAlignment;
+  constexpr size_t ExecutionPlan::kNoArenaOffset;
+  constexpr uint32_t ExecutionPlan::kImageVersion;
+  constexpr size_t ExecutionPlan::kFusionBandBytes;
+  constexpr int ExecutionPlan::kBandOutput;
+
+  int ExecutionPlan::addOperand(const std::vector<int32_t>& dims, intptr_t data) {
+    Operand operand;
+    operand.shape.ReplaceWith(dims.size(), dims.data());
+    operand.data = data;
+    operand.bytes = 0;
+    operand.planned = false;
+    operand.pinned = false;
+    operand.alias = -1;
+    operand.aliasOffset = 0;
+    operand.arenaOffset = kNoArenaOffset;
+    operands_.push_back(operand);
+    return operands_.size() - 1;
+  }
+
+  int ExecutionPlan::addPlannedOperand(const std::vector<int32_t>& dims, int bytes) {
+    const int index = addOperand(dims, 0);
+    operands_[index].bytes = bytes;
+    operands_[index].planned = true;
+    return index;
+  }
+
+  int ExecutionPlan::addConstant(const std::vector<int32_t>& dims, intptr_t data, int bytes) {
+    const int index = addOperand(dims, data);
+    operands_[index].bytes = bytes;
+    return index;
+  }
+
+  void ExecutionPlan::identifyInputsAndOutputs(const std::vector<int>& inputs,
+                                               const std::vector<int>& outputs) {
+    for (int index : inputs) {
+      checkOperand(index);
+      operands_[index].pinned = true;
+    }
+    for (int index : outputs) {
+      checkOperand(index);
+      operands_[index].pinned = true;
+    }
+  }
+
+  int ExecutionPlan::planMemory() {
+    const int numOps = ops_.size();
+    std::vector<int> first(operands_.size(), std::numeric_limits<int>::max());
+    std::vector<int> last(operands_.size(), -1);
+    auto touch = [&](int index, int op) {
+      if (index >= 0) {
+        first[index] = std::min(first[index], op);
+        last[index] = std::max(last[index], op);
+      }
+    };
+    for (int i = 0; i < numOps; ++i) {
+      const Op& op = ops_[i];
+      for (int index : op.inputs) {
+        touch(index, i);
+      }
+      touch(op.output, i);
+      for (int k = 0; k < op.listCount; ++k) {
+        touch(operandLists_[op.listBegin + k], i);
+      }
+      for (int k = 0; k < op.epilogueCount; ++k) {
+        touch(epilogues_[op.epilogueBegin + k].other, i);
+      }
+    }
+    // A root lives as long as any of its views.
+    for (size_t i = 0; i < operands_.size(); ++i) {
+      const int root = operands_[i].alias;
+      if (root >= 0 && last[i] >= 0) {
+        first[root] = std::min(first[root], first[i]);
+        last[root] = std::max(last[root], last[i]);
+      }
+    }
+
+    struct Placement {
+      int operand;
+      size_t offset;
+    };
+    std::vector<int> order;
+    for (size_t i = 0; i < operands_.size(); ++i) {
+      Operand& operand = operands_[i];
+      if (!operand.planned || operand.alias >= 0) {
+        continue;
+      }
+      if (operand.pinned) {
+        first[i] = -1;
+        last[i] = numOps;
+      }
+      if (last[i] < 0 || operand.bytes == 0) {
+        // never touched: no storage
+        operand.data = 0;
+        continue;
+      }
+      order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+      return operands_[a].bytes > operands_[b].bytes;
+    });
+
+    std::vector<Placement> placed;
+    std::vector<Placement> conflicts;
+    size_t arenaSize = 0;
+    for (int index : order) {
+      const size_t bytes = alignArena(operands_[index].bytes);
+      conflicts.clear();
+      for (const Placement& other : placed) {
+        if (first[other.operand] <= last[index] && first[index] <= last[other.operand]) {
+          conflicts.push_back(other);
+        }
+      }
+      std::sort(conflicts.begin(), conflicts.end(),
+                [](const Placement& a, const Placement& b) { return a.offset < b.offset; });
+      size_t offset = 0;
+      for (const Placement& other : conflicts) {
+        if (offset + bytes <= other.offset) {
+          break;
+        }
+        offset = std::max(offset, other.offset + alignArena(operands_[other.operand].bytes));
+      }
+      placed.push_back({index, offset});
+      arenaSize = std::max(arenaSize, offset + bytes);
+    }
+
+    arena_.reset(new (std::nothrow) char[arenaSize + kArenaAlignment]);
+    if (arena_ == nullptr) {
+      throw std::string("ExecutionPlan: not enough memory for the tensor arena");
+    }
+    arenaSize_ = arenaSize;
+    char* base = reinterpret_cast<char*>(
+        alignArena(reinterpret_cast<uintptr_t>(arena_.get())));
+    for (const Placement& placement : placed) {
+      operands_[placement.operand].data = reinterpret_cast<intptr_t>(base + placement.offset);
+      operands_[placement.operand].arenaOffset = placement.offset;
+    }
+    for (Operand& operand : operands_) {
+      if (operand.alias >= 0) {
+        const intptr_t root = operands_[operand.alias].data;
+        operand.data = root ? root + operand.aliasOffset : 0;
+      }
+    }
+
+    reserveScratch();
+    return arenaSize;
+  }
+
+  void ExecutionPlan::reserveScratch() {
+    // im2col buffers are used by the calling thread only, quantized conv,
+    // depthwise and Winograd scratch by every thread.
+    size_t im2colBytes = 0;
+    size_t threadBytes = 0;
+    for (const Op& op : ops_) {
+      if (op.code == kPlanConvFloat32 && op.packedFilter >= 0) {
+        const WinogradFilter& filter = winogradFilters_[op.packedFilter];
+        threadBytes = std::max(threadBytes, WinogradScratchBytes(filter.tile, filter.inputDepth,
+                                                                 filter.outputDepth));
+      } else if (op.code == kPlanConvFloat32 || op.code == kPlanConvUint8) {
+        const uint64_t bytes = Im2colBytes(shape(op.inputs[0]), shape(op.inputs[1]), shape(op.output),
+                                           op.code == kPlanConvFloat32 ? sizeof(float) : 1);
+        im2colBytes = std::max<size_t>(im2colBytes, std::min<uint64_t>(bytes, 0x7fffffff));
+      } else if (op.packedFilter >= 0 && isConvCode(op.code)) {
+        threadBytes = std::max(threadBytes,
+                               QuantizedConvScratchBytes(shape(op.output).Dims(3),
+                                                         packedConv_[op.packedFilter].packedPatchSize, 1));
+      } else if (isDepthwiseCode(op.code) &&
+                 (op.packedFilter >= 0 || (op.code == kPlanDepthwiseConvFloat32 &&
+                                           op.depthwiseKernel != kDepthwiseGeneric))) {
+        // One accumulator row, int32 or float.
+        threadBytes = std::max(threadBytes, shape(op.output).Dims(3) * sizeof(int32_t));
+      }
+    }
+    Pool().ReserveScratch(threadBytes);
+    Pool().ReserveSharedScratch(im2colBytes);
+    scratchSize_ = std::max(threadBytes, im2colBytes);
+  }
+
+  int ExecutionPlan::getImageSize() const {
+    const size_t bytes = writeImage(nullptr);
+    if (bytes > 0x7fffffff) {
+      throw std::string("ExecutionPlan: plan image too large");
+    }
+    return bytes;
+  }
+
+  void ExecutionPlan::save(intptr_t image, int bytes) const {
+    if (bytes < getImageSize()) {
+      throw std::string("ExecutionPlan: plan image buffer too small");
+    }
+    writeImage(reinterpret_cast<char*>(image));
+  }
+
+  size_t ExecutionPlan::writeImage(char* image) const {
+    PlanImageWriter writer(image);
+    PlanImageHeader header;
+    memset(&header, 0, sizeof(header));
+    // written again once the counts are known
+    writer.put(&header, 1);
+
+    std::vector<PlanImageOperand> operands(operands_.size());
+    std::vector<int32_t> dims;
+    for (size_t i = 0; i < operands_.size(); ++i) {
+      const Operand& operand = operands_[i];
+      PlanImageOperand& record = operands[i];
+      memset(&record, 0, sizeof(record));
+      record.rank = operand.shape.DimensionsCount();
+      record.dimsBegin = dims.size();
+      for (int d = 0; d < record.rank; ++d) {
+        dims.push_back(operand.shape.Dims(d));
+      }
+      record.alias = operand.alias;
+      record.bytes = operand.bytes;
+      record.aliasOffset = operand.aliasOffset;
+      record.offset = kNoArenaOffset;
+      if (operand.pinned) {
+        record.flags |= kImagePinned;
+      }
+      if (operand.planned) {
+        record.flags |= kImagePlanned;
+        record.offset = operand.arenaOffset;
+      } else if (operand.bytes > 0) {
+        record.flags |= kImageConstant;
+        record.offset = writer.put(reinterpret_cast<const char*>(operand.data), operand.bytes);
+      } else if (operand.data != 0) {
+        throw std::string("ExecutionPlan: constants must be added with addConstant() to be saved");
+      }
+    }
+
+    // Requantization arrays hold one value per output channel. The
+    // concatenation pointers are set by runOp().
+    std::vector<Op> ops(ops_);
+    for (Op& op : ops) {
+      if (op.code == kPlanExternal) {
+        throw std::string("ExecutionPlan: plans with externals cannot be saved");
+      }
+      if (op.outputMultipliers != 0 || op.outputShifts != 0) {
+        const size_t channels = shape(op.output).Dims(3);
+        op.outputMultipliers = writer.put(reinterpret_cast<const int32_t*>(op.outputMultipliers),
+                                          channels);
+        op.outputShifts = writer.put(reinterpret_cast<const int32_t*>(op.outputShifts), channels);
+      }
+      op.concatenation.input_scale = nullptr;
+      op.concatenation.input_zeropoint = nullptr;
+    }
+
+    header.recordsOffset = writer.put(dims.data(), dims.size());
+    writer.put(operands.data(), operands.size());
+    writer.put(ops.data(), ops.size());
+    writer.put(epilogues_.data(), epilogues_.size());
+    writer.put(fusedInto_.data(), fusedInto_.size());
+    writer.put(operandLists_.data(), operandLists_.size());
+    writer.put(concatScales_.data(), concatScales_.size());
+    writer.put(concatZeroPoints_.data(), concatZeroPoints_.size());
+    for (const PackedConvFilter<int8_t>& filter : packedConv_) {
+      const PlanImagePackedConv record = {filter.outputDepth, filter.patchSize,
+                                          filter.packedPatchSize, 0,
+                                          filter.data.size(), filter.rowSums.size()};
+      writer.put(&record, 1);
+      writer.put(filter.data.data(), filter.data.size());
+      writer.put(filter.rowSums.data(), filter.rowSums.size());
+    }
+    for (const PackedDepthwiseFilter& filter : packedDepthwise_) {
+      const PlanImagePackedDepthwise record = {filter.weightsOffset, 0, filter.taps.size()};
+      writer.put(&record, 1);
+      writer.put(filter.taps.data(), filter.taps.size());
+    }
+    for (const WinogradFilter& filter : winogradFilters_) {
+      const PlanImageWinograd record = {filter.tile, filter.inputDepth, filter.outputDepth, 0,
+                                        filter.data.size()};
+      writer.put(&record, 1);
+      writer.put(filter.data.data(), filter.data.size());
+    }
+
+    if (image != nullptr) {
+      memcpy(header.magic, kPlanImageMagic, sizeof(header.magic));
+      header.version = kImageVersion;
+      header.flavour = PlanImageFlavour();
+      header.opSize = sizeof(Op);
+      header.epilogueSize = sizeof(Epilogue);
+      header.profiling = profiling_;
+      header.operandCount = operands.size();
+      header.dimCount = dims.size();
+      header.opCount = ops.size();
+      header.epilogueCount = epilogues_.size();
+      header.fusedCount = fusedInto_.size();
+      header.listCount = operandLists_.size();
+      header.concatCount = concatScales_.size();
+      header.packedConvCount = packedConv_.size();
+      header.packedDepthwiseCount = packedDepthwise_.size();
+      header.winogradCount = winogradFilters_.size();
+      header.arenaSize = arenaSize_;
+      header.imageBytes = writer.size();
+      memcpy(image, &header, sizeof(header));
+    }
+    return writer.size();
+  }
+
+  bool ExecutionPlan::load(intptr_t image, int bytes) {
+    if (!operands_.empty() || !ops_.empty()) {
+      throw std::string("ExecutionPlan: load() needs an empty plan");
+    }
+    PlanImageReader reader(reinterpret_cast<const char*>(image), std::max(bytes, 0));
+    const PlanImageHeader& header = *reader.get<PlanImageHeader>(1);
+    if (memcmp(header.magic, kPlanImageMagic, sizeof(header.magic)) != 0) {
+      throw std::string("ExecutionPlan: not a plan image");
+    }
+    if (header.version != kImageVersion || header.flavour != PlanImageFlavour() ||
+        header.opSize != sizeof(Op) || header.epilogueSize != sizeof(Epilogue)) {
+      return false;
+    }
+    if (header.imageBytes != (uint64_t)bytes) {
+      throw std::string("ExecutionPlan: truncated plan image");
+    }
+
+    // Check every index and range before the plan is touched.
+    reader.seek(header.recordsOffset);
+    const int32_t* dims = reader.get<int32_t>(header.dimCount);
+    const PlanImageOperand* operands = reader.get<PlanImageOperand>(header.operandCount);
+    const Op* ops = reader.get<Op>(header.opCount);
+    const Epilogue* epilogues = reader.get<Epilogue>(header.epilogueCount);
+    const int* fusedInto = reader.get<int>(header.fusedCount);
+    const int* lists = reader.get<int>(header.listCount);
+    const float* concatScales = reader.get<float>(header.concatCount);
+    const int32_t* concatZeroPoints = reader.get<int32_t>(header.concatCount);
+    const int operandCount = header.operandCount;
+    auto checkIndex = [](bool valid) {
+      if (!valid) {
+        throw std::string("ExecutionPlan: invalid plan image");
+      }
+    };
+    checkIndex(header.operandCount <= 0x7fffffff && header.arenaSize <= 0x7fffffff);
+    for (int i = 0; i < operandCount; ++i) {
+      const PlanImageOperand& record = operands[i];
+      checkIndex(record.rank >= 0 && record.dimsBegin <= header.dimCount &&
+                 (uint32_t)record.rank <= header.dimCount - record.dimsBegin);
+      checkIndex(record.alias < operandCount &&
+                 (record.alias < 0 || operands[record.alias].alias < 0));
+      if (record.flags & kImageConstant) {
+        reader.at<char>(record.offset, record.bytes);
+      } else if ((record.flags & kImagePlanned) && record.offset != kNoArenaOffset) {
+        checkIndex(record.offset <= header.arenaSize &&
+                   record.bytes <= header.arenaSize - record.offset);
+      }
+    }
+    auto isOperand = [operandCount](int index) { return index >= 0 && index < operandCount; };
+    for (uint32_t i = 0; i < header.opCount; ++i) {
+      const Op& op = ops[i];
+      for (int index : op.inputs) {
+        checkIndex(index == -1 || isOperand(index));
+      }
+      checkIndex(op.code != kPlanExternal && (op.output == -1 || isOperand(op.output)));
+      checkIndex(op.listBegin >= 0 && op.listCount >= 0 &&
+                 (uint32_t)op.listBegin + op.listCount <= header.listCount);
+      checkIndex(op.epilogueBegin >= 0 && op.epilogueCount >= 0 &&
+                 (uint32_t)op.epilogueBegin + op.epilogueCount <= header.epilogueCount);
+      if (op.code == kPlanConcatenationFloat32 || op.code == kPlanConcatenationUint8) {
+        checkIndex((uint32_t)op.listBegin + op.listCount <= header.concatCount);
+      }
+      const uint32_t filters = op.code == kPlanConvFloat32 ? header.winogradCount :
+                               isConvCode(op.code) ? header.packedConvCount :
+                               header.packedDepthwiseCount;
+      checkIndex(op.packedFilter < 0 || (uint32_t)op.packedFilter < filters);
+      if (op.outputMultipliers != 0 || op.outputShifts != 0) {
+        checkIndex(isOperand(op.output) && operands[op.output].rank == 4);
+        const int32_t channels = dims[operands[op.output].dimsBegin + 3];
+        reader.at<int32_t>(op.outputMultipliers, channels);
+        reader.at<int32_t>(op.outputShifts, channels);
+      }
+    }
+    for (uint32_t i = 0; i < header.epilogueCount; ++i) {
+      checkIndex(epilogues[i].other == -1 || isOperand(epilogues[i].other));
+    }
+    for (uint32_t i = 0; i < header.listCount; ++i) {
+      checkIndex(isOperand(lists[i]));
+    }
+
+    arena_.reset(new (std::nothrow) char[header.arenaSize + kArenaAlignment]);
+    if (arena_ == nullptr) {
+      throw std::string("ExecutionPlan: not enough memory for the tensor arena");
+    }
+    arenaSize_ = header.arenaSize;
+    char* base = reinterpret_cast<char*>(
+        alignArena(reinterpret_cast<uintptr_t>(arena_.get())));
+    for (int i = 0; i < operandCount; ++i) {
+      const PlanImageOperand& record = operands[i];
+      Operand operand;
+      operand.shape.ReplaceWith(record.rank, dims + record.dimsBegin);
+      operand.bytes = record.bytes;
+      operand.planned = (record.flags & kImagePlanned) != 0;
+      operand.pinned = (record.flags & kImagePinned) != 0;
+      operand.alias = record.alias;
+      operand.aliasOffset = record.aliasOffset;
+      operand.arenaOffset = operand.planned ? record.offset : kNoArenaOffset;
+      operand.data = 0;
+      if (record.flags & kImageConstant) {
+        operand.data = image + record.offset;
+      } else if (operand.arenaOffset != kNoArenaOffset) {
+        operand.data = reinterpret_cast<intptr_t>(base + operand.arenaOffset);
+      }
+      operands_.push_back(operand);
+    }
+    for (Operand& operand : operands_) {
+      if (operand.alias >= 0) {
+        const intptr_t root = operands_[operand.alias].data;
+        operand.data = root ? root + operand.aliasOffset : 0;
+      }
+    }
+
+    ops_.assign(ops, ops + header.opCount);
+    for (Op& op : ops_) {
+      if (op.outputMultipliers != 0 || op.outputShifts != 0) {
+        op.outputMultipliers += image;
+        op.outputShifts += image;
+      }
+    }
+    timings_.assign(ops_.size(), 0.0);
+    profiling_ = header.profiling != 0;
+    epilogues_.assign(epilogues, epilogues + header.epilogueCount);
+    fusedInto_.assign(fusedInto, fusedInto + header.fusedCount);
+    operandLists_.assign(lists, lists + header.listCount);
+    concatScales_.assign(concatScales, concatScales + header.concatCount);
+    concatZeroPoints_.assign(concatZeroPoints, concatZeroPoints + header.concatCount);
+    concatShapes_.assign(header.concatCount, nullptr);
+    for (const Op& op : ops_) {
+      if (op.code == kPlanConcatenationFloat32 || op.code == kPlanConcatenationUint8) {
+        for (int k = 0; k < op.listCount; ++k) {
+          concatShapes_[op.listBegin + k] = &operands_[operandLists_[op.listBegin + k]].shape;
+        }
+      }
+    }
+    concatFloatData_.resize(operandLists_.size());
+    concatUint8Data_.resize(operandLists_.size());
+
+    for (uint32_t i = 0; i < header.packedConvCount; ++i) {
+      const PlanImagePackedConv& record = *reader.get<PlanImagePackedConv>(1);
+      const int8_t* data = reader.get<int8_t>(record.dataCount);
+      const int32_t* rowSums = reader.get<int32_t>(record.rowSumsCount);
+      packedConv_.emplace_back();
+      PackedConvFilter<int8_t>& filter = packedConv_.back();
+      filter.outputDepth = record.outputDepth;
+      filter.patchSize = record.patchSize;
+      filter.packedPatchSize = record.packedPatchSize;
+      filter.data.assign(data, data + record.dataCount);
+      filter.rowSums.assign(rowSums, rowSums + record.rowSumsCount);
+    }
+    for (uint32_t i = 0; i < header.packedDepthwiseCount; ++i) {
+      const PlanImagePackedDepthwise& record = *reader.get<PlanImagePackedDepthwise>(1);
+      const int16_t* taps = reader.get<int16_t>(record.tapsCount);
+      packedDepthwise_.emplace_back();
+      packedDepthwise_.back().weightsOffset = record.weightsOffset;
+      packedDepthwise_.back().taps.assign(taps, taps + record.tapsCount);
+    }
+    for (uint32_t i = 0; i < header.winogradCount; ++i) {
+      const PlanImageWinograd& record = *reader.get<PlanImageWinograd>(1);
+      const float* data = reader.get<float>(record.dataCount);
+      winogradFilters_.emplace_back();
+      WinogradFilter& filter = winogradFilters_.back();
+      filter.tile = record.tile;
+      filter.inputDepth = record.inputDepth;
+      filter.outputDepth = record.outputDepth;
+      filter.data.assign(data, data + record.dataCount);
+    }
+
+    reserveScratch();
+    return true;
+  }
+
+  int ExecutionPlan::alias() {
+    std::vector<bool> external(operands_.size(), false);
+    for (const Op& op : ops_) {
+      if (op.code == kPlanExternal) {
+        for (int k = 0; k < op.listCount; ++k) {
+          external[operandLists_[op.listBegin + k]] = true;
+        }
+      }
+    }
+    // A root that can become a view.
+    auto movable = [this](int index) {
+      const Operand& operand = operands_[index];
+      return operand.alias < 0 && operand.planned && !operand.pinned && operand.bytes > 0;
+    };
+    // Whether root `index` and its views may live in the storage of `root`.
+    auto joinable = [&](int index, int root) {
+      if (!operands_[root].planned || operands_[root].bytes == 0) {
+        return false;
+      }
+      if (!operands_[root].pinned) {
+        return true;
+      }
+      for (size_t i = 0; i < operands_.size(); ++i) {
+        if (external[i] && (int(i) == index || operands_[i].alias == index)) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    int aliased = 0;
+    std::vector<int> roots;
+    for (Op& op : ops_) {
+      const int output = op.output;
+      if (op.code == kPlanReshapeFloat32 || op.code == kPlanReshapeUint8) {
+        const int input = op.inputs[0];
+        const int root = aliasRoot(input);
+        if (operands_[input].bytes != operands_[output].bytes || !operands_[input].planned) {
+          continue;
+        }
+        if (movable(root) && operands_[root].bytes == operands_[output].bytes &&
+            joinable(root, output)) {
+          joinAlias(root, output, 0);
+        } else if (movable(output) && joinable(output, root)) {
+          joinAlias(output, root, operands_[input].alias >= 0 ? operands_[input].aliasOffset : 0);
+        } else {
+          continue;
+        }
+      } else if (op.code == kPlanConcatenationFloat32 || op.code == kPlanConcatenationUint8) {
+        // Slices are contiguous when every axis before the concatenated one
+        // has size 1.
+        const RuntimeShape& outputShape = shape(output);
+        bool contiguous = true;
+        for (int d = 0; d < op.concatenation.axis; ++d) {
+          contiguous = contiguous && outputShape.Dims(d) == 1;
+        }
+        size_t bytes = 0;
+        roots.clear();
+        for (int k = 0; k < op.listCount && contiguous; ++k) {
+          const int input = operandLists_[op.listBegin + k];
+          const int root = aliasRoot(input);
+          contiguous = movable(root) && operands_[root].bytes == operands_[input].bytes &&
+                       std::find(roots.begin(), roots.end(), root) == roots.end() &&
+                       joinable(root, output);
+          if (op.code == kPlanConcatenationUint8) {
+            contiguous = contiguous &&
+                         concatScales_[op.listBegin + k] == op.concatenation.output_scale &&
+                         concatZeroPoints_[op.listBegin + k] == op.concatenation.output_zeropoint;
+          }
+          roots.push_back(root);
+          bytes += operands_[input].bytes;
+        }
+        if (!contiguous || bytes != operands_[output].bytes) {
+          continue;
+        }
+        size_t offset = 0;
+        for (int root : roots) {
+          const size_t rootBytes = operands_[root].bytes;
+          joinAlias(root, output, offset);
+          offset += rootBytes;
+        }
+      } else {
+        continue;
+      }
+      op.code = kPlanNop;
+      ++aliased;
+    }
+    return aliased;
+  }
+
+  int ExecutionPlan::aliasRoot(int index) const {
+    const int root = operands_[index].alias;
+    return root >= 0 ? root : index;
+  }
+
+  void ExecutionPlan::joinAlias(int index, int root, size_t offset) {
+    for (Operand& operand : operands_) {
+      if (operand.alias == index) {
+        operand.alias = root;
+        operand.aliasOffset += offset;
+      }
+    }
+    operands_[index].alias = root;
+    operands_[index].aliasOffset = offset;
+  }
+
+  int ExecutionPlan::fuse() {
+    // Folded records change the costs of their producers.
+    costs_.clear();
+    const int numOps = ops_.size();
+    std::vector<int> uses(operands_.size(), 0);
+    std::vector<int> consumer(operands_.size(), -1);
+    std::vector<int> writer(operands_.size(), -1);
+    for (int i = 0; i < numOps; ++i) {
+      const Op& op = ops_[i];
+      for (int index : op.inputs) {
+        if (index >= 0) {
+          ++uses[index];
+          consumer[index] = i;
+        }
+      }
+      // External lists hold inputs and outputs; count both ways.
+      for (int k = 0; k < op.listCount; ++k) {
+        const int index = operandLists_[op.listBegin + k];
+        ++uses[index];
+        consumer[index] = i;
+        if (op.code == kPlanExternal) {
+          writer[index] = i;
+        }
+      }
+      for (int k = 0; k < op.epilogueCount; ++k) {
+        const int index = epilogues_[op.epilogueBegin + k].other;
+        if (index >= 0) {
+          ++uses[index];
+        }
+      }
+      if (op.output >= 0) {
+        writer[op.output] = i;
+      }
+    }
+
+    fusedInto_.assign(numOps, -1);
+    int fused = 0;
+    for (int i = 0; i < numOps; ++i) {
+      Op& producer = ops_[i];
+      if (!isBanded(producer.code)) {
+        continue;
+      }
+      for (;;) {
+        const int value = producer.output;
+        if (value < 0 || operands_[value].pinned || uses[value] != 1 || consumer[value] <= i) {
+          break;
+        }
+        const int j = consumer[value];
+        Epilogue epilogue;
+        if (!makeEpilogue(producer.code, ops_[j], value, &epilogue) ||
+            (epilogue.other >= 0 && writer[epilogue.other] >= i)) {
+          break;
+        }
+        if (producer.epilogueCount == 0) {
+          producer.epilogueBegin = epilogues_.size();
+        }
+        epilogues_.push_back(epilogue);
+        ++producer.epilogueCount;
+        producer.output = ops_[j].output;
+        writer[producer.output] = i;
+        ops_[j] = newOp(kPlanNop, {}, -1);
+        fusedInto_[j] = i;
+        ++fused;
+      }
+    }
+    return fused;
+  }
+
+  int ExecutionPlan::getFusedInto(int index) const {
+    checkOp(index);
+    return index < (int)fusedInto_.size() ? fusedInto_[index] : -1;
+  }
+
+  void ExecutionPlan::setOperandData(int index, intptr_t data) {
+    checkOperand(index);
+    operands_[index].data = data;
+    for (Operand& operand : operands_) {
+      if (operand.alias == index) {
+        operand.data = data + operand.aliasOffset;
+      }
+    }
+  }
+
+  intptr_t ExecutionPlan::getOperandData(int index) {
+    checkOperand(index);
+    return operands_[index].data;
+  }
+
+  int ExecutionPlan::addExternal(const std::vector<int>& inputs, const std::vector<int>& outputs) {
+    Op op = newOp(kPlanExternal, {}, -1);
+    op.listBegin = operandLists_.size();
+    for (int index : inputs) {
+      checkOperand(index);
+      operandLists_.push_back(index);
+    }
+    for (int index : outputs) {
+      checkOperand(index);
+      operandLists_.push_back(index);
+    }
+    op.listCount = operandLists_.size() - op.listBegin;
+    return push(op);
+  }
+
+  int ExecutionPlan::addNop() {
+    return push(newOp(kPlanNop, {}, -1));
+  }
+
+  int ExecutionPlan::addArithmetic(PlanOpCode code, const ArithmeticParams& params,
+                                   int input1, int input2, int output) {
+    Op op = newOp(code, {input1, input2}, output);
+    op.arithmetic = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addConv(PlanOpCode code, const ConvParams& params,
+                             int input, int filter, int bias, int output,
+                             intptr_t outputMultipliers, intptr_t outputShifts) {
+    Op op = newOp(code, {input, filter, bias}, output);
+    op.conv = params;
+    op.outputMultipliers = outputMultipliers;
+    op.outputShifts = outputShifts;
+    if ((code == kPlanConvInt8 || code == kPlanConvUint8PerChannel ||
+         code == kPlanConvInt8PerChannel) && isConstant(filter)) {
+      op.packedFilter = packConvFilter(filter);
+    } else if (code == kPlanConvFloat32 && isConstant(filter)) {
+      const int tile = WinogradTileSize(params, shape(input), shape(filter), shape(output));
+      if (tile > 0) {
+        op.packedFilter = transformWinogradFilter(filter, tile);
+      }
+    }
+    return push(op);
+  }
+
+  int ExecutionPlan::addDepthwiseConv(PlanOpCode code, const DepthwiseParams& params,
+                                      int input, int filter, int bias, int output,
+                                      intptr_t outputMultipliers, intptr_t outputShifts) {
+    Op op = newOp(code, {input, filter, bias}, output);
+    op.depthwise = params;
+    op.outputMultipliers = outputMultipliers;
+    op.outputShifts = outputShifts;
+    op.depthwiseKernel = SelectDepthwiseKernel(params, shape(filter));
+    if ((code == kPlanDepthwiseConvInt8 || code == kPlanDepthwiseConvUint8PerChannel ||
+         code == kPlanDepthwiseConvInt8PerChannel) && isConstant(filter)) {
+      op.packedFilter = packDepthwiseFilter(filter, params.weights_offset);
+    }
+    return push(op);
+  }
+
+  int ExecutionPlan::addPool(PlanOpCode code, const PoolParams& params, int input, int output) {
+    Op op = newOp(code, {input}, output);
+    op.pool = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addSoftmax(PlanOpCode code, const SoftmaxParams& params, int input, int output) {
+    Op op = newOp(code, {input}, output);
+    op.softmax = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addConcatenation(PlanOpCode code, const ConcatenationParams& params,
+                                      const std::vector<int>& inputs,
+                                      const std::vector<float>& inputScales,
+                                      const std::vector<int32_t>& inputZeroPoints,
+                                      int output) {
+    if (inputs.size() != params.inputs_count ||
+        (code == kPlanConcatenationUint8 &&
+         (inputScales.size() != inputs.size() || inputZeroPoints.size() != inputs.size()))) {
+      throw std::string("ExecutionPlan: invalid concatenation inputs");
+    }
+    Op op = newOp(code, {}, output);
+    op.concatenation = params;
+    op.listBegin = operandLists_.size();
+    op.listCount = inputs.size();
+    // The concat* arrays are indexed in parallel with operandLists_.
+    concatShapes_.resize(op.listBegin);
+    concatScales_.resize(op.listBegin);
+    concatZeroPoints_.resize(op.listBegin);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      checkOperand(inputs[i]);
+      operandLists_.push_back(inputs[i]);
+      concatShapes_.push_back(&operands_[inputs[i]].shape);
+      concatScales_.push_back(i < inputScales.size() ? inputScales[i] : 0.f);
+      concatZeroPoints_.push_back(i < inputZeroPoints.size() ? inputZeroPoints[i] : 0);
+    }
+    concatFloatData_.resize(operandLists_.size());
+    concatUint8Data_.resize(operandLists_.size());
+    return push(op);
+  }
+
+  int ExecutionPlan::addFullyConnected(PlanOpCode code, const FullyConnectedParams& params,
+                                       int input, int weights, int bias, int output) {
+    Op op = newOp(code, {input, weights, bias}, output);
+    op.fullyConnected = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addResizeBilinear(PlanOpCode code, const ResizeBilinearParams& params,
+                                       int input, int outSize, int output) {
+    Op op = newOp(code, {input, outSize}, output);
+    op.resizeBilinear = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addTranspose(PlanOpCode code, const TransposeParams& params, int input, int output) {
+    Op op = newOp(code, {input}, output);
+    op.transpose = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addLogistic(PlanOpCode code, const LogisticParams& params, int input, int output) {
+    Op op = newOp(code, {input}, output);
+    op.logistic = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addPrelu(PlanOpCode code, const PreluParams& params, int input, int alpha, int output) {
+    Op op = newOp(code, {input, alpha}, output);
+    op.prelu = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addQuantize(PlanOpCode code, const QuantizeParams& params, int input, int output) {
+    Op op = newOp(code, {input}, output);
+    op.quantize = params;
+    return push(op);
+  }
+
+  int ExecutionPlan::addOperation(PlanOpCode code, int input1, int input2, int input3, int output) {
+    return push(newOp(code, {input1, input2, input3}, output));
+  }
+
+  void ExecutionPlan::addTiming(int index, double ms) {
+    checkOp(index);
+    timings_[index] += ms;
+    const double end = NowMs();
+    recordProfile(index, end - ms, end);
+  }
+
+  void ExecutionPlan::resetTimings() {
+    std::fill(timings_.begin(), timings_.end(), 0.0);
+    profileHead_ = 0;
+    profileSamples_ = 0;
+  }
+
+  ExecutionPlan::OpCost ExecutionPlan::opCost(const Op& op) const {
+    OpCost cost = {0, 0, 0};
+    if (op.code == kPlanNop || op.code == kPlanExternal) {
+      return cost;
+    }
+    const bool byteCode = isUint8Code(op.code) || op.code == kPlanConvInt8 ||
+                          op.code == kPlanConvInt8PerChannel ||
+                          op.code == kPlanDepthwiseConvInt8 ||
+                          op.code == kPlanDepthwiseConvInt8PerChannel ||
+                          op.code == kPlanAveragePoolUint8 || op.code == kPlanAveragePoolInt8 ||
+                          op.code == kPlanMaxPoolUint8 || op.code == kPlanSoftmaxUint8 ||
+                          op.code == kPlanReshapeUint8 || op.code == kPlanConcatenationUint8 ||
+                          op.code == kPlanFullyConnectedUint8;
+    const double elementSize = byteCode ? 1 : 4;
+    auto bytes = [&](int index, double size) {
+      const Operand& o = operand(index);
+      return o.bytes > 0 ? double(o.bytes) : o.shape.FlatSize() * size;
+    };
+    const bool hasBias = isConvCode(op.code) || isDepthwiseCode(op.code) ||
+                         op.code == kPlanFullyConnectedFloat32 ||
+                         op.code == kPlanFullyConnectedUint8;
+    for (int k = 0; k < 3; ++k) {
+      if (op.inputs[k] >= 0) {
+        // Biases of the quantized kernels are int32.
+        cost.bytesRead += bytes(op.inputs[k], k == 2 && hasBias ? 4 : elementSize);
+      }
+    }
+    for (int k = 0; k < op.listCount; ++k) {
+      cost.bytesRead += bytes(operandLists_[op.listBegin + k], elementSize);
+    }
+    cost.bytesWritten = bytes(op.output, elementSize);
+
+    const double outputs = shape(op.output).FlatSize();
+    if (isConvCode(op.code)) {
+      const RuntimeShape& filter = shape(op.inputs[1]);
+      cost.macs = outputs * filter.Dims(1) * filter.Dims(2) * filter.Dims(3);
+    } else if (isDepthwiseCode(op.code)) {
+      const RuntimeShape& filter = shape(op.inputs[1]);
+      cost.macs = outputs * filter.Dims(1) * filter.Dims(2);
+    } else if (op.code == kPlanFullyConnectedFloat32 || op.code == kPlanFullyConnectedUint8) {
+      const RuntimeShape& weights = shape(op.inputs[1]);
+      cost.macs = outputs * weights.Dims(weights.DimensionsCount() - 1);
+    } else if (op.code == kPlanAveragePoolFloat32 || op.code == kPlanAveragePoolUint8 ||
+               op.code == kPlanAveragePoolInt8 || op.code == kPlanMaxPoolFloat32 ||
+               op.code == kPlanMaxPoolUint8) {
+      cost.macs = outputs * op.pool.filter_height * op.pool.filter_width;
+    } else if (op.code != kPlanReshapeFloat32 && op.code != kPlanReshapeUint8 &&
+               op.code != kPlanConcatenationFloat32 && op.code != kPlanConcatenationUint8 &&
+               op.code != kPlanTransposeFloat32 && op.code != kPlanBatchToSpaceNDFloat32) {
+      cost.macs = outputs;
+    }
+    for (int k = 0; k < op.epilogueCount; ++k) {
+      const Epilogue& epilogue = epilogues_[op.epilogueBegin + k];
+      cost.macs += outputs;
+      if (epilogue.other >= 0) {
+        cost.bytesRead += bytes(epilogue.other, elementSize);
+      }
+    }
+    return cost;
+  }
+
+  void ExecutionPlan::recordProfile(int index, double start, double end) {
+    if (costs_.size() != ops_.size()) {
+      costs_.resize(ops_.size());
+      for (size_t i = 0; i < ops_.size(); ++i) {
+        costs_[i] = opCost(ops_[i]);
+      }
+      profileRing_.assign(std::max<size_t>(ops_.size(), 1) * kProfileRuns * kProfileSampleSize, 0.0);
+      profileHead_ = 0;
+      profileSamples_ = 0;
+    }
+    const OpCost& cost = costs_[index];
+    double* sample = profileRing_.data() + profileHead_ * kProfileSampleSize;
+    sample[0] = index;
+    sample[1] = start;
+    sample[2] = end;
+    sample[3] = cost.macs;
+    sample[4] = cost.bytesRead;
+    sample[5] = cost.bytesWritten;
+    const size_t capacity = profileRing_.size() / kProfileSampleSize;
+    profileHead_ = (profileHead_ + 1) % capacity;
+    profileSamples_ = std::min(profileSamples_ + 1, capacity);
+  }
+
+  intptr_t ExecutionPlan::getProfile() {
+    profile_.assign(ops_.size() * kProfileStatsSize, 0.0);
+    std::vector<std::vector<double>> latencies(ops_.size());
+    for (size_t k = 0; k < profileSamples_; ++k) {
+      const double* sample = profileRing_.data() + k * kProfileSampleSize;
+      latencies[static_cast<size_t>(sample[0])].push_back(sample[2] - sample[1]);
+    }
+    for (size_t i = 0; i < ops_.size(); ++i) {
+      std::vector<double>& runs = latencies[i];
+      if (runs.empty()) {
+        continue;
+      }
+      std::sort(runs.begin(), runs.end());
+      // Nearest-rank percentiles.
+      auto percentile = [&](double p) {
+        const size_t rank = static_cast<size_t>(std::ceil(p * runs.size()));
+        return runs[std::max<size_t>(rank, 1) - 1];
+      };
+      double mean = 0;
+      for (double ms : runs) {
+        mean += ms;
+      }
+      mean /= runs.size();
+      const OpCost& cost = costs_[i];
+      double* stats = profile_.data() + i * kProfileStatsSize;
+      stats[0] = runs.size();
+      stats[1] = runs.front();
+      stats[2] = percentile(0.5);
+      stats[3] = percentile(0.99);
+      stats[4] = mean;
+      stats[5] = cost.macs;
+      stats[6] = cost.bytesRead;
+      stats[7] = cost.bytesWritten;
+      stats[8] = mean > 0 ? 2 * cost.macs / (mean * 1e6) : 0;
+      stats[9] = mean > 0 ? (cost.bytesRead + cost.bytesWritten) / (mean * 1e6) : 0;
+    }
+    return reinterpret_cast<intptr_t>(profile_.data());
+  }
+
+  void ExecutionPlan::run(int begin, int end) {
+    if (begin < 0 || end > (int)ops_.size() || begin > end) {
+      throw std::string("ExecutionPlan: invalid op range");
+    }
+    for (int i = begin; i < end; ++i) {
+      if (profiling_) {
+        const double start = NowMs();
+        runOp(ops_[i]);
+        const double finish = NowMs();
+        timings_[i] += finish - start;
+        if (ops_[i].code != kPlanNop) {
+          recordProfile(i, start, finish);
+        }
+      } else {
+        runOp(ops_[i]);
+      }
+    }
+  }
+
+  struct ExecutionPlan::AsyncRun {
+#ifdef NN_KERNELS_THREADS
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stop = false;
+    // A range is queued or running.
+    bool pending = false;
+    int begin = 0;
+    int end = 0;
+#endif
+    // 1 once the run of the last start() has finished, see getDoneFlag().
+    std::atomic<int32_t> doneFlag{1};
+    bool failed = false;
+    std::string error;
+  };
+
+  ExecutionPlan::ExecutionPlan() {}
+
+  ExecutionPlan::~ExecutionPlan() {
+#ifdef NN_KERNELS_THREADS
+    if (async_ && async_->thread.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(async_->mutex);
+        async_->stop = true;
+      }
+      async_->wake.notify_one();
+      async_->thread.join();
+    }
+    if (running_) {
+      --started_plans;
+    }
+#endif
+  }
+
+  void ExecutionPlan::start(int begin, int end) {
+    if (running_) {
+      throw std::string("ExecutionPlan: a started run has not finished");
+    }
+#ifdef NN_KERNELS_THREADS
+    if (started_plans.load() > 0) {
+      throw std::string("ExecutionPlan: another started plan has not finished");
+    }
+#endif
+    if (!async_) {
+      async_.reset(new AsyncRun);
+    }
+    async_->failed = false;
+#ifdef NN_KERNELS_THREADS
+    if (!async_->thread.joinable()) {
+      async_->thread = std::thread(&ExecutionPlan::asyncLoop, this);
+    }
+    {
+      std::lock_guard<std::mutex> lock(async_->mutex);
+      async_->begin = begin;
+      async_->end = end;
+      async_->pending = true;
+      async_->doneFlag = 0;
+    }
+    ++started_plans;
+    async_->wake.notify_one();
+#else
+    runTimed(begin, end);
+#endif
+    running_ = true;
+  }
+
+  bool ExecutionPlan::done() {
+    if (!running_) {
+      return true;
+    }
+#ifdef NN_KERNELS_THREADS
+    {
+      std::lock_guard<std::mutex> lock(async_->mutex);
+      if (async_->pending) {
+        return false;
+      }
+    }
+    --started_plans;
+#endif
+    running_ = false;
+    if (async_->failed) {
+      throw async_->error;
+    }
+    return true;
+  }
+
+  intptr_t ExecutionPlan::getDoneFlag() {
+    if (!async_) {
+      async_.reset(new AsyncRun);
+    }
+    return reinterpret_cast<intptr_t>(&async_->doneFlag);
+  }
+
+  void ExecutionPlan::wait() {
+#ifdef NN_KERNELS_THREADS
+    if (running_) {
+      std::unique_lock<std::mutex> lock(async_->mutex);
+      async_->finished.wait(lock, [this] { return !async_->pending; });
+    }
+#endif
+    done();
+  }
+
+#ifdef NN_KERNELS_THREADS
+  void ExecutionPlan::asyncLoop() {
+    current_context = &kernel_context;
+    std::unique_lock<std::mutex> lock(async_->mutex);
+    for (;;) {
+      async_->wake.wait(lock, [this] { return async_->stop || async_->pending; });
+      if (async_->stop) {
+        return;
+      }
+      lock.unlock();
+      runTimed(async_->begin, async_->end);
+      lock.lock();
+      async_->pending = false;
+      async_->doneFlag = 1;
+#ifdef __EMSCRIPTEN_PTHREADS__
+      emscripten_futex_wake(&async_->doneFlag, INT_MAX);
+#endif
+      async_->finished.notify_all();
+    }
+  }
+#endif
+
+  // Errors cannot leave the thread, done() rethrows them.
+  void ExecutionPlan::runTimed(int begin, int end) {
+    const double startTime = NowMs();
+    try {
+      run(begin, end);
+    } catch (const std::string& error) {
+      async_->failed = true;
+      async_->error = error;
+    } catch (...) {
+      async_->failed = true;
+      async_->error = "ExecutionPlan: run failed";
+    }
+    runTime_ = NowMs() - startTime;
+  }
+
+  ExecutionPlan::Op ExecutionPlan::newOp(PlanOpCode code, std::initializer_list<int> inputs, int output) {
+    Op op;
+    memset(&op, 0, sizeof(op));
+    op.code = code;
+    int i = 0;
+    for (int index : inputs) {
+      op.inputs[i++] = index;
+    }
+    for (; i < 3; ++i) {
+      op.inputs[i] = -1;
+    }
+    op.output = output;
+    op.packedFilter = -1;
+    op.depthwiseKernel = kDepthwiseGeneric;
+    return op;
+  }
+
+  bool ExecutionPlan::isConvCode(PlanOpCode code) {
+    return code >= kPlanConvFloat32 && code <= kPlanConvInt8PerChannel;
+  }
+
+  bool ExecutionPlan::isDepthwiseCode(PlanOpCode code) {
+    return code >= kPlanDepthwiseConvFloat32 && code <= kPlanDepthwiseConvInt8PerChannel;
+  }
+
+  bool ExecutionPlan::isBanded(PlanOpCode code) {
+    return isConvCode(code) || isDepthwiseCode(code) ||
+           code == kPlanAddFloat32 || code == kPlanAddUint8 || code == kPlanMulFloat32 ||
+           code == kPlanLogisticFloat32 || code == kPlanLogisticUint8;
+  }
+
+  bool ExecutionPlan::isFloat32Code(PlanOpCode code) {
+    switch (code) {
+      case kPlanAddFloat32: case kPlanBroadCastAddFloat32: case kPlanMulFloat32:
+      case kPlanBroadCastMulFloat32: case kPlanConvFloat32: case kPlanDepthwiseConvFloat32:
+      case kPlanLogisticFloat32: case kPlanPreluFloat32:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool ExecutionPlan::isUint8Code(PlanOpCode code) {
+    switch (code) {
+      case kPlanAddUint8: case kPlanConvUint8: case kPlanConvUint8PerChannel:
+      case kPlanDepthwiseConvUint8: case kPlanDepthwiseConvUint8PerChannel:
+      case kPlanLogisticUint8: case kPlanPreluUint8:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  int ExecutionPlan::epiloguePeriod(int other, const RuntimeShape& shape) const {
+    const RuntimeShape& otherShape = this->shape(other);
+    if (otherShape == shape) {
+      return 0;
+    }
+    const int last = otherShape.DimensionsCount() - 1;
+    const int channels = shape.Dims(shape.DimensionsCount() - 1);
+    if (last >= 0 && otherShape.Dims(last) == channels && otherShape.FlatSize() == channels) {
+      return channels;
+    }
+    return -1;
+  }
+
+  bool ExecutionPlan::makeEpilogue(PlanOpCode producer, const Op& op, int value, Epilogue* epilogue) const {
+    const bool isFloat32 = isFloat32Code(op.code);
+    if ((isFloat32 && !isFloat32Code(producer)) ||
+        (isUint8Code(op.code) && !isUint8Code(producer)) ||
+        !(shape(op.output) == shape(value))) {
+      return false;
+    }
+    memset(epilogue, 0, sizeof(*epilogue));
+    epilogue->code = op.code;
+    epilogue->other = -1;
+    switch (op.code) {
+      case kPlanAddFloat32:
+      case kPlanBroadCastAddFloat32:
+      case kPlanMulFloat32:
+      case kPlanBroadCastMulFloat32:
+      case kPlanAddUint8:
+        epilogue->otherFirst = op.inputs[1] == value;
+        epilogue->other = epilogue->otherFirst ? op.inputs[0] : op.inputs[1];
+        epilogue->arithmetic = op.arithmetic;
+        break;
+      case kPlanPreluFloat32:
+      case kPlanPreluUint8:
+        if (op.inputs[0] != value) {
+          return false;
+        }
+        epilogue->other = op.inputs[1];
+        epilogue->prelu = op.prelu;
+        break;
+      case kPlanLogisticFloat32:
+      case kPlanLogisticUint8:
+        epilogue->logistic = op.logistic;
+        return true;
+      default:
+        return false;
+    }
+    epilogue->period = epiloguePeriod(epilogue->other, shape(value));
+    // The quantized add kernel only handles operands of the same shape.
+    return epilogue->period == 0 || (epilogue->period > 0 && op.code != kPlanAddUint8);
+  }
+
+  void ExecutionPlan::runFused(const Op& op) {
+    const RuntimeShape& outputShape = shape(op.output);
+    const int elementSize = isFloat32Code(op.code) ? sizeof(float) : sizeof(uint8_t);
+    const int channels = outputShape.Dims(outputShape.DimensionsCount() - 1);
+    if (isConvCode(op.code) || isDepthwiseCode(op.code)) {
+      const int batches = outputShape.Dims(0);
+      const int height = outputShape.Dims(1);
+      const int rowSize = outputShape.Dims(2) * channels;
+      const int bandRows = std::max<int>(1, kFusionBandBytes / (rowSize * elementSize));
+      for (int b = 0; b < batches; ++b) {
+        for (int y = 0; y < height; y += bandRows) {
+          const int rows = std::min(bandRows, height - y);
+          runConvBand(op, elementSize, b, y, rows);
+          runEpilogues(op, (b * height + y) * rowSize, rows * rowSize);
+        }
+      }
+    } else {
+      const int size = outputShape.FlatSize();
+      const int band = std::max<int>(1, kFusionBandBytes / (channels * elementSize)) * channels;
+      for (int offset = 0; offset < size; offset += band) {
+        const int count = std::min(band, size - offset);
+        Op part = op;
+        part.epilogueCount = 0;
+        for (int k = 0; k < 3; ++k) {
+          if (op.inputs[k] >= 0) {
+            setBandOperand(k, &count, 1, data(op.inputs[k]) + offset * elementSize);
+            part.inputs[k] = bandOperand(k);
+          }
+        }
+        setBandOperand(kBandOutput, &count, 1, data(op.output) + offset * elementSize);
+        part.output = bandOperand(kBandOutput);
+        runOp(part);
+        runEpilogues(op, offset, count);
+      }
+    }
+  }
+
+  void ExecutionPlan::runConvBand(const Op& op, int elementSize, int b, int y, int rows) {
+    const bool depthwise = isDepthwiseCode(op.code);
+    const int stride = depthwise ? op.depthwise.stride_height : op.conv.stride_height;
+    const int dilation = depthwise ? op.depthwise.dilation_height_factor
+                                   : op.conv.dilation_height_factor;
+    const int pad = depthwise ? op.depthwise.padding_values.height
+                              : op.conv.padding_values.height;
+    const int filterHeight = shape(op.inputs[1]).Dims(1);
+    const RuntimeShape& inputShape = shape(op.inputs[0]);
+    const RuntimeShape& outputShape = shape(op.output);
+    const int inputHeight = inputShape.Dims(1);
+    const int inputRowSize = inputShape.Dims(2) * inputShape.Dims(3);
+    const int outputRowSize = outputShape.Dims(2) * outputShape.Dims(3);
+
+    int inBegin = std::max(0, y * stride - pad);
+    int inEnd = std::min(inputHeight, (y + rows - 1) * stride - pad +
+                                      (filterHeight - 1) * dilation + 1);
+    if (inEnd <= inBegin) {
+      // Every tap of the band falls into the padding; any single row
+      // outside of the receptive field will do.
+      inBegin = std::min(inBegin, inputHeight - 1);
+      inEnd = inBegin + 1;
+    }
+    const int32_t inputDims[4] = {1, inEnd - inBegin, inputShape.Dims(2), inputShape.Dims(3)};
+    const int32_t outputDims[4] = {1, rows, outputShape.Dims(2), outputShape.Dims(3)};
+    setBandOperand(0, inputDims, 4,
+                   data(op.inputs[0]) + (b * inputHeight + inBegin) * inputRowSize * elementSize);
+    setBandOperand(kBandOutput, outputDims, 4,
+                   data(op.output) + (b * outputShape.Dims(1) + y) * outputRowSize * elementSize);
+
+    Op part = op;
+    part.epilogueCount = 0;
+    part.inputs[0] = bandOperand(0);
+    part.output = bandOperand(kBandOutput);
+    const int bandPad = pad - y * stride + inBegin;
+    if (depthwise) {
+      part.depthwise.padding_values.height = bandPad;
+    } else {
+      part.conv.padding_values.height = bandPad;
+    }
+    runOp(part);
+  }
+
+  void ExecutionPlan::runEpilogues(const Op& op, int offset, int count) {
+    const bool isFloat32 = isFloat32Code(op.code);
+    const int elementSize = isFloat32 ? sizeof(float) : sizeof(uint8_t);
+    const intptr_t values = data(op.output) + offset * elementSize;
+    const RuntimeShape flat(1, &count);
+    for (int k = 0; k < op.epilogueCount; ++k) {
+      const Epilogue& epilogue = epilogues_[op.epilogueBegin + k];
+      intptr_t other = 0;
+      int rows = 1;
+      int rowSize = count;
+      if (epilogue.other >= 0) {
+        other = data(epilogue.other);
+        if (epilogue.period == 0) {
+          other += offset * elementSize;
+        } else {
+          rowSize = epilogue.period;
+          rows = count / rowSize;
+        }
+      }
+      switch (epilogue.code) {
+        case kPlanAddFloat32:
+        case kPlanBroadCastAddFloat32:
+          EpilogueAddFloat32(epilogue.arithmetic, reinterpret_cast<float*>(values),
+                             reinterpret_cast<const float*>(other), rows, rowSize);
+          break;
+        case kPlanMulFloat32:
+        case kPlanBroadCastMulFloat32:
+          EpilogueMulFloat32(epilogue.arithmetic, reinterpret_cast<float*>(values),
+                             reinterpret_cast<const float*>(other), rows, rowSize);
+          break;
+        case kPlanAddUint8:
+          addUint8Wrapper(epilogue.arithmetic,
+                          flat, epilogue.otherFirst ? other : values,
+                          flat, epilogue.otherFirst ? values : other,
+                          flat, values);
+          break;
+        case kPlanPreluFloat32:
+          PreluChannelwise(reinterpret_cast<const float*>(values),
+                           reinterpret_cast<const float*>(other), rows, rowSize,
+                           reinterpret_cast<float*>(values));
+          break;
+        case kPlanPreluUint8: {
+          const int32_t inputDims[4] = {1, 1, rows, rowSize};
+          const int32_t alphaDims[4] = {1, 1, 1, rowSize};
+          const RuntimeShape inputShape(4, inputDims);
+          preluUint8Wrapper(epilogue.prelu, inputShape, values,
+                            RuntimeShape(4, alphaDims), other, inputShape, values);
+        } break;
+        case kPlanLogisticFloat32:
+          logisticFloat32Wrapper(flat, values, flat, values);
+          break;
+        case kPlanLogisticUint8:
+          logisticUint8Wrapper(epilogue.logistic, flat, values, flat, values);
+          break;
+        default:
+          throw std::string("ExecutionPlan: invalid epilogue");
+      }
+    }
+  }
+
+  void ExecutionPlan::setBandOperand(int slot, const int32_t* dims, int rank, intptr_t data) {
+    band_[slot].shape.ReplaceWith(rank, dims);
+    band_[slot].data = data;
+  }
+
+  bool ExecutionPlan::isConstant(int index) const {
+    checkOperand(index);
+    return !operands_[index].planned && operands_[index].data != 0;
+  }
+
+  int ExecutionPlan::packConvFilter(int filter) {
+    auto it = packedConvIndex_.find(filter);
+    if (it != packedConvIndex_.end()) {
+      return it->second;
+    }
+    packedConv_.emplace_back();
+    PackConvFilter(shape(filter), reinterpret_cast<const int8_t*>(data(filter)),
+                   &packedConv_.back());
+    packedConvIndex_[filter] = packedConv_.size() - 1;
+    return packedConv_.size() - 1;
+  }
+
+  int ExecutionPlan::packDepthwiseFilter(int filter, int32_t weightsOffset) {
+    const std::pair<int, int32_t> key(filter, weightsOffset);
+    auto it = packedDepthwiseIndex_.find(key);
+    if (it != packedDepthwiseIndex_.end()) {
+      return it->second;
+    }
+    packedDepthwise_.emplace_back();
+    PackDepthwiseFilter(shape(filter), reinterpret_cast<const int8_t*>(data(filter)),
+                        weightsOffset, &packedDepthwise_.back());
+    packedDepthwiseIndex_[key] = packedDepthwise_.size() - 1;
+    return packedDepthwise_.size() - 1;
+  }
+
+  int ExecutionPlan::transformWinogradFilter(int filter, int tile) {
+    const std::pair<int, int> key(filter, tile);
+    auto it = winogradFilterIndex_.find(key);
+    if (it != winogradFilterIndex_.end()) {
+      return it->second;
+    }
+    winogradFilters_.emplace_back();
+    TransformWinogradFilter(shape(filter), reinterpret_cast<const float*>(data(filter)), tile,
+                            &winogradFilters_.back());
+    winogradFilterIndex_[key] = winogradFilters_.size() - 1;
+    return winogradFilters_.size() - 1;
+  }
+
+  int ExecutionPlan::push(const Op& op) {
+    for (int index : op.inputs) {
+      if (index != -1) {
+        checkOperand(index);
+      }
+    }
+    if (op.output != -1) {
+      checkOperand(op.output);
+    }
+    ops_.push_back(op);
+    timings_.push_back(0.0);
+    return ops_.size() - 1;
+  }
+
+  void ExecutionPlan::checkOperand(int index) const {
+    if (index < 0 || index >= (int)operands_.size()) {
+      throw std::string("ExecutionPlan: invalid operand index");
+    }
+  }
+
+  size_t ExecutionPlan::alignArena(size_t value) {
+    return (value + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+  }
+
+  void ExecutionPlan::checkOp(int index) const {
+    if (index < 0 || index >= (int)ops_.size()) {
+      throw std::string("ExecutionPlan: invalid op index");
+    }
+  }
+
+  const ExecutionPlan::Operand& ExecutionPlan::operand(int index) const {
+    return index >= 0 ? operands_[index] : band_[-2 - index];
+  }
+
+  void ExecutionPlan::runPackedOp(const Op& op) {
+    const int* in = op.inputs;
+    const int out = op.output;
+    const int32_t* multipliers = reinterpret_cast<const int32_t*>(op.outputMultipliers);
+    const int32_t* shifts = reinterpret_cast<const int32_t*>(op.outputShifts);
+    const int32_t* bias = reinterpret_cast<const int32_t*>(data(in[2]));
+    switch (op.code) {
+      case kPlanConvFloat32:
+        WinogradConvNhwc(op.conv, shape(in[0]), reinterpret_cast<const float*>(data(in[0])),
+                         winogradFilters_[op.packedFilter],
+                         reinterpret_cast<const float*>(data(in[2])),
+                         shape(out), reinterpret_cast<float*>(data(out)));
+        break;
+      case kPlanConvInt8: {
+        const int32_t multiplier = op.conv.output_multiplier;
+        const int32_t shift = op.conv.output_shift;
+        QuantizedConvNhwc(op.conv, &multiplier, &shift, 0,
+                          shape(in[0]), reinterpret_cast<const int8_t*>(data(in[0])),
+                          shape(in[1]), packedConv_[op.packedFilter], bias,
+                          shape(out), reinterpret_cast<int8_t*>(data(out)));
+      } break;
+      case kPlanConvUint8PerChannel:
+        QuantizedConvNhwc(op.conv, multipliers, shifts, 1,
+                          shape(in[0]), reinterpret_cast<const uint8_t*>(data(in[0])),
+                          shape(in[1]), packedConv_[op.packedFilter], bias,
+                          shape(out), reinterpret_cast<uint8_t*>(data(out)));
+        break;
+      case kPlanConvInt8PerChannel:
+        QuantizedConvNhwc(op.conv, multipliers, shifts, 1,
+                          shape(in[0]), reinterpret_cast<const int8_t*>(data(in[0])),
+                          shape(in[1]), packedConv_[op.packedFilter], bias,
+                          shape(out), reinterpret_cast<int8_t*>(data(out)));
+        break;
+      case kPlanDepthwiseConvInt8: {
+        const int32_t multiplier = op.depthwise.output_multiplier;
+        const int32_t shift = op.depthwise.output_shift;
+        QuantizedDepthwiseConvNhwc(op.depthwise, op.depthwiseKernel, &multiplier, &shift, 0,
+                                   shape(in[0]), reinterpret_cast<const int8_t*>(data(in[0])),
+                                   shape(in[1]), packedDepthwise_[op.packedFilter], bias,
+                                   shape(out), reinterpret_cast<int8_t*>(data(out)));
+      } break;
+      case kPlanDepthwiseConvUint8PerChannel:
+        QuantizedDepthwiseConvNhwc(op.depthwise, op.depthwiseKernel, multipliers, shifts, 1,
+                                   shape(in[0]), reinterpret_cast<const uint8_t*>(data(in[0])),
+                                   shape(in[1]), packedDepthwise_[op.packedFilter], bias,
+                                   shape(out), reinterpret_cast<uint8_t*>(data(out)));
+        break;
+      case kPlanDepthwiseConvInt8PerChannel:
+        QuantizedDepthwiseConvNhwc(op.depthwise, op.depthwiseKernel, multipliers, shifts, 1,
+                                   shape(in[0]), reinterpret_cast<const int8_t*>(data(in[0])),
+                                   shape(in[1]), packedDepthwise_[op.packedFilter], bias,
+                                   shape(out), reinterpret_cast<int8_t*>(data(out)));
+        break;
+      default:
+        throw std::string("ExecutionPlan: op code has no packed filter");
+    }
+  }
+
+  void ExecutionPlan::runOp(Op& op) {
+    if (op.epilogueCount > 0) {
+      runFused(op);
+      return;
+    }
+    if (op.packedFilter >= 0) {
+      runPackedOp(op);
+      return;
+    }
+    const int* in = op.inputs;
+    const int out = op.output;
+    switch (op.code) {
+      case kPlanExternal:
+        throw std::string("ExecutionPlan: external op inside run range");
+      case kPlanNop:
+        break;
+      case kPlanAddFloat32:
+        addFloat32Wrapper(op.arithmetic, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                          shape(out), data(out));
+        break;
+      case kPlanAddUint8:
+        addUint8Wrapper(op.arithmetic, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                        shape(out), data(out));
+        break;
+      case kPlanBroadCastAddFloat32:
+        broadCastAddFloat32Wrapper(op.arithmetic, shape(in[0]), data(in[0]),
+                                   shape(in[1]), data(in[1]), shape(out), data(out));
+        break;
+      case kPlanMulFloat32:
+        mulFloat32Wrapper(op.arithmetic, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                          shape(out), data(out));
+        break;
+      case kPlanBroadCastMulFloat32:
+        broadCastMulFloat32Wrapper(op.arithmetic, shape(in[0]), data(in[0]),
+                                   shape(in[1]), data(in[1]), shape(out), data(out));
+        break;
+      case kPlanConvFloat32:
+        convFloat32Wrapper(op.conv, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                           shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanConvUint8:
+        convUint8Wrapper(op.conv, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                         shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanConvUint8PerChannel:
+        convUint8PerChannelWrapper(op.conv, op.outputMultipliers, op.outputShifts,
+                                   shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                                   shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanConvInt8:
+        convInt8Wrapper(op.conv, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                        shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanConvInt8PerChannel:
+        convInt8PerChannelWrapper(op.conv, op.outputMultipliers, op.outputShifts,
+                                  shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                                  shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanDepthwiseConvFloat32:
+        if (op.depthwiseKernel != kDepthwiseGeneric) {
+          FloatDepthwiseConvNhwc(op.depthwise, op.depthwiseKernel,
+                                 shape(in[0]), reinterpret_cast<const float*>(data(in[0])),
+                                 reinterpret_cast<const float*>(data(in[1])),
+                                 reinterpret_cast<const float*>(data(in[2])),
+                                 shape(out), reinterpret_cast<float*>(data(out)));
+          break;
+        }
+        depthwiseConvFloat32Wrapper(op.depthwise, shape(in[0]), data(in[0]),
+                                    shape(in[1]), data(in[1]), shape(in[2]), data(in[2]),
+                                    shape(out), data(out));
+        break;
+      case kPlanDepthwiseConvUint8:
+        depthwiseConvUint8Wrapper(op.depthwise, shape(in[0]), data(in[0]),
+                                  shape(in[1]), data(in[1]), shape(in[2]), data(in[2]),
+                                  shape(out), data(out));
+        break;
+      case kPlanDepthwiseConvUint8PerChannel:
+        depthwiseConvUint8PerChannelWrapper(op.depthwise, op.outputMultipliers, op.outputShifts,
+                                            shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                                            shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanDepthwiseConvInt8:
+        depthwiseConvInt8Wrapper(op.depthwise, shape(in[0]), data(in[0]),
+                                 shape(in[1]), data(in[1]), shape(in[2]), data(in[2]),
+                                 shape(out), data(out));
+        break;
+      case kPlanDepthwiseConvInt8PerChannel:
+        depthwiseConvInt8PerChannelWrapper(op.depthwise, op.outputMultipliers, op.outputShifts,
+                                           shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                                           shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanAveragePoolFloat32:
+        averagePoolFloat32Wrapper(op.pool, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanAveragePoolUint8:
+        averagePoolUint8Wrapper(op.pool, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanAveragePoolInt8:
+        averagePoolInt8Wrapper(op.pool, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanMaxPoolFloat32:
+        maxPoolFloat32Wrapper(op.pool, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanMaxPoolUint8:
+        maxPoolUint8Wrapper(op.pool, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanSoftmaxFloat32:
+        softmaxFloat32Wrapper(op.softmax, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanSoftmaxUint8:
+        softmaxUint8Wrapper(op.softmax, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanReshapeFloat32:
+        reshapeFloat32Wrapper(shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanReshapeUint8:
+        reshapeUint8Wrapper(shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanConcatenationFloat32: {
+        const int count = op.concatenation.inputs_count;
+        const float** inputData = concatFloatData_.data() + op.listBegin;
+        for (int i = 0; i < count; ++i) {
+          inputData[i] = reinterpret_cast<const float*>(data(operandLists_[op.listBegin + i]));
+        }
+        optimized_ops::Concatenation<float>(op.concatenation,
+                                            concatShapes_.data() + op.listBegin, inputData,
+                                            shape(out), reinterpret_cast<float*>(data(out)));
+      } break;
+      case kPlanConcatenationUint8: {
+        const int count = op.concatenation.inputs_count;
+        const uint8_t** inputData = concatUint8Data_.data() + op.listBegin;
+        for (int i = 0; i < count; ++i) {
+          inputData[i] = reinterpret_cast<const uint8_t*>(data(operandLists_[op.listBegin + i]));
+        }
+        op.concatenation.input_scale = concatScales_.data() + op.listBegin;
+        op.concatenation.input_zeropoint = concatZeroPoints_.data() + op.listBegin;
+        optimized_ops::ConcatenationWithScaling(op.concatenation,
+                                                concatShapes_.data() + op.listBegin, inputData,
+                                                shape(out), reinterpret_cast<uint8_t*>(data(out)));
+      } break;
+      case kPlanFullyConnectedFloat32:
+        fullyConnectedFloat32Wrapper(op.fullyConnected, shape(in[0]), data(in[0]),
+                                     shape(in[1]), data(in[1]), shape(in[2]), data(in[2]),
+                                     shape(out), data(out));
+        break;
+      case kPlanFullyConnectedUint8:
+        fullyConnectedUint8Wrapper(op.fullyConnected, shape(in[0]), data(in[0]),
+                                   shape(in[1]), data(in[1]), shape(in[2]), data(in[2]),
+                                   shape(out), data(out));
+        break;
+      case kPlanResizeBilinearFloat32:
+        resizeBilinearFloat32Wrapper(op.resizeBilinear, shape(in[0]), data(in[0]),
+                                     shape(in[1]), data(in[1]), shape(out), data(out));
+        break;
+      case kPlanTanhFloat32:
+        tanhFloat32Wrapper(shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanMaximumFloat32:
+        maximumFloat32Wrapper(shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                              shape(out), data(out));
+        break;
+      case kPlanBatchToSpaceNDFloat32:
+        batchToSpaceNDFloat32Wrapper(shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                                     shape(in[2]), data(in[2]), shape(out), data(out));
+        break;
+      case kPlanTransposeFloat32:
+        transposeFloat32Wrapper(op.transpose, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanArgMaxFloat32:
+        argMaxFloat32Wrapper(shape(in[0]), data(in[0]), data(in[1]), shape(out), data(out));
+        break;
+      case kPlanLogisticFloat32:
+        logisticFloat32Wrapper(shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanLogisticUint8:
+        logisticUint8Wrapper(op.logistic, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanPreluFloat32:
+        preluFloat32Wrapper(shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                            shape(out), data(out));
+        break;
+      case kPlanPreluUint8:
+        preluUint8Wrapper(op.prelu, shape(in[0]), data(in[0]), shape(in[1]), data(in[1]),
+                          shape(out), data(out));
+        break;
+      case kPlanQuantizeUint8:
+        quantizeUint8Wrapper(op.quantize, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      case kPlanDequantizeUint8:
+        dequantizeUint8Wrapper(op.quantize, shape(in[0]), data(in[0]), shape(out), data(out));
+        break;
+      default:
+        throw std::string("ExecutionPlan: unknown op code");
+    }
+  }
+}
@@ -0,0 +1,1155 @@
+// Kernel layer of nn_ops: the operation wrappers and ExecutionPlan, free of
+// any Emscripten dependency. binding.cpp exposes them to JavaScript through
+// embind; native builds (nn_kernels, nn_ops_bench) link them directly.
+#ifndef NN_KERNELS_H_
+#define NN_KERNELS_H_
+
+#include "external/tensorflow/tensorflow/lite/kernels/internal/types.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace binding_utils {
+  using namespace tflite;
+
+  // Thread counts of the gemmlowp, ruy and hand-written kernels. Changing
+  // one while an ExecutionPlan is started throws, see ExecutionPlan::start.
+  void set_gemm_context_threads_num(int threads_num);
+
+  void set_cpu_context_threads_num(int max_num_threads);
+
+  void set_kernel_threads_num(int threads_num);
+
+  // Kernel scratch memory is owned by the worker pool, one region per
+  // thread, and only grows. These count the regions (re)allocated so far,
+  // including growth of the filters packed per call by the standalone
+  // quantized conv wrappers, and the bytes reserved now; a prepared model
+  // running frame after frame should leave the count unchanged.
+  int get_scratch_allocations();
+
+  int get_scratch_bytes();
+
+  void addFloat32Wrapper(const ArithmeticParams& op_params,
+                         const RuntimeShape& input1_shape,
+                         const intptr_t input1_data,
+                         const RuntimeShape& input2_shape,
+                         const intptr_t input2_data,
+                         const RuntimeShape& output_shape,
+                         intptr_t output_data);
+
+  void addUint8Wrapper(const ArithmeticParams& op_params,
+                       const RuntimeShape& input1_shape,
+                       const intptr_t input1_data,
+                       const RuntimeShape& input2_shape,
+                       const intptr_t input2_data,
+                       const RuntimeShape& output_shape,
+                       intptr_t output_data);
+
+  void broadCastAddFloat32Wrapper(const ArithmeticParams& op_params,
+                                  const RuntimeShape& input1_shape,
+                                  const intptr_t input1_data,
+                                  const RuntimeShape& input2_shape,
+                                  const intptr_t input2_data,
+                                  const RuntimeShape& output_shape,
+                                  intptr_t output_data);
+
+  void mulFloat32Wrapper(const ArithmeticParams& op_params,
+                         const RuntimeShape& input1_shape,
+                         const intptr_t input1_data,
+                         const RuntimeShape& input2_shape,
+                         const intptr_t input2_data,
+                         const RuntimeShape& output_shape,
+                         intptr_t output_data);
+
+  void broadCastMulFloat32Wrapper(const ArithmeticParams& op_params,
+                                  const RuntimeShape& input1_shape,
+                                  const intptr_t input1_data,
+                                  const RuntimeShape& input2_shape,
+                                  const intptr_t input2_data,
+                                  const RuntimeShape& output_shape,
+                                  intptr_t output_data);
+
+  void floorFloat32Wrapper(const RuntimeShape& input_shape,
+                           const intptr_t inputData,
+                           const RuntimeShape& output_shape,
+                           intptr_t outputData);
+
+  void depthwiseConvFloat32Wrapper(const DepthwiseParams& convParams,
+                                   const RuntimeShape& inputShape,
+                                   const intptr_t inputData,
+                                   const RuntimeShape& filterShape,
+                                   const intptr_t filterData,
+                                   const RuntimeShape& biasShape,
+                                   const intptr_t biasData,
+                                   const RuntimeShape& outputShape,
+                                   intptr_t outputData);
+
+  void depthwiseConvUint8Wrapper(const DepthwiseParams& convParams,
+                                 const RuntimeShape& inputShape,
+                                 const intptr_t inputData,
+                                 const RuntimeShape& filterShape,
+                                 const intptr_t filterData,
+                                 const RuntimeShape& biasShape,
+                                 const intptr_t biasData,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData);
+
+  void depthwiseConvInt8Wrapper(const DepthwiseParams& convParams,
+                                const RuntimeShape& inputShape,
+                                const intptr_t inputData,
+                                const RuntimeShape& filterShape,
+                                const intptr_t filterData,
+                                const RuntimeShape& biasShape,
+                                const intptr_t biasData,
+                                const RuntimeShape& outputShape,
+                                intptr_t outputData);
+
+  void depthwiseConvUint8PerChannelWrapper(const DepthwiseParams& convParams,
+                                           const intptr_t outputMultiplierData,
+                                           const intptr_t outputShiftData,
+                                           const RuntimeShape& inputShape,
+                                           const intptr_t inputData,
+                                           const RuntimeShape& filterShape,
+                                           const intptr_t filterData,
+                                           const RuntimeShape& biasShape,
+                                           const intptr_t biasData,
+                                           const RuntimeShape& outputShape,
+                                           intptr_t outputData);
+
+  void depthwiseConvInt8PerChannelWrapper(const DepthwiseParams& convParams,
+                                          const intptr_t outputMultiplierData,
+                                          const intptr_t outputShiftData,
+                                          const RuntimeShape& inputShape,
+                                          const intptr_t inputData,
+                                          const RuntimeShape& filterShape,
+                                          const intptr_t filterData,
+                                          const RuntimeShape& biasShape,
+                                          const intptr_t biasData,
+                                          const RuntimeShape& outputShape,
+                                          intptr_t outputData);
+
+  void convFloat32Wrapper(const ConvParams& convParams,
+                          const RuntimeShape& inputShape,
+                          const intptr_t inputData,
+                          const RuntimeShape& filterShape,
+                          const intptr_t filterData,
+                          const RuntimeShape& biasShape,
+                          const intptr_t biasData,
+                          const RuntimeShape& outputShape,
+                          intptr_t outputData);
+
+  void convUint8Wrapper(const ConvParams& convParams,
+                        const RuntimeShape& inputShape,
+                        const intptr_t inputData,
+                        const RuntimeShape& filterShape,
+                        const intptr_t filterData,
+                        const RuntimeShape& biasShape,
+                        const intptr_t biasData,
+                        const RuntimeShape& outputShape,
+                        intptr_t outputData);
+
+  void convInt8Wrapper(const ConvParams& convParams,
+                       const RuntimeShape& inputShape,
+                       const intptr_t inputData,
+                       const RuntimeShape& filterShape,
+                       const intptr_t filterData,
+                       const RuntimeShape& biasShape,
+                       const intptr_t biasData,
+                       const RuntimeShape& outputShape,
+                       intptr_t outputData);
+
+  void convUint8PerChannelWrapper(const ConvParams& convParams,
+                                  const intptr_t outputMultiplierData,
+                                  const intptr_t outputShiftData,
+                                  const RuntimeShape& inputShape,
+                                  const intptr_t inputData,
+                                  const RuntimeShape& filterShape,
+                                  const intptr_t filterData,
+                                  const RuntimeShape& biasShape,
+                                  const intptr_t biasData,
+                                  const RuntimeShape& outputShape,
+                                  intptr_t outputData);
+
+  void convInt8PerChannelWrapper(const ConvParams& convParams,
+                                 const intptr_t outputMultiplierData,
+                                 const intptr_t outputShiftData,
+                                 const RuntimeShape& inputShape,
+                                 const intptr_t inputData,
+                                 const RuntimeShape& filterShape,
+                                 const intptr_t filterData,
+                                 const RuntimeShape& biasShape,
+                                 const intptr_t biasData,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData);
+
+  void averagePoolFloat32Wrapper(const PoolParams op_params,
+                                 const RuntimeShape& inputShape,
+                                 const intptr_t inputData,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData);
+
+  void averagePoolUint8Wrapper(const PoolParams op_params,
+                               const RuntimeShape& inputShape,
+                               const intptr_t inputData,
+                               const RuntimeShape& outputShape,
+                               intptr_t outputData);
+
+  void averagePoolInt8Wrapper(const PoolParams op_params,
+                              const RuntimeShape& inputShape,
+                              const intptr_t inputData,
+                              const RuntimeShape& outputShape,
+                              intptr_t outputData);
+
+  void maxPoolFloat32Wrapper(const PoolParams op_params,
+                             const RuntimeShape& inputShape,
+                             const intptr_t inputData,
+                             const RuntimeShape& outputShape,
+                             intptr_t outputData);
+
+  void maxPoolUint8Wrapper(const PoolParams op_params,
+                           const RuntimeShape& inputShape,
+                           const intptr_t inputData,
+                           const RuntimeShape& outputShape,
+                           intptr_t outputData);
+
+  void softmaxFloat32Wrapper(const SoftmaxParams op_params,
+                             const RuntimeShape& inputShape,
+                             const intptr_t inputData,
+                             const RuntimeShape& outputShape,
+                             intptr_t outputData);
+
+  void softmaxUint8Wrapper(const SoftmaxParams op_params,
+                           const RuntimeShape& inputShape,
+                           const intptr_t inputData,
+                           const RuntimeShape& outputShape,
+                           intptr_t outputData);
+
+  void reshapeFloat32Wrapper(const RuntimeShape& inputShape,
+                             const intptr_t inputData,
+                             const RuntimeShape& outputShape,
+                             intptr_t outputData);
+
+  void reshapeUint8Wrapper(const RuntimeShape& inputShape,
+                           const intptr_t inputData,
+                           const RuntimeShape& outputShape,
+                           intptr_t outputData);
+
+  // The inputs of a concatenation, described once when a model is prepared:
+  // params, shapes and uint8 quantization are copied in and the data
+  // pointers kept, so the wrappers below neither allocate nor convert
+  // anything per call. setInputData() repoints one input.
+  class ConcatenationInputs {
+   public:
+    explicit ConcatenationInputs(const ConcatenationParams& params);
+    // params_ points into the object.
+    ConcatenationInputs(const ConcatenationInputs&) = delete;
+    ConcatenationInputs& operator=(const ConcatenationInputs&) = delete;
+
+    // `scale` and `zeroPoint` are only read by the uint8 wrapper.
+    void setInput(int index, const RuntimeShape& shape, intptr_t data,
+                  float scale, int32_t zeroPoint);
+
+    void setInputData(int index, intptr_t data);
+
+    const ConcatenationParams& params() const { return params_; }
+    const RuntimeShape* const* shapes() const { return shapePointers_.data(); }
+    const float* const* floatData() const { return floatData_.data(); }
+    const uint8_t* const* uint8Data() const { return uint8Data_.data(); }
+
+   private:
+    void checkIndex(int index) const;
+
+    ConcatenationParams params_;
+    std::vector<RuntimeShape> shapes_;
+    std::vector<const RuntimeShape*> shapePointers_;
+    std::vector<const float*> floatData_;
+    std::vector<const uint8_t*> uint8Data_;
+    // params_.input_scale and input_zeropoint point here.
+    std::vector<float> scales_;
+    std::vector<int32_t> zeroPoints_;
+  };
+
+  void concatenationFloat32Wrapper(const ConcatenationInputs& inputs,
+                                   const RuntimeShape& outputShape,
+                                   intptr_t outputData);
+
+  void concatenationUint8Wrapper(const ConcatenationInputs& inputs,
+                                 const RuntimeShape& outputShape,
+                                 intptr_t outputData);
+
+  void fullyConnectedFloat32Wrapper(const FullyConnectedParams op_params,
+                                    const RuntimeShape& inputShape,
+                                    const intptr_t inputData,
+                                    const RuntimeShape& weightsShape,
+                                    const intptr_t weightsData,
+                                    const RuntimeShape& biasShape,
+                                    const intptr_t biasData,
+                                    const RuntimeShape& outputShape,
+                                    intptr_t outputData);
+
+  void fullyConnectedUint8Wrapper(const FullyConnectedParams op_params,
+                                  const RuntimeShape& inputShape,
+                                  const intptr_t inputData,
+                                  const RuntimeShape& weightsShape,
+                                  const intptr_t weightsData,
+                                  const RuntimeShape& biasShape,
+                                  const intptr_t biasData,
+                                  const RuntimeShape& outputShape,
+                                  intptr_t outputData);
+
+  void resizeBilinearFloat32Wrapper(const ResizeBilinearParams op_params,
+                                    const RuntimeShape& inputShape,
+                                    const intptr_t inputData,
+                                    const RuntimeShape& outSizeShape,
+                                    const intptr_t outSizeData,
+                                    const RuntimeShape& outputShape,
+                                    intptr_t outputData);
+
+  void tanhFloat32Wrapper(const RuntimeShape& inputShape,
+                          const intptr_t inputData,
+                          const RuntimeShape& outputShape,
+                          intptr_t outputData);
+
+  void maximumFloat32Wrapper(const RuntimeShape& input1_shape,
+                             const intptr_t input1_data,
+                             const RuntimeShape& input2_shape,
+                             const intptr_t input2_data,
+                             const RuntimeShape& output_shape,
+                             intptr_t output_data);
+
+  void batchToSpaceNDFloat32Wrapper(const RuntimeShape& unextended_input1_shape,
+                                    const intptr_t input1_data,
+                                    const RuntimeShape& unextended_input2_shape,
+                                    const intptr_t block_shape_data,
+                                    const RuntimeShape& unextended_input3_shape,
+                                    const intptr_t crops_data,
+                                    const RuntimeShape& unextended_output_shape,
+                                    intptr_t output_data);
+
+  void transposeFloat32Wrapper(const TransposeParams& op_params,
+                               const RuntimeShape& unextended_input_shape,
+                               const intptr_t input_data,
+                               const RuntimeShape& unextended_output_shape,
+                               intptr_t output_data);
+
+  void argMaxFloat32Wrapper(const RuntimeShape& input1_shape,
+                            const intptr_t input1_data,
+                            const intptr_t input2_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data);
+
+  void logisticFloat32Wrapper(const RuntimeShape& input_shape,
+                              const intptr_t inputData,
+                              const RuntimeShape& output_shape,
+                              intptr_t outputData);
+
+  void logisticUint8Wrapper(const LogisticParams& params,
+                            const RuntimeShape& input_shape,
+                            const intptr_t input_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data);
+
+  void preluFloat32Wrapper(const RuntimeShape& input_shape,
+                           const intptr_t input_data,
+                           const RuntimeShape& alpha_shape,
+                           const intptr_t alpha_data,
+                           const RuntimeShape& output_shape,
+                           intptr_t output_data);
+
+  void preluUint8Wrapper(const PreluParams& params,
+                         const RuntimeShape& input_shape,
+                         const intptr_t input_data,
+                         const RuntimeShape& alpha_shape,
+                         const intptr_t alpha_data,
+                         const RuntimeShape& output_shape,
+                         intptr_t output_data);
+
+  // Affine uint8 quantization of the quantize and dequantize kernels:
+  // real = scale * (q - zero_point). Quantized values are rounded to nearest
+  // and saturated.
+  struct QuantizeParams {
+    float scale;
+    int32_t zero_point;
+  };
+
+  void quantizeUint8Wrapper(const QuantizeParams& params,
+                            const RuntimeShape& input_shape,
+                            const intptr_t input_data,
+                            const RuntimeShape& output_shape,
+                            intptr_t output_data);
+
+  void dequantizeUint8Wrapper(const QuantizeParams& params,
+                              const RuntimeShape& input_shape,
+                              const intptr_t input_data,
+                              const RuntimeShape& output_shape,
+                              intptr_t output_data);
+
+  // Input preprocessing of preprocessRGBA*. The crop rectangle of an RGBA
+  // source image is bilinearly resized to draw_width x draw_height at the
+  // top-left corner of a dst_width x dst_height output; the rest of the output
+  // reads as a zero pixel, like the undrawn part of a canvas. Output channel c
+  // takes source channel channel_map[c], or the mean of R, G and B when it is
+  // -1, and stores value * scale[c] + bias[c] in NHWC or, with nchw, NCHW
+  // order. Uint8 outputs are rounded and saturated.
+  struct PreprocessParams {
+    int32_t src_width;
+    int32_t src_height;
+    int32_t crop_x;
+    int32_t crop_y;
+    int32_t crop_width;
+    int32_t crop_height;
+    int32_t dst_width;
+    int32_t dst_height;
+    int32_t draw_width;
+    int32_t draw_height;
+    int32_t channels;
+    std::array<int32_t, 4> channel_map;
+    std::array<float, 4> scale;
+    std::array<float, 4> bias;
+    bool nchw;
+  };
+
+  void preprocessRGBAFloat32Wrapper(const PreprocessParams& params,
+                                    const intptr_t input_data,
+                                    intptr_t output_data);
+
+  void preprocessRGBAUint8Wrapper(const PreprocessParams& params,
+                                  const intptr_t input_data,
+                                  intptr_t output_data);
+
+  // SSD box decoding and non-max suppression, following the TFLite
+  // Detection_PostProcess custom op. `box_data` holds [num_boxes, 4]
+  // (ty, tx, th, tw) encodings of the [num_boxes, 4] (ycenter, xcenter, h, w)
+  // anchors; `score_data` holds [num_boxes, num_classes] scores, of which the
+  // first label_offset columns (background) are skipped. Regular NMS runs per
+  // class; otherwise only the best class of every box takes part, in one
+  // class-agnostic pass. Uint8 inputs are read as (q - zero_point) * scale.
+  struct SsdPostprocessParams {
+    int32_t num_boxes;
+    int32_t num_classes;
+    int32_t label_offset;
+    float y_scale;
+    float x_scale;
+    float h_scale;
+    float w_scale;
+    float score_threshold;
+    float iou_threshold;
+    int32_t max_detections;
+    int32_t max_detections_per_class;
+    bool use_regular_nms;
+    float box_scale;
+    int32_t box_zero_point;
+    float score_scale;
+    int32_t score_zero_point;
+  };
+
+  // Both write at most max_detections rows of [ymin, xmin, ymax, xmax, class,
+  // score] to `output_data`, by decreasing score, and return their number.
+  // `class` is the column of the score tensor.
+  int ssdPostprocessFloat32Wrapper(const SsdPostprocessParams& params,
+                                   const intptr_t box_data,
+                                   const intptr_t score_data,
+                                   const intptr_t anchor_data,
+                                   intptr_t output_data);
+
+  int ssdPostprocessUint8Wrapper(const SsdPostprocessParams& params,
+                                 const intptr_t box_data,
+                                 const intptr_t score_data,
+                                 const intptr_t anchor_data,
+                                 intptr_t output_data);
+
+  // YOLOv2 region decoding of a [grid_height, grid_width, num_anchors *
+  // (5 + num_classes)] output: sigmoid on objectness and the box centre, exp
+  // on the box size scaled by the [num_anchors, 2] (width, height) anchors,
+  // softmax over the classes times objectness, obj_threshold on the result,
+  // and per-class NMS with nms_threshold, as in Yolo2Decoder.js.
+  struct Yolo2RegionParams {
+    int32_t grid_height;
+    int32_t grid_width;
+    int32_t num_anchors;
+    int32_t num_classes;
+    float obj_threshold;
+    float nms_threshold;
+  };
+
+  // Writes one [class, x, y, width, height, score] row for every cell with a
+  // surviving class, its best one, in cell order and in units of the image,
+  // and returns their number. `output_data` must hold a row per cell.
+  int yolo2RegionFloat32Wrapper(const Yolo2RegionParams& params,
+                                const intptr_t input_data,
+                                const intptr_t anchor_data,
+                                intptr_t output_data);
+
+  // Lane features of an RGBA camera frame, fusing the OpenCV.js pipeline of
+  // the lane demos. A source pixel is set when its HLS saturation is above
+  // s_threshold, when its absolute 3x3 Sobel x gradient of HLS lightness is
+  // above sobel_threshold (reflected at the borders), or, with color_mask,
+  // when its OpenCV 8-bit HSV value (H in [0, 180]) lies in
+  // [hsv_lower, hsv_upper]. The mask is warped to a bird's-eye view that maps
+  // the src_quad corners (x, y pairs: top-left, top-right, bottom-right,
+  // bottom-left) to the corners of the dst_width x dst_height output.
+  struct LaneFeatureParams {
+    int32_t src_width;
+    int32_t src_height;
+    int32_t dst_width;
+    int32_t dst_height;
+    std::array<float, 8> src_quad;
+    int32_t s_threshold;
+    int32_t sobel_threshold;
+    bool color_mask;
+    std::array<int32_t, 4> hsv_lower;
+    std::array<int32_t, 4> hsv_upper;
+    int32_t histogram_row;
+  };
+
+  // Fills `map_data` with the int32 source pixel of every output pixel, by
+  // nearest neighbour, or -1 outside the frame. Depends on the sizes and
+  // src_quad only, so callers compute it once and pass it to laneFeatures.
+  void laneWarpMapWrapper(const LaneFeatureParams& params,
+                          intptr_t map_data);
+
+  // Writes the warped uint8 mask, 0 or 255, to `output_data` and the number
+  // of set pixels of every output column from row histogram_row down to
+  // `histogram_data` (int32), in a single pass over the output.
+  void laneFeaturesWrapper(const LaneFeatureParams& params,
+                           const intptr_t input_data,
+                           const intptr_t map_data,
+                           intptr_t output_data,
+                           intptr_t histogram_data);
+
+  // LaneTracker configuration, in pixels of the warped lane mask.
+  struct LaneTrackerParams {
+    int32_t width;
+    int32_t height;
+    // Windows per lane of a full search.
+    int32_t num_windows;
+    // Half width of a window, and of the band searched around the last fit.
+    int32_t margin;
+    // Pixels of a window that recentre the next window on their mean.
+    int32_t min_window_pixels;
+    // Pixels a lane needs for its fit to be used.
+    int32_t min_lane_pixels;
+    // Fraction of its pixels at the last full search a tracked lane must
+    // keep; below it the lane counts as lost.
+    float min_track_ratio;
+    // First mask row of the histogram that seeds a full search.
+    int32_t histogram_row;
+    // Weight in [0, 1) of the previous fit when a tracked lane is refitted.
+    float smoothing;
+  };
+
+  // Second-order fits x = a * y^2 + b * y + c of the left and right lanes
+  // over a sequence of warped masks (see laneFeatures), nonzero bytes being
+  // lane pixels. The first frame, and any frame where tracking loses a lane,
+  // runs a full search: the histogram peaks of the left and right halves
+  // seed num_windows stacked windows per lane, each recentred on the pixels
+  // of the one below. Other frames only scan `margin` pixels either side of
+  // the previous fits, as long as both lanes keep min_lane_pixels and
+  // min_track_ratio of their pixels. Least squares use per-row sums, so no
+  // pixel lists are kept, and all state is allocated by the constructor.
+  class LaneTracker {
+   public:
+    struct Result {
+      // [a, b, c] of the left, then the right lane; x and y in mask pixels.
+      float fits[2][3];
+      // Lane pixels behind each fit.
+      int32_t pixels[2];
+      // Lanes fitted on this frame, bit 0 left and bit 1 right. Lanes that
+      // were not keep their last fit.
+      int32_t found;
+      // Whether this frame ran a full search.
+      int32_t full_search;
+    };
+
+    explicit LaneTracker(const LaneTrackerParams& params);
+
+    // Fit the lanes of a width x height uint8 mask. `histogram_data` is the
+    // int32 per-column count of mask pixels from row histogram_row down, as
+    // laneFeatures writes it, or 0 to count them here. Returns Result::found.
+    int update(intptr_t mask_data, intptr_t histogram_data);
+
+    // Forget the fits; the next update runs a full search.
+    void reset();
+
+    // Read it as a Float32Array of 6 fit coefficients followed by an
+    // Int32Array of the 4 other fields of Result.
+    intptr_t getResult() { return reinterpret_cast<intptr_t>(&result_); }
+
+   private:
+    // Normal equations of one lane, over t = y / height.
+    struct LaneSums {
+      double n, t, t2, t3, t4, x, xt, xt2;
+      void addRow(double t, int count, int sumX);
+    };
+
+    // Add the mask pixels of row y in columns [begin, end) to `sums`;
+    // returns their count and adds their columns to *sumX.
+    int scanRow(const uint8_t* mask, int y, int begin, int end, LaneSums* sums, int* sumX) const;
+
+    // Least-squares fit of `sums` into fits_[lane], when it has enough
+    // pixels and rows; smoothing blends it with the previous fit.
+    bool fitLane(int lane, const LaneSums& sums, float smoothing);
+
+    void fullSearch(const uint8_t* mask, const int32_t* histogram);
+
+    bool track(const uint8_t* mask);
+
+    LaneTrackerParams params_;
+    std::vector<int32_t> histogram_;
+    // Lanes with a fit from the previous frame.
+    bool tracked_[2];
+    // Pixels of each lane at the last full search.
+    int32_t searchPixels_[2];
+    Result result_;
+  };
+
+  // Patch depth of one packed filter group, see PackedConvFilter.
+  constexpr int kConvPackedDepth = 8;
+
+  // OHWI filter of QuantizedConvNhwc in the layout ConvMicroKernel4x4
+  // consumes. Output channels are padded with zero rows to blocks of four and
+  // the patch to a multiple of kConvPackedDepth taps; within a block, every
+  // group of kConvPackedDepth taps stores the four rows back to back, so the
+  // kernel reads one contiguous stream per block. `rowSums` holds the sum of
+  // each unpadded row.
+  template <typename FilterT>
+  struct PackedConvFilter {
+    int outputDepth;
+    int patchSize;
+    int packedPatchSize;
+    std::vector<FilterT> data;
+    std::vector<int32_t> rowSums;
+  };
+
+  // [1, H, W, OC] depthwise filter with every tap widened to int16 and the
+  // weights offset folded in, so the per-pixel loop only offsets the input.
+  // The layout stays tap-major: each tap is one contiguous row of channels.
+  struct PackedDepthwiseFilter {
+    int32_t weightsOffset;
+    std::vector<int16_t> taps;
+  };
+
+  // Depthwise kernels specialized at compile time for the layers MobileNet
+  // and SSD are made of: 3x3 filters, depth multiplier 1, no dilation and
+  // stride 1 or 2. Other layers run the generic kernels.
+  enum DepthwiseKernel {
+    kDepthwiseGeneric,
+    kDepthwise3x3Stride1,
+    kDepthwise3x3Stride2,
+  };
+
+  // 3x3 float filter transformed for the Winograd F(tile x tile, 3x3) conv
+  // of convFloat32Wrapper: U = G g G^T for every output and input channel,
+  // stored as (tile + 2)^2 [inputDepth][outputDepth] matrices, one per
+  // position of the transformed tile.
+  struct WinogradFilter {
+    int tile;
+    int inputDepth;
+    int outputDepth;
+    std::vector<float> data;
+  };
+
+  // The two paths of convFloat32Wrapper, exposed so nn_kernels_test and
+  // nn_ops_bench can run a layer on either. WinogradTileSize gives the
+  // output tile (2 or 4) the wrapper picks for a layer, 0 for im2col;
+  // TransformWinogradFilter accepts either tile for any 3x3 stride 1 conv.
+  int WinogradTileSize(const ConvParams& params, const RuntimeShape& inputShape,
+                       const RuntimeShape& filterShape, const RuntimeShape& outputShape);
+
+  void TransformWinogradFilter(const RuntimeShape& filterShape, const float* filterData,
+                               int tile, WinogradFilter* transformed);
+
+  void WinogradConvNhwc(const ConvParams& params,
+                        const RuntimeShape& inputShape, const float* inputData,
+                        const WinogradFilter& filter, const float* biasData,
+                        const RuntimeShape& outputShape, float* outputData);
+
+  void Im2colConvFloat32(const ConvParams& convParams,
+                         const RuntimeShape& inputShape, const float* inputData,
+                         const RuntimeShape& filterShape, const float* filterData,
+                         const RuntimeShape& biasShape, const float* biasData,
+                         const RuntimeShape& outputShape, float* outputData);
+
+  // Kernels an ExecutionPlan op record can dispatch to. The names match the
+  // standalone nn_ops functions the records replace.
+  enum PlanOpCode {
+    kPlanExternal,
+    kPlanNop,
+    kPlanAddFloat32,
+    kPlanAddUint8,
+    kPlanBroadCastAddFloat32,
+    kPlanMulFloat32,
+    kPlanBroadCastMulFloat32,
+    kPlanConvFloat32,
+    kPlanConvUint8,
+    kPlanConvUint8PerChannel,
+    kPlanConvInt8,
+    kPlanConvInt8PerChannel,
+    kPlanDepthwiseConvFloat32,
+    kPlanDepthwiseConvUint8,
+    kPlanDepthwiseConvUint8PerChannel,
+    kPlanDepthwiseConvInt8,
+    kPlanDepthwiseConvInt8PerChannel,
+    kPlanAveragePoolFloat32,
+    kPlanAveragePoolUint8,
+    kPlanAveragePoolInt8,
+    kPlanMaxPoolFloat32,
+    kPlanMaxPoolUint8,
+    kPlanSoftmaxFloat32,
+    kPlanSoftmaxUint8,
+    kPlanReshapeFloat32,
+    kPlanReshapeUint8,
+    kPlanConcatenationFloat32,
+    kPlanConcatenationUint8,
+    kPlanFullyConnectedFloat32,
+    kPlanFullyConnectedUint8,
+    kPlanResizeBilinearFloat32,
+    kPlanTanhFloat32,
+    kPlanMaximumFloat32,
+    kPlanBatchToSpaceNDFloat32,
+    kPlanTransposeFloat32,
+    kPlanArgMaxFloat32,
+    kPlanLogisticFloat32,
+    kPlanLogisticUint8,
+    kPlanPreluFloat32,
+    kPlanPreluUint8,
+    kPlanQuantizeUint8,
+    kPlanDequantizeUint8,
+  };
+
+  // A model compiled for repeated execution. PreparedModel registers every
+  // operand (shape and heap pointer) and then one op record per operation,
+  // with padding, activation ranges and quantized multipliers already
+  // resolved. run() walks the records and calls the kernels directly, so a
+  // frame costs one embind call per contiguous run of WASM ops instead of one
+  // call (plus param marshalling) per op.
+  //
+  // Ops executed outside of nn_ops (WEBNN_SUBGRAPH) are kept as kPlanExternal
+  // records so record indexes match PreparedModel._operations; callers run
+  // the ranges between them.
+  //
+  // Non-constant tensors are registered without storage and placed by
+  // planMemory() into a single arena: tensors whose live ranges (first to last
+  // record touching them) do not overlap share bytes.
+  //
+  // Constant filters of the quantized conv and depthwise kernels are packed
+  // when their record is added and cached by operand index, so run() never
+  // re-lays out weights. Float 3x3 stride 1 convs wide enough for the
+  // Winograd path get their filter transformed the same way.
+  //
+  // fuse() folds elementwise records into the record producing their input;
+  // the fused record runs in bands of output rows and applies the folded
+  // records as epilogues to each band while it is still in cache.
+  //
+  // alias() turns reshapes and concatenations into views: their inputs share
+  // the storage of their output, so nothing is copied at run time.
+  class ExecutionPlan {
+   public:
+    struct Operand {
+      RuntimeShape shape;
+      intptr_t data;
+      size_t bytes;
+      // Storage is assigned by planMemory().
+      bool planned;
+      // Model inputs and outputs stay live across the whole run.
+      bool pinned;
+      // Operand whose storage this one is a view of, at byte aliasOffset,
+      // -1 if none. Always a root: views of views are resolved by alias().
+      int alias;
+      size_t aliasOffset;
+      // Offset of its storage in the arena, kNoArenaOffset if planMemory()
+      // gave it none.
+      size_t arenaOffset;
+    };
+
+    static constexpr size_t kNoArenaOffset = ~size_t(0);
+
+    static constexpr size_t kArenaAlignment = 64;
+
+    // Output bytes a fused record computes before running its epilogues.
+    static constexpr size_t kFusionBandBytes = 128 * 1024;
+
+    // An elementwise record folded into the record producing its input.
+    struct Epilogue {
+      PlanOpCode code;
+      // The add/mul operand or PReLU alpha, -1 for logistic.
+      int other;
+      // `other` is input1 of the folded record.
+      bool otherFirst;
+      // `other` repeats every `period` values (per-channel operands), 0 if it
+      // has the shape of the output.
+      int period;
+      ArithmeticParams arithmetic;
+      LogisticParams logistic;
+      PreluParams prelu;
+    };
+
+    struct Op {
+      PlanOpCode code;
+      int inputs[3];
+      int output;
+      // Per-channel requantization arrays of conv and depthwise records.
+      intptr_t outputMultipliers;
+      intptr_t outputShifts;
+      // Index into packedConv_, packedDepthwise_ or (float convs)
+      // winogradFilters_, -1 if the filter is passed to the wrapper as is.
+      int packedFilter;
+      // Kernel of depthwise records, selected when the record is added.
+      DepthwiseKernel depthwiseKernel;
+      // Range of epilogues_ applied to the output, see fuse().
+      int epilogueBegin;
+      int epilogueCount;
+      // Operands used besides inputs/output (concatenation inputs, external
+      // inputs and outputs), as a range of operandLists_.
+      int listBegin;
+      int listCount;
+      ArithmeticParams arithmetic;
+      ConvParams conv;
+      DepthwiseParams depthwise;
+      PoolParams pool;
+      SoftmaxParams softmax;
+      ConcatenationParams concatenation;
+      FullyConnectedParams fullyConnected;
+      ResizeBilinearParams resizeBilinear;
+      TransposeParams transpose;
+      LogisticParams logistic;
+      PreluParams prelu;
+      QuantizeParams quantize;
+    };
+
+    // Operands are addressed by the index returned here; PreparedModel adds
+    // the model operands first so the indexes coincide.
+    int addOperand(const std::vector<int32_t>& dims, intptr_t data);
+
+    // A tensor of `bytes` bytes whose storage comes from the arena.
+    int addPlannedOperand(const std::vector<int32_t>& dims, int bytes);
+
+    // A constant tensor of `bytes` bytes at `data`. Unlike addOperand, the
+    // plan knows its size, so save() can store its values.
+    int addConstant(const std::vector<int32_t>& dims, intptr_t data, int bytes);
+
+    void identifyInputsAndOutputs(const std::vector<int>& inputs,
+                                  const std::vector<int>& outputs);
+
+    // Place every planned operand in the arena, greedy by size: the largest
+    // tensors are placed first, each at the lowest offset that does not
+    // collide with an already placed tensor whose live range overlaps. Must
+    // be called after all records are added. Returns the arena size in bytes.
+    //
+    // The kernel scratch the records need (im2col buffers, quantized conv
+    // patches, Winograd tiles) is reserved as well, so runs do not allocate.
+    int planMemory();
+
+    int getArenaSize() const { return arenaSize_; }
+
+    // Scratch bytes reserved by planMemory() for the calling thread.
+    int getScratchSize() const { return scratchSize_; }
+
+    // Version of the images written by save(). Images of other versions, or
+    // of nn_kernels built with other SIMD or pointer size, are refused by
+    // load().
+    static constexpr uint32_t kImageVersion = 1;
+
+    // Bytes save() writes.
+    int getImageSize() const;
+
+    // Write the planned model as one flat image at `image`: every operand
+    // (shape, arena placement, constant values), the records with their
+    // epilogues and requantization arrays, the packed and transformed
+    // filters and the arena size. Must be called after planMemory(), on a
+    // plan without externals whose constants were added with addConstant().
+    void save(intptr_t image, int bytes) const;
+
+    // Rebuild an empty plan from an image written by save(), without
+    // packing filters or planning memory again. Constants and requantization
+    // arrays are used in place, so the image must outlive the plan; the
+    // arena and scratch are allocated as by planMemory(). Returns false,
+    // leaving the plan empty, for an image of another version or build.
+    bool load(intptr_t image, int bytes);
+
+    // Fold every add, mul, PReLU and logistic record into the conv,
+    // depthwise or elementwise record producing its input, when it is the
+    // only consumer of that value and the value is not a model output. Chains
+    // are folded one record at a time. The intermediate values get no storage
+    // and folded records become kPlanNop, so indexes still match the caller's
+    // operations. Must be called before planMemory(). Returns the number of
+    // folded records.
+    int fuse();
+
+    // Make the output of every reshape a view of its input (or the input of
+    // its output), and every input of a concatenation along its outermost
+    // non-unit axis a view of its slice of the output, so producers write
+    // the concatenated tensor in place. Inputs of uint8 concatenations must
+    // share the output's quantization. Aliased records become kPlanNop.
+    // Operands read by externals are never moved under a model input or
+    // output, whose storage setOperandData() may replace. Must be called
+    // after fuse() and identifyInputsAndOutputs() and before planMemory().
+    // Returns the number of aliased records.
+    int alias();
+
+    // Record a folded record was fused into, -1 if it was not.
+    int getFusedInto(int index) const;
+
+    // Views of `index` follow its new storage.
+    void setOperandData(int index, intptr_t data);
+
+    intptr_t getOperandData(int index);
+
+    int size() const { return ops_.size(); }
+
+    // `inputs` and `outputs` only extend the live ranges of those operands.
+    int addExternal(const std::vector<int>& inputs, const std::vector<int>& outputs);
+
+    int addNop();
+
+    int addArithmetic(PlanOpCode code, const ArithmeticParams& params,
+                      int input1, int input2, int output);
+
+    int addConv(PlanOpCode code, const ConvParams& params,
+                int input, int filter, int bias, int output,
+                intptr_t outputMultipliers, intptr_t outputShifts);
+
+    int addDepthwiseConv(PlanOpCode code, const DepthwiseParams& params,
+                         int input, int filter, int bias, int output,
+                         intptr_t outputMultipliers, intptr_t outputShifts);
+
+    int addPool(PlanOpCode code, const PoolParams& params, int input, int output);
+
+    int addSoftmax(PlanOpCode code, const SoftmaxParams& params, int input, int output);
+
+    int addConcatenation(PlanOpCode code, const ConcatenationParams& params,
+                         const std::vector<int>& inputs,
+                         const std::vector<float>& inputScales,
+                         const std::vector<int32_t>& inputZeroPoints,
+                         int output);
+
+    int addFullyConnected(PlanOpCode code, const FullyConnectedParams& params,
+                          int input, int weights, int bias, int output);
+
+    int addResizeBilinear(PlanOpCode code, const ResizeBilinearParams& params,
+                          int input, int outSize, int output);
+
+    int addTranspose(PlanOpCode code, const TransposeParams& params, int input, int output);
+
+    int addLogistic(PlanOpCode code, const LogisticParams& params, int input, int output);
+
+    int addPrelu(PlanOpCode code, const PreluParams& params, int input, int alpha, int output);
+
+    // Float to uint8 (quantizeUint8) or back (dequantizeUint8).
+    int addQuantize(PlanOpCode code, const QuantizeParams& params, int input, int output);
+
+    // Ops without a params struct: reshape, tanh, maximum, batchToSpaceND
+    // (input, block shape, crops), argMax (input, axis), logisticFloat32 and
+    // preluFloat32.
+    int addOperation(PlanOpCode code, int input1, int input2, int input3, int output);
+
+    // Accumulated milliseconds per record, written by run() when profiling is
+    // on and by addTiming() for externals. Read it as a Float64Array of
+    // size() entries.
+    void setProfiling(bool enabled) { profiling_ = enabled; }
+    intptr_t getTimings() { return reinterpret_cast<intptr_t>(timings_.data()); }
+    void addTiming(int index, double ms);
+    void resetTimings();
+
+    // Every profiled run of a record is also kept in a ring buffer holding
+    // the last kProfileRuns runs per record on average, as kProfileSampleSize
+    // doubles: record, start and end in ms, and the record's MACs, bytes read
+    // and bytes written. MACs and bytes are estimated from the shapes, so
+    // they do not depend on the kernels or the machine; see opCost().
+    static constexpr int kProfileRuns = 128;
+    static constexpr int kProfileSampleSize = 6;
+
+    // Per record statistics of the runs in the ring: run count, min, p50,
+    // p99 and mean latency in ms, MACs, bytes read, bytes written, GFLOP/s
+    // (2 flops per MAC) and GB/s at the mean latency. Read it as a
+    // Float64Array of size() * kProfileStatsSize entries; records without
+    // runs are all zero.
+    static constexpr int kProfileStatsSize = 10;
+    intptr_t getProfile();
+
+    // Execute records [begin, end). The range must not contain externals.
+    void run(int begin, int end);
+
+    // Defined with the destructor where AsyncRun is complete.
+    ExecutionPlan();
+    ~ExecutionPlan();
+
+    // run(begin, end) on a thread of the plan's own, so the caller can
+    // prepare the next inputs meanwhile; builds without threads run it
+    // before returning. Until done() returns true no operand of the plan may
+    // be touched or rebound. The plan runs on the worker pool and contexts
+    // set up by the set_*_threads_num functions, which throw if they would
+    // change meanwhile; kernels the caller runs in the meantime, including
+    // other plans, get a single-threaded context of their own. Only one plan
+    // can be started at a time.
+    void start(int begin, int end);
+
+    // Whether the run of the last start() has finished. Rethrows its error.
+    bool done();
+
+    // Address of an int32 that is 0 while the run of the last start() is
+    // going and 1 once it has finished; the plan's thread notifies waiters
+    // on it (memory.atomic.notify), so the page can Atomics.waitAsync on it
+    // instead of polling done(). done() must still be called afterwards.
+    intptr_t getDoneFlag();
+
+    // Block until the run of the last start() has finished. Rethrows its
+    // error.
+    void wait();
+
+    // Milliseconds the run of the last start() took, measured on its thread.
+    double getRunTime() const { return runTime_; }
+
+   private:
+    Op newOp(PlanOpCode code, std::initializer_list<int> inputs, int output);
+
+    static bool isConvCode(PlanOpCode code);
+
+    static bool isDepthwiseCode(PlanOpCode code);
+
+    // Records that can compute their output band by band.
+    static bool isBanded(PlanOpCode code);
+
+    static bool isFloat32Code(PlanOpCode code);
+
+    static bool isUint8Code(PlanOpCode code);
+
+    // Period of `other` as an epilogue operand of a value shaped `shape`: 0
+    // for the same shape, the channel count for a per-channel operand ([C]
+    // or [1, ..., 1, C]), -1 otherwise.
+    int epiloguePeriod(int other, const RuntimeShape& shape) const;
+
+    // Describe `op`, which reads `value`, as an epilogue of a record with
+    // code `producer`. Only folds that keep the value's shape and element
+    // type are accepted.
+    bool makeEpilogue(PlanOpCode producer, const Op& op, int value, Epilogue* epilogue) const;
+
+    // Run a record with epilogues: its output is computed in bands of about
+    // kFusionBandBytes, whole rows for conv and depthwise, and every band
+    // goes through the epilogues right after it is written.
+    void runFused(const Op& op);
+
+    // Compute output rows [y, y + rows) of batch `b` of a conv or depthwise
+    // record from the input rows they need, with the top padding adjusted.
+    void runConvBand(const Op& op, int elementSize, int b, int y, int rows);
+
+    // Apply the epilogues of `op` to output values [offset, offset + count).
+    // Bands are whole rows, so per-channel operands start at channel 0.
+    void runEpilogues(const Op& op, int offset, int count);
+
+    // Operands describing the band a fused record is working on. They are
+    // addressed by negative indexes so they never collide with model
+    // operands: slot k (0-2 for inputs, kBandOutput) is index -2 - k.
+    static constexpr int kBandOutput = 3;
+    static int bandOperand(int slot) { return -2 - slot; }
+
+    void setBandOperand(int slot, const int32_t* dims, int rank, intptr_t data);
+
+    // Constants are the only operands with storage before planMemory().
+    bool isConstant(int index) const;
+
+    int aliasRoot(int index) const;
+
+    // Make root `index` and its views views of root `root` at `offset`.
+    void joinAlias(int index, int root, size_t offset);
+
+    int packConvFilter(int filter);
+
+    // The weights offset is folded into the packed taps, so it is part of
+    // the key.
+    int packDepthwiseFilter(int filter, int32_t weightsOffset);
+
+    int transformWinogradFilter(int filter, int tile);
+
+    int push(const Op& op);
+
+    void checkOperand(int index) const;
+
+    static size_t alignArena(size_t value);
+
+    // Reserve the kernel scratch of the records, see planMemory().
+    void reserveScratch();
+
+    // Lay out the image of save() at `image`, or only measure it if null.
+    // Returns its size.
+    size_t writeImage(char* image) const;
+
+    void checkOp(int index) const;
+
+    const Operand& operand(int index) const;
+    const RuntimeShape& shape(int index) const { return operand(index).shape; }
+    intptr_t data(int index) const { return operand(index).data; }
+
+    // Conv and depthwise records whose filter was packed (or transformed) by
+    // addConv or addDepthwiseConv.
+    void runPackedOp(const Op& op);
+
+    struct OpCost {
+      double macs;
+      double bytesRead;
+      double bytesWritten;
+    };
+
+    // Conv, depthwise and fully connected records count their multiply-
+    // accumulates, pooling one per window tap and other arithmetic records
+    // (and each fused epilogue) one per output value; data movement records
+    // count none. Bytes are the tensors read and written once; externals
+    // count nothing.
+    OpCost opCost(const Op& op) const;
+
+    void recordProfile(int index, double start, double end);
+
+    void runOp(Op& op);
+
+    // State of start(), defined with the threads support in nn_kernels.cpp.
+    struct AsyncRun;
+
+    void asyncLoop();
+
+    void runTimed(int begin, int end);
+
+    // A deque keeps operand addresses stable, concatShapes_ points into it.
+    std::deque<Operand> operands_;
+    std::vector<Op> ops_;
+    std::vector<double> timings_;
+    bool profiling_ = false;
+    // Filled on the first profiled run, after fuse().
+    std::vector<OpCost> costs_;
+    std::vector<double> profileRing_;
+    size_t profileHead_ = 0;
+    size_t profileSamples_ = 0;
+    std::vector<double> profile_;
+    std::unique_ptr<char[]> arena_;
+    int arenaSize_ = 0;
+    int scratchSize_ = 0;
+    std::vector<int> operandLists_;
+    std::vector<const RuntimeShape*> concatShapes_;
+    std::vector<float> concatScales_;
+    std::vector<int32_t> concatZeroPoints_;
+    std::vector<const float*> concatFloatData_;
+    std::vector<const uint8_t*> concatUint8Data_;
+    std::deque<PackedConvFilter<int8_t>> packedConv_;
+    std::map<int, int> packedConvIndex_;
+    std::deque<PackedDepthwiseFilter> packedDepthwise_;
+    std::map<std::pair<int, int32_t>, int> packedDepthwiseIndex_;
+    std::deque<WinogradFilter> winogradFilters_;
+    std::map<std::pair<int, int>, int> winogradFilterIndex_;
+    std::vector<Epilogue> epilogues_;
+    std::vector<int> fusedInto_;
+    Operand band_[4];
+    bool running_ = false;
+    double runTime_ = 0;
+    // Last, as the constructor never has to destroy it.
+    std::unique_ptr<AsyncRun> async_;
+  };
+}
+
+#endif  // NN_KERNELS_H_
@@ -0,0 +1,664 @@
+// Correctness tests of the hand-written nn_ops kernels, built natively (see
+// README.md) and run by ctest.
+//
+// The quantized conv and depthwise wrappers are compared bit for bit with
+// the TF Lite reference_integer_ops kernels on random layers that cover
+// padding, strides, dilations, depth multipliers and odd channel counts.
+// The Winograd float conv is compared with the im2col path it replaces
+// within a tolerance, for both output tiles. An ExecutionPlan must not grow
+// the kernel scratch once planMemory() has sized it. preprocessRGBA* is
+// compared with a bilinear reference on frames of increasing size.
+//
+//   nn_kernels_test [--filter=<substring>] [--threads=<n>]
+
+#include "bind/src/nn_kernels.h"
+
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace binding_utils;
+
+namespace {
+  std::mt19937 random_engine(2020);
+
+  int Uniform(int lo, int hi) {
+    return std::uniform_int_distribution<int>(lo, hi)(random_engine);
+  }
+
+  template <typename T>
+  std::vector<T> RandomVector(size_t size, int lo, int hi) {
+    std::vector<T> v(size);
+    for (T& x : v) x = static_cast<T>(Uniform(lo, hi));
+    return v;
+  }
+
+  std::vector<float> RandomFloats(size_t size, float lo, float hi) {
+    std::uniform_real_distribution<float> distribution(lo, hi);
+    std::vector<float> v(size);
+    for (float& x : v) x = distribution(random_engine);
+    return v;
+  }
+
+  intptr_t Data(const void* p) { return reinterpret_cast<intptr_t>(p); }
+
+  RuntimeShape Shape(const std::vector<int32_t>& dims) {
+    RuntimeShape shape;
+    shape.ReplaceWith(dims.size(), dims.data());
+    return shape;
+  }
+
+  struct Test {
+    std::string name;
+    // Returns the number of failed checks, after printing the first ones.
+    std::function<int()> run;
+  };
+
+  std::vector<Test> tests;
+
+  void Register(const std::string& name, std::function<int()> run) {
+    tests.push_back(Test{name, run});
+  }
+
+  // Reports a mismatch of `actual` against `expected` at the first element
+  // that differs.
+  template <typename T>
+  int Compare(const std::string& what, const std::vector<T>& expected,
+              const std::vector<T>& actual) {
+    for (size_t i = 0; i < expected.size(); ++i) {
+      if (expected[i] != actual[i]) {
+        printf("  %s: element %zu is %d, expected %d\n", what.c_str(), i,
+               int(actual[i]), int(expected[i]));
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // Float results of different summation orders: `actual` may be off by
+  // `tolerance` times the magnitude of the expected value, plus one.
+  int CompareNear(const std::string& what, const std::vector<float>& expected,
+                  const std::vector<float>& actual, float tolerance) {
+    for (size_t i = 0; i < expected.size(); ++i) {
+      if (!(std::fabs(actual[i] - expected[i]) <= tolerance * (1 + std::fabs(expected[i])))) {
+        printf("  %s: element %zu is %g, expected %g\n", what.c_str(), i, actual[i],
+               expected[i]);
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  // A random conv or depthwise layer. Padding covers VALID (0), SAME and
+  // more than SAME, including top/left padding wider than a dilated tap.
+  struct Layer {
+    int batches, height, width, inputDepth, outputDepth;
+    int filterHeight, filterWidth, stride, dilation, padding;
+    int depthMultiplier;
+    int outputHeight, outputWidth;
+
+    std::string Describe() const {
+      char s[160];
+      snprintf(s, sizeof(s), "%dx%dx%dx%d->%d k%dx%d s%d d%d p%d m%d", batches, height, width,
+               inputDepth, outputDepth, filterHeight, filterWidth, stride, dilation, padding,
+               depthMultiplier);
+      return s;
+    }
+  };
+
+  Layer RandomLayer(bool depthwise) {
+    for (;;) {
+      Layer l;
+      l.batches = Uniform(1, 2);
+      l.height = Uniform(1, 13);
+      l.width = Uniform(1, 13);
+      // Odd counts on purpose: the packed kernels work in blocks of 4
+      // output channels and 8 or 16 input values.
+      l.inputDepth = Uniform(0, 3) ? 2 * Uniform(0, 10) + 1 : Uniform(1, 40);
+      l.depthMultiplier = depthwise ? Uniform(1, 3) : 1;
+      l.outputDepth = depthwise ? l.inputDepth * l.depthMultiplier
+                                : (Uniform(0, 3) ? 2 * Uniform(0, 12) + 1 : Uniform(1, 48));
+      const int sizes[] = {1, 3, 3, 3, 5};
+      l.filterHeight = sizes[Uniform(0, 4)];
+      l.filterWidth = Uniform(0, 3) ? l.filterHeight : sizes[Uniform(0, 4)];
+      l.stride = Uniform(1, 2);
+      l.dilation = Uniform(0, 3) ? 1 : 2;
+      l.padding = Uniform(0, 2);
+      l.outputHeight = (l.height + 2 * l.padding - l.dilation * (l.filterHeight - 1) - 1) /
+                       l.stride + 1;
+      l.outputWidth = (l.width + 2 * l.padding - l.dilation * (l.filterWidth - 1) - 1) /
+                      l.stride + 1;
+      if (l.outputHeight > 0 && l.outputWidth > 0) {
+        return l;
+      }
+    }
+  }
+
+  // Per-channel requantization of realistic range: a multiplier in
+  // [0.5, 1) and a right shift of 6 to 10.
+  void RandomRequantization(int channels, std::vector<int32_t>* multipliers,
+                            std::vector<int32_t>* shifts) {
+    multipliers->resize(channels);
+    shifts->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      (*multipliers)[c] = (1 << 30) + Uniform(0, (1 << 30) - 1);
+      (*shifts)[c] = -Uniform(6, 10);
+    }
+  }
+
+  // The uint8 wrappers are checked against the int8 reference: flipping the
+  // top bit of every uint8 value and moving the offsets by 128 gives the
+  // same accumulators and the same outputs, minus 128.
+  std::vector<int8_t> ToInt8(const std::vector<uint8_t>& v) {
+    std::vector<int8_t> r(v.size());
+    for (size_t i = 0; i < v.size(); ++i) r[i] = static_cast<int8_t>(v[i] - 128);
+    return r;
+  }
+
+  std::vector<uint8_t> ToUint8(const std::vector<int8_t>& v) {
+    std::vector<uint8_t> r(v.size());
+    for (size_t i = 0; i < v.size(); ++i) r[i] = static_cast<uint8_t>(v[i] + 128);
+    return r;
+  }
+
+  int TestQuantizedConv(int iterations) {
+    int failures = 0;
+    for (int i = 0; i < iterations; ++i) {
+      const Layer l = RandomLayer(false);
+      const RuntimeShape input = Shape({l.batches, l.height, l.width, l.inputDepth});
+      const RuntimeShape filter =
+          Shape({l.outputDepth, l.filterHeight, l.filterWidth, l.inputDepth});
+      const RuntimeShape bias = Shape({l.outputDepth});
+      const RuntimeShape output = Shape({l.batches, l.outputHeight, l.outputWidth, l.outputDepth});
+
+      ConvParams p = ConvParams();
+      p.padding_values.height = p.padding_values.width = l.padding;
+      p.stride_height = p.stride_width = l.stride;
+      p.dilation_height_factor = p.dilation_width_factor = l.dilation;
+      p.input_offset = Uniform(-127, 128);
+      p.output_offset = Uniform(-128, 127);
+      p.quantized_activation_min = -128;
+      p.quantized_activation_max = 127;
+      if (Uniform(0, 3) == 0) {
+        p.quantized_activation_min = Uniform(-128, 0);
+        p.quantized_activation_max = Uniform(0, 127);
+      }
+      std::vector<int32_t> multipliers, shifts;
+      RandomRequantization(l.outputDepth, &multipliers, &shifts);
+      p.output_multiplier = multipliers[0];
+      p.output_shift = shifts[0];
+      const std::vector<int8_t> inputData = RandomVector<int8_t>(input.FlatSize(), -128, 127);
+      const std::vector<int8_t> filterData = RandomVector<int8_t>(filter.FlatSize(), -127, 127);
+      const std::vector<int32_t> biasData = RandomVector<int32_t>(l.outputDepth, -5000, 5000);
+      std::vector<int8_t> expected(output.FlatSize()), actual(output.FlatSize());
+      const std::string name = l.Describe();
+
+      reference_integer_ops::ConvPerChannel(p, multipliers.data(), shifts.data(), input,
+                                            inputData.data(), filter, filterData.data(), bias,
+                                            biasData.data(), output, expected.data());
+      convInt8PerChannelWrapper(p, Data(multipliers.data()), Data(shifts.data()),
+                                input, Data(inputData.data()), filter, Data(filterData.data()),
+                                bias, Data(biasData.data()), output, Data(actual.data()));
+      failures += Compare("convInt8PerChannel " + name, expected, actual);
+
+      // uint8 activations with an int8 per-channel filter.
+      ConvParams p8 = p;
+      p8.input_offset = p.input_offset - 128;
+      p8.output_offset = p.output_offset + 128;
+      p8.quantized_activation_min = p.quantized_activation_min + 128;
+      p8.quantized_activation_max = p.quantized_activation_max + 128;
+      const std::vector<uint8_t> inputUint8 = ToUint8(inputData);
+      std::vector<uint8_t> actualUint8(output.FlatSize());
+      convUint8PerChannelWrapper(p8, Data(multipliers.data()), Data(shifts.data()),
+                                 input, Data(inputUint8.data()), filter, Data(filterData.data()),
+                                 bias, Data(biasData.data()), output, Data(actualUint8.data()));
+      failures += Compare("convUint8PerChannel " + name, ToUint8(expected), actualUint8);
+
+      // Per-tensor int8, with a weights offset folded into the reference
+      // filter; filter values stay in int8 range once offset.
+      const std::vector<int32_t> sameMultipliers(l.outputDepth, p.output_multiplier);
+      const std::vector<int32_t> sameShifts(l.outputDepth, p.output_shift);
+      p.weights_offset = Uniform(-20, 20);
+      std::vector<int8_t> offsetFilter(filterData.size()), narrowFilter(filterData.size());
+      for (size_t j = 0; j < filterData.size(); ++j) {
+        narrowFilter[j] = static_cast<int8_t>(filterData[j] * 100 / 127);
+        offsetFilter[j] = static_cast<int8_t>(narrowFilter[j] + p.weights_offset);
+      }
+      reference_integer_ops::ConvPerChannel(p, sameMultipliers.data(), sameShifts.data(), input,
+                                            inputData.data(), filter, offsetFilter.data(), bias,
+                                            biasData.data(), output, expected.data());
+      convInt8Wrapper(p, input, Data(inputData.data()), filter, Data(narrowFilter.data()),
+                      bias, Data(biasData.data()), output, Data(actual.data()));
+      failures += Compare("convInt8 " + name, expected, actual);
+    }
+    return failures;
+  }
+
+  int TestQuantizedDepthwiseConv(int iterations) {
+    int failures = 0;
+    for (int i = 0; i < iterations; ++i) {
+      const Layer l = RandomLayer(true);
+      const RuntimeShape input = Shape({l.batches, l.height, l.width, l.inputDepth});
+      const RuntimeShape filter = Shape({1, l.filterHeight, l.filterWidth, l.outputDepth});
+      const RuntimeShape bias = Shape({l.outputDepth});
+      const RuntimeShape output = Shape({l.batches, l.outputHeight, l.outputWidth, l.outputDepth});
+
+      DepthwiseParams p = DepthwiseParams();
+      p.padding_values.height = p.padding_values.width = l.padding;
+      p.stride_height = p.stride_width = l.stride;
+      p.dilation_height_factor = p.dilation_width_factor = l.dilation;
+      p.depth_multiplier = l.depthMultiplier;
+      p.input_offset = Uniform(-127, 128);
+      p.output_offset = Uniform(-128, 127);
+      p.quantized_activation_min = -128;
+      p.quantized_activation_max = 127;
+      if (Uniform(0, 3) == 0) {
+        p.quantized_activation_min = Uniform(-128, 0);
+        p.quantized_activation_max = Uniform(0, 127);
+      }
+      std::vector<int32_t> multipliers, shifts;
+      RandomRequantization(l.outputDepth, &multipliers, &shifts);
+      // Depthwise accumulators are small, shift less so outputs spread.
+      for (int32_t& shift : shifts) shift += 4;
+      p.output_multiplier = multipliers[0];
+      p.output_shift = shifts[0];
+      const std::vector<int8_t> inputData = RandomVector<int8_t>(input.FlatSize(), -128, 127);
+      const std::vector<int8_t> filterData = RandomVector<int8_t>(filter.FlatSize(), -127, 127);
+      const std::vector<int32_t> biasData = RandomVector<int32_t>(l.outputDepth, -2000, 2000);
+      std::vector<int8_t> expected(output.FlatSize()), actual(output.FlatSize());
+      const std::string name = l.Describe();
+
+      reference_integer_ops::DepthwiseConvPerChannel(p, multipliers.data(), shifts.data(), input,
+                                                     inputData.data(), filter, filterData.data(),
+                                                     bias, biasData.data(), output,
+                                                     expected.data());
+      depthwiseConvInt8PerChannelWrapper(p, Data(multipliers.data()), Data(shifts.data()),
+                                         input, Data(inputData.data()),
+                                         filter, Data(filterData.data()),
+                                         bias, Data(biasData.data()), output, Data(actual.data()));
+      failures += Compare("depthwiseConvInt8PerChannel " + name, expected, actual);
+
+      DepthwiseParams p8 = p;
+      p8.input_offset = p.input_offset - 128;
+      p8.output_offset = p.output_offset + 128;
+      p8.quantized_activation_min = p.quantized_activation_min + 128;
+      p8.quantized_activation_max = p.quantized_activation_max + 128;
+      const std::vector<uint8_t> inputUint8 = ToUint8(inputData);
+      std::vector<uint8_t> actualUint8(output.FlatSize());
+      depthwiseConvUint8PerChannelWrapper(p8, Data(multipliers.data()), Data(shifts.data()),
+                                          input, Data(inputUint8.data()),
+                                          filter, Data(filterData.data()),
+                                          bias, Data(biasData.data()),
+                                          output, Data(actualUint8.data()));
+      failures += Compare("depthwiseConvUint8PerChannel " + name, ToUint8(expected), actualUint8);
+
+      const std::vector<int32_t> sameMultipliers(l.outputDepth, p.output_multiplier);
+      const std::vector<int32_t> sameShifts(l.outputDepth, p.output_shift);
+      p.weights_offset = Uniform(-20, 20);
+      std::vector<int8_t> offsetFilter(filterData.size()), narrowFilter(filterData.size());
+      for (size_t j = 0; j < filterData.size(); ++j) {
+        narrowFilter[j] = static_cast<int8_t>(filterData[j] * 100 / 127);
+        offsetFilter[j] = static_cast<int8_t>(narrowFilter[j] + p.weights_offset);
+      }
+      reference_integer_ops::DepthwiseConvPerChannel(p, sameMultipliers.data(), sameShifts.data(),
+                                                     input, inputData.data(), filter,
+                                                     offsetFilter.data(), bias, biasData.data(),
+                                                     output, expected.data());
+      depthwiseConvInt8Wrapper(p, input, Data(inputData.data()), filter, Data(narrowFilter.data()),
+                               bias, Data(biasData.data()), output, Data(actual.data()));
+      failures += Compare("depthwiseConvInt8 " + name, expected, actual);
+    }
+    return failures;
+  }
+
+  // WinogradConvNhwc with both tiles against the im2col path on random 3x3
+  // stride 1 layers. Output sizes of 1 to 13 leave ragged tiles at the
+  // bottom and right edges of F(2x2, 3x3) and F(4x4, 3x3), padding goes up
+  // to 2 (outputs wider than the input) and channel counts run on both sides
+  // of kWinogradMinChannels; a forced tile must work on any of them.
+  // F(4x4, 3x3) transforms scale values by up to 8 before the products, so
+  // its results are further from the im2col sums than those of F(2x2, 3x3).
+  int TestWinogradConv(int iterations) {
+    const int depths[] = {1, 3, 8, 15, 16, 17, 33};
+    int failures = 0;
+    for (int i = 0; i < iterations; ++i) {
+      const int batches = Uniform(1, 2);
+      const int padding = Uniform(0, 2);
+      const int height = Uniform(std::max(1, 3 - 2 * padding), 15);
+      const int width = Uniform(std::max(1, 3 - 2 * padding), 15);
+      const int inputDepth = depths[Uniform(0, 6)];
+      const int outputDepth = depths[Uniform(0, 6)];
+      const RuntimeShape input = Shape({batches, height, width, inputDepth});
+      const RuntimeShape filter = Shape({outputDepth, 3, 3, inputDepth});
+      const RuntimeShape bias = Shape({outputDepth});
+      const RuntimeShape output =
+          Shape({batches, height + 2 * padding - 2, width + 2 * padding - 2, outputDepth});
+
+      ConvParams p = ConvParams();
+      p.padding_values.height = p.padding_values.width = padding;
+      p.stride_height = p.stride_width = 1;
+      p.dilation_height_factor = p.dilation_width_factor = 1;
+      p.float_activation_min = -std::numeric_limits<float>::max();
+      p.float_activation_max = std::numeric_limits<float>::max();
+      if (Uniform(0, 3) == 0) {
+        p.float_activation_min = 0;
+        p.float_activation_max = 6;
+      }
+      const std::vector<float> inputData = RandomFloats(input.FlatSize(), -1, 1);
+      const std::vector<float> filterData = RandomFloats(filter.FlatSize(), -1, 1);
+      const std::vector<float> biasData = RandomFloats(outputDepth, -1, 1);
+      std::vector<float> expected(output.FlatSize()), actual(output.FlatSize());
+      char name[96];
+      snprintf(name, sizeof(name), "%dx%dx%dx%d->%d p%d", batches, height, width, inputDepth,
+               outputDepth, padding);
+
+      Im2colConvFloat32(p, input, inputData.data(), filter, filterData.data(),
+                        bias, biasData.data(), output, expected.data());
+      for (int tile = 2; tile <= 4; tile += 2) {
+        WinogradFilter transformed;
+        TransformWinogradFilter(filter, filterData.data(), tile, &transformed);
+        WinogradConvNhwc(p, input, inputData.data(), transformed, biasData.data(),
+                         output, actual.data());
+        failures += CompareNear("winograd F" + std::to_string(tile) + " " + name,
+                                expected, actual, tile == 2 ? 2e-5f : 2e-4f);
+      }
+    }
+    return failures;
+  }
+
+  // The layers convFloat32Wrapper runs on the Winograd path, and with which
+  // tile.
+  int TestWinogradSelection() {
+    struct Case {
+      int outputSize, inputDepth, outputDepth, filterSize, stride, dilation, tile;
+    };
+    const Case cases[] = {
+      {8, 16, 16, 3, 1, 1, 4},
+      {19, 32, 64, 3, 1, 1, 4},
+      {7, 16, 16, 3, 1, 1, 2},
+      {1, 16, 16, 3, 1, 1, 2},
+      {8, 15, 16, 3, 1, 1, 0},
+      {8, 16, 15, 3, 1, 1, 0},
+      {8, 16, 16, 3, 2, 1, 0},
+      {8, 16, 16, 3, 1, 2, 0},
+      {8, 16, 16, 1, 1, 1, 0},
+      {8, 16, 16, 5, 1, 1, 0},
+    };
+    int failures = 0;
+    for (const Case& c : cases) {
+      const int inputSize = (c.outputSize - 1) * c.stride + 1;
+      const int padding = c.dilation * (c.filterSize - 1) / 2;
+      const RuntimeShape input = Shape({1, inputSize, inputSize, c.inputDepth});
+      const RuntimeShape filter = Shape({c.outputDepth, c.filterSize, c.filterSize, c.inputDepth});
+      const RuntimeShape bias = Shape({c.outputDepth});
+      const RuntimeShape output = Shape({1, c.outputSize, c.outputSize, c.outputDepth});
+      ConvParams p = ConvParams();
+      p.padding_values.height = p.padding_values.width = padding;
+      p.stride_height = p.stride_width = c.stride;
+      p.dilation_height_factor = p.dilation_width_factor = c.dilation;
+      p.float_activation_min = -std::numeric_limits<float>::max();
+      p.float_activation_max = std::numeric_limits<float>::max();
+      char name[96];
+      snprintf(name, sizeof(name), "%dx%dx%d->%d k%d s%d d%d", c.outputSize, c.outputSize,
+               c.inputDepth, c.outputDepth, c.filterSize, c.stride, c.dilation);
+
+      const int tile = WinogradTileSize(p, input, filter, output);
+      if (tile != c.tile) {
+        printf("  WinogradTileSize %s: %d, expected %d\n", name, tile, c.tile);
+        ++failures;
+        continue;
+      }
+      // The wrapper must produce exactly what the selected path does.
+      const std::vector<float> inputData = RandomFloats(input.FlatSize(), -1, 1);
+      const std::vector<float> filterData = RandomFloats(filter.FlatSize(), -1, 1);
+      const std::vector<float> biasData = RandomFloats(c.outputDepth, -1, 1);
+      std::vector<float> expected(output.FlatSize()), actual(output.FlatSize());
+      if (tile > 0) {
+        WinogradFilter transformed;
+        TransformWinogradFilter(filter, filterData.data(), tile, &transformed);
+        WinogradConvNhwc(p, input, inputData.data(), transformed, biasData.data(),
+                         output, expected.data());
+      } else {
+        Im2colConvFloat32(p, input, inputData.data(), filter, filterData.data(),
+                          bias, biasData.data(), output, expected.data());
+      }
+      convFloat32Wrapper(p, input, Data(inputData.data()), filter, Data(filterData.data()),
+                         bias, Data(biasData.data()), output, Data(actual.data()));
+      failures += CompareNear(std::string("convFloat32 ") + name, expected, actual, 0);
+    }
+    return failures;
+  }
+
+  // planMemory() reserves the scratch of every record, so running a plan
+  // must not grow the kernel scratch: not on the first run and not on any
+  // run after it, from run() or from start(). The plan holds a record of
+  // each kind that uses scratch: an im2col float conv, a Winograd float
+  // conv, a packed int8 conv and a packed int8 depthwise conv.
+  int TestPlanSteadyState() {
+    const int height = 24, width = 40, depth = 16;
+    const std::vector<int32_t> inputDims = {1, height, width, depth};
+    const int count = height * width * depth;
+    const std::vector<float> narrowFilter = RandomFloats(8 * 9 * depth, -1, 1);
+    const std::vector<float> filter = RandomFloats(depth * 9 * depth, -1, 1);
+    const std::vector<float> bias = RandomFloats(depth, -1, 1);
+    const std::vector<int8_t> quantizedFilter = RandomVector<int8_t>(depth * 9 * depth, -127, 127);
+    const std::vector<int8_t> depthwiseFilter = RandomVector<int8_t>(9 * depth, -127, 127);
+    const std::vector<int32_t> quantizedBias = RandomVector<int32_t>(depth, -5000, 5000);
+    std::vector<int32_t> multipliers, shifts;
+    RandomRequantization(depth, &multipliers, &shifts);
+
+    ExecutionPlan plan;
+    const int input = plan.addPlannedOperand(inputDims, count * 4);
+    const int quantizedInput = plan.addPlannedOperand(inputDims, count);
+    const int narrowOutput = plan.addPlannedOperand({1, height, width, 8}, height * width * 8 * 4);
+    const int output = plan.addPlannedOperand(inputDims, count * 4);
+    const int quantizedOutput = plan.addPlannedOperand(inputDims, count);
+    const int depthwiseOutput = plan.addPlannedOperand(inputDims, count);
+
+    ConvParams conv = ConvParams();
+    conv.padding_values.height = conv.padding_values.width = 1;
+    conv.stride_height = conv.stride_width = 1;
+    conv.dilation_height_factor = conv.dilation_width_factor = 1;
+    conv.float_activation_min = -std::numeric_limits<float>::max();
+    conv.float_activation_max = std::numeric_limits<float>::max();
+    conv.quantized_activation_min = -128;
+    conv.quantized_activation_max = 127;
+    plan.addConv(kPlanConvFloat32, conv, input,
+                 plan.addOperand({8, 3, 3, depth}, Data(narrowFilter.data())),
+                 plan.addOperand({8}, Data(bias.data())), narrowOutput, 0, 0);
+    plan.addConv(kPlanConvFloat32, conv, input,
+                 plan.addOperand({depth, 3, 3, depth}, Data(filter.data())),
+                 plan.addOperand({depth}, Data(bias.data())), output, 0, 0);
+    plan.addConv(kPlanConvInt8PerChannel, conv, quantizedInput,
+                 plan.addOperand({depth, 3, 3, depth}, Data(quantizedFilter.data())),
+                 plan.addOperand({depth}, Data(quantizedBias.data())), quantizedOutput,
+                 Data(multipliers.data()), Data(shifts.data()));
+    DepthwiseParams depthwise = DepthwiseParams();
+    depthwise.padding_values.height = depthwise.padding_values.width = 1;
+    depthwise.stride_height = depthwise.stride_width = 1;
+    depthwise.dilation_height_factor = depthwise.dilation_width_factor = 1;
+    depthwise.depth_multiplier = 1;
+    depthwise.quantized_activation_min = -128;
+    depthwise.quantized_activation_max = 127;
+    plan.addDepthwiseConv(kPlanDepthwiseConvInt8PerChannel, depthwise, quantizedInput,
+                          plan.addOperand({1, 3, 3, depth}, Data(depthwiseFilter.data())),
+                          plan.addOperand({depth}, Data(quantizedBias.data())), depthwiseOutput,
+                          Data(multipliers.data()), Data(shifts.data()));
+    plan.identifyInputsAndOutputs({input, quantizedInput},
+                                  {narrowOutput, output, quantizedOutput, depthwiseOutput});
+    plan.fuse();
+    plan.alias();
+    plan.planMemory();
+
+    const int allocations = get_scratch_allocations();
+    int failures = 0;
+    for (int i = 0; i < 2; ++i) {
+      plan.run(0, plan.size());
+      if (get_scratch_allocations() != allocations) {
+        printf("  after run %d: scratch grew %d times\n", i + 1,
+               get_scratch_allocations() - allocations);
+        ++failures;
+      }
+    }
+    for (int i = 0; i < 2; ++i) {
+      plan.start(0, plan.size());
+      while (!plan.done()) {
+      }
+      if (get_scratch_allocations() != allocations) {
+        printf("  after start %d: scratch grew %d times\n", i + 1,
+               get_scratch_allocations() - allocations);
+        ++failures;
+      }
+    }
+    return failures;
+  }
+  // Reference of preprocessRGBA* in double: bilinear with half-pixel centres
+  // clamped to the crop, then channel selection, scale and bias.
+  std::vector<float> ReferencePreprocess(const PreprocessParams& p,
+                                         const std::vector<uint8_t>& frame) {
+    const int channels = p.channels;
+    std::vector<float> output(p.dst_width * p.dst_height * channels);
+    auto tap = [](int out, int outSize, int size, int* i0, int* i1) {
+      double position = (out + 0.5) * size / outSize - 0.5;
+      position = std::min(std::max(position, 0.0), size - 1.0);
+      *i0 = static_cast<int>(position);
+      *i1 = std::min(*i0 + 1, size - 1);
+      return position - *i0;
+    };
+    for (int y = 0; y < p.dst_height; ++y) {
+      for (int x = 0; x < p.dst_width; ++x) {
+        double pixel[4] = {0, 0, 0, 0};
+        const bool drawn = y < p.draw_height && x < p.draw_width;
+        if (drawn) {
+          int y0, y1, x0, x1;
+          const double wy = tap(y, p.draw_height, p.crop_height, &y0, &y1);
+          const double wx = tap(x, p.draw_width, p.crop_width, &x0, &x1);
+          auto at = [&](int row, int column, int c) {
+            return static_cast<double>(
+                frame[((p.crop_y + row) * p.src_width + p.crop_x + column) * 4 + c]);
+          };
+          for (int c = 0; c < 4; ++c) {
+            const double top = at(y0, x0, c) + (at(y0, x1, c) - at(y0, x0, c)) * wx;
+            const double bottom = at(y1, x0, c) + (at(y1, x1, c) - at(y1, x0, c)) * wx;
+            pixel[c] = top + (bottom - top) * wy;
+          }
+        }
+        for (int c = 0; c < channels; ++c) {
+          const int source = p.channel_map[c];
+          const double value = source < 0 ? (pixel[0] + pixel[1] + pixel[2]) / 3 : pixel[source];
+          const size_t index = p.nchw ? (c * p.dst_height + y) * p.dst_width + x
+                                      : (y * p.dst_width + x) * channels + c;
+          output[index] = drawn ? value * p.scale[c] + p.bias[c] : p.bias[c];
+        }
+      }
+    }
+    return output;
+  }
+
+  // Frames of a video grow when the page resizes it, and PreparedModel then
+  // moves its frame buffer. Two frames of increasing size, each read from a
+  // buffer of exactly its size, must preprocess into the same input like
+  // the reference, in float and uint8, NHWC and NCHW.
+  int TestPreprocessGrowingFrames() {
+    int failures = 0;
+    const int frameSizes[][2] = {{40, 30}, {160, 120}};
+    for (bool nchw : {false, true}) {
+      PreprocessParams p;
+      p.dst_width = 32;
+      p.dst_height = 24;
+      p.channels = 3;
+      p.channel_map = {{2, 1, -1, 0}};
+      p.scale = {{1 / 127.5f, 1 / 127.5f, 1 / 127.5f, 1}};
+      p.bias = {{-1, -1, -1, 0}};
+      p.nchw = nchw;
+      std::vector<float> actual(p.dst_width * p.dst_height * p.channels);
+      std::vector<uint8_t> actualUint8(actual.size());
+      for (const auto& size : frameSizes) {
+        p.src_width = size[0];
+        p.src_height = size[1];
+        p.crop_x = size[0] / 8;
+        p.crop_y = size[1] / 10;
+        p.crop_width = size[0] - 2 * p.crop_x;
+        p.crop_height = size[1] - p.crop_y;
+        p.draw_width = p.dst_width;
+        p.draw_height = p.dst_height * 3 / 4;
+        const std::vector<uint8_t> frame = RandomVector<uint8_t>(size[0] * size[1] * 4, 0, 255);
+        const std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]) +
+                                 (nchw ? " nchw" : " nhwc");
+
+        preprocessRGBAFloat32Wrapper(p, Data(frame.data()), Data(actual.data()));
+        failures += CompareNear("preprocessRGBAFloat32 " + name,
+                                ReferencePreprocess(p, frame), actual, 1e-5f);
+
+        PreprocessParams pixels = p;
+        pixels.scale = {{1, 1, 1, 1}};
+        pixels.bias = {{0, 0, 0, 0}};
+        preprocessRGBAUint8Wrapper(pixels, Data(frame.data()), Data(actualUint8.data()));
+        // Rounded, so within half a step of the reference.
+        const std::vector<float> expected = ReferencePreprocess(pixels, frame);
+        for (size_t i = 0; i < expected.size(); ++i) {
+          if (std::fabs(actualUint8[i] - expected[i]) > 0.501f) {
+            printf("  preprocessRGBAUint8 %s: element %zu is %d, expected %g\n", name.c_str(), i,
+                   actualUint8[i], expected[i]);
+            ++failures;
+            break;
+          }
+        }
+      }
+    }
+    return failures;
+  }
+}
+
+int main(int argc, char** argv) {
+  std::string filter;
+  int threads = 1;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (!strncmp(arg, "--filter=", 9)) {
+      filter = arg + 9;
+    } else if (!strncmp(arg, "--threads=", 10)) {
+      threads = atoi(arg + 10);
+    } else {
+      fprintf(stderr, "usage: %s [--filter=<substring>] [--threads=<n>]\n", argv[0]);
+      return 1;
+    }
+  }
+  set_gemm_context_threads_num(threads);
+  set_cpu_context_threads_num(threads);
+  set_kernel_threads_num(threads);
+
+  Register("QuantizedConv", [] { return TestQuantizedConv(300); });
+  Register("QuantizedDepthwiseConv", [] { return TestQuantizedDepthwiseConv(300); });
+  Register("WinogradConv", [] { return TestWinogradConv(300); });
+  Register("WinogradSelection", TestWinogradSelection);
+  Register("PlanSteadyState", TestPlanSteadyState);
+  Register("PreprocessGrowingFrames", TestPreprocessGrowingFrames);
+
+  int failed = 0;
+  for (const Test& t : tests) {
+    if (t.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    int failures;
+    try {
+      failures = t.run();
+    } catch (const std::string& error) {
+      printf("  %s\n", error.c_str());
+      failures = 1;
+    }
+    printf("%-40s %s\n", t.name.c_str(), failures ? "FAILED" : "ok");
+    failed += failures != 0;
+  }
+  return failed != 0;
+}
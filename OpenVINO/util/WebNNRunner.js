@@ -11,6 +11,8 @@ class WebNNRunner extends BaseRunner {
     this._deQuantizeParams = null;
     this._bEagerMode = false;
     this._supportedOps = [];
+    this._frameCanvas = null;
+    this._bInputInWasm = false;
   }
 
   /**
@@ -324,6 +326,11 @@ class WebNNRunner extends BaseRunner {
     image.width = image.videoWidth || image.naturalWidth;
     image.height = image.videoHeight || image.naturalHeight;
 
+    this._bInputInWasm = this._getTensorInWasm(input);
+    if (this._bInputInWasm) {
+      return;
+    }
+
     const [height, width, channels] = options.inputSize;
     const preOptions = options.preOptions || {};
     const mean = preOptions.mean || [0, 0, 0, 0];
@@ -407,6 +414,67 @@ class WebNNRunner extends BaseRunner {
     }
   };
 
+  /**
+   * This method is to preprocess the frame of input.src with the nn_ops
+   * preprocessRGBA kernel, straight into the input operand of the WASM
+   * backend. Only the source frame is read back from the canvas; resizing,
+   * normalization and layout happen in one pass in wasm.
+   * @param {!Object<string, *>} input The same input as _getTensor.
+   * @returns {boolean} This returns false if the compilation or the options
+   *     need the canvas preprocessing of _getTensor.
+   */
+  _getTensorInWasm = (input) => {
+    const execution = this._model._execution;
+    if (this._currentBackend !== 'WASM' || !execution ||
+        typeof execution.supportsInputRGBA !== 'function' || !execution.supportsInputRGBA()) {
+      return false;
+    }
+
+    const image = input.src;
+    const options = input.options;
+    const [height, width] = options.inputSize;
+    const drawOptions = options.drawOptions;
+    let crop = {x: 0, y: 0, width: image.width, height: image.height};
+    let draw = {width: width, height: height};
+    if (drawOptions) {
+      crop = {x: drawOptions.sx, y: drawOptions.sy, width: drawOptions.sWidth, height: drawOptions.sHeight};
+      draw = {width: drawOptions.dWidth, height: drawOptions.dHeight};
+    } else if (options.scaledFlag) {
+      const resizeRatio = Math.max(Math.max(image.width / width, image.height / height), 1);
+      draw = {width: Math.floor(image.width / resizeRatio), height: Math.floor(image.height / resizeRatio)};
+    }
+    // drawImage clips rectangles that leave the image or the canvas
+    if (crop.x < 0 || crop.y < 0 || crop.width < 1 || crop.height < 1 ||
+        crop.x + crop.width > image.width || crop.y + crop.height > image.height ||
+        draw.width < 1 || draw.height < 1 || draw.width > width || draw.height > height) {
+      return false;
+    }
+
+    if (!this._frameCanvas) {
+      this._frameCanvas = document.createElement('canvas');
+    }
+    const canvasElement = this._frameCanvas;
+    if (canvasElement.width !== image.width || canvasElement.height !== image.height) {
+      canvasElement.width = image.width;
+      canvasElement.height = image.height;
+    }
+    const canvasContext = canvasElement.getContext('2d');
+    canvasContext.drawImage(image, 0, 0);
+    const pixels = canvasContext.getImageData(0, 0, image.width, image.height).data;
+
+    const preOptions = options.preOptions || {};
+    execution.setInputRGBA(0, pixels, image.width, image.height, {
+      crop: crop,
+      draw: draw,
+      mean: preOptions.mean,
+      std: preOptions.std,
+      norm: preOptions.norm,
+      channelScheme: preOptions.channelScheme,
+      nchwFlag: preOptions.nchwFlag,
+    });
+    return true;
+  };
+
   /**
    * This method is to get downsample audio buffer.
    * @param {!Float32Array} buffer
@@ -539,6 +607,7 @@ class WebNNRunner extends BaseRunner {
 
   /** @override */
   _getInputTensor = async (input) => {
+    this._bInputInWasm = false;
     if (input.src.tagName === 'AUDIO') {
       await this._getTensorByAudio(input);
     } else {
@@ -548,7 +617,9 @@ class WebNNRunner extends BaseRunner {
 
   /** @override */
   _doInference = async () => {
-    let status = await this._model.compute(this._inputTensor, this._outputTensor);
+    // an input preprocessed in wasm is already set on the execution
+    const inputTensor = this._bInputInWasm ? [] : this._inputTensor;
+    let status = await this._model.compute(inputTensor, this._outputTensor);
     console.log(`Computed Status: [${status}]`);
   };
 
@@ -260,6 +260,27 @@ const NMS = (options, outputBoxTensor, outputClassScoresTensor) => {
   return [totalDetections, boxesList, scoresList, classesList];
 };
 
+/**
+* Decode boxes and run NMS
+* Runs in wasm on the outputs of the last compute when the execution
+* supports it (WASM backend on nn_ops), otherwise decodes outputBoxTensor in
+* place and calls NMS.
+*
+* @param {object} options - The options of NMS, plus box_output_index and
+*     score_output_index, the model outputs of boxes and scores (0 and 1).
+* @param {object} execution - The execution that computed the tensors, or null.
+* @returns {Array} [totalDetections, boxesList, scoresList, classesList]
+*/
+const decodeAndNMS = (options, outputBoxTensor, outputClassScoresTensor, anchors, execution = null) => {
+  if (execution && typeof execution.supportsSsdPostprocess === 'function' &&
+      execution.supportsSsdPostprocess()) {
+    const {box_output_index = 0, score_output_index = 1} = options;
+    return execution.ssdPostprocess(box_output_index, score_output_index, anchors, options);
+  }
+  decodeOutputBoxTensor(options, outputBoxTensor, anchors);
+  return NMS(options, outputBoxTensor, outputClassScoresTensor);
+};
+
 
 /**
 * Crop box
@@ -38,7 +38,14 @@ class bounding_box {
   };
 }
 
-const decodeYOLOv2 = (options, output, anchors) => {
+// Rows returned by the wasm path of decodeYOLOv2: views of the detections
+// of the last yolo2Region call, reused while that array stays the same.
+const yolo2RegionRows = {detections: null, views: [], result: []};
+
+// `execution` is optional: when it computed `output` and supports
+// yolo2Region (WASM backend on nn_ops), the region is decoded in wasm. Its
+// result array and rows are then reused, valid until the next call.
+const decodeYOLOv2 = (options, output, anchors, execution = null) => {
   const {
     nb_class = 80,
     nb_box = 5,
@@ -46,9 +53,28 @@ const decodeYOLOv2 = (options, output, anchors) => {
     grid_w = 13,
     obj_threshold = 0.5,
     nms_threshold = 0.3,
+    output_index = 0,
   } = options;
   let size = 4 + 1 + nb_class;  // (x, y, w, h) + confidence + classes
 
+  if (execution && typeof execution.supportsYolo2Region === 'function' &&
+      execution.supportsYolo2Region()) {
+    const {count, detections} = execution.yolo2Region(output_index, anchors, options);
+    const rows = yolo2RegionRows;
+    if (rows.detections !== detections) {
+      rows.detections = detections;
+      rows.views.length = 0;
+    }
+    for (let i = rows.views.length; i < count; ++i) {
+      rows.views.push(detections.subarray(6 * i, 6 * i + 6));
+    }
+    rows.result.length = count;
+    for (let i = 0; i < count; ++i) {
+      rows.result[i] = rows.views[i];
+    }
+    return rows.result;
+  }
+
   // decode the output by the network
   for (let i = 0; i < grid_h * grid_w * nb_box; ++i) {
     output[size * i + 4] = _sigmoid(output[size * i + 4]);
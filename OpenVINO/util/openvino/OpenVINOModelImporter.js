@@ -29,6 +29,8 @@ class OpenVINOModelImporter {
     }
     this._bEagerMode = false;
     this._supportedOps = new Set();
+    this._quantization = null;
+    this._planCacheKey = null;
   }
 
   setEagerMode = (flag) => {
@@ -39,6 +41,18 @@ class OpenVINOModelImporter {
     this._supportedOps = ops;
   };
 
+  // Runs a float model on the quantized WASM kernels, calibrated on `frames`,
+  // see Compilation.setQuantization.
+  setQuantization = (frames, options = {}) => {
+    this._quantization = {frames: frames, options: options};
+  };
+
+  // Keeps the compiled WASM model under `key` for the next page loads, see
+  // Compilation.setPlanCache.
+  setPlanCache = (key) => {
+    this._planCacheKey = key;
+  };
+
   async createCompiledModel() {
     let options = {
       backend: this._backend,
@@ -57,10 +71,20 @@ class OpenVINOModelImporter {
 
     let start = performance.now();
     this._compilation.setPreference(getPreferCode(this._backend, this._prefer));
+    if (this._quantization) {
+      this._compilation.setQuantization(this._quantization.frames, this._quantization.options);
+    }
+    if (this._planCacheKey) {
+      this._compilation.setPlanCache(this._planCacheKey);
+    }
     await this._compilation.finish();
     this._execution = await this._compilation.createExecution();
     let elapsed = performance.now() - start;
-    console.log(`compilation time: ${elapsed.toFixed(2)} ms`);
+    const cached = this._planCacheKey && this._compilation.isPlanCached() ? ' (cached plan)' : '';
+    console.log(`compilation time: ${elapsed.toFixed(2)} ms${cached}`);
+    if (this._quantization) {
+      console.log('quantization drift:', this._compilation.getQuantizationReport());
+    }
   }
 
   async compute(inputTensors, outputTensors) {